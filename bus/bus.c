@@ -37,6 +37,7 @@
 #include "dir-watch.h"
 #include <dbus/dbus-list.h>
 #include <dbus/dbus-hash.h>
+#include <dbus/dbus-connection-internal.h>
 #include <dbus/dbus-credentials.h>
 #include <dbus/dbus-internals.h>
 
@@ -198,6 +199,9 @@ new_connection_callback (DBusServer     *server,
   dbus_connection_set_allow_anonymous (new_connection,
                                        context->allow_anonymous);
 
+  /* the bus holds messages from many peers at once */
+  _dbus_connection_set_spill_large_bodies (new_connection, TRUE);
+
   /* on OOM, we won't have ref'd the connection so it will die. */
 }
 
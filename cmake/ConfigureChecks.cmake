@@ -33,6 +33,11 @@ check_symbol_exists(writev       "sys/uio.h"        HAVE_WRITEV)             #
 check_symbol_exists(setrlimit    "sys/resource.h"   HAVE_SETRLIMIT)          #  dbus-sysdeps.c, dbus-sysdeps-win.c, test/test-segfault.c
 check_symbol_exists(socketpair   "sys/socket.h"     HAVE_SOCKETPAIR)         #  dbus-sysdeps.c
 check_symbol_exists(socklen_t    "sys/socket.h"     HAVE_SOCKLEN_T)          #  dbus-sysdeps-unix.c
+set(CMAKE_REQUIRED_DEFINITIONS -D_GNU_SOURCE)
+check_symbol_exists(accept4      "sys/socket.h"     HAVE_ACCEPT4)            #  dbus-sysdeps-unix.c
+check_symbol_exists(memfd_create "sys/mman.h"       HAVE_MEMFD_CREATE)       #  dbus-shm-channel.c
+check_symbol_exists(eventfd      "sys/eventfd.h"    HAVE_EVENTFD)            #  dbus-shm-channel.c
+set(CMAKE_REQUIRED_DEFINITIONS)
 check_symbol_exists(setlocale    "locale.h"         HAVE_SETLOCALE)          #  dbus-test-main.c
 check_symbol_exists(localeconv   "locale.h"         HAVE_LOCALECONV)         #  dbus-sysdeps.c
 check_symbol_exists(strtoll      "stdlib.h"         HAVE_STRTOLL)            #  dbus-send.c
@@ -26,6 +26,7 @@
 #cmakedefine DBUS_VERSION ((@DBUS_MAJOR_VERSION@ << 16) | (@DBUS_MINOR_VERSION@ << 8) | (@DBUS_MICRO_VERSION@))
 #cmakedefine DBUS_VERSION_STRING "@DBUS_VERSION_STRING@"
 #cmakedefine DBUS_ENABLE_STATS
+#cmakedefine DBUS_ENABLE_FUTEX
 
 #define VERSION DBUS_VERSION_STRING
 
@@ -166,6 +167,15 @@
 /* Define to 1 if you have socketpair */
 #cmakedefine   HAVE_SOCKETPAIR 1
 
+/* Define to 1 if you have accept4 */
+#cmakedefine   HAVE_ACCEPT4 1
+
+/* Define to 1 if you have memfd_create */
+#cmakedefine   HAVE_MEMFD_CREATE 1
+
+/* Define to 1 if you have eventfd */
+#cmakedefine   HAVE_EVENTFD 1
+
 /* Define to 1 if you have setenv */
 #cmakedefine   HAVE_SETENV 1
 
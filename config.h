@@ -55,6 +55,9 @@
 /* Defined if we have gcc 3.3 and thus the new gcov format */
 #undef DBUS_HAVE_GCC33_GCOV
 
+/* Define to use epoll(4) on Linux */
+#define DBUS_HAVE_LINUX_EPOLL 1
+
 /* Where per-session bus puts its sockets */
 #define DBUS_SESSION_SOCKET_DIR "/data"
 
@@ -118,6 +121,9 @@
 /* Define to 1 if you have the <errno.h> header file. */
 #define HAVE_ERRNO_H 1
 
+/* Define to 1 if you have the `eventfd' function. */
+#define HAVE_EVENTFD 1
+
 /* Define to 1 if you have the <execinfo.h> header file. */
 #define HAVE_EXECINFO_H 1
 
@@ -151,6 +157,9 @@
 /* Define to 1 if you have the `socket' library (-lsocket). */
 #undef HAVE_LIBSOCKET
 
+/* Define to 1 if you have the `memfd_create' function. */
+#define HAVE_MEMFD_CREATE 1
+
 /* Define to 1 if you have the <memory.h> header file. */
 #define HAVE_MEMORY_H 1
 
@@ -472,6 +472,25 @@ _dbus_auth_script_run (const DBusString *filename)
           _dbus_auth_set_mechanisms (auth, (const char **) mechs);
           dbus_free_string_array (mechs);
         }
+      else if (_dbus_string_starts_with_c_str (&line,
+                                               "UNIX_FD_POSSIBLE"))
+        {
+          _dbus_auth_set_unix_fd_possible (auth, TRUE);
+        }
+      else if (_dbus_string_starts_with_c_str (&line,
+                                               "MEMFD_BODY_POSSIBLE"))
+        {
+          _dbus_auth_set_memfd_body_possible (auth, TRUE);
+        }
+      else if (_dbus_string_starts_with_c_str (&line,
+                                               "PIPELINED"))
+        {
+          if (!_dbus_auth_set_pipelined (auth))
+            {
+              _dbus_warn ("no memory to pipeline authentication\n");
+              goto out;
+            }
+        }
       else if (_dbus_string_starts_with_c_str (&line,
                                                "SEND"))
         {
@@ -711,6 +730,24 @@ _dbus_auth_script_run (const DBusString *filename)
               goto out;
             }
         }
+      else if (_dbus_string_starts_with_c_str (&line,
+                                               "EXPECT_MEMFD_BODY_NEGOTIATED"))
+        {
+          if (!_dbus_auth_get_memfd_body_negotiated (auth))
+            {
+              _dbus_warn ("Expected memfd bodies to be negotiated, but they weren't\n");
+              goto out;
+            }
+        }
+      else if (_dbus_string_starts_with_c_str (&line,
+                                               "EXPECT_MEMFD_BODY_NOT_NEGOTIATED"))
+        {
+          if (_dbus_auth_get_memfd_body_negotiated (auth))
+            {
+              _dbus_warn ("Expected memfd bodies not to be negotiated, but they were\n");
+              goto out;
+            }
+        }
       else if (_dbus_string_starts_with_c_str (&line,
                                                "EXPECT"))
         {
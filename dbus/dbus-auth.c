@@ -126,7 +126,9 @@ typedef enum {
   DBUS_AUTH_COMMAND_ERROR,
   DBUS_AUTH_COMMAND_UNKNOWN,
   DBUS_AUTH_COMMAND_NEGOTIATE_UNIX_FD,
-  DBUS_AUTH_COMMAND_AGREE_UNIX_FD
+  DBUS_AUTH_COMMAND_AGREE_UNIX_FD,
+  DBUS_AUTH_COMMAND_NEGOTIATE_MEMFD_BODY,
+  DBUS_AUTH_COMMAND_AGREE_MEMFD_BODY
 } DBusAuthCommand;
 
 /**
@@ -191,6 +193,11 @@ struct DBusAuth
 
   unsigned int unix_fd_possible : 1;  /**< This side could do unix fd passing */
   unsigned int unix_fd_negotiated : 1; /**< Unix fd was successfully negotiated */
+
+  unsigned int memfd_body_possible : 1;   /**< This side could send bodies in memfds */
+  unsigned int memfd_body_negotiated : 1; /**< Memfd bodies were successfully negotiated */
+
+  unsigned int pipelined : 1; /**< Client sent BEGIN without waiting for OK */
 };
 
 /**
@@ -234,6 +241,8 @@ static dbus_bool_t send_begin                (DBusAuth *auth);
 static dbus_bool_t send_cancel               (DBusAuth *auth);
 static dbus_bool_t send_negotiate_unix_fd    (DBusAuth *auth);
 static dbus_bool_t send_agree_unix_fd        (DBusAuth *auth);
+static dbus_bool_t send_negotiate_memfd_body (DBusAuth *auth);
+static dbus_bool_t send_agree_memfd_body     (DBusAuth *auth);
 
 /**
  * Client states
@@ -275,6 +284,9 @@ static dbus_bool_t handle_client_state_waiting_for_reject (DBusAuth         *aut
 static dbus_bool_t handle_client_state_waiting_for_agree_unix_fd (DBusAuth         *auth,
                                                            DBusAuthCommand   command,
                                                            const DBusString *args);
+static dbus_bool_t handle_client_state_waiting_for_agree_memfd_body (DBusAuth         *auth,
+                                                           DBusAuthCommand   command,
+                                                           const DBusString *args);
 
 static const DBusAuthStateData client_state_need_send_auth = {
   "NeedSendAuth", NULL
@@ -291,6 +303,9 @@ static const DBusAuthStateData client_state_waiting_for_reject = {
 static const DBusAuthStateData client_state_waiting_for_agree_unix_fd = {
   "WaitingForAgreeUnixFD", handle_client_state_waiting_for_agree_unix_fd
 };
+static const DBusAuthStateData client_state_waiting_for_agree_memfd_body = {
+  "WaitingForAgreeMemfdBody", handle_client_state_waiting_for_agree_memfd_body
+};
 
 /**
  * Common terminal states.  Terminal states have handler == NULL.
@@ -1571,6 +1586,17 @@ process_ok(DBusAuth *auth,
   _dbus_verbose ("Got GUID '%s' from the server\n",
                  _dbus_string_get_const_data (& DBUS_AUTH_CLIENT (auth)->guid_from_server));
 
+  if (auth->pipelined)
+    {
+      /* NEGOTIATE_UNIX_FD and BEGIN already went out behind the AUTH */
+      if (auth->unix_fd_possible)
+        goto_state (auth, &client_state_waiting_for_agree_unix_fd);
+      else
+        goto_state (auth, &common_state_authenticated);
+
+      return TRUE;
+    }
+
   if (auth->unix_fd_possible)
     return send_negotiate_unix_fd(auth);
 
@@ -1661,6 +1687,33 @@ send_agree_unix_fd (DBusAuth *auth)
   return TRUE;
 }
 
+static dbus_bool_t
+send_negotiate_memfd_body (DBusAuth *auth)
+{
+  if (!_dbus_string_append (&auth->outgoing,
+                            "NEGOTIATE_MEMFD_BODY\r\n"))
+    return FALSE;
+
+  goto_state (auth, &client_state_waiting_for_agree_memfd_body);
+  return TRUE;
+}
+
+static dbus_bool_t
+send_agree_memfd_body (DBusAuth *auth)
+{
+  _dbus_assert (auth->unix_fd_negotiated && auth->memfd_body_possible);
+
+  auth->memfd_body_negotiated = TRUE;
+  _dbus_verbose ("Agreed to memfd message bodies\n");
+
+  if (!_dbus_string_append (&auth->outgoing,
+                            "AGREE_MEMFD_BODY\r\n"))
+    return FALSE;
+
+  goto_state (auth, &server_state_waiting_for_begin);
+  return TRUE;
+}
+
 static dbus_bool_t
 handle_auth (DBusAuth *auth, const DBusString *args)
 {
@@ -1753,12 +1806,14 @@ handle_server_state_waiting_for_auth  (DBusAuth         *auth,
       return send_rejected (auth);
 
     case DBUS_AUTH_COMMAND_NEGOTIATE_UNIX_FD:
+    case DBUS_AUTH_COMMAND_NEGOTIATE_MEMFD_BODY:
       return send_error (auth, "Need to authenticate first");
 
     case DBUS_AUTH_COMMAND_REJECTED:
     case DBUS_AUTH_COMMAND_OK:
     case DBUS_AUTH_COMMAND_UNKNOWN:
     case DBUS_AUTH_COMMAND_AGREE_UNIX_FD:
+    case DBUS_AUTH_COMMAND_AGREE_MEMFD_BODY:
     default:
       return send_error (auth, "Unknown command");
     }
@@ -1786,12 +1841,14 @@ handle_server_state_waiting_for_data  (DBusAuth         *auth,
       return TRUE;
 
     case DBUS_AUTH_COMMAND_NEGOTIATE_UNIX_FD:
+    case DBUS_AUTH_COMMAND_NEGOTIATE_MEMFD_BODY:
       return send_error (auth, "Need to authenticate first");
 
     case DBUS_AUTH_COMMAND_REJECTED:
     case DBUS_AUTH_COMMAND_OK:
     case DBUS_AUTH_COMMAND_UNKNOWN:
     case DBUS_AUTH_COMMAND_AGREE_UNIX_FD:
+    case DBUS_AUTH_COMMAND_AGREE_MEMFD_BODY:
     default:
       return send_error (auth, "Unknown command");
     }
@@ -1820,10 +1877,18 @@ handle_server_state_waiting_for_begin (DBusAuth         *auth,
       else
         return send_error(auth, "Unix FD passing not supported, not authenticated or otherwise not possible");
 
+    case DBUS_AUTH_COMMAND_NEGOTIATE_MEMFD_BODY:
+      /* the body travels as one more fd, so fd passing must come first */
+      if (auth->unix_fd_negotiated && auth->memfd_body_possible)
+        return send_agree_memfd_body (auth);
+      else
+        return send_error (auth, "Memfd message bodies not supported or unix FD passing not negotiated");
+
     case DBUS_AUTH_COMMAND_REJECTED:
     case DBUS_AUTH_COMMAND_OK:
     case DBUS_AUTH_COMMAND_UNKNOWN:
     case DBUS_AUTH_COMMAND_AGREE_UNIX_FD:
+    case DBUS_AUTH_COMMAND_AGREE_MEMFD_BODY:
     default:
       return send_error (auth, "Unknown command");
 
@@ -1978,6 +2043,16 @@ handle_client_state_waiting_for_data (DBusAuth         *auth,
                                       const DBusString *args)
 {
   _dbus_assert (auth->mech != NULL);
+
+  /* The server has already read our BEGIN, so anything but OK means
+   * it is about to hang up on us */
+  if (auth->pipelined && command != DBUS_AUTH_COMMAND_OK)
+    {
+      _dbus_verbose ("%s: Server did not accept pipelined authentication\n",
+                     DBUS_AUTH_NAME (auth));
+      goto_state (auth, &common_state_need_disconnect);
+      return TRUE;
+    }
  
   switch (command)
     {
@@ -1999,6 +2074,8 @@ handle_client_state_waiting_for_data (DBusAuth         *auth,
     case DBUS_AUTH_COMMAND_UNKNOWN:
     case DBUS_AUTH_COMMAND_NEGOTIATE_UNIX_FD:
     case DBUS_AUTH_COMMAND_AGREE_UNIX_FD:
+    case DBUS_AUTH_COMMAND_NEGOTIATE_MEMFD_BODY:
+    case DBUS_AUTH_COMMAND_AGREE_MEMFD_BODY:
     default:
       return send_error (auth, "Unknown command");
     }
@@ -2027,6 +2104,8 @@ handle_client_state_waiting_for_ok (DBusAuth         *auth,
     case DBUS_AUTH_COMMAND_UNKNOWN:
     case DBUS_AUTH_COMMAND_NEGOTIATE_UNIX_FD:
     case DBUS_AUTH_COMMAND_AGREE_UNIX_FD:
+    case DBUS_AUTH_COMMAND_NEGOTIATE_MEMFD_BODY:
+    case DBUS_AUTH_COMMAND_AGREE_MEMFD_BODY:
     default:
       return send_error (auth, "Unknown command");
     }
@@ -2051,6 +2130,8 @@ handle_client_state_waiting_for_reject (DBusAuth         *auth,
     case DBUS_AUTH_COMMAND_UNKNOWN:
     case DBUS_AUTH_COMMAND_NEGOTIATE_UNIX_FD:
     case DBUS_AUTH_COMMAND_AGREE_UNIX_FD:
+    case DBUS_AUTH_COMMAND_NEGOTIATE_MEMFD_BODY:
+    case DBUS_AUTH_COMMAND_AGREE_MEMFD_BODY:
     default:
       goto_state (auth, &common_state_need_disconnect);
       return TRUE;
@@ -2068,13 +2149,13 @@ handle_client_state_waiting_for_agree_unix_fd(DBusAuth         *auth,
       _dbus_assert(auth->unix_fd_possible);
       auth->unix_fd_negotiated = TRUE;
       _dbus_verbose("Successfully negotiated UNIX FD passing\n");
-      return send_begin (auth);
+      break;
 
     case DBUS_AUTH_COMMAND_ERROR:
       _dbus_assert(auth->unix_fd_possible);
       auth->unix_fd_negotiated = FALSE;
       _dbus_verbose("Failed to negotiate UNIX FD passing\n");
-      return send_begin (auth);
+      break;
 
     case DBUS_AUTH_COMMAND_OK:
     case DBUS_AUTH_COMMAND_DATA:
@@ -2084,9 +2165,84 @@ handle_client_state_waiting_for_agree_unix_fd(DBusAuth         *auth,
     case DBUS_AUTH_COMMAND_BEGIN:
     case DBUS_AUTH_COMMAND_UNKNOWN:
     case DBUS_AUTH_COMMAND_NEGOTIATE_UNIX_FD:
+    case DBUS_AUTH_COMMAND_NEGOTIATE_MEMFD_BODY:
+    case DBUS_AUTH_COMMAND_AGREE_MEMFD_BODY:
     default:
+      /* the server is past the auth conversation if we pipelined */
+      if (auth->pipelined)
+        {
+          goto_state (auth, &common_state_need_disconnect);
+          return TRUE;
+        }
+
       return send_error (auth, "Unknown command");
     }
+
+  if (auth->pipelined)
+    {
+      /* NEGOTIATE_MEMFD_BODY went out too, and the server will have
+       * answered it whatever it said to NEGOTIATE_UNIX_FD */
+      if (auth->memfd_body_possible)
+        goto_state (auth, &client_state_waiting_for_agree_memfd_body);
+      else
+        goto_state (auth, &common_state_authenticated);
+
+      return TRUE;
+    }
+
+  if (auth->unix_fd_negotiated && auth->memfd_body_possible)
+    return send_negotiate_memfd_body (auth);
+
+  return send_begin (auth);
+}
+
+static dbus_bool_t
+handle_client_state_waiting_for_agree_memfd_body (DBusAuth         *auth,
+                                                  DBusAuthCommand   command,
+                                                  const DBusString *args)
+{
+  switch (command)
+    {
+    case DBUS_AUTH_COMMAND_AGREE_MEMFD_BODY:
+      /* a pipelined NEGOTIATE_MEMFD_BODY may be agreed to by a server
+       * that refused unix fds, but we can't use it then */
+      auth->memfd_body_negotiated = auth->unix_fd_negotiated;
+      _dbus_verbose ("Negotiated memfd message bodies: %d\n",
+                     auth->memfd_body_negotiated);
+      break;
+
+    case DBUS_AUTH_COMMAND_ERROR:
+      auth->memfd_body_negotiated = FALSE;
+      _dbus_verbose ("Failed to negotiate memfd message bodies\n");
+      break;
+
+    case DBUS_AUTH_COMMAND_OK:
+    case DBUS_AUTH_COMMAND_DATA:
+    case DBUS_AUTH_COMMAND_REJECTED:
+    case DBUS_AUTH_COMMAND_AUTH:
+    case DBUS_AUTH_COMMAND_CANCEL:
+    case DBUS_AUTH_COMMAND_BEGIN:
+    case DBUS_AUTH_COMMAND_UNKNOWN:
+    case DBUS_AUTH_COMMAND_NEGOTIATE_UNIX_FD:
+    case DBUS_AUTH_COMMAND_AGREE_UNIX_FD:
+    case DBUS_AUTH_COMMAND_NEGOTIATE_MEMFD_BODY:
+    default:
+      if (auth->pipelined)
+        {
+          goto_state (auth, &common_state_need_disconnect);
+          return TRUE;
+        }
+
+      return send_error (auth, "Unknown command");
+    }
+
+  if (auth->pipelined)
+    {
+      goto_state (auth, &common_state_authenticated);
+      return TRUE;
+    }
+
+  return send_begin (auth);
 }
 
 /**
@@ -2106,7 +2262,9 @@ static const DBusAuthCommandName auth_command_names[] = {
   { "OK",                DBUS_AUTH_COMMAND_OK },
   { "ERROR",             DBUS_AUTH_COMMAND_ERROR },
   { "NEGOTIATE_UNIX_FD", DBUS_AUTH_COMMAND_NEGOTIATE_UNIX_FD },
-  { "AGREE_UNIX_FD",     DBUS_AUTH_COMMAND_AGREE_UNIX_FD }
+  { "AGREE_UNIX_FD",     DBUS_AUTH_COMMAND_AGREE_UNIX_FD },
+  { "NEGOTIATE_MEMFD_BODY", DBUS_AUTH_COMMAND_NEGOTIATE_MEMFD_BODY },
+  { "AGREE_MEMFD_BODY",  DBUS_AUTH_COMMAND_AGREE_MEMFD_BODY }
 };
 
 static DBusAuthCommand
@@ -2793,6 +2951,85 @@ _dbus_auth_set_unix_fd_possible(DBusAuth *auth, dbus_bool_t b)
   auth->unix_fd_possible = b;
 }
 
+/**
+ * Sets whether message bodies could be sent in memfds on the
+ * transport, and hence NEGOTIATE_MEMFD_BODY shall follow a successful
+ * NEGOTIATE_UNIX_FD.
+ *
+ * @param auth the auth conversation
+ * @param b TRUE when memfd bodies shall be negotiated, otherwise FALSE
+ */
+void
+_dbus_auth_set_memfd_body_possible (DBusAuth    *auth,
+                                    dbus_bool_t  b)
+{
+  auth->memfd_body_possible = b;
+}
+
+/**
+ * Makes a client that has only sent AUTH EXTERNAL so far follow it
+ * with NEGOTIATE_UNIX_FD and NEGOTIATE_MEMFD_BODY (if possible) and
+ * BEGIN straight away, instead of waiting for the server to answer each
+ * one. The transport can then send messages right behind them, as
+ * _dbus_auth_is_pipelining() says.
+ *
+ * This saves two round trips, but only works if the server accepts
+ * EXTERNAL: it reads our BEGIN as a protocol error otherwise, and
+ * hangs up, so there is no falling back to another mechanism. Only
+ * use it where the server is known to check credentials from the
+ * kernel. Does nothing if the conversation has already moved on.
+ *
+ * @param auth the auth conversation
+ * @returns #FALSE if no memory
+ */
+dbus_bool_t
+_dbus_auth_set_pipelined (DBusAuth *auth)
+{
+  int orig_len;
+
+  if (!DBUS_AUTH_IS_CLIENT (auth) ||
+      auth->pipelined ||
+      auth->state != &client_state_waiting_for_data ||
+      auth->mech != &all_mechanisms[0] ||
+      _dbus_string_get_length (&auth->incoming) > 0)
+    return TRUE;
+
+  orig_len = _dbus_string_get_length (&auth->outgoing);
+
+  if ((auth->unix_fd_possible &&
+       !_dbus_string_append (&auth->outgoing, "NEGOTIATE_UNIX_FD\r\n")) ||
+      (auth->unix_fd_possible && auth->memfd_body_possible &&
+       !_dbus_string_append (&auth->outgoing, "NEGOTIATE_MEMFD_BODY\r\n")) ||
+      !_dbus_string_append (&auth->outgoing, "BEGIN\r\n"))
+    {
+      _dbus_string_set_length (&auth->outgoing, orig_len);
+      return FALSE;
+    }
+
+  _dbus_verbose ("%s: pipelining %s and BEGIN\n", DBUS_AUTH_NAME (auth),
+                 auth->unix_fd_possible ? "NEGOTIATE_UNIX_FD" : "nothing else");
+
+  auth->pipelined = TRUE;
+  return TRUE;
+}
+
+/**
+ * Whether messages may be sent before the conversation is over,
+ * because the client pipelined its authentication and has sent
+ * everything up to BEGIN. The replies to AUTH and NEGOTIATE_UNIX_FD
+ * still have to be read before any messages.
+ *
+ * @param auth the auth conversation
+ * @returns #TRUE if messages may follow the bytes sent so far
+ */
+dbus_bool_t
+_dbus_auth_is_pipelining (DBusAuth *auth)
+{
+  return auth->pipelined &&
+    _dbus_string_get_length (&auth->outgoing) == 0 &&
+    !DBUS_AUTH_IN_END_STATE (auth);
+}
+
 /**
  * Queries whether unix fd passing was successfully negotiated.
  *
@@ -2805,6 +3042,19 @@ _dbus_auth_get_unix_fd_negotiated(DBusAuth *auth)
   return auth->unix_fd_negotiated;
 }
 
+/**
+ * Queries whether both sides agreed to send large message bodies in
+ * memfds.
+ *
+ * @param auth the auth conversion
+ * @returns #TRUE when memfd bodies were negotiated.
+ */
+dbus_bool_t
+_dbus_auth_get_memfd_body_negotiated (DBusAuth *auth)
+{
+  return auth->memfd_body_negotiated;
+}
+
 /** @} */
 
 /* tests in dbus-auth-util.c */
@@ -77,6 +77,12 @@ const char*   _dbus_auth_get_guid_from_server(DBusAuth               *auth);
 
 void          _dbus_auth_set_unix_fd_possible(DBusAuth               *auth, dbus_bool_t b);
 dbus_bool_t   _dbus_auth_get_unix_fd_negotiated(DBusAuth             *auth);
+void          _dbus_auth_set_memfd_body_possible (DBusAuth           *auth,
+                                                  dbus_bool_t         b);
+dbus_bool_t   _dbus_auth_get_memfd_body_negotiated (DBusAuth         *auth);
+
+dbus_bool_t   _dbus_auth_set_pipelined       (DBusAuth               *auth);
+dbus_bool_t   _dbus_auth_is_pipelining       (DBusAuth               *auth);
 
 DBUS_END_DECLS
 
@@ -31,6 +31,9 @@
 #include "dbus-threads-internal.h"
 #include "dbus-connection-internal.h"
 #include "dbus-string.h"
+#ifdef DBUS_UNIX
+#include "dbus-sysdeps-unix.h"
+#endif
 
 /**
  * @defgroup DBusBus Message bus APIs
@@ -421,6 +424,38 @@ _dbus_bus_notify_shared_connection_disconnected_unlocked (DBusConnection *connec
   _DBUS_UNLOCK (bus);
 }
 
+/* If the kernel can tell who is on the other end of the socket, the
+ * system bus can check our credentials the same way and will accept
+ * EXTERNAL, so we send BEGIN and Hello() without waiting for it to.
+ *
+ * The system bus validates every message it routes, so there is no
+ * point in validating the bodies again here; but only if the other end
+ * of the socket really is a bus we trust, one running as root or as
+ * ourselves, not just something listening on the configured address.
+ */
+static void
+setup_system_bus (DBusConnection *connection)
+{
+#ifdef DBUS_UNIX
+  dbus_uid_t uid;
+  int fd;
+
+  if (!dbus_connection_get_socket (connection, &fd) ||
+      !_dbus_read_peer_unix_user (fd, &uid))
+    return;
+
+  /* on OOM, just authenticate the slow way */
+  _dbus_connection_set_pipelined_auth (connection);
+
+  if (uid == 0 || uid == _dbus_getuid ())
+    {
+      _dbus_verbose ("system bus runs as uid "DBUS_UID_FORMAT", trusting its message bodies\n",
+                     uid);
+      dbus_connection_set_trust_peer_data (connection, TRUE);
+    }
+#endif
+}
+
 static DBusConnection *
 internal_bus_get (DBusBusType  type,
                   dbus_bool_t  private,
@@ -484,6 +519,9 @@ internal_bus_get (DBusBusType  type,
       goto out;
     }
 
+  if (type == DBUS_BUS_SYSTEM)
+    setup_system_bus (connection);
+
   if (!dbus_bus_register (connection, error))
     {
       _dbus_connection_close_possibly_shared (connection);
@@ -78,6 +78,9 @@ void              _dbus_connection_do_iteration_unlocked       (DBusConnection
                                                                 int                 timeout_milliseconds);
 void              _dbus_connection_close_possibly_shared       (DBusConnection     *connection);
 void              _dbus_connection_close_if_only_one_ref       (DBusConnection     *connection);
+dbus_bool_t       _dbus_connection_set_pipelined_auth          (DBusConnection     *connection);
+void              _dbus_connection_set_spill_large_bodies      (DBusConnection     *connection,
+                                                                dbus_bool_t         spill);
 
 DBusPendingCall*  _dbus_pending_call_new                       (DBusConnection     *connection,
                                                                 int                 timeout_milliseconds,
@@ -258,6 +258,35 @@ static dbus_bool_t _dbus_modify_sigpipe = FALSE;
 static dbus_bool_t _dbus_modify_sigpipe = TRUE;
 #endif
 
+/**
+ * A thread blocked in _dbus_connection_do_iteration_unlocked() while
+ * the I/O thread owns the transport. Lives on the blocked thread's
+ * stack, linked into the connection for as long as it waits.
+ */
+typedef struct DBusIOWaiter DBusIOWaiter;
+
+struct DBusIOWaiter
+{
+  DBusIOWaiter *next;          /**< Next waiter on the same connection */
+  dbus_uint32_t reply_serial;  /**< Reply to wait for, or 0 to wake on any I/O */
+  DBusCondVar *cond;           /**< Signalled when this waiter is woken */
+  dbus_bool_t woken;           /**< Protected by io_path_mutex */
+};
+
+/**
+ * One of the threads started by dbus_connection_start_dispatch_workers().
+ * Each worker has its own queue, so messages sent to the same worker
+ * are handled in the order they arrived.
+ */
+typedef struct DBusDispatchWorker DBusDispatchWorker;
+
+struct DBusDispatchWorker
+{
+  DBusConnection *connection;  /**< Connection whose messages we handle */
+  DBusList *queue;             /**< Messages waiting for this worker; protected by worker_mutex */
+  DBusCondVar *cond;           /**< Signalled when the queue grows or the workers should quit */
+};
+
 /**
  * Implementation details of DBusConnection. All fields are private.
  */
@@ -295,6 +324,8 @@ struct DBusConnection
   DBusDataSlotList slot_list;   /**< Data stored by allocated integer ID */
 
   DBusHashTable *pending_replies;  /**< Hash of message serials to #DBusPendingCall. */  
+  DBusHashTable *incoming_replies; /**< Hash of reply serials to the first link in incoming_messages replying to it */
+  int n_incoming_unindexed;        /**< Replies in incoming_messages missing from incoming_replies */
   
   dbus_uint32_t client_serial;       /**< Client serial. Increments each time a message is sent  */
   DBusList *disconnect_message_link; /**< Preallocated list node for queueing the disconnection message */
@@ -313,6 +344,19 @@ struct DBusConnection
 
   char *server_guid; /**< GUID of server if we are in shared_connections, #NULL if server GUID is unknown or connection is private */
 
+  DBusList *io_thread_watches;    /**< Watches the I/O thread polls, if it is running */
+  DBusIOWaiter *io_waiters;       /**< Threads waiting for the I/O thread to make progress */
+  int io_thread_wakeup_fds[2];    /**< Pipe used to interrupt the I/O thread's poll */
+
+  DBusCMutex *worker_mutex;        /**< Protects the dispatch workers' queues and the counts below */
+  DBusCondVar *worker_space_cond;  /**< Signalled when a worker finishes a message or exits */
+  DBusDispatchWorker *workers;     /**< Dispatch workers, or #NULL */
+  int n_workers;                   /**< Length of the workers array */
+  int n_workers_running;           /**< Workers that have not exited yet */
+  int n_worker_messages;           /**< Messages handed to workers and not yet handled */
+  int max_worker_messages;         /**< Handing a message over blocks at this many */
+  dbus_bool_t workers_quit;        /**< Workers should exit once their queues are empty */
+
   /* These two MUST be bools and not bitfields, because they are protected by a separate lock
    * from connection->mutex and all bitfields in a word have to be read/written together.
    * So you can't have a different lock for different bitfields in the same word.
@@ -333,6 +377,12 @@ struct DBusConnection
   unsigned int disconnected_message_processed : 1; /**< We did our default handling of the disconnected message,
                                                     * such as closing the connection.
                                                     */
+
+  unsigned int io_thread_running : 1; /**< A library-owned thread does all reading and writing */
+  unsigned int io_thread_quit : 1;    /**< The I/O thread has been asked to stop */
+  unsigned int io_thread_woken : 1;   /**< A wakeup is already pending in the I/O thread's pipe */
+
+  unsigned int have_dispatch_workers : 1; /**< Object path handlers run on the dispatch workers */
   
 #ifndef DBUS_DISABLE_CHECKS
   unsigned int have_connection_lock : 1; /**< Used to check locking */
@@ -354,6 +404,14 @@ static void               _dbus_connection_close_possibly_shared_and_unlock  (DB
 static dbus_bool_t        _dbus_connection_get_is_connected_unlocked         (DBusConnection     *connection);
 static dbus_bool_t        _dbus_connection_peek_for_reply_unlocked           (DBusConnection     *connection,
                                                                               dbus_uint32_t       client_serial);
+static void               _dbus_connection_wake_io_waiters_unlocked          (DBusConnection     *connection,
+                                                                              dbus_uint32_t       reply_serial,
+                                                                              dbus_bool_t         wake_all);
+static void               _dbus_memory_pause_based_on_timeout                (int                 timeout_milliseconds);
+static void               _dbus_connection_queue_for_worker_and_unlock       (DBusConnection     *connection,
+                                                                              DBusList           *message_link);
+static void               _dbus_connection_join_dispatch_workers             (DBusConnection     *connection);
+static void               _dbus_connection_free_dispatch_workers             (DBusConnection     *connection);
 
 static DBusMessageFilter *
 _dbus_message_filter_ref (DBusMessageFilter *filter)
@@ -476,6 +534,86 @@ _dbus_connection_test_get_locks (DBusConnection *connection,
 }
 #endif
 
+/*
+ * The incoming queue is indexed by reply serial, so that a thread
+ * blocking on a reply does not have to walk past every signal queued
+ * ahead of it. The index holds the earliest queued reply to each
+ * serial. A reply that could not be indexed (a peer repeating a reply
+ * serial, or no memory) is counted instead, and while any are queued
+ * lookups fall back to walking the queue.
+ */
+static void
+_dbus_connection_index_incoming_link_unlocked (DBusConnection *connection,
+                                               DBusList       *link,
+                                               dbus_bool_t     at_front)
+{
+  dbus_uint32_t reply_serial;
+
+  reply_serial = dbus_message_get_reply_serial (link->data);
+  if (reply_serial == 0)
+    return;
+
+  if (_dbus_hash_table_lookup_int (connection->incoming_replies,
+                                   reply_serial) != NULL)
+    {
+      /* If this one goes in front, the one already indexed no longer
+       * is the earliest, so it's the one left out of the index */
+      connection->n_incoming_unindexed += 1;
+      if (!at_front)
+        return;
+    }
+
+  if (!_dbus_hash_table_insert_int (connection->incoming_replies,
+                                    reply_serial, link))
+    connection->n_incoming_unindexed += 1;
+}
+
+static void
+_dbus_connection_unindex_incoming_link_unlocked (DBusConnection *connection,
+                                                 DBusList       *link)
+{
+  dbus_uint32_t reply_serial;
+
+  reply_serial = dbus_message_get_reply_serial (link->data);
+  if (reply_serial == 0)
+    return;
+
+  if (_dbus_hash_table_lookup_int (connection->incoming_replies,
+                                   reply_serial) == link)
+    {
+      _dbus_hash_table_remove_int (connection->incoming_replies,
+                                   reply_serial);
+    }
+  else
+    {
+      _dbus_assert (connection->n_incoming_unindexed > 0);
+      connection->n_incoming_unindexed -= 1;
+    }
+}
+
+static DBusList*
+_dbus_connection_find_incoming_reply_unlocked (DBusConnection *connection,
+                                               dbus_uint32_t   client_serial)
+{
+  DBusList *link;
+
+  if (connection->n_incoming_unindexed == 0)
+    return _dbus_hash_table_lookup_int (connection->incoming_replies,
+                                        client_serial);
+
+  link = _dbus_list_get_first_link (&connection->incoming_messages);
+
+  while (link != NULL)
+    {
+      if (dbus_message_get_reply_serial (link->data) == client_serial)
+        return link;
+
+      link = _dbus_list_get_next_link (&connection->incoming_messages, link);
+    }
+
+  return NULL;
+}
+
 /**
  * Adds a message-containing list link to the incoming message queue,
  * taking ownership of the link and the message's current refcount.
@@ -496,6 +634,7 @@ _dbus_connection_queue_received_message_link (DBusConnection  *connection,
   
   _dbus_list_append_link (&connection->incoming_messages,
                           link);
+  _dbus_connection_index_incoming_link_unlocked (connection, link, FALSE);
   message = link->data;
 
   /* If this is a reply we're waiting on, remove timeout for it */
@@ -512,6 +651,9 @@ _dbus_connection_queue_received_message_link (DBusConnection  *connection,
 
 	  _dbus_pending_call_set_timeout_added_unlocked (pending, FALSE);
 	}
+
+      _dbus_connection_wake_io_waiters_unlocked (connection, reply_serial,
+                                                 FALSE);
     }
   
   
@@ -556,6 +698,7 @@ _dbus_connection_queue_synthesized_message_link (DBusConnection *connection,
   HAVE_LOCK_CHECK (connection);
   
   _dbus_list_append_link (&connection->incoming_messages, link);
+  _dbus_connection_index_incoming_link_unlocked (connection, link, FALSE);
 
   connection->n_incoming += 1;
 
@@ -1167,6 +1310,145 @@ _dbus_connection_release_io_path (DBusConnection *connection)
   _dbus_cmutex_unlock (connection->io_path_mutex);
 }
 
+/**
+ * Interrupts the I/O thread's poll so that it looks at the outgoing
+ * queue and its watches again. Does nothing if a wakeup is already
+ * pending.
+ *
+ * @param connection the connection.
+ */
+static void
+_dbus_connection_wake_io_thread_unlocked (DBusConnection *connection)
+{
+  DBusString byte;
+
+  HAVE_LOCK_CHECK (connection);
+
+  if (!connection->io_thread_running || connection->io_thread_woken)
+    return;
+
+  connection->io_thread_woken = TRUE;
+
+  /* If the pipe is full, a wakeup is pending anyway */
+  _dbus_string_init_const_len (&byte, "", 1);
+  _dbus_write_socket (connection->io_thread_wakeup_fds[1], &byte, 0, 1);
+}
+
+/**
+ * Wakes threads blocked in _dbus_connection_wait_for_io_thread_unlocked().
+ * Each waiter has its own condition variable, so only the threads
+ * concerned are woken: those waiting for the given reply serial, or
+ * for any I/O if reply_serial is 0.
+ *
+ * @param connection the connection.
+ * @param reply_serial the reply that arrived, or 0 for any I/O
+ * @param wake_all #TRUE to wake every waiter regardless of serial
+ */
+static void
+_dbus_connection_wake_io_waiters_unlocked (DBusConnection *connection,
+                                           dbus_uint32_t   reply_serial,
+                                           dbus_bool_t     wake_all)
+{
+  DBusIOWaiter *waiter;
+
+  HAVE_LOCK_CHECK (connection);
+
+  if (connection->io_waiters == NULL)
+    return;
+
+  _dbus_cmutex_lock (connection->io_path_mutex);
+
+  for (waiter = connection->io_waiters; waiter != NULL; waiter = waiter->next)
+    {
+      if (!waiter->woken &&
+          (wake_all || waiter->reply_serial == reply_serial))
+        {
+          waiter->woken = TRUE;
+          _dbus_condvar_wake_one (waiter->cond);
+        }
+    }
+
+  _dbus_cmutex_unlock (connection->io_path_mutex);
+}
+
+/**
+ * Blocks until the I/O thread wakes us, or the timeout expires. If
+ * pending is not #NULL we wait for its reply specifically, otherwise
+ * for the next round of I/O. As with
+ * _dbus_connection_do_iteration_unlocked(), the caller must recheck
+ * whatever it was waiting for.
+ *
+ * Called with connection lock held; drops it while blocking.
+ *
+ * @param connection the connection.
+ * @param pending the pending call whose reply we want, or #NULL
+ * @param timeout_milliseconds maximum blocking time, or -1 for no limit.
+ */
+static void
+_dbus_connection_wait_for_io_thread_unlocked (DBusConnection  *connection,
+                                              DBusPendingCall *pending,
+                                              int              timeout_milliseconds)
+{
+  DBusIOWaiter waiter;
+  DBusIOWaiter **p;
+
+  HAVE_LOCK_CHECK (connection);
+
+  waiter.reply_serial = 0;
+
+  if (pending != NULL)
+    {
+      waiter.reply_serial = _dbus_pending_call_get_reply_serial_unlocked (pending);
+
+      if (_dbus_pending_call_get_completed_unlocked (pending) ||
+          _dbus_connection_peek_for_reply_unlocked (connection,
+                                                    waiter.reply_serial))
+        return;
+    }
+
+  waiter.cond = _dbus_condvar_new ();
+  if (waiter.cond == NULL)
+    {
+      CONNECTION_UNLOCK (connection);
+      _dbus_memory_pause_based_on_timeout (timeout_milliseconds);
+      CONNECTION_LOCK (connection);
+      return;
+    }
+
+  waiter.woken = FALSE;
+  waiter.next = connection->io_waiters;
+  connection->io_waiters = &waiter;
+
+  _dbus_verbose ("waiting for I/O thread, reply serial %u\n",
+                 waiter.reply_serial);
+
+  /* The I/O thread only sets woken with both the connection lock and
+   * io_path_mutex held, so checking it under io_path_mutex is enough
+   * to avoid losing a wakeup once we let go of the connection lock.
+   */
+  CONNECTION_UNLOCK (connection);
+  _dbus_cmutex_lock (connection->io_path_mutex);
+
+  if (!waiter.woken)
+    {
+      if (timeout_milliseconds < 0)
+        _dbus_condvar_wait (waiter.cond, connection->io_path_mutex);
+      else
+        _dbus_condvar_wait_timeout (waiter.cond, connection->io_path_mutex,
+                                    timeout_milliseconds);
+    }
+
+  _dbus_cmutex_unlock (connection->io_path_mutex);
+  CONNECTION_LOCK (connection);
+
+  for (p = &connection->io_waiters; *p != &waiter; p = &(*p)->next)
+    _dbus_assert (*p != NULL);
+
+  *p = waiter.next;
+
+  _dbus_condvar_free (waiter.cond);
+}
+
 /**
  * Queues incoming messages and sends outgoing messages for this
  * connection, optionally blocking in the process. Each call to
@@ -1215,6 +1497,23 @@ _dbus_connection_do_iteration_unlocked (DBusConnection *connection,
   if (connection->n_outgoing == 0)
     flags &= ~DBUS_ITERATION_DO_WRITING;
 
+  if (connection->io_thread_running)
+    {
+      /* The I/O thread owns the transport; all we can do is tell it
+       * there is something to write, and wait for it.
+       */
+      if (flags & DBUS_ITERATION_DO_WRITING)
+        _dbus_connection_wake_io_thread_unlocked (connection);
+
+      if ((flags & DBUS_ITERATION_BLOCK) && timeout_milliseconds != 0 &&
+          ((flags & DBUS_ITERATION_DO_READING) || connection->n_outgoing > 0))
+        _dbus_connection_wait_for_io_thread_unlocked (connection, pending,
+                                                      timeout_milliseconds);
+
+      _dbus_verbose ("end (I/O thread)\n");
+      return;
+    }
+
   if (_dbus_connection_acquire_io_path (connection,
 					(flags & DBUS_ITERATION_BLOCK) ? timeout_milliseconds : 0))
     {
@@ -1260,6 +1559,7 @@ _dbus_connection_new_for_transport (DBusTransport *transport)
   DBusWatchList *watch_list;
   DBusTimeoutList *timeout_list;
   DBusHashTable *pending_replies;
+  DBusHashTable *incoming_replies;
   DBusList *disconnect_link;
   DBusMessage *disconnect_message;
   DBusCounter *outgoing_counter;
@@ -1268,6 +1568,7 @@ _dbus_connection_new_for_transport (DBusTransport *transport)
   watch_list = NULL;
   connection = NULL;
   pending_replies = NULL;
+  incoming_replies = NULL;
   timeout_list = NULL;
   disconnect_link = NULL;
   disconnect_message = NULL;
@@ -1288,6 +1589,10 @@ _dbus_connection_new_for_transport (DBusTransport *transport)
                           (DBusFreeFunction)free_pending_call_on_hash_removal);
   if (pending_replies == NULL)
     goto error;
+
+  incoming_replies = _dbus_hash_table_new (DBUS_HASH_INT, NULL, NULL);
+  if (incoming_replies == NULL)
+    goto error;
   
   connection = dbus_new0 (DBusConnection, 1);
   if (connection == NULL)
@@ -1317,6 +1622,15 @@ _dbus_connection_new_for_transport (DBusTransport *transport)
   if (connection->slot_mutex == NULL)
     goto error;
 
+#ifdef DBUS_ENABLE_STATS
+  _dbus_rmutex_set_profile_name (connection->mutex, "connection");
+  _dbus_cmutex_set_profile_name (connection->io_path_mutex,
+                                 "connection_io_path");
+  _dbus_cmutex_set_profile_name (connection->dispatch_mutex,
+                                 "connection_dispatch");
+  _dbus_rmutex_set_profile_name (connection->slot_mutex, "connection_slot");
+#endif
+
   disconnect_message = dbus_message_new_signal (DBUS_PATH_LOCAL,
                                                 DBUS_INTERFACE_LOCAL,
                                                 "Disconnected");
@@ -1345,6 +1659,7 @@ _dbus_connection_new_for_transport (DBusTransport *transport)
   connection->watches = watch_list;
   connection->timeouts = timeout_list;
   connection->pending_replies = pending_replies;
+  connection->incoming_replies = incoming_replies;
   connection->outgoing_counter = outgoing_counter;
   connection->filter_list = NULL;
   connection->last_dispatch_status = DBUS_DISPATCH_COMPLETE; /* so we're notified first time there's data */
@@ -1400,6 +1715,9 @@ _dbus_connection_new_for_transport (DBusTransport *transport)
     }
   if (pending_replies)
     _dbus_hash_table_unref (pending_replies);
+
+  if (incoming_replies)
+    _dbus_hash_table_unref (incoming_replies);
   
   if (watch_list)
     _dbus_watch_list_free (watch_list);
@@ -1542,6 +1860,7 @@ close_connection_on_shutdown (DBusConnection *connection)
   DBusMessage *message;
 
   dbus_connection_ref (connection);
+  dbus_connection_stop_io_thread (connection);
   _dbus_connection_close_possibly_shared (connection);
 
   /* Churn through to the Disconnected message */
@@ -1973,12 +2292,12 @@ _dbus_connection_preallocate_send_unlocked (DBusConnection *connection)
   return NULL;
 }
 
-/* Called with lock held, does not update dispatch status */
+/* Called with lock held, only adds the message to the outgoing queue */
 static void
-_dbus_connection_send_preallocated_unlocked_no_update (DBusConnection       *connection,
-                                                       DBusPreallocatedSend *preallocated,
-                                                       DBusMessage          *message,
-                                                       dbus_uint32_t        *client_serial)
+_dbus_connection_queue_preallocated_unlocked (DBusConnection       *connection,
+                                              DBusPreallocatedSend *preallocated,
+                                              DBusMessage          *message,
+                                              dbus_uint32_t        *client_serial)
 {
   dbus_uint32_t serial;
 
@@ -2034,7 +2353,12 @@ _dbus_connection_send_preallocated_unlocked_no_update (DBusConnection       *con
                  message, dbus_message_get_serial (message));
   
   dbus_message_lock (message);
+}
 
+/* Called with lock held, tries to write out whatever has been queued */
+static void
+_dbus_connection_write_queued_unlocked (DBusConnection *connection)
+{
   /* Now we need to run an iteration to hopefully just write the messages
    * out immediately, and otherwise get them queued up
    */
@@ -2048,6 +2372,18 @@ _dbus_connection_send_preallocated_unlocked_no_update (DBusConnection       *con
     _dbus_connection_wakeup_mainloop (connection);
 }
 
+/* Called with lock held, does not update dispatch status */
+static void
+_dbus_connection_send_preallocated_unlocked_no_update (DBusConnection       *connection,
+                                                       DBusPreallocatedSend *preallocated,
+                                                       DBusMessage          *message,
+                                                       dbus_uint32_t        *client_serial)
+{
+  _dbus_connection_queue_preallocated_unlocked (connection, preallocated,
+                                                message, client_serial);
+  _dbus_connection_write_queued_unlocked (connection);
+}
+
 static void
 _dbus_connection_send_preallocated_and_unlock (DBusConnection       *connection,
 					       DBusPreallocatedSend *preallocated,
@@ -2143,6 +2479,47 @@ _dbus_connection_close_if_only_one_ref (DBusConnection *connection)
     CONNECTION_UNLOCK (connection);
 }
 
+/**
+ * Makes a client connection that has not started authenticating yet
+ * send its whole side of the conversation, and then its first
+ * messages, without waiting for the server to answer; see
+ * _dbus_auth_set_pipelined() for when that is safe. Does nothing on
+ * connections that are already authenticating or authenticated.
+ *
+ * @param connection the connection
+ * @returns #FALSE if no memory
+ */
+dbus_bool_t
+_dbus_connection_set_pipelined_auth (DBusConnection *connection)
+{
+  dbus_bool_t res;
+
+  CONNECTION_LOCK (connection);
+  res = _dbus_transport_set_pipelined_auth (connection->transport);
+  CONNECTION_UNLOCK (connection);
+  return res;
+}
+
+/**
+ * Makes the connection write the bodies of large incoming messages to
+ * a memfd as they are read, in large chunks, instead of buffering each
+ * one until it is complete. Worth it for a process like the bus that
+ * reads large messages from many peers at once; the memfd of each
+ * spilled message counts against dbus_connection_set_max_received_unix_fds()
+ * like one the peer sent. Does nothing where memfds are not available.
+ *
+ * @param connection the connection
+ * @param spill #TRUE to spill large bodies
+ */
+void
+_dbus_connection_set_spill_large_bodies (DBusConnection *connection,
+                                         dbus_bool_t     spill)
+{
+  CONNECTION_LOCK (connection);
+  _dbus_transport_set_spill_large_bodies (connection->transport, spill);
+  CONNECTION_UNLOCK (connection);
+}
+
 
 /**
  * When a function that blocks has been called with a timeout, and we
@@ -2219,26 +2596,55 @@ static dbus_bool_t
 _dbus_connection_peek_for_reply_unlocked (DBusConnection *connection,
                                           dbus_uint32_t   client_serial)
 {
-  DBusList *link;
   HAVE_LOCK_CHECK (connection);
 
-  link = _dbus_list_get_first_link (&connection->incoming_messages);
-
-  while (link != NULL)
+  if (_dbus_connection_find_incoming_reply_unlocked (connection,
+                                                     client_serial) != NULL)
     {
-      DBusMessage *reply = link->data;
-
-      if (dbus_message_get_reply_serial (reply) == client_serial)
-        {
-          _dbus_verbose ("%s reply to %d found in queue\n", _DBUS_FUNCTION_NAME, client_serial);
-          return TRUE;
-        }
-      link = _dbus_list_get_next_link (&connection->incoming_messages, link);
+      _dbus_verbose ("%s reply to %d found in queue\n", _DBUS_FUNCTION_NAME, client_serial);
+      return TRUE;
     }
 
   return FALSE;
 }
 
+/*
+ * Checks the header names of an incoming message that the loader left
+ * unchecked because we trust the peer (see
+ * dbus_connection_set_trust_peer_data()), before the message is
+ * handed to anyone. An invalid message is taken off the queue and
+ * dropped, and the peer is disconnected just as if the loader had
+ * rejected it.
+ *
+ * Returns #FALSE if the message was dropped.
+ */
+static dbus_bool_t
+_dbus_connection_check_incoming_link_unlocked (DBusConnection *connection,
+                                               DBusList       *link)
+{
+  DBusValidity validity;
+
+  HAVE_LOCK_CHECK (connection);
+
+  validity = _dbus_message_check_deferred_fields (link->data);
+  if (validity == DBUS_VALID)
+    return TRUE;
+
+  _dbus_verbose ("Message %p has an invalid header field, code %d\n",
+                 link->data, validity);
+
+  _dbus_connection_unindex_incoming_link_unlocked (connection, link);
+  _dbus_list_unlink (&connection->incoming_messages, link);
+  connection->n_incoming -= 1;
+
+  /* released when we unlock */
+  _dbus_list_append_link (&connection->expired_messages, link);
+
+  _dbus_transport_reject_message (connection->transport, validity);
+
+  return FALSE;
+}
+
 /* This is slightly strange since we can pop a message here without
  * the dispatch lock.
  */
@@ -2247,25 +2653,23 @@ check_for_reply_unlocked (DBusConnection *connection,
                           dbus_uint32_t   client_serial)
 {
   DBusList *link;
+  DBusMessage *reply;
 
   HAVE_LOCK_CHECK (connection);
   
-  link = _dbus_list_get_first_link (&connection->incoming_messages);
+  link = _dbus_connection_find_incoming_reply_unlocked (connection,
+                                                        client_serial);
+  if (link == NULL ||
+      !_dbus_connection_check_incoming_link_unlocked (connection, link))
+    return NULL;
 
-  while (link != NULL)
-    {
-      DBusMessage *reply = link->data;
+  reply = link->data;
 
-      if (dbus_message_get_reply_serial (reply) == client_serial)
-	{
-	  _dbus_list_remove_link (&connection->incoming_messages, link);
-	  connection->n_incoming  -= 1;
-	  return reply;
-	}
-      link = _dbus_list_get_next_link (&connection->incoming_messages, link);
-    }
+  _dbus_connection_unindex_incoming_link_unlocked (connection, link);
+  _dbus_list_remove_link (&connection->incoming_messages, link);
+  connection->n_incoming  -= 1;
 
-  return NULL;
+  return reply;
 }
 
 static void
@@ -2353,9 +2757,6 @@ check_for_reply_and_update_dispatch_unlocked (DBusConnection  *connection,
  * filter callbacks.
  *
  * Returns immediately if pending call already got a reply.
- * 
- * @todo could use performance improvements (it keeps scanning
- * the whole message queue for example)
  *
  * @param pending the pending call we block for a reply on
  */
@@ -2379,8 +2780,11 @@ _dbus_connection_block_pending_call (DBusPendingCall *pending)
 
   connection = _dbus_pending_call_get_connection_and_lock (pending);
   
-  /* Flush message queue - note, can affect dispatch status */
-  _dbus_connection_flush_unlocked (connection);
+  /* Flush message queue - note, can affect dispatch status. The I/O
+   * thread, if there is one, writes the call out without our help.
+   */
+  if (!connection->io_thread_running)
+    _dbus_connection_flush_unlocked (connection);
 
   client_serial = _dbus_pending_call_get_reply_serial_unlocked (pending);
 
@@ -2475,16 +2879,19 @@ _dbus_connection_block_pending_call (DBusPendingCall *pending)
            */
           _dbus_verbose ("dbus_connection_send_with_reply_and_block() waiting for more memory\n");
 
-          _dbus_memory_pause_based_on_timeout (timeout_milliseconds - elapsed_milliseconds);
+          _dbus_memory_pause_based_on_timeout (timeout_milliseconds);
         }
       else
         {          
-          /* block again, we don't have the reply buffered yet. */
+          /* block again, we don't have the reply buffered yet. There is
+           * no deadline, so keep blocking with -1: anything else would
+           * be taken as a (negative) timeout.
+           */
           _dbus_connection_do_iteration_unlocked (connection,
                                                   pending,
                                                   DBUS_ITERATION_DO_READING |
                                                   DBUS_ITERATION_BLOCK,
-                                                  timeout_milliseconds - elapsed_milliseconds);
+                                                  timeout_milliseconds);
         }
 
       goto recheck_status;
@@ -2509,7 +2916,7 @@ _dbus_connection_block_pending_call (DBusPendingCall *pending)
         {          
           /* block again, we don't have the reply buffered yet. */
           _dbus_connection_do_iteration_unlocked (connection,
-                                                  NULL,
+                                                  pending,
                                                   DBUS_ITERATION_DO_READING |
                                                   DBUS_ITERATION_BLOCK,
                                                   timeout_milliseconds - elapsed_milliseconds);
@@ -2713,6 +3120,9 @@ _dbus_connection_last_unref (DBusConnection *connection)
 
   _dbus_hash_table_unref (connection->pending_replies);
   connection->pending_replies = NULL;
+
+  _dbus_hash_table_unref (connection->incoming_replies);
+  connection->incoming_replies = NULL;
   
   _dbus_list_clear (&connection->filter_list);
   
@@ -2737,6 +3147,15 @@ _dbus_connection_last_unref (DBusConnection *connection)
       _dbus_list_free_link (connection->disconnect_message_link);
     }
 
+  /* Running workers hold a reference, so any left have exited */
+  _dbus_connection_free_dispatch_workers (connection);
+
+  if (connection->worker_mutex != NULL)
+    {
+      _dbus_condvar_free_at_location (&connection->worker_space_cond);
+      _dbus_cmutex_free_at_location (&connection->worker_mutex);
+    }
+
   _dbus_condvar_free_at_location (&connection->dispatch_cond);
   _dbus_condvar_free_at_location (&connection->io_path_cond);
 
@@ -3283,19 +3702,111 @@ dbus_connection_send (DBusConnection *connection,
 					   serial);
 }
 
-static dbus_bool_t
-reply_handler_timeout (void *data)
+/**
+ * Adds several messages to the outgoing message queue, as if by
+ * calling dbus_connection_send() on each of them in turn, but taking
+ * the connection lock and trying to write to the network only once
+ * for the whole batch. This is cheaper when an application has many
+ * messages to send at once, such as a burst of signals.
+ *
+ * Either all of the messages are queued, or (if memory runs out, or
+ * one of the messages carries unix fds and the connection cannot pass
+ * them) none of them are and #FALSE is returned.
+ *
+ * @param connection the connection.
+ * @param messages the messages to write, in the order they should be sent.
+ * @param n_messages the number of messages.
+ * @param serials return location for an array of n_messages serials, or #NULL
+ * @returns #TRUE on success.
+ */
+dbus_bool_t
+dbus_connection_send_batch (DBusConnection  *connection,
+                            DBusMessage    **messages,
+                            int              n_messages,
+                            dbus_uint32_t   *serials)
 {
-  DBusConnection *connection;
+  DBusPreallocatedSend **preallocated;
   DBusDispatchStatus status;
-  DBusPendingCall *pending = data;
+  int i;
 
-  connection = _dbus_pending_call_get_connection_and_lock (pending);
-  _dbus_connection_ref_unlocked (connection);
+  _dbus_return_val_if_fail (connection != NULL, FALSE);
+  _dbus_return_val_if_fail (messages != NULL || n_messages == 0, FALSE);
+  _dbus_return_val_if_fail (n_messages >= 0, FALSE);
 
-  _dbus_pending_call_queue_timeout_error_unlocked (pending, 
-                                                   connection);
-  _dbus_connection_remove_timeout_unlocked (connection,
+  for (i = 0; i < n_messages; i++)
+    {
+      DBusMessage *message = messages[i];
+
+      _dbus_return_val_if_fail (message != NULL, FALSE);
+      _dbus_return_val_if_fail (dbus_message_get_type (message) != DBUS_MESSAGE_TYPE_METHOD_CALL ||
+                                dbus_message_get_member (message) != NULL, FALSE);
+      _dbus_return_val_if_fail (dbus_message_get_type (message) != DBUS_MESSAGE_TYPE_SIGNAL ||
+                                (dbus_message_get_interface (message) != NULL &&
+                                 dbus_message_get_member (message) != NULL), FALSE);
+    }
+
+  if (n_messages == 0)
+    return TRUE;
+
+  preallocated = dbus_new (DBusPreallocatedSend *, n_messages);
+  if (preallocated == NULL)
+    return FALSE;
+
+  CONNECTION_LOCK (connection);
+
+  for (i = 0; i < n_messages; i++)
+    {
+#ifdef HAVE_UNIX_FD_PASSING
+      /* As in dbus_connection_send(), refuse to send fds on a
+       * connection that cannot handle them */
+      if (!_dbus_transport_can_pass_unix_fd(connection->transport) &&
+          messages[i]->n_unix_fds > 0)
+        goto failed;
+#endif
+
+      preallocated[i] = _dbus_connection_preallocate_send_unlocked (connection);
+      if (preallocated[i] == NULL)
+        goto failed;
+    }
+
+  for (i = 0; i < n_messages; i++)
+    _dbus_connection_queue_preallocated_unlocked (connection,
+                                                  preallocated[i],
+                                                  messages[i],
+                                                  serials ? &serials[i] : NULL);
+
+  dbus_free (preallocated);
+
+  _dbus_connection_write_queued_unlocked (connection);
+
+  status = _dbus_connection_get_dispatch_status_unlocked (connection);
+
+  /* this calls out to user code */
+  _dbus_connection_update_dispatch_status_and_unlock (connection, status);
+  return TRUE;
+
+ failed:
+  while (--i >= 0)
+    dbus_connection_free_preallocated_send (connection, preallocated[i]);
+
+  CONNECTION_UNLOCK (connection);
+  dbus_free (preallocated);
+  return FALSE;
+}
+
+static dbus_bool_t
+reply_handler_timeout (void *data)
+{
+  DBusConnection *connection;
+  DBusDispatchStatus status;
+  DBusPendingCall *pending = data;
+
+  connection = _dbus_pending_call_get_connection_and_lock (pending);
+  _dbus_connection_ref_unlocked (connection);
+
+  _dbus_pending_call_queue_timeout_error_unlocked (pending, 
+                                                   connection);
+  _dbus_connection_remove_timeout_unlocked (connection,
 				            _dbus_pending_call_get_timeout_unlocked (pending));
   _dbus_pending_call_set_timeout_added_unlocked (pending, FALSE);
 
@@ -3826,6 +4337,11 @@ dbus_connection_borrow_message (DBusConnection *connection)
   /* While a message is outstanding, the dispatch lock is held */
   _dbus_assert (connection->message_borrowed == NULL);
 
+  while (connection->n_incoming > 0 &&
+         !_dbus_connection_check_incoming_link_unlocked (connection,
+             _dbus_list_get_first_link (&connection->incoming_messages)))
+    ;
+
   connection->message_borrowed = _dbus_list_get_first (&connection->incoming_messages);
   
   message = connection->message_borrowed;
@@ -3903,6 +4419,8 @@ dbus_connection_steal_borrowed_message (DBusConnection *connection,
  
   _dbus_assert (message == connection->message_borrowed);
 
+  _dbus_connection_unindex_incoming_link_unlocked (connection,
+      _dbus_list_get_first_link (&connection->incoming_messages));
   pop_message = _dbus_list_pop_first (&connection->incoming_messages);
   _dbus_assert (message == pop_message);
   (void) pop_message; /* unused unless asserting */
@@ -3931,12 +4449,18 @@ _dbus_connection_pop_message_link_unlocked (DBusConnection *connection)
   HAVE_LOCK_CHECK (connection);
   
   _dbus_assert (connection->message_borrowed == NULL);
-  
+
+  while (connection->n_incoming > 0 &&
+         !_dbus_connection_check_incoming_link_unlocked (connection,
+             _dbus_list_get_first_link (&connection->incoming_messages)))
+    ;
+
   if (connection->n_incoming > 0)
     {
       DBusList *link;
 
       link = _dbus_list_pop_first_link (&connection->incoming_messages);
+      _dbus_connection_unindex_incoming_link_unlocked (connection, link);
       connection->n_incoming -= 1;
 
       _dbus_verbose ("Message %p (%s %s %s %s '%s') removed from incoming queue %p, %d incoming\n",
@@ -4005,6 +4529,8 @@ _dbus_connection_putback_message_link_unlocked (DBusConnection *connection,
 
   _dbus_list_prepend_link (&connection->incoming_messages,
                            message_link);
+  _dbus_connection_index_incoming_link_unlocked (connection, message_link,
+                                                 TRUE);
   connection->n_incoming += 1;
 
   _dbus_verbose ("Message %p (%s %s %s '%s') put back into queue %p, %d incoming\n",
@@ -4073,6 +4599,67 @@ dbus_connection_pop_message (DBusConnection *connection)
   return message;
 }
 
+/**
+ * Like dbus_connection_pop_message(), but removes up to max_messages
+ * messages from the front of the incoming queue at once, storing them
+ * in order in the messages array. The caller owns a reference to each
+ * message returned. This takes the connection and dispatch locks once
+ * for the whole batch, so it is cheaper than popping messages one by
+ * one when draining a busy connection.
+ *
+ * The same caveats as for dbus_connection_pop_message() apply.
+ *
+ * @param connection the connection.
+ * @param messages array to store at most max_messages messages in
+ * @param max_messages the size of the array
+ * @returns the number of messages stored in the array, 0 if the queue was empty
+ */
+int
+dbus_connection_pop_messages (DBusConnection  *connection,
+                              DBusMessage    **messages,
+                              int              max_messages)
+{
+  DBusDispatchStatus status;
+  int n_messages;
+
+  _dbus_return_val_if_fail (connection != NULL, 0);
+  _dbus_return_val_if_fail (messages != NULL || max_messages == 0, 0);
+  _dbus_return_val_if_fail (max_messages >= 0, 0);
+
+  if (max_messages == 0)
+    return 0;
+
+  /* this is called for the side effect that it queues
+   * up any messages from the transport
+   */
+  status = dbus_connection_get_dispatch_status (connection);
+  if (status != DBUS_DISPATCH_DATA_REMAINS)
+    return 0;
+
+  CONNECTION_LOCK (connection);
+  _dbus_connection_acquire_dispatch (connection);
+  HAVE_LOCK_CHECK (connection);
+
+  n_messages = 0;
+  while (n_messages < max_messages)
+    {
+      messages[n_messages] = _dbus_connection_pop_message_unlocked (connection);
+      if (messages[n_messages] == NULL)
+        break;
+
+      n_messages++;
+    }
+
+  _dbus_verbose ("Returning %d popped messages\n", n_messages);
+
+  _dbus_connection_release_dispatch (connection);
+
+  status = _dbus_connection_get_dispatch_status_unlocked (connection);
+  _dbus_connection_update_dispatch_status_and_unlock (connection, status);
+
+  return n_messages;
+}
+
 /**
  * Acquire the dispatcher. This is a separate lock so the main
  * connection lock can be dropped to call out to application dispatch
@@ -4139,6 +4726,8 @@ _dbus_connection_failed_pop (DBusConnection *connection,
 {
   _dbus_list_prepend_link (&connection->incoming_messages,
 			   message_link);
+  _dbus_connection_index_incoming_link_unlocked (connection, message_link,
+                                                 TRUE);
   connection->n_incoming += 1;
 }
 
@@ -4463,6 +5052,86 @@ _dbus_connection_run_builtin_filters_unlocked_no_update (DBusConnection *connect
   return _dbus_connection_peer_filter_unlocked_no_update (connection, message);
 }
 
+/**
+ * Replies to a method call that no filter or object handled with an
+ * UnknownMethod or UnknownObject error. The reply is queued without
+ * updating the dispatch status, and freed when the lock is released.
+ *
+ * @param connection the connection.
+ * @param message the unhandled method call
+ * @param found_object whether an object was registered at its path
+ * @returns #DBUS_HANDLER_RESULT_HANDLED or #DBUS_HANDLER_RESULT_NEED_MEMORY
+ */
+static DBusHandlerResult
+_dbus_connection_reply_unknown_method_unlocked (DBusConnection *connection,
+                                                DBusMessage    *message,
+                                                dbus_bool_t     found_object)
+{
+  DBusMessage *reply;
+  DBusString str;
+  DBusPreallocatedSend *preallocated;
+  DBusList *expire_link;
+
+  _dbus_verbose ("  sending error %s\n",
+                 DBUS_ERROR_UNKNOWN_METHOD);
+
+  if (!_dbus_string_init (&str))
+    {
+      _dbus_verbose ("no memory for error string in dispatch\n");
+      return DBUS_HANDLER_RESULT_NEED_MEMORY;
+    }
+          
+  if (!_dbus_string_append_printf (&str,
+                                   "Method \"%s\" with signature \"%s\" on interface \"%s\" doesn't exist\n",
+                                   dbus_message_get_member (message),
+                                   dbus_message_get_signature (message),
+                                   dbus_message_get_interface (message)))
+    {
+      _dbus_string_free (&str);
+      _dbus_verbose ("no memory for error string in dispatch\n");
+      return DBUS_HANDLER_RESULT_NEED_MEMORY;
+    }
+  
+  reply = dbus_message_new_error (message,
+                                  found_object ? DBUS_ERROR_UNKNOWN_METHOD : DBUS_ERROR_UNKNOWN_OBJECT,
+                                  _dbus_string_get_const_data (&str));
+  _dbus_string_free (&str);
+
+  if (reply == NULL)
+    {
+      _dbus_verbose ("no memory for error reply in dispatch\n");
+      return DBUS_HANDLER_RESULT_NEED_MEMORY;
+    }
+
+  expire_link = _dbus_list_alloc_link (reply);
+
+  if (expire_link == NULL)
+    {
+      dbus_message_unref (reply);
+      _dbus_verbose ("no memory for error send in dispatch\n");
+      return DBUS_HANDLER_RESULT_NEED_MEMORY;
+    }
+
+  preallocated = _dbus_connection_preallocate_send_unlocked (connection);
+
+  if (preallocated == NULL)
+    {
+      _dbus_list_free_link (expire_link);
+      /* It's OK that this is finalized, because it hasn't been seen by
+       * anything that could attach user callbacks */
+      dbus_message_unref (reply);
+      _dbus_verbose ("no memory for error send in dispatch\n");
+      return DBUS_HANDLER_RESULT_NEED_MEMORY;
+    }
+
+  _dbus_connection_send_preallocated_unlocked_no_update (connection, preallocated,
+                                                         reply, NULL);
+  /* reply will be freed when we release the lock */
+  _dbus_list_prepend_link (&connection->expired_messages, expire_link);
+
+  return DBUS_HANDLER_RESULT_HANDLED;
+}
+
 /**
  * Processes any incoming data.
  *
@@ -4489,7 +5158,10 @@ _dbus_connection_run_builtin_filters_unlocked_no_update (DBusConnection *connect
  * Third, if the message is a method call it is forwarded to
  * any registered object path handlers added with
  * dbus_connection_register_object_path() or
- * dbus_connection_register_fallback().
+ * dbus_connection_register_fallback(). If
+ * dbus_connection_start_dispatch_workers() has been called, this step
+ * happens on a worker thread instead, and dbus_connection_dispatch()
+ * may block until the workers have room for the message.
  *
  * A single call to dbus_connection_dispatch() will process at most
  * one message; it will not clear the entire message queue.
@@ -4660,6 +5332,31 @@ dbus_connection_dispatch (DBusConnection *connection)
       goto out;
     }
 
+  if (connection->have_dispatch_workers)
+    {
+      if (!connection->disconnected_message_arrived)
+        {
+          /* unlocks */
+          _dbus_connection_queue_for_worker_and_unlock (connection,
+                                                        message_link);
+          CONNECTION_LOCK (connection);
+
+          /* the worker frees them */
+          message_link = NULL;
+          message = NULL;
+          result = DBUS_HANDLER_RESULT_HANDLED;
+          goto out;
+        }
+
+      /* Let the workers finish what came before the Disconnected
+       * signal, then handle it here as usual.
+       */
+      connection->have_dispatch_workers = FALSE;
+      CONNECTION_UNLOCK (connection);
+      _dbus_connection_join_dispatch_workers (connection);
+      CONNECTION_LOCK (connection);
+    }
+
   /* We're still protected from dispatch() reentrancy here
    * since we acquired the dispatcher
    */
@@ -4688,76 +5385,9 @@ dbus_connection_dispatch (DBusConnection *connection)
     }
 
   if (dbus_message_get_type (message) == DBUS_MESSAGE_TYPE_METHOD_CALL)
-    {
-      DBusMessage *reply;
-      DBusString str;
-      DBusPreallocatedSend *preallocated;
-      DBusList *expire_link;
-
-      _dbus_verbose ("  sending error %s\n",
-                     DBUS_ERROR_UNKNOWN_METHOD);
-
-      if (!_dbus_string_init (&str))
-        {
-          result = DBUS_HANDLER_RESULT_NEED_MEMORY;
-          _dbus_verbose ("no memory for error string in dispatch\n");
-          goto out;
-        }
-              
-      if (!_dbus_string_append_printf (&str,
-                                       "Method \"%s\" with signature \"%s\" on interface \"%s\" doesn't exist\n",
-                                       dbus_message_get_member (message),
-                                       dbus_message_get_signature (message),
-                                       dbus_message_get_interface (message)))
-        {
-          _dbus_string_free (&str);
-          result = DBUS_HANDLER_RESULT_NEED_MEMORY;
-          _dbus_verbose ("no memory for error string in dispatch\n");
-          goto out;
-        }
-      
-      reply = dbus_message_new_error (message,
-                                      found_object ? DBUS_ERROR_UNKNOWN_METHOD : DBUS_ERROR_UNKNOWN_OBJECT,
-                                      _dbus_string_get_const_data (&str));
-      _dbus_string_free (&str);
-
-      if (reply == NULL)
-        {
-          result = DBUS_HANDLER_RESULT_NEED_MEMORY;
-          _dbus_verbose ("no memory for error reply in dispatch\n");
-          goto out;
-        }
-
-      expire_link = _dbus_list_alloc_link (reply);
-
-      if (expire_link == NULL)
-        {
-          dbus_message_unref (reply);
-          result = DBUS_HANDLER_RESULT_NEED_MEMORY;
-          _dbus_verbose ("no memory for error send in dispatch\n");
-          goto out;
-        }
-
-      preallocated = _dbus_connection_preallocate_send_unlocked (connection);
-
-      if (preallocated == NULL)
-        {
-          _dbus_list_free_link (expire_link);
-          /* It's OK that this is finalized, because it hasn't been seen by
-           * anything that could attach user callbacks */
-          dbus_message_unref (reply);
-          result = DBUS_HANDLER_RESULT_NEED_MEMORY;
-          _dbus_verbose ("no memory for error send in dispatch\n");
-          goto out;
-        }
-
-      _dbus_connection_send_preallocated_unlocked_no_update (connection, preallocated,
-                                                             reply, NULL);
-      /* reply will be freed when we release the lock */
-      _dbus_list_prepend_link (&connection->expired_messages, expire_link);
-
-      result = DBUS_HANDLER_RESULT_HANDLED;
-    }
+    result = _dbus_connection_reply_unknown_method_unlocked (connection,
+                                                             message,
+                                                             found_object);
   
   _dbus_verbose ("  done dispatching %p (%s %s %s '%s') on connection %p\n", message,
                  dbus_message_type_to_string (dbus_message_get_type (message)),
@@ -4906,97 +5536,880 @@ dbus_connection_set_watch_functions (DBusConnection              *connection,
   return retval;
 }
 
-/**
- * Sets the timeout functions for the connection. These functions are
- * responsible for making the application's main loop aware of timeouts.
- * When using Qt, typically the DBusAddTimeoutFunction would create a
- * QTimer. When using GLib, the DBusAddTimeoutFunction would call
- * g_timeout_add.
- * 
- * The DBusTimeoutToggledFunction notifies the application that the
- * timeout has been enabled or disabled. Call
- * dbus_timeout_get_enabled() to check this. A disabled timeout should
- * have no effect, and enabled timeout should be added to the main
- * loop. This feature is used instead of simply adding/removing the
- * timeout because enabling/disabling can be done without memory
- * allocation. With Qt, QTimer::start() and QTimer::stop() can be used
- * to enable and disable. The toggled function may be NULL if a main
- * loop re-queries dbus_timeout_get_enabled() every time anyway.
- * Whenever a timeout is toggled, its interval may change.
- *
- * The DBusTimeout can be queried for the timer interval using
- * dbus_timeout_get_interval(). dbus_timeout_handle() should be called
- * repeatedly, each time the interval elapses, starting after it has
- * elapsed once. The timeout stops firing when it is removed with the
- * given remove_function.  The timer interval may change whenever the
- * timeout is added, removed, or toggled.
- *
- * @note The thread lock on DBusConnection is held while
- * timeout functions are invoked, so inside these functions you
- * may not invoke any methods on DBusConnection or it will deadlock.
- * See the comments in the code or http://lists.freedesktop.org/archives/dbus/2007-July/thread.html#8144
- * if you encounter this issue and want to attempt writing a patch.
- *
- * @param connection the connection.
- * @param add_function function to add a timeout.
- * @param remove_function function to remove a timeout.
- * @param toggled_function function to notify of enable/disable
- * @param data data to pass to add_function and remove_function.
- * @param free_data_function function to be called to free the data.
- * @returns #FALSE on failure (no memory)
- */
-dbus_bool_t
-dbus_connection_set_timeout_functions   (DBusConnection            *connection,
-					 DBusAddTimeoutFunction     add_function,
-					 DBusRemoveTimeoutFunction  remove_function,
-                                         DBusTimeoutToggledFunction toggled_function,
-					 void                      *data,
-					 DBusFreeFunction           free_data_function)
+static dbus_bool_t
+io_thread_add_watch (DBusWatch *watch,
+                     void      *data)
 {
-  dbus_bool_t retval;
+  DBusConnection *connection = data;
 
-  _dbus_return_val_if_fail (connection != NULL, FALSE);
-  
-  CONNECTION_LOCK (connection);
+  if (!_dbus_list_append (&connection->io_thread_watches, watch))
+    return FALSE;
 
-  retval = _dbus_timeout_list_set_functions (connection->timeouts,
-                                             add_function, remove_function,
-                                             toggled_function,
-                                             data, free_data_function);
+  _dbus_connection_wake_io_thread_unlocked (connection);
+  return TRUE;
+}
 
-  CONNECTION_UNLOCK (connection);
+static void
+io_thread_remove_watch (DBusWatch *watch,
+                        void      *data)
+{
+  DBusConnection *connection = data;
 
-  return retval;
+  _dbus_list_remove_last (&connection->io_thread_watches, watch);
+  _dbus_connection_wake_io_thread_unlocked (connection);
 }
 
-/**
- * Sets the mainloop wakeup function for the connection. This function
- * is responsible for waking up the main loop (if its sleeping in
- * another thread) when some some change has happened to the
- * connection that the mainloop needs to reconsider (e.g. a message
- * has been queued for writing).  When using Qt, this typically
- * results in a call to QEventLoop::wakeUp().  When using GLib, it
- * would call g_main_context_wakeup().
- *
- * @param connection the connection.
- * @param wakeup_main_function function to wake up the mainloop
- * @param data data to pass wakeup_main_function
- * @param free_data_function function to be called to free the data.
- */
-void
-dbus_connection_set_wakeup_main_function (DBusConnection            *connection,
-					  DBusWakeupMainFunction     wakeup_main_function,
-					  void                      *data,
-					  DBusFreeFunction           free_data_function)
+static void
+io_thread_toggle_watch (DBusWatch *watch,
+                        void      *data)
 {
-  void *old_data;
-  DBusFreeFunction old_free_data;
+  _dbus_connection_wake_io_thread_unlocked (data);
+}
 
-  _dbus_return_if_fail (connection != NULL);
-  
-  CONNECTION_LOCK (connection);
-  old_data = connection->wakeup_main_data;
-  old_free_data = connection->free_wakeup_main_data;
+static short
+watch_flags_to_poll_events (unsigned int flags)
+{
+  short events = 0;
+
+  if (flags & DBUS_WATCH_READABLE)
+    events |= _DBUS_POLLIN;
+  if (flags & DBUS_WATCH_WRITABLE)
+    events |= _DBUS_POLLOUT;
+
+  return events;
+}
+
+static unsigned int
+watch_flags_from_poll_revents (short revents)
+{
+  unsigned int condition = 0;
+
+  if (revents & _DBUS_POLLIN)
+    condition |= DBUS_WATCH_READABLE;
+  if (revents & _DBUS_POLLOUT)
+    condition |= DBUS_WATCH_WRITABLE;
+  if (revents & _DBUS_POLLHUP)
+    condition |= DBUS_WATCH_HANGUP;
+  if (revents & _DBUS_POLLERR)
+    condition |= DBUS_WATCH_ERROR;
+
+  return condition;
+}
+
+/*
+ * Body of the thread started by dbus_connection_start_io_thread().
+ * This is a small main loop over the connection's own watches plus a
+ * wakeup pipe. It is the only thread that touches the transport, so
+ * it never has to compete for the I/O path; other threads queue
+ * messages, poke the pipe and sleep until woken.
+ */
+static void
+io_thread_main (void *data)
+{
+  DBusConnection *connection = data;
+  DBusPollFD *fds = NULL;
+  DBusWatch **watches = NULL;
+  int n_allocated = 0;
+  DBusString drain;
+  dbus_bool_t have_drain;
+  dbus_int32_t old_refcount;
+
+  have_drain = _dbus_string_init (&drain);
+
+  CONNECTION_LOCK (connection);
+
+  _dbus_verbose ("I/O thread started for connection %p\n", connection);
+
+  while (!connection->io_thread_quit &&
+         _dbus_connection_get_is_connected_unlocked (connection))
+    {
+      DBusDispatchStatus status;
+      DBusList *link;
+      int n_fds, poll_res, i;
+
+      /* Write what we can straight away. Like any iteration this also
+       * enables the write watch if something is left over.
+       */
+      if (connection->n_outgoing > 0 &&
+          _dbus_connection_acquire_io_path (connection, -1))
+        {
+          _dbus_transport_do_iteration (connection->transport,
+                                        DBUS_ITERATION_DO_WRITING, 0);
+          _dbus_connection_release_io_path (connection);
+        }
+
+      /* Flushes and plain blocking reads recheck their condition each
+       * time round; replies wake their own waiter as they are queued.
+       */
+      _dbus_connection_wake_io_waiters_unlocked (connection, 0, FALSE);
+
+      n_fds = _dbus_list_get_length (&connection->io_thread_watches) + 1;
+      if (n_fds > n_allocated)
+        {
+          DBusPollFD *new_fds;
+          DBusWatch **new_watches;
+
+          new_fds = dbus_realloc (fds, n_fds * sizeof (DBusPollFD));
+          if (new_fds != NULL)
+            fds = new_fds;
+
+          new_watches = dbus_realloc (watches, n_fds * sizeof (DBusWatch *));
+          if (new_watches != NULL)
+            watches = new_watches;
+
+          if (new_fds == NULL || new_watches == NULL || !have_drain)
+            {
+              CONNECTION_UNLOCK (connection);
+              _dbus_memory_pause_based_on_timeout (-1);
+              if (!have_drain)
+                have_drain = _dbus_string_init (&drain);
+              CONNECTION_LOCK (connection);
+              continue;
+            }
+
+          n_allocated = n_fds;
+        }
+
+      fds[0].fd = connection->io_thread_wakeup_fds[0];
+      fds[0].events = _DBUS_POLLIN;
+      fds[0].revents = 0;
+      n_fds = 1;
+
+      for (link = _dbus_list_get_first_link (&connection->io_thread_watches);
+           link != NULL;
+           link = _dbus_list_get_next_link (&connection->io_thread_watches,
+                                            link))
+        {
+          DBusWatch *watch = link->data;
+
+          if (!dbus_watch_get_enabled (watch))
+            continue;
+
+          fds[n_fds].fd = dbus_watch_get_socket (watch);
+          fds[n_fds].events =
+            watch_flags_to_poll_events (dbus_watch_get_flags (watch));
+          fds[n_fds].revents = 0;
+          watches[n_fds] = _dbus_watch_ref (watch);
+          n_fds += 1;
+        }
+
+      CONNECTION_UNLOCK (connection);
+
+      poll_res = _dbus_poll (fds, n_fds, -1);
+
+      CONNECTION_LOCK (connection);
+
+      if (poll_res > 0 && fds[0].revents != 0)
+        {
+          connection->io_thread_woken = FALSE;
+          _dbus_read_socket (fds[0].fd, &drain, 64);
+          _dbus_string_set_length (&drain, 0);
+        }
+
+      for (i = 1; i < n_fds; i++)
+        {
+          /* The watch may have gone away or been disabled while we
+           * were polling without the lock.
+           */
+          if (poll_res > 0 && fds[i].revents != 0 &&
+              _dbus_list_find_last (&connection->io_thread_watches,
+                                    watches[i]) != NULL &&
+              dbus_watch_get_enabled (watches[i]) &&
+              _dbus_connection_acquire_io_path (connection, -1))
+            {
+              _dbus_transport_handle_watch (connection->transport, watches[i],
+                                            watch_flags_from_poll_revents (fds[i].revents));
+              _dbus_connection_release_io_path (connection);
+            }
+
+          _dbus_watch_unref (watches[i]);
+        }
+
+      status = _dbus_connection_get_dispatch_status_unlocked (connection);
+
+      /* this calls out to user code */
+      _dbus_connection_update_dispatch_status_and_unlock (connection, status);
+
+      CONNECTION_LOCK (connection);
+    }
+
+  _dbus_verbose ("I/O thread exiting for connection %p\n", connection);
+
+  dbus_free (fds);
+  dbus_free (watches);
+
+  if (have_drain)
+    _dbus_string_free (&drain);
+
+  connection->io_thread_running = FALSE;
+
+  _dbus_watch_list_set_functions (connection->watches,
+                                  NULL, NULL, NULL, NULL, NULL);
+  _dbus_list_clear (&connection->io_thread_watches);
+
+  _dbus_close_socket (connection->io_thread_wakeup_fds[0], NULL);
+  _dbus_close_socket (connection->io_thread_wakeup_fds[1], NULL);
+
+  /* Drop our reference before anyone can see that we have stopped:
+   * once dbus_connection_stop_io_thread() returns, the application may
+   * go on to call dbus_shutdown(). If ours was the last reference,
+   * nobody else can be waiting for us.
+   */
+  old_refcount = _dbus_atomic_dec (&connection->refcount);
+  _dbus_connection_trace_ref (connection, old_refcount, old_refcount - 1,
+                              "io_thread_main");
+
+  /* Anyone still waiting falls back to doing I/O for themselves */
+  _dbus_connection_wake_io_waiters_unlocked (connection, 0, TRUE);
+
+  CONNECTION_UNLOCK (connection);
+
+  if (old_refcount == 1)
+    _dbus_connection_last_unref (connection);
+}
+
+/**
+ * Starts a thread owned by libdbus that does all reading and writing
+ * for this connection. This helps applications where many threads
+ * share one connection: rather than taking turns at the socket, a
+ * thread sending a message only queues it and wakes the I/O thread,
+ * and a thread blocked in dbus_connection_send_with_reply_and_block()
+ * sleeps until its own reply arrives.
+ *
+ * The I/O thread takes over the connection's watches, replacing any
+ * functions set with dbus_connection_set_watch_functions(), so the
+ * connection should not also be attached to a main loop for I/O.
+ * Timeouts are not affected. Incoming messages other than replies to
+ * blocking calls still have to be dispatched by the application;
+ * the dispatch status function and the wakeup main function are
+ * called from the I/O thread when there is something to dispatch.
+ *
+ * The thread holds a reference to the connection. It exits when the
+ * connection is disconnected, or when dbus_connection_stop_io_thread()
+ * is called. This function initializes threads with
+ * dbus_threads_init_default() if the application has not already.
+ *
+ * Does nothing and returns #TRUE if the I/O thread is already running.
+ *
+ * @param connection the connection
+ * @returns #FALSE if the connection is not connected, or on OOM or
+ *   failure to create the thread
+ */
+dbus_bool_t
+dbus_connection_start_io_thread (DBusConnection *connection)
+{
+  int fds[2];
+
+  _dbus_return_val_if_fail (connection != NULL, FALSE);
+
+  /* The connection's locks have to be real ones before another thread
+   * can be allowed to use them.
+   */
+  if (!dbus_threads_init_default ())
+    return FALSE;
+
+  CONNECTION_LOCK (connection);
+
+  if (connection->io_thread_running)
+    {
+      CONNECTION_UNLOCK (connection);
+      return TRUE;
+    }
+
+  if (!_dbus_connection_get_is_connected_unlocked (connection))
+    {
+      CONNECTION_UNLOCK (connection);
+      return FALSE;
+    }
+
+  if (!_dbus_full_duplex_pipe (&fds[0], &fds[1], FALSE, NULL))
+    {
+      CONNECTION_UNLOCK (connection);
+      return FALSE;
+    }
+
+  if (!_dbus_watch_list_set_functions (connection->watches,
+                                       io_thread_add_watch,
+                                       io_thread_remove_watch,
+                                       io_thread_toggle_watch,
+                                       connection, NULL))
+    goto failed;
+
+  connection->io_thread_wakeup_fds[0] = fds[0];
+  connection->io_thread_wakeup_fds[1] = fds[1];
+  connection->io_thread_quit = FALSE;
+  connection->io_thread_woken = FALSE;
+  connection->io_thread_running = TRUE;
+
+  _dbus_connection_ref_unlocked (connection);
+
+  if (!_dbus_thread_start (io_thread_main, connection))
+    {
+      connection->io_thread_running = FALSE;
+      _dbus_watch_list_set_functions (connection->watches,
+                                      NULL, NULL, NULL, NULL, NULL);
+      _dbus_list_clear (&connection->io_thread_watches);
+      _dbus_connection_unref_unlocked (connection);
+      goto failed;
+    }
+
+  _dbus_verbose ("started I/O thread for connection %p\n", connection);
+
+  CONNECTION_UNLOCK (connection);
+  return TRUE;
+
+ failed:
+  _dbus_close_socket (fds[0], NULL);
+  _dbus_close_socket (fds[1], NULL);
+  CONNECTION_UNLOCK (connection);
+  return FALSE;
+}
+
+/**
+ * Stops the thread started by dbus_connection_start_io_thread(), and
+ * waits until it has let go of the connection. Afterwards the
+ * connection behaves as it did before, except that it has no watch
+ * functions; the application can set its own again with
+ * dbus_connection_set_watch_functions().
+ *
+ * The thread is not joined: libdbus threads are detached, and the
+ * thread may still be returning from its last unlock of the
+ * connection when this function returns. It does not touch the
+ * connection or any of its own resources after that point.
+ *
+ * Must not be called from the I/O thread itself, i.e. from a dispatch
+ * status or wakeup main function, since it would wait for itself.
+ *
+ * Does nothing if the I/O thread is not running.
+ *
+ * @param connection the connection
+ */
+void
+dbus_connection_stop_io_thread (DBusConnection *connection)
+{
+  _dbus_return_if_fail (connection != NULL);
+
+  CONNECTION_LOCK (connection);
+
+  if (connection->io_thread_running)
+    {
+      connection->io_thread_quit = TRUE;
+      _dbus_connection_wake_io_thread_unlocked (connection);
+
+      while (connection->io_thread_running)
+        _dbus_connection_wait_for_io_thread_unlocked (connection, NULL, -1);
+    }
+
+  CONNECTION_UNLOCK (connection);
+}
+
+/*
+ * Picks the worker for a message. Method calls are spread by object
+ * path and signals by sender, so that everything for one object, or
+ * from one peer, is handled by one worker in the order it arrived.
+ */
+static int
+dispatch_worker_index (DBusConnection *connection,
+                       DBusMessage    *message)
+{
+  const char *key = NULL;
+  unsigned int h = 0;
+
+  if (dbus_message_get_type (message) == DBUS_MESSAGE_TYPE_SIGNAL)
+    key = dbus_message_get_sender (message);
+
+  if (key == NULL)
+    key = dbus_message_get_path (message);
+
+  if (key != NULL)
+    {
+      /* same hash as DBusHashTable uses for strings */
+      for (; *key != '\0'; key++)
+        h = (h << 5) - h + (unsigned char) *key;
+    }
+
+  return h % connection->n_workers;
+}
+
+/*
+ * Hands a message that has been through the filters to its dispatch
+ * worker. Blocks while the workers already have max_worker_messages
+ * between them, so that the incoming queue, and eventually the
+ * transport, stop being drained until they catch up.
+ *
+ * Called with the connection lock and the dispatcher held; returns
+ * with only the dispatcher held.
+ */
+static void
+_dbus_connection_queue_for_worker_and_unlock (DBusConnection *connection,
+                                              DBusList       *message_link)
+{
+  DBusDispatchWorker *worker;
+
+  HAVE_LOCK_CHECK (connection);
+  _dbus_assert (connection->have_dispatch_workers);
+
+  worker = &connection->workers[dispatch_worker_index (connection,
+                                                       message_link->data)];
+
+  CONNECTION_UNLOCK (connection);
+
+  _dbus_cmutex_lock (connection->worker_mutex);
+
+  while (connection->n_worker_messages >= connection->max_worker_messages)
+    _dbus_condvar_wait (connection->worker_space_cond,
+                        connection->worker_mutex);
+
+  connection->n_worker_messages += 1;
+  _dbus_list_append_link (&worker->queue, message_link);
+  _dbus_condvar_wake_one (worker->cond);
+
+  _dbus_cmutex_unlock (connection->worker_mutex);
+}
+
+/*
+ * Tells the dispatch workers to exit once they have handled what is
+ * already queued, and waits until they have. Must be called without
+ * the connection lock, since the workers need it to run handlers.
+ */
+static void
+_dbus_connection_join_dispatch_workers (DBusConnection *connection)
+{
+  int i;
+
+  _dbus_cmutex_lock (connection->worker_mutex);
+
+  connection->workers_quit = TRUE;
+
+  for (i = 0; i < connection->n_workers; i++)
+    _dbus_condvar_wake_one (connection->workers[i].cond);
+
+  while (connection->n_workers_running > 0)
+    _dbus_condvar_wait (connection->worker_space_cond,
+                        connection->worker_mutex);
+
+  _dbus_cmutex_unlock (connection->worker_mutex);
+}
+
+/*
+ * Frees the workers array once none of the workers are running.
+ */
+static void
+_dbus_connection_free_dispatch_workers (DBusConnection *connection)
+{
+  int i;
+
+  if (connection->workers == NULL)
+    return;
+
+  _dbus_assert (connection->n_workers_running == 0);
+
+  for (i = 0; i < connection->n_workers; i++)
+    {
+      _dbus_assert (connection->workers[i].queue == NULL);
+
+      if (connection->workers[i].cond != NULL)
+        _dbus_condvar_free (connection->workers[i].cond);
+    }
+
+  dbus_free (connection->workers);
+  connection->workers = NULL;
+  connection->n_workers = 0;
+}
+
+/*
+ * Runs the object path handlers for a message on a dispatch worker,
+ * and replies to method calls that nobody handled, as
+ * dbus_connection_dispatch() would have done.
+ */
+static void
+dispatch_worker_handle_message (DBusConnection *connection,
+                                DBusMessage    *message)
+{
+  DBusHandlerResult result;
+  dbus_bool_t found_object;
+
+  while (TRUE)
+    {
+      CONNECTION_LOCK (connection);
+      result = _dbus_object_tree_dispatch_and_unlock (connection->objects,
+                                                      message,
+                                                      &found_object);
+
+      if (result == DBUS_HANDLER_RESULT_NOT_YET_HANDLED &&
+          dbus_message_get_type (message) == DBUS_MESSAGE_TYPE_METHOD_CALL)
+        {
+          CONNECTION_LOCK (connection);
+          result = _dbus_connection_reply_unknown_method_unlocked (connection,
+                                                                   message,
+                                                                   found_object);
+
+          /* unlocks and calls user code */
+          _dbus_connection_update_dispatch_status_and_unlock (connection,
+              _dbus_connection_get_dispatch_status_unlocked (connection));
+        }
+
+      if (result != DBUS_HANDLER_RESULT_NEED_MEMORY)
+        break;
+
+      /* As with dbus_connection_dispatch(), handlers that did not
+       * return HANDLED have to cope with seeing the message again.
+       */
+      _dbus_memory_pause_based_on_timeout (-1);
+    }
+}
+
+/*
+ * Body of each thread started by dbus_connection_start_dispatch_workers().
+ * Filters have already run on the thread that called
+ * dbus_connection_dispatch(); the worker only runs object path
+ * handlers, one message at a time, so it can reply with
+ * dbus_connection_send() like any other thread.
+ */
+static void
+dispatch_worker_main (void *data)
+{
+  DBusDispatchWorker *worker = data;
+  DBusConnection *connection = worker->connection;
+  dbus_int32_t old_refcount;
+
+  _dbus_cmutex_lock (connection->worker_mutex);
+
+  while (TRUE)
+    {
+      DBusList *link;
+
+      while (worker->queue == NULL && !connection->workers_quit)
+        _dbus_condvar_wait (worker->cond, connection->worker_mutex);
+
+      link = _dbus_list_pop_first_link (&worker->queue);
+      if (link == NULL)
+        break;
+
+      _dbus_cmutex_unlock (connection->worker_mutex);
+
+      dispatch_worker_handle_message (connection, link->data);
+
+      dbus_message_unref (link->data);
+      _dbus_list_free_link (link);
+
+      _dbus_cmutex_lock (connection->worker_mutex);
+
+      connection->n_worker_messages -= 1;
+      _dbus_condvar_wake_one (connection->worker_space_cond);
+    }
+
+  /* As in io_thread_main(), drop our reference before anyone can see
+   * that we have stopped.
+   */
+  old_refcount = _dbus_atomic_dec (&connection->refcount);
+  _dbus_connection_trace_ref (connection, old_refcount, old_refcount - 1,
+                              "dispatch_worker_main");
+
+  connection->n_workers_running -= 1;
+  _dbus_condvar_wake_one (connection->worker_space_cond);
+
+  _dbus_cmutex_unlock (connection->worker_mutex);
+
+  if (old_refcount == 1)
+    _dbus_connection_last_unref (connection);
+}
+
+/**
+ * Runs object path handlers on a pool of threads owned by libdbus,
+ * rather than on the thread that calls dbus_connection_dispatch().
+ * This helps a service where one slow handler would otherwise hold
+ * up calls to all of its other objects.
+ *
+ * dbus_connection_dispatch() still completes pending calls and runs
+ * filters itself, then hands the message to a worker. Method calls
+ * are assigned to workers by object path, and signals by sender, so
+ * that messages to one object or from one peer are still handled in
+ * order; messages to unrelated objects may be handled in parallel,
+ * and in any order relative to each other. Handlers registered on
+ * several paths must be thread-safe.
+ *
+ * Handlers may reply with dbus_connection_send() from the worker. As
+ * for any thread, the reply is written straight away unless another
+ * thread is blocked on the connection's socket, in which case it is
+ * left to the main loop; dbus_connection_start_io_thread() avoids
+ * that wait, and suits this mode well.
+ *
+ * Once the workers have max_queued messages between them,
+ * dbus_connection_dispatch() blocks until one of them finishes, so a
+ * backlog stays in the incoming queue, where the transport's
+ * limits on received data apply, rather than building up without
+ * bound.
+ *
+ * The Disconnected signal is not handed to the workers: they finish
+ * whatever is queued and exit, and the signal is then dispatched as
+ * usual. Each worker holds a reference to the connection until it
+ * exits. This function initializes threads with
+ * dbus_threads_init_default() if the application has not already.
+ *
+ * Does nothing and returns #TRUE if the workers are already running.
+ *
+ * @param connection the connection
+ * @param n_workers number of threads to start
+ * @param max_queued messages the workers may have between them before
+ *   dispatching blocks, or 0 for a default
+ * @returns #FALSE if the connection is not connected, or on OOM or
+ *   failure to create a thread
+ */
+dbus_bool_t
+dbus_connection_start_dispatch_workers (DBusConnection *connection,
+                                        int             n_workers,
+                                        int             max_queued)
+{
+  int i;
+
+  _dbus_return_val_if_fail (connection != NULL, FALSE);
+  _dbus_return_val_if_fail (n_workers > 0, FALSE);
+  _dbus_return_val_if_fail (max_queued >= 0, FALSE);
+
+  if (!dbus_threads_init_default ())
+    return FALSE;
+
+  if (max_queued == 0)
+    max_queued = n_workers * 32;
+
+  CONNECTION_LOCK (connection);
+
+  if (connection->have_dispatch_workers)
+    {
+      CONNECTION_UNLOCK (connection);
+      return TRUE;
+    }
+
+  if (!_dbus_connection_get_is_connected_unlocked (connection))
+    {
+      CONNECTION_UNLOCK (connection);
+      return FALSE;
+    }
+
+  /* Workers that exited at disconnection are only freed here or at
+   * finalization; a connection that is connected cannot have any.
+   */
+  _dbus_assert (connection->workers == NULL);
+
+  if (connection->worker_mutex == NULL)
+    {
+      _dbus_cmutex_new_at_location (&connection->worker_mutex);
+      if (connection->worker_mutex == NULL)
+        goto oom;
+
+      _dbus_condvar_new_at_location (&connection->worker_space_cond);
+      if (connection->worker_space_cond == NULL)
+        {
+          _dbus_cmutex_free_at_location (&connection->worker_mutex);
+          goto oom;
+        }
+
+#ifdef DBUS_ENABLE_STATS
+      _dbus_cmutex_set_profile_name (connection->worker_mutex,
+                                     "connection_worker");
+#endif
+    }
+
+  connection->workers = dbus_new0 (DBusDispatchWorker, n_workers);
+  if (connection->workers == NULL)
+    goto oom;
+
+  connection->n_workers = n_workers;
+
+  for (i = 0; i < n_workers; i++)
+    {
+      connection->workers[i].connection = connection;
+      connection->workers[i].cond = _dbus_condvar_new ();
+      if (connection->workers[i].cond == NULL)
+        {
+          _dbus_connection_free_dispatch_workers (connection);
+          goto oom;
+        }
+    }
+
+  connection->n_worker_messages = 0;
+  connection->max_worker_messages = max_queued;
+  connection->workers_quit = FALSE;
+  connection->n_workers_running = 0;
+
+  for (i = 0; i < n_workers; i++)
+    {
+      _dbus_connection_ref_unlocked (connection);
+
+      _dbus_cmutex_lock (connection->worker_mutex);
+      connection->n_workers_running += 1;
+      _dbus_cmutex_unlock (connection->worker_mutex);
+
+      if (!_dbus_thread_start (dispatch_worker_main, &connection->workers[i]))
+        {
+          _dbus_cmutex_lock (connection->worker_mutex);
+          connection->n_workers_running -= 1;
+          _dbus_cmutex_unlock (connection->worker_mutex);
+
+          _dbus_connection_unref_unlocked (connection);
+
+          /* The ones already started do not need the connection lock
+           * to exit, since their queues are empty.
+           */
+          _dbus_connection_join_dispatch_workers (connection);
+          _dbus_connection_free_dispatch_workers (connection);
+          CONNECTION_UNLOCK (connection);
+          return FALSE;
+        }
+    }
+
+  connection->have_dispatch_workers = TRUE;
+
+  _dbus_verbose ("started %d dispatch workers for connection %p\n",
+                 n_workers, connection);
+
+  CONNECTION_UNLOCK (connection);
+  return TRUE;
+
+ oom:
+  CONNECTION_UNLOCK (connection);
+  return FALSE;
+}
+
+/**
+ * Stops the threads started by dbus_connection_start_dispatch_workers(),
+ * after they have handled every message already handed to them, and
+ * waits for them to finish. Object path handlers then run in
+ * dbus_connection_dispatch() again.
+ *
+ * Must not be called from a filter or object path handler, since it
+ * waits for dispatching to finish.
+ *
+ * Does nothing if the workers are not running.
+ *
+ * @param connection the connection
+ */
+void
+dbus_connection_stop_dispatch_workers (DBusConnection *connection)
+{
+  _dbus_return_if_fail (connection != NULL);
+
+  CONNECTION_LOCK (connection);
+
+  if (connection->workers == NULL)
+    {
+      CONNECTION_UNLOCK (connection);
+      return;
+    }
+
+  _dbus_connection_ref_unlocked (connection);
+
+  /* Holding the dispatcher keeps new messages from overtaking the
+   * ones the workers still have queued.
+   */
+  _dbus_connection_acquire_dispatch (connection);
+  connection->have_dispatch_workers = FALSE;
+  CONNECTION_UNLOCK (connection);
+
+  _dbus_connection_join_dispatch_workers (connection);
+
+  CONNECTION_LOCK (connection);
+  _dbus_connection_free_dispatch_workers (connection);
+  _dbus_connection_release_dispatch (connection);
+
+  _dbus_verbose ("stopped dispatch workers for connection %p\n", connection);
+
+  CONNECTION_UNLOCK (connection);
+  dbus_connection_unref (connection);
+}
+
+/**
+ * Sets the timeout functions for the connection. These functions are
+ * responsible for making the application's main loop aware of timeouts.
+ * When using Qt, typically the DBusAddTimeoutFunction would create a
+ * QTimer. When using GLib, the DBusAddTimeoutFunction would call
+ * g_timeout_add.
+ * 
+ * The DBusTimeoutToggledFunction notifies the application that the
+ * timeout has been enabled or disabled. Call
+ * dbus_timeout_get_enabled() to check this. A disabled timeout should
+ * have no effect, and enabled timeout should be added to the main
+ * loop. This feature is used instead of simply adding/removing the
+ * timeout because enabling/disabling can be done without memory
+ * allocation. With Qt, QTimer::start() and QTimer::stop() can be used
+ * to enable and disable. The toggled function may be NULL if a main
+ * loop re-queries dbus_timeout_get_enabled() every time anyway.
+ * Whenever a timeout is toggled, its interval may change.
+ *
+ * The DBusTimeout can be queried for the timer interval using
+ * dbus_timeout_get_interval(). dbus_timeout_handle() should be called
+ * repeatedly, each time the interval elapses, starting after it has
+ * elapsed once. The timeout stops firing when it is removed with the
+ * given remove_function.  The timer interval may change whenever the
+ * timeout is added, removed, or toggled.
+ *
+ * @note The thread lock on DBusConnection is held while
+ * timeout functions are invoked, so inside these functions you
+ * may not invoke any methods on DBusConnection or it will deadlock.
+ * See the comments in the code or http://lists.freedesktop.org/archives/dbus/2007-July/thread.html#8144
+ * if you encounter this issue and want to attempt writing a patch.
+ *
+ * @param connection the connection.
+ * @param add_function function to add a timeout.
+ * @param remove_function function to remove a timeout.
+ * @param toggled_function function to notify of enable/disable
+ * @param data data to pass to add_function and remove_function.
+ * @param free_data_function function to be called to free the data.
+ * @returns #FALSE on failure (no memory)
+ */
+dbus_bool_t
+dbus_connection_set_timeout_functions   (DBusConnection            *connection,
+					 DBusAddTimeoutFunction     add_function,
+					 DBusRemoveTimeoutFunction  remove_function,
+                                         DBusTimeoutToggledFunction toggled_function,
+					 void                      *data,
+					 DBusFreeFunction           free_data_function)
+{
+  dbus_bool_t retval;
+
+  _dbus_return_val_if_fail (connection != NULL, FALSE);
+  
+  CONNECTION_LOCK (connection);
+
+  retval = _dbus_timeout_list_set_functions (connection->timeouts,
+                                             add_function, remove_function,
+                                             toggled_function,
+                                             data, free_data_function);
+
+  CONNECTION_UNLOCK (connection);
+
+  return retval;
+}
+
+/**
+ * Sets the mainloop wakeup function for the connection. This function
+ * is responsible for waking up the main loop (if its sleeping in
+ * another thread) when some some change has happened to the
+ * connection that the mainloop needs to reconsider (e.g. a message
+ * has been queued for writing).  When using Qt, this typically
+ * results in a call to QEventLoop::wakeUp().  When using GLib, it
+ * would call g_main_context_wakeup().
+ *
+ * @param connection the connection.
+ * @param wakeup_main_function function to wake up the mainloop
+ * @param data data to pass wakeup_main_function
+ * @param free_data_function function to be called to free the data.
+ */
+void
+dbus_connection_set_wakeup_main_function (DBusConnection            *connection,
+					  DBusWakeupMainFunction     wakeup_main_function,
+					  void                      *data,
+					  DBusFreeFunction           free_data_function)
+{
+  void *old_data;
+  DBusFreeFunction old_free_data;
+
+  _dbus_return_if_fail (connection != NULL);
+  
+  CONNECTION_LOCK (connection);
+  old_data = connection->wakeup_main_data;
+  old_free_data = connection->free_wakeup_main_data;
 
   connection->wakeup_main_function = wakeup_main_function;
   connection->wakeup_main_data = data;
@@ -6082,6 +7495,56 @@ dbus_connection_get_max_message_unix_fds (DBusConnection *connection)
   return res;
 }
 
+/**
+ * Specifies whether the bodies of messages received on this connection
+ * are validated. By default they are, as is every message header; a
+ * connection that trusts its peer only validates the headers, so it
+ * still splits the stream into messages correctly, but reads each
+ * body as it is. It also only checks the names in a header (the
+ * sender, destination, interface, member and error name) when the
+ * message is taken from the incoming queue rather than as it is read
+ * from the socket; an invalid one still disconnects the peer.
+ *
+ * This is only safe if the peer validates every message body itself
+ * and would not send a malformed one on purpose: a corrupt body can
+ * then crash this process. The message bus validates everything it
+ * routes, so dbus_bus_get() and dbus_bus_get_private() turn this on
+ * for the system bus when it runs as root or as the same user as
+ * this process, which could harm it anyway.
+ *
+ * @param connection the connection
+ * @param trust #TRUE to stop validating message bodies
+ */
+void
+dbus_connection_set_trust_peer_data (DBusConnection *connection,
+                                     dbus_bool_t     trust)
+{
+  _dbus_return_if_fail (connection != NULL);
+
+  CONNECTION_LOCK (connection);
+  _dbus_transport_set_trust_peer_data (connection->transport, trust);
+  CONNECTION_UNLOCK (connection);
+}
+
+/**
+ * Gets the value set by dbus_connection_set_trust_peer_data().
+ *
+ * @param connection the connection
+ * @returns #TRUE if message bodies are not validated
+ */
+dbus_bool_t
+dbus_connection_get_trust_peer_data (DBusConnection *connection)
+{
+  dbus_bool_t res;
+
+  _dbus_return_val_if_fail (connection != NULL, FALSE);
+
+  CONNECTION_LOCK (connection);
+  res = _dbus_transport_get_trust_peer_data (connection->transport);
+  CONNECTION_UNLOCK (connection);
+  return res;
+}
+
 /**
  * Sets the maximum total number of bytes that can be used for all messages
  * received on this connection. Messages count toward the maximum until
@@ -215,6 +215,10 @@ void               dbus_connection_steal_borrowed_message       (DBusConnection
 DBUS_EXPORT
 DBusMessage*       dbus_connection_pop_message                  (DBusConnection             *connection);
 DBUS_EXPORT
+int                dbus_connection_pop_messages                 (DBusConnection             *connection,
+                                                                 DBusMessage               **messages,
+                                                                 int                         max_messages);
+DBUS_EXPORT
 DBusDispatchStatus dbus_connection_get_dispatch_status          (DBusConnection             *connection);
 DBUS_EXPORT
 DBusDispatchStatus dbus_connection_dispatch                     (DBusConnection             *connection);
@@ -225,6 +229,11 @@ dbus_bool_t        dbus_connection_send                         (DBusConnection
                                                                  DBusMessage                *message,
                                                                  dbus_uint32_t              *client_serial);
 DBUS_EXPORT
+dbus_bool_t        dbus_connection_send_batch                   (DBusConnection             *connection,
+                                                                 DBusMessage               **messages,
+                                                                 int                         n_messages,
+                                                                 dbus_uint32_t              *serials);
+DBUS_EXPORT
 dbus_bool_t        dbus_connection_send_with_reply              (DBusConnection             *connection,
                                                                  DBusMessage                *message,
                                                                  DBusPendingCall           **pending_return,
@@ -259,6 +268,16 @@ void               dbus_connection_set_dispatch_status_function (DBusConnection
                                                                  void                       *data,
                                                                  DBusFreeFunction            free_data_function);
 DBUS_EXPORT
+dbus_bool_t        dbus_connection_start_io_thread              (DBusConnection             *connection);
+DBUS_EXPORT
+void               dbus_connection_stop_io_thread               (DBusConnection             *connection);
+DBUS_EXPORT
+dbus_bool_t        dbus_connection_start_dispatch_workers       (DBusConnection             *connection,
+                                                                 int                         n_workers,
+                                                                 int                         max_queued);
+DBUS_EXPORT
+void               dbus_connection_stop_dispatch_workers        (DBusConnection             *connection);
+DBUS_EXPORT
 dbus_bool_t        dbus_connection_get_unix_user                (DBusConnection             *connection,
                                                                  unsigned long              *uid);
 DBUS_EXPORT
@@ -336,6 +355,11 @@ void dbus_connection_set_max_message_unix_fds (DBusConnection *connection,
 DBUS_EXPORT
 long dbus_connection_get_max_message_unix_fds (DBusConnection *connection);
 DBUS_EXPORT
+void        dbus_connection_set_trust_peer_data (DBusConnection *connection,
+                                                 dbus_bool_t     trust);
+DBUS_EXPORT
+dbus_bool_t dbus_connection_get_trust_peer_data (DBusConnection *connection);
+DBUS_EXPORT
 void dbus_connection_set_max_received_unix_fds(DBusConnection *connection,
                                                long            n);
 DBUS_EXPORT
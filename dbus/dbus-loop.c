@@ -0,0 +1,683 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/* dbus-loop.c  Main loop for connections, servers and other sources
+ *
+ * Licensed under the Academic Free License version 2.1
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <config.h>
+#include "dbus-loop.h"
+#include "dbus-internals.h"
+#include "dbus-mainloop.h"
+#include "dbus-timeout.h"
+#include "dbus-watch.h"
+
+/**
+ * @defgroup DBusLoop DBusLoop
+ * @ingroup  DBus
+ * @brief A main loop for connections, servers, fds and timers
+ *
+ * A DBusLoop waits for any number of connections and servers, and for
+ * the applications' own fds, timers and idles, and dispatches them as
+ * they become ready. It is the loop the message bus daemon runs on,
+ * and uses epoll where it is available, so programs that do not
+ * already have a main loop of their own do not need to write the
+ * glue for dbus_connection_set_watch_functions() and friends.
+ *
+ * A program with its own epoll or poll loop can instead wait for the
+ * one fd from dbus_loop_get_fd() and call dbus_loop_process() when it
+ * is readable, rather than mirroring every watch and timeout.
+ *
+ * A loop, and everything attached to it, must only be used from one
+ * thread at a time. Each connection, server and source added to a
+ * loop keeps a reference to it until it is removed.
+ *
+ * @{
+ */
+
+/**
+ * Internals of DBusLoopSource
+ */
+struct DBusLoopSource
+{
+  DBusLoop *loop;                         /**< Loop the source was added to */
+  DBusWatch *watch;                       /**< Watch for an fd source */
+  DBusTimeout *timeout;                   /**< Timeout for a timer */
+  DBusLoopFdFunction fd_function;         /**< Callback for an fd source */
+  DBusLoopSourceFunction function;        /**< Callback for a timer or idle */
+  void *data;                             /**< Data for the callback */
+  DBusFreeFunction free_data_function;    /**< Frees data */
+};
+
+static DBusLoopSource *
+source_new (DBusLoop               *loop,
+            void                   *data,
+            DBusFreeFunction        free_data_function)
+{
+  DBusLoopSource *source;
+
+  source = dbus_new0 (DBusLoopSource, 1);
+  if (source == NULL)
+    return NULL;
+
+  source->loop = _dbus_loop_ref (loop);
+  source->data = data;
+  source->free_data_function = free_data_function;
+
+  return source;
+}
+
+static void
+source_free (DBusLoopSource *source)
+{
+  if (source->watch != NULL)
+    {
+      _dbus_watch_invalidate (source->watch);
+      _dbus_watch_unref (source->watch);
+    }
+
+  if (source->timeout != NULL)
+    _dbus_timeout_unref (source->timeout);
+
+  if (source->free_data_function != NULL)
+    (* source->free_data_function) (source->data);
+
+  _dbus_loop_unref (source->loop);
+  dbus_free (source);
+}
+
+static dbus_bool_t
+handle_fd_source (DBusWatch    *watch,
+                  unsigned int  condition,
+                  void         *data)
+{
+  DBusLoopSource *source = data;
+
+  /* the source may be removed, and freed, by the callback */
+  (* source->fd_function) (source, dbus_watch_get_socket (watch),
+                           condition, source->data);
+  return TRUE;
+}
+
+static dbus_bool_t
+handle_timer_source (void *data)
+{
+  DBusLoopSource *source = data;
+
+  (* source->function) (source, source->data);
+  return TRUE;
+}
+
+static void
+handle_idle_source (void *data)
+{
+  DBusLoopSource *source = data;
+
+  (* source->function) (source, source->data);
+}
+
+/* Connections and servers hold one of these for their watch functions
+ * and another for their timeout functions */
+typedef struct
+{
+  DBusLoop *loop;
+  DBusConnection *connection;
+  DBusServer *server;
+} LoopData;
+
+static LoopData *
+loop_data_new (DBusLoop       *loop,
+               DBusConnection *connection,
+               DBusServer     *server)
+{
+  LoopData *ld;
+
+  ld = dbus_new0 (LoopData, 1);
+  if (ld == NULL)
+    return NULL;
+
+  ld->loop = _dbus_loop_ref (loop);
+
+  if (connection != NULL)
+    ld->connection = dbus_connection_ref (connection);
+
+  if (server != NULL)
+    ld->server = dbus_server_ref (server);
+
+  return ld;
+}
+
+static void
+loop_data_free (void *data)
+{
+  LoopData *ld = data;
+
+  if (ld->connection != NULL)
+    dbus_connection_unref (ld->connection);
+
+  if (ld->server != NULL)
+    dbus_server_unref (ld->server);
+
+  _dbus_loop_unref (ld->loop);
+  dbus_free (ld);
+}
+
+static dbus_bool_t
+add_watch (DBusWatch *watch,
+           void      *data)
+{
+  LoopData *ld = data;
+
+  return _dbus_loop_add_watch (ld->loop, watch);
+}
+
+static void
+remove_watch (DBusWatch *watch,
+              void      *data)
+{
+  LoopData *ld = data;
+
+  _dbus_loop_remove_watch (ld->loop, watch);
+}
+
+static void
+toggle_watch (DBusWatch *watch,
+              void      *data)
+{
+  LoopData *ld = data;
+
+  _dbus_loop_toggle_watch (ld->loop, watch);
+}
+
+static dbus_bool_t
+add_timeout (DBusTimeout *timeout,
+             void        *data)
+{
+  LoopData *ld = data;
+
+  return _dbus_loop_add_timeout (ld->loop, timeout);
+}
+
+static void
+remove_timeout (DBusTimeout *timeout,
+                void        *data)
+{
+  LoopData *ld = data;
+
+  _dbus_loop_remove_timeout (ld->loop, timeout);
+}
+
+static void
+dispatch_status_function (DBusConnection    *connection,
+                          DBusDispatchStatus new_status,
+                          void              *data)
+{
+  DBusLoop *loop = data;
+
+  if (new_status != DBUS_DISPATCH_COMPLETE)
+    {
+      while (!_dbus_loop_queue_dispatch (loop, connection))
+        _dbus_wait_for_memory ();
+    }
+}
+
+/**
+ * Creates a new, empty main loop.
+ *
+ * @returns the new loop, or #NULL if no memory
+ */
+DBusLoop *
+dbus_loop_new (void)
+{
+  return _dbus_loop_new ();
+}
+
+/**
+ * Increments the reference count of a loop.
+ *
+ * @param loop the loop
+ * @returns the loop
+ */
+DBusLoop *
+dbus_loop_ref (DBusLoop *loop)
+{
+  _dbus_return_val_if_fail (loop != NULL, NULL);
+
+  return _dbus_loop_ref (loop);
+}
+
+/**
+ * Decrements the reference count of a loop, freeing it if the count
+ * reaches 0. Anything still attached to the loop keeps it alive.
+ *
+ * @param loop the loop
+ */
+void
+dbus_loop_unref (DBusLoop *loop)
+{
+  _dbus_return_if_fail (loop != NULL);
+
+  _dbus_loop_unref (loop);
+}
+
+/**
+ * Has the loop read, write and dispatch the connection from now on,
+ * replacing any watch, timeout and dispatch status functions the
+ * connection already had.
+ *
+ * @param loop the loop
+ * @param connection the connection
+ * @returns #FALSE if no memory
+ */
+dbus_bool_t
+dbus_loop_add_connection (DBusLoop       *loop,
+                          DBusConnection *connection)
+{
+  LoopData *ld;
+
+  _dbus_return_val_if_fail (loop != NULL, FALSE);
+  _dbus_return_val_if_fail (connection != NULL, FALSE);
+
+  dbus_connection_set_dispatch_status_function (connection,
+                                                dispatch_status_function,
+                                                _dbus_loop_ref (loop),
+                                                (DBusFreeFunction) _dbus_loop_unref);
+
+  ld = loop_data_new (loop, connection, NULL);
+  if (ld == NULL)
+    goto nomem;
+
+  if (!dbus_connection_set_watch_functions (connection,
+                                            add_watch,
+                                            remove_watch,
+                                            toggle_watch,
+                                            ld, loop_data_free))
+    goto nomem;
+
+  ld = loop_data_new (loop, connection, NULL);
+  if (ld == NULL)
+    goto nomem;
+
+  if (!dbus_connection_set_timeout_functions (connection,
+                                              add_timeout,
+                                              remove_timeout,
+                                              NULL,
+                                              ld, loop_data_free))
+    goto nomem;
+
+  if (dbus_connection_get_dispatch_status (connection) != DBUS_DISPATCH_COMPLETE)
+    {
+      if (!_dbus_loop_queue_dispatch (loop, connection))
+        {
+          ld = NULL;
+          goto nomem;
+        }
+    }
+
+  return TRUE;
+
+ nomem:
+  if (ld != NULL)
+    loop_data_free (ld);
+
+  dbus_loop_remove_connection (loop, connection);
+  return FALSE;
+}
+
+/**
+ * Stops the loop looking after a connection added with
+ * dbus_loop_add_connection(), leaving it with no watch, timeout or
+ * dispatch status functions.
+ *
+ * @param loop the loop
+ * @param connection the connection
+ */
+void
+dbus_loop_remove_connection (DBusLoop       *loop,
+                             DBusConnection *connection)
+{
+  _dbus_return_if_fail (loop != NULL);
+  _dbus_return_if_fail (connection != NULL);
+
+  /* setting them to NULL can't fail */
+  dbus_connection_set_watch_functions (connection, NULL, NULL, NULL,
+                                       NULL, NULL);
+  dbus_connection_set_timeout_functions (connection, NULL, NULL, NULL,
+                                         NULL, NULL);
+  dbus_connection_set_dispatch_status_function (connection, NULL, NULL, NULL);
+}
+
+/**
+ * Has the loop accept new connections on the server from now on,
+ * replacing any watch and timeout functions the server already had.
+ * The server's new connection function is called from the loop, and
+ * may add the new connection to it with dbus_loop_add_connection().
+ *
+ * @param loop the loop
+ * @param server the server
+ * @returns #FALSE if no memory
+ */
+dbus_bool_t
+dbus_loop_add_server (DBusLoop   *loop,
+                      DBusServer *server)
+{
+  LoopData *ld;
+
+  _dbus_return_val_if_fail (loop != NULL, FALSE);
+  _dbus_return_val_if_fail (server != NULL, FALSE);
+
+  ld = loop_data_new (loop, NULL, server);
+  if (ld == NULL)
+    goto nomem;
+
+  if (!dbus_server_set_watch_functions (server,
+                                        add_watch,
+                                        remove_watch,
+                                        toggle_watch,
+                                        ld, loop_data_free))
+    goto nomem;
+
+  ld = loop_data_new (loop, NULL, server);
+  if (ld == NULL)
+    goto nomem;
+
+  if (!dbus_server_set_timeout_functions (server,
+                                          add_timeout,
+                                          remove_timeout,
+                                          NULL,
+                                          ld, loop_data_free))
+    goto nomem;
+
+  return TRUE;
+
+ nomem:
+  if (ld != NULL)
+    loop_data_free (ld);
+
+  dbus_loop_remove_server (loop, server);
+  return FALSE;
+}
+
+/**
+ * Stops the loop looking after a server added with
+ * dbus_loop_add_server(). The server is not disconnected.
+ *
+ * @param loop the loop
+ * @param server the server
+ */
+void
+dbus_loop_remove_server (DBusLoop   *loop,
+                         DBusServer *server)
+{
+  _dbus_return_if_fail (loop != NULL);
+  _dbus_return_if_fail (server != NULL);
+
+  dbus_server_set_watch_functions (server, NULL, NULL, NULL, NULL, NULL);
+  dbus_server_set_timeout_functions (server, NULL, NULL, NULL, NULL, NULL);
+}
+
+/**
+ * Calls a function whenever an fd is ready, until the source is
+ * removed with dbus_loop_remove_source(). The fd is not closed when
+ * the source is removed.
+ *
+ * The condition passed to the function may include
+ * #DBUS_WATCH_HANGUP or #DBUS_WATCH_ERROR even if they were not
+ * asked for.
+ *
+ * @param loop the loop
+ * @param fd the fd to wait for
+ * @param flags #DBUS_WATCH_READABLE, #DBUS_WATCH_WRITABLE or both
+ * @param function function to call
+ * @param data data to pass to the function
+ * @param free_data_function function to free the data when the source is removed, or #NULL
+ * @returns the new source, or #NULL if no memory
+ */
+DBusLoopSource *
+dbus_loop_add_fd (DBusLoop           *loop,
+                  int                 fd,
+                  unsigned int        flags,
+                  DBusLoopFdFunction  function,
+                  void               *data,
+                  DBusFreeFunction    free_data_function)
+{
+  DBusLoopSource *source;
+
+  _dbus_return_val_if_fail (loop != NULL, NULL);
+  _dbus_return_val_if_fail (fd >= 0, NULL);
+  _dbus_return_val_if_fail ((flags & ~(DBUS_WATCH_READABLE |
+                                       DBUS_WATCH_WRITABLE)) == 0, NULL);
+  _dbus_return_val_if_fail (function != NULL, NULL);
+
+  source = source_new (loop, NULL, NULL);
+  if (source == NULL)
+    return NULL;
+
+  source->fd_function = function;
+  source->watch = _dbus_watch_new (fd, flags, TRUE, handle_fd_source,
+                                   source, NULL);
+
+  if (source->watch == NULL ||
+      !_dbus_loop_add_watch (loop, source->watch))
+    {
+      source_free (source);
+      return NULL;
+    }
+
+  source->data = data;
+  source->free_data_function = free_data_function;
+  return source;
+}
+
+/**
+ * Calls a function every interval milliseconds, until the source is
+ * removed with dbus_loop_remove_source().
+ *
+ * @param loop the loop
+ * @param interval milliseconds between calls
+ * @param function function to call
+ * @param data data to pass to the function
+ * @param free_data_function function to free the data when the source is removed, or #NULL
+ * @returns the new source, or #NULL if no memory
+ */
+DBusLoopSource *
+dbus_loop_add_timer (DBusLoop               *loop,
+                     int                     interval,
+                     DBusLoopSourceFunction  function,
+                     void                   *data,
+                     DBusFreeFunction        free_data_function)
+{
+  DBusLoopSource *source;
+
+  _dbus_return_val_if_fail (loop != NULL, NULL);
+  _dbus_return_val_if_fail (interval >= 0, NULL);
+  _dbus_return_val_if_fail (function != NULL, NULL);
+
+  source = source_new (loop, NULL, NULL);
+  if (source == NULL)
+    return NULL;
+
+  source->function = function;
+  source->timeout = _dbus_timeout_new (interval, handle_timer_source,
+                                       source, NULL);
+
+  if (source->timeout == NULL ||
+      !_dbus_loop_add_timeout (loop, source->timeout))
+    {
+      source_free (source);
+      return NULL;
+    }
+
+  source->data = data;
+  source->free_data_function = free_data_function;
+  return source;
+}
+
+/**
+ * Calls a function on every iteration of the loop, until the source
+ * is removed with dbus_loop_remove_source(). The loop does not sleep
+ * while it has idles.
+ *
+ * @param loop the loop
+ * @param function function to call
+ * @param data data to pass to the function
+ * @param free_data_function function to free the data when the source is removed, or #NULL
+ * @returns the new source, or #NULL if no memory
+ */
+DBusLoopSource *
+dbus_loop_add_idle (DBusLoop               *loop,
+                    DBusLoopSourceFunction  function,
+                    void                   *data,
+                    DBusFreeFunction        free_data_function)
+{
+  DBusLoopSource *source;
+
+  _dbus_return_val_if_fail (loop != NULL, NULL);
+  _dbus_return_val_if_fail (function != NULL, NULL);
+
+  source = source_new (loop, NULL, NULL);
+  if (source == NULL)
+    return NULL;
+
+  source->function = function;
+
+  if (!_dbus_loop_add_idle (loop, handle_idle_source, source))
+    {
+      source_free (source);
+      return NULL;
+    }
+
+  source->data = data;
+  source->free_data_function = free_data_function;
+  return source;
+}
+
+/**
+ * Removes and frees an fd, timer or idle source, freeing its data.
+ * This may be called from the source's own function.
+ *
+ * @param source the source
+ */
+void
+dbus_loop_remove_source (DBusLoopSource *source)
+{
+  _dbus_return_if_fail (source != NULL);
+
+  if (source->watch != NULL)
+    _dbus_loop_remove_watch (source->loop, source->watch);
+  else if (source->timeout != NULL)
+    _dbus_loop_remove_timeout (source->loop, source->timeout);
+  else
+    _dbus_loop_remove_idle (source->loop, handle_idle_source, source);
+
+  source_free (source);
+}
+
+/**
+ * Runs the loop until dbus_loop_quit() is called. Runs may be
+ * nested; each dbus_loop_quit() ends the innermost one.
+ *
+ * @param loop the loop
+ */
+void
+dbus_loop_run (DBusLoop *loop)
+{
+  _dbus_return_if_fail (loop != NULL);
+
+  _dbus_loop_run (loop);
+}
+
+/**
+ * Makes the innermost dbus_loop_run() return once the current
+ * callback has finished.
+ *
+ * @param loop the loop
+ */
+void
+dbus_loop_quit (DBusLoop *loop)
+{
+  _dbus_return_if_fail (loop != NULL);
+
+  _dbus_loop_quit (loop);
+}
+
+/**
+ * Runs one iteration of the loop: waits for ready fds and expired
+ * timers, if block is #TRUE and there is nothing to do yet, and calls
+ * their functions, then dispatches connections and runs idles.
+ *
+ * @param loop the loop
+ * @param block whether to wait for something to happen
+ * @returns #TRUE if anything was done
+ */
+dbus_bool_t
+dbus_loop_iterate (DBusLoop    *loop,
+                   dbus_bool_t  block)
+{
+  _dbus_return_val_if_fail (loop != NULL, FALSE);
+
+  return _dbus_loop_iterate (loop, block);
+}
+
+/**
+ * Gets a single fd for waiting on the loop from another main loop. It
+ * polls readable, level-triggered, whenever dbus_loop_process() has
+ * something to do: an fd ready, a timer or connection timeout due, a
+ * connection with messages to dispatch, or an idle. Registering it
+ * once replaces mirroring each connection's watches and timeouts,
+ * which connections enable and disable often.
+ *
+ * For one fd per connection, give each connection a loop of its own.
+ * The fd belongs to the loop and must not be closed.
+ *
+ * This is only supported on Linux, with epoll.
+ *
+ * @param loop the loop
+ * @returns the fd, or -1 if not supported or no memory
+ */
+int
+dbus_loop_get_fd (DBusLoop *loop)
+{
+  _dbus_return_val_if_fail (loop != NULL, -1);
+
+  return _dbus_loop_get_fd (loop);
+}
+
+/**
+ * Does whatever the loop has to do now without blocking: handles
+ * ready fds and due timeouts, dispatches messages, taking one from
+ * each connection in turn, and runs idles. At most max_messages are
+ * dispatched, so that one busy loop cannot starve the rest of the
+ * program; a negative max_messages means no limit.
+ *
+ * The fd from dbus_loop_get_fd() stays readable while there is more
+ * to do, so a caller that stops at the limit is woken again.
+ *
+ * @param loop the loop
+ * @param max_messages most messages to dispatch, or -1
+ * @returns #TRUE if there are messages or idles left for next time
+ */
+dbus_bool_t
+dbus_loop_process (DBusLoop *loop,
+                   int       max_messages)
+{
+  _dbus_return_val_if_fail (loop != NULL, FALSE);
+
+  return _dbus_loop_process (loop, max_messages);
+}
+
+/** @} */
@@ -0,0 +1,113 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/* dbus-loop.h  Main loop for connections, servers and other sources
+ *
+ * Licensed under the Academic Free License version 2.1
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+#if !defined (DBUS_INSIDE_DBUS_H) && !defined (DBUS_COMPILATION)
+#error "Only <dbus/dbus.h> can be included directly, this file may disappear or change contents."
+#endif
+
+#ifndef DBUS_LOOP_H
+#define DBUS_LOOP_H
+
+#include <dbus/dbus-connection.h>
+#include <dbus/dbus-server.h>
+
+DBUS_BEGIN_DECLS
+
+/**
+ * @addtogroup DBusLoop
+ * @{
+ */
+
+/** Opaque type representing a main loop */
+typedef struct DBusLoop DBusLoop;
+/** Opaque type representing an fd, timer or idle added to a #DBusLoop */
+typedef struct DBusLoopSource DBusLoopSource;
+
+/** Called when the fd of a source added with dbus_loop_add_fd() is
+ * ready; condition is a combination of #DBusWatchFlags.
+ */
+typedef void (* DBusLoopFdFunction) (DBusLoopSource *source,
+                                     int             fd,
+                                     unsigned int    condition,
+                                     void           *data);
+/** Called when a timer expires, or on each iteration for an idle */
+typedef void (* DBusLoopSourceFunction) (DBusLoopSource *source,
+                                         void           *data);
+
+DBUS_EXPORT
+DBusLoop*       dbus_loop_new               (void);
+DBUS_EXPORT
+DBusLoop*       dbus_loop_ref               (DBusLoop               *loop);
+DBUS_EXPORT
+void            dbus_loop_unref             (DBusLoop               *loop);
+
+DBUS_EXPORT
+dbus_bool_t     dbus_loop_add_connection    (DBusLoop               *loop,
+                                             DBusConnection         *connection);
+DBUS_EXPORT
+void            dbus_loop_remove_connection (DBusLoop               *loop,
+                                             DBusConnection         *connection);
+DBUS_EXPORT
+dbus_bool_t     dbus_loop_add_server        (DBusLoop               *loop,
+                                             DBusServer             *server);
+DBUS_EXPORT
+void            dbus_loop_remove_server     (DBusLoop               *loop,
+                                             DBusServer             *server);
+
+DBUS_EXPORT
+DBusLoopSource* dbus_loop_add_fd            (DBusLoop               *loop,
+                                             int                     fd,
+                                             unsigned int            flags,
+                                             DBusLoopFdFunction      function,
+                                             void                   *data,
+                                             DBusFreeFunction        free_data_function);
+DBUS_EXPORT
+DBusLoopSource* dbus_loop_add_timer         (DBusLoop               *loop,
+                                             int                     interval,
+                                             DBusLoopSourceFunction  function,
+                                             void                   *data,
+                                             DBusFreeFunction        free_data_function);
+DBUS_EXPORT
+DBusLoopSource* dbus_loop_add_idle          (DBusLoop               *loop,
+                                             DBusLoopSourceFunction  function,
+                                             void                   *data,
+                                             DBusFreeFunction        free_data_function);
+DBUS_EXPORT
+void            dbus_loop_remove_source     (DBusLoopSource         *source);
+
+DBUS_EXPORT
+void            dbus_loop_run               (DBusLoop               *loop);
+DBUS_EXPORT
+void            dbus_loop_quit              (DBusLoop               *loop);
+DBUS_EXPORT
+dbus_bool_t     dbus_loop_iterate           (DBusLoop               *loop,
+                                             dbus_bool_t             block);
+
+DBUS_EXPORT
+int             dbus_loop_get_fd            (DBusLoop               *loop);
+DBUS_EXPORT
+dbus_bool_t     dbus_loop_process           (DBusLoop               *loop,
+                                             int                     max_messages);
+
+/** @} */
+
+DBUS_END_DECLS
+
+#endif /* DBUS_LOOP_H */
@@ -32,6 +32,15 @@
 #include <dbus/dbus-socket-set.h>
 #include <dbus/dbus-watch.h>
 
+#if defined(DBUS_HAVE_LINUX_EPOLL) && defined(HAVE_EVENTFD)
+#define LOOP_HAVE_FD 1
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#endif
+
 #define MAINLOOP_SPEW 0
 
 #if MAINLOOP_SPEW
@@ -67,6 +76,12 @@ struct DBusLoop
   int timeout_count;
   int depth; /**< number of recursive runs */
   DBusList *need_dispatch;
+  DBusList *idles; /**< IdleCallback to run on every iteration */
+  /** eventfd and timerfd in the socket set, making its fd poll readable
+   * when there is dispatching to do or a timeout due; -1 until
+   * _dbus_loop_get_fd() is first called */
+  int wakeup_fd;
+  int timer_fd;
   /** TRUE if we will skip a watch next time because it was OOM; becomes
    * FALSE between polling, and dealing with the results of the poll */
   unsigned oom_watch_pending : 1;
@@ -81,6 +96,12 @@ typedef struct
 
 #define TIMEOUT_CALLBACK(callback) ((TimeoutCallback*)callback)
 
+typedef struct
+{
+  DBusIdleFunction function;
+  void *data;
+} IdleCallback;
+
 static TimeoutCallback*
 timeout_callback_new (DBusTimeout         *timeout)
 {
@@ -151,6 +172,8 @@ _dbus_loop_new (void)
     }
 
   loop->refcount = 1;
+  loop->wakeup_fd = -1;
+  loop->timer_fd = -1;
 
   return loop;
 }
@@ -182,12 +205,25 @@ _dbus_loop_unref (DBusLoop *loop)
           dbus_connection_unref (connection);
         }
 
+      while (loop->idles)
+        dbus_free (_dbus_list_pop_first (&loop->idles));
+
+#ifdef LOOP_HAVE_FD
+      if (loop->wakeup_fd >= 0)
+        close (loop->wakeup_fd);
+
+      if (loop->timer_fd >= 0)
+        close (loop->timer_fd);
+#endif
+
       _dbus_hash_table_unref (loop->watches);
       _dbus_socket_set_free (loop->socket_set);
       dbus_free (loop);
     }
 }
 
+static void update_fds (DBusLoop *loop);
+
 static DBusList **
 ensure_watch_table_entry (DBusLoop *loop,
                           int       fd)
@@ -406,7 +442,8 @@ _dbus_loop_add_timeout (DBusLoop           *loop,
       timeout_callback_free (tcb);
       return FALSE;
     }
-  
+
+  update_fds (loop);
   return TRUE;
 }
 
@@ -428,6 +465,7 @@ _dbus_loop_remove_timeout (DBusLoop           *loop,
           loop->callback_list_serial += 1;
           loop->timeout_count -= 1;
           timeout_callback_free (this);
+          update_fds (loop);
 
           return;
         }
@@ -438,6 +476,91 @@ _dbus_loop_remove_timeout (DBusLoop           *loop,
   _dbus_warn ("could not find timeout %p to remove\n", timeout);
 }
 
+dbus_bool_t
+_dbus_loop_add_idle (DBusLoop         *loop,
+                     DBusIdleFunction  function,
+                     void             *data)
+{
+  IdleCallback *icb;
+
+  icb = dbus_new (IdleCallback, 1);
+  if (icb == NULL)
+    return FALSE;
+
+  icb->function = function;
+  icb->data = data;
+
+  if (!_dbus_list_append (&loop->idles, icb))
+    {
+      dbus_free (icb);
+      return FALSE;
+    }
+
+  loop->callback_list_serial += 1;
+  update_fds (loop);
+  return TRUE;
+}
+
+void
+_dbus_loop_remove_idle (DBusLoop         *loop,
+                        DBusIdleFunction  function,
+                        void             *data)
+{
+  DBusList *link;
+
+  link = _dbus_list_get_first_link (&loop->idles);
+  while (link != NULL)
+    {
+      DBusList *next = _dbus_list_get_next_link (&loop->idles, link);
+      IdleCallback *this = link->data;
+
+      if (this->function == function && this->data == data)
+        {
+          _dbus_list_remove_link (&loop->idles, link);
+          loop->callback_list_serial += 1;
+          dbus_free (this);
+
+          return;
+        }
+
+      link = next;
+    }
+
+  _dbus_warn ("could not find idle %p to remove\n", data);
+}
+
+/* Runs each idle once, starting again next iteration if one of them
+ * adds or removes callbacks or quits the loop */
+static dbus_bool_t
+run_idles (DBusLoop *loop,
+           int       orig_depth)
+{
+  DBusList *link;
+  int initial_serial;
+
+  if (loop->idles == NULL)
+    return FALSE;
+
+  initial_serial = loop->callback_list_serial;
+
+  link = _dbus_list_get_first_link (&loop->idles);
+  while (link != NULL)
+    {
+      DBusList *next = _dbus_list_get_next_link (&loop->idles, link);
+      IdleCallback *icb = link->data;
+
+      (* icb->function) (icb->data);
+
+      if (initial_serial != loop->callback_list_serial ||
+          loop->depth != orig_depth)
+        break;
+
+      link = next;
+    }
+
+  return TRUE;
+}
+
 /* Convolutions from GLib, there really must be a better way
  * to do this.
  */
@@ -531,6 +654,226 @@ check_timeout (unsigned long    tv_sec,
   return *timeout == 0;
 }
 
+/* Milliseconds until the next enabled timeout is due, or -1 if there
+ * are none */
+static long
+get_next_timeout (DBusLoop *loop)
+{
+  unsigned long tv_sec;
+  unsigned long tv_usec;
+  DBusList *link;
+  long timeout;
+
+  timeout = -1;
+
+  if (loop->timeout_count == 0)
+    return timeout;
+
+  _dbus_get_monotonic_time (&tv_sec, &tv_usec);
+
+  link = _dbus_list_get_first_link (&loop->timeouts);
+  while (link != NULL)
+    {
+      DBusList *next = _dbus_list_get_next_link (&loop->timeouts, link);
+      TimeoutCallback *tcb = link->data;
+
+      if (dbus_timeout_get_enabled (tcb->timeout))
+        {
+          int msecs_remaining;
+
+          check_timeout (tv_sec, tv_usec, tcb, &msecs_remaining);
+
+          if (timeout < 0)
+            timeout = msecs_remaining;
+          else
+            timeout = MIN (msecs_remaining, timeout);
+
+#if MAINLOOP_SPEW
+          _dbus_verbose ("  timeout added, %d remaining, aggregate timeout %ld\n",
+                         msecs_remaining, timeout);
+#endif
+
+          _dbus_assert (timeout >= 0);
+
+          if (timeout == 0)
+            break; /* it's not going to get shorter... */
+        }
+#if MAINLOOP_SPEW
+      else
+        {
+          _dbus_verbose ("  skipping disabled timeout\n");
+        }
+#endif
+
+      link = next;
+    }
+
+  return timeout;
+}
+
+/* Makes the loop's fd poll readable now if there is dispatching or an
+ * idle to run, and when the next timeout is due otherwise */
+static void
+update_fds (DBusLoop *loop)
+{
+#ifdef LOOP_HAVE_FD
+  struct itimerspec its;
+  long timeout;
+
+  if (loop->wakeup_fd < 0)
+    return;
+
+  if (loop->need_dispatch != NULL || loop->idles != NULL)
+    {
+      uint64_t one = 1;
+
+      /* can only fail if the counter is already huge, when it is
+       * readable anyway */
+      if (write (loop->wakeup_fd, &one, sizeof (one)) < 0)
+        _dbus_verbose ("could not signal loop eventfd: %s\n",
+                       _dbus_strerror_from_errno ());
+    }
+
+  timeout = get_next_timeout (loop);
+
+  if (loop->oom_watch_pending)
+    timeout = timeout < 0 ? _dbus_get_oom_wait () :
+      MIN (timeout, _dbus_get_oom_wait ());
+
+  memset (&its, 0, sizeof (its));
+
+  if (timeout >= 0)
+    {
+      its.it_value.tv_sec = timeout / 1000;
+      its.it_value.tv_nsec = (timeout % 1000) * 1000000;
+
+      /* all zeroes would disarm it */
+      if (timeout == 0)
+        its.it_value.tv_nsec = 1;
+    }
+
+  if (timerfd_settime (loop->timer_fd, 0, &its, NULL) < 0)
+    _dbus_verbose ("could not set loop timerfd: %s\n",
+                   _dbus_strerror_from_errno ());
+#endif
+}
+
+/* Clears the wakeup or timer fd if fd is one of them */
+static dbus_bool_t
+drain_loop_fd (DBusLoop *loop,
+               int       fd)
+{
+#ifdef LOOP_HAVE_FD
+  if (fd == loop->wakeup_fd || fd == loop->timer_fd)
+    {
+      uint64_t count;
+
+      /* both hold an 8-byte counter; EAGAIN just means it was
+       * already clear */
+      if (read (fd, &count, sizeof (count)) < 0)
+        _dbus_verbose ("nothing to read from loop fd %d\n", fd);
+
+      return TRUE;
+    }
+#endif
+
+  return FALSE;
+}
+
+/**
+ * Returns an fd that polls readable whenever the loop has something
+ * to do: an fd ready, a timeout due, or a connection to dispatch.
+ * It is level-triggered, and _dbus_loop_process() clears it.
+ *
+ * @returns the fd, or -1 if not supported here or no memory
+ */
+int
+_dbus_loop_get_fd (DBusLoop *loop)
+{
+#ifdef LOOP_HAVE_FD
+  int wakeup_fd;
+  int timer_fd;
+  int fd;
+
+  fd = _dbus_socket_set_get_fd (loop->socket_set);
+
+  if (fd < 0 || loop->wakeup_fd >= 0)
+    return fd;
+
+  wakeup_fd = eventfd (0, EFD_CLOEXEC | EFD_NONBLOCK);
+  timer_fd = timerfd_create (CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+
+  if (wakeup_fd < 0 || timer_fd < 0)
+    goto failed;
+
+  if (!_dbus_socket_set_add (loop->socket_set, wakeup_fd,
+                             DBUS_WATCH_READABLE, TRUE))
+    goto failed;
+
+  if (!_dbus_socket_set_add (loop->socket_set, timer_fd,
+                             DBUS_WATCH_READABLE, TRUE))
+    {
+      _dbus_socket_set_remove (loop->socket_set, wakeup_fd);
+      goto failed;
+    }
+
+  loop->wakeup_fd = wakeup_fd;
+  loop->timer_fd = timer_fd;
+  update_fds (loop);
+
+  return fd;
+
+ failed:
+  if (wakeup_fd >= 0)
+    close (wakeup_fd);
+
+  if (timer_fd >= 0)
+    close (timer_fd);
+
+  return -1;
+#else
+  return -1;
+#endif
+}
+
+/* Dispatches at most budget messages, taking one from each connection
+ * in turn so that a busy one cannot hold up the others */
+static dbus_bool_t
+dispatch_some (DBusLoop *loop,
+               int       budget)
+{
+  if (budget < 0)
+    return _dbus_loop_dispatch (loop);
+
+  if (loop->need_dispatch == NULL)
+    return FALSE;
+
+  while (budget > 0 && loop->need_dispatch != NULL)
+    {
+      DBusList *link = _dbus_list_pop_first_link (&loop->need_dispatch);
+      DBusConnection *connection = link->data;
+      DBusDispatchStatus status;
+
+      status = dbus_connection_dispatch (connection);
+      budget -= 1;
+
+      if (status == DBUS_DISPATCH_COMPLETE)
+        {
+          _dbus_list_free_link (link);
+          dbus_connection_unref (connection);
+        }
+      else
+        {
+          if (status == DBUS_DISPATCH_NEED_MEMORY)
+            _dbus_wait_for_memory ();
+
+          _dbus_list_append_link (&loop->need_dispatch, link);
+        }
+    }
+
+  return TRUE;
+}
+
 dbus_bool_t
 _dbus_loop_dispatch (DBusLoop *loop)
 {
@@ -576,6 +919,7 @@ _dbus_loop_queue_dispatch (DBusLoop       *loop,
   if (_dbus_list_append (&loop->need_dispatch, connection))
     {
       dbus_connection_ref (connection);
+      update_fds (loop);
       return TRUE;
     }
   else
@@ -586,9 +930,10 @@ _dbus_loop_queue_dispatch (DBusLoop       *loop,
  * descriptors, which is just used in test code as a debug hack
  */
 
-dbus_bool_t
-_dbus_loop_iterate (DBusLoop     *loop,
-                    dbus_bool_t   block)
+static dbus_bool_t
+iterate (DBusLoop     *loop,
+         dbus_bool_t   block,
+         int           budget)
 {  
 #define N_STACK_DESCRIPTORS 64
   dbus_bool_t retval;
@@ -610,57 +955,14 @@ _dbus_loop_iterate (DBusLoop     *loop,
 #endif
 
   if (_dbus_hash_table_get_n_entries (loop->watches) == 0 &&
-      loop->timeouts == NULL)
+      loop->timeouts == NULL &&
+      loop->idles == NULL)
     goto next_iteration;
 
-  timeout = -1;
-  if (loop->timeout_count > 0)
-    {
-      unsigned long tv_sec;
-      unsigned long tv_usec;
-      
-      _dbus_get_monotonic_time (&tv_sec, &tv_usec);
+  timeout = get_next_timeout (loop);
 
-      link = _dbus_list_get_first_link (&loop->timeouts);
-      while (link != NULL)
-        {
-          DBusList *next = _dbus_list_get_next_link (&loop->timeouts, link);
-          TimeoutCallback *tcb = link->data;
-
-          if (dbus_timeout_get_enabled (tcb->timeout))
-            {
-              int msecs_remaining;
-
-              check_timeout (tv_sec, tv_usec, tcb, &msecs_remaining);
-
-              if (timeout < 0)
-                timeout = msecs_remaining;
-              else
-                timeout = MIN (msecs_remaining, timeout);
-
-#if MAINLOOP_SPEW
-              _dbus_verbose ("  timeout added, %d remaining, aggregate timeout %ld\n",
-                             msecs_remaining, timeout);
-#endif
-              
-              _dbus_assert (timeout >= 0);
-                  
-              if (timeout == 0)
-                break; /* it's not going to get shorter... */
-            }
-#if MAINLOOP_SPEW
-          else
-            {
-              _dbus_verbose ("  skipping disabled timeout\n");
-            }
-#endif
-          
-          link = next;
-        }
-    }
-
-  /* Never block if we have stuff to dispatch */
-  if (!block || loop->need_dispatch != NULL)
+  /* Never block if we have stuff to dispatch or idles to run */
+  if (!block || loop->need_dispatch != NULL || loop->idles != NULL)
     {
       timeout = 0;
 #if MAINLOOP_SPEW
@@ -819,6 +1121,9 @@ _dbus_loop_iterate (DBusLoop     *loop,
           if (condition == 0)
             continue;
 
+          if (drain_loop_fd (loop, ready_fds[i].fd))
+            continue;
+
           watches = _dbus_hash_table_lookup_int (loop->watches,
                                                  ready_fds[i].fd);
 
@@ -877,8 +1182,13 @@ _dbus_loop_iterate (DBusLoop     *loop,
   _dbus_verbose ("  moving to next iteration\n");
 #endif
 
-  if (_dbus_loop_dispatch (loop))
+  if (dispatch_some (loop, budget))
+    retval = TRUE;
+
+  if (loop->depth == orig_depth && run_idles (loop, orig_depth))
     retval = TRUE;
+
+  update_fds (loop);
   
 #if MAINLOOP_SPEW
   _dbus_verbose ("Returning %d\n", retval);
@@ -887,6 +1197,28 @@ _dbus_loop_iterate (DBusLoop     *loop,
   return retval;
 }
 
+dbus_bool_t
+_dbus_loop_iterate (DBusLoop     *loop,
+                    dbus_bool_t   block)
+{
+  return iterate (loop, block, -1);
+}
+
+/**
+ * Does whatever the loop has to do now without blocking, dispatching
+ * at most budget messages, or any number if budget is negative.
+ *
+ * @returns #TRUE if there is dispatching or an idle left to do
+ */
+dbus_bool_t
+_dbus_loop_process (DBusLoop *loop,
+                    int       budget)
+{
+  iterate (loop, FALSE, budget);
+
+  return loop->need_dispatch != NULL || loop->idles != NULL;
+}
+
 void
 _dbus_loop_run (DBusLoop *loop)
 {
@@ -28,11 +28,10 @@
 
 #include <dbus/dbus.h>
 
-typedef struct DBusLoop DBusLoop;
-
 typedef dbus_bool_t (* DBusWatchFunction)   (DBusWatch     *watch,
                                              unsigned int   condition,
                                              void          *data);
+typedef void        (* DBusIdleFunction)    (void          *data);
 
 DBusLoop*   _dbus_loop_new            (void);
 DBusLoop*   _dbus_loop_ref            (DBusLoop            *loop);
@@ -47,6 +46,12 @@ dbus_bool_t _dbus_loop_add_timeout    (DBusLoop            *loop,
                                        DBusTimeout         *timeout);
 void        _dbus_loop_remove_timeout (DBusLoop            *loop,
                                        DBusTimeout         *timeout);
+dbus_bool_t _dbus_loop_add_idle       (DBusLoop            *loop,
+                                       DBusIdleFunction     function,
+                                       void                *data);
+void        _dbus_loop_remove_idle    (DBusLoop            *loop,
+                                       DBusIdleFunction     function,
+                                       void                *data);
 
 dbus_bool_t _dbus_loop_queue_dispatch (DBusLoop            *loop,
                                        DBusConnection      *connection);
@@ -56,6 +61,9 @@ void        _dbus_loop_quit           (DBusLoop            *loop);
 dbus_bool_t _dbus_loop_iterate        (DBusLoop            *loop,
                                        dbus_bool_t          block);
 dbus_bool_t _dbus_loop_dispatch       (DBusLoop            *loop);
+int         _dbus_loop_get_fd         (DBusLoop            *loop);
+dbus_bool_t _dbus_loop_process        (DBusLoop            *loop,
+                                       int                  budget);
 
 int  _dbus_get_oom_wait    (void);
 void _dbus_wait_for_memory (void);
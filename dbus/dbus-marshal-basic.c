@@ -29,6 +29,23 @@
 
 #include <string.h>
 
+/* Vector implementations of the byte-swapping in _dbus_swap_array()
+ * and _dbus_swap_fixed_layout_array(). SSSE3 and AVX2 are compiled in
+ * with target attributes and only used if the CPU has them. NEON is
+ * part of the aarch64 baseline.
+ */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && \
+  (defined(__clang__) || __GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#define DBUS_SWAP_HAVE_SSSE3 1
+#define DBUS_SWAP_HAVE_AVX2 1
+#include <immintrin.h>
+#endif
+
+#if defined(__GNUC__) && defined(__aarch64__) && defined(__ARM_NEON)
+#define DBUS_SWAP_HAVE_NEON 1
+#include <arm_neon.h>
+#endif
+
 #if defined(__GNUC__) && (__GNUC__ >= 4)
 # define _DBUS_ASSERT_ALIGNMENT(type, op, val) \
   _DBUS_STATIC_ASSERT (__extension__ __alignof__ (type) op val)
@@ -938,6 +955,264 @@ marshal_1_octets_array (DBusString          *str,
   return TRUE;
 }
 
+/*
+ * Byte-swapping kernels. Each one applies a byte shuffle to n_chunks
+ * consecutive 16-byte chunks of data, using masks[0..15] for the first
+ * chunk, masks[16..31] for the second and so on, wrapping around after
+ * n_masks masks. Byte i of a chunk is replaced by byte mask[i] of the
+ * same chunk. Since every value we swap is at most 8 bytes and aligned
+ * to its size, none straddles a chunk boundary.
+ *
+ * The "scalar" implementation has no kernel and swaps one value at a
+ * time; it is also the reference the others are tested against.
+ */
+typedef void (* DBusSwapChunksFunction) (unsigned char       *data,
+                                         int                  n_chunks,
+                                         const unsigned char *masks,
+                                         int                  n_masks);
+
+#define SWAP_MAX_MASKS 8
+
+static const unsigned char swap_mask_2[16] =
+  { 1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14 };
+static const unsigned char swap_mask_4[16] =
+  { 3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12 };
+static const unsigned char swap_mask_8[16] =
+  { 7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8 };
+
+#ifdef DBUS_SWAP_HAVE_SSSE3
+__attribute__ ((target ("ssse3")))
+static void
+swap_chunks_ssse3 (unsigned char       *data,
+                   int                  n_chunks,
+                   const unsigned char *masks,
+                   int                  n_masks)
+{
+  __m128i *chunk = (__m128i *) data;
+  __m128i *end = chunk + n_chunks;
+  int i;
+
+  if (n_masks == 1)
+    {
+      __m128i mask = _mm_loadu_si128 ((const __m128i *) masks);
+
+      for (; chunk < end; chunk++)
+        _mm_storeu_si128 (chunk,
+                          _mm_shuffle_epi8 (_mm_loadu_si128 (chunk), mask));
+
+      return;
+    }
+
+  for (; end - chunk >= n_masks; chunk += n_masks)
+    {
+      for (i = 0; i < n_masks; i++)
+        {
+          __m128i mask = _mm_loadu_si128 ((const __m128i *) (masks + i * 16));
+
+          _mm_storeu_si128 (chunk + i,
+                            _mm_shuffle_epi8 (_mm_loadu_si128 (chunk + i), mask));
+        }
+    }
+
+  for (i = 0; chunk < end; chunk++, i++)
+    {
+      __m128i mask = _mm_loadu_si128 ((const __m128i *) (masks + i * 16));
+
+      _mm_storeu_si128 (chunk,
+                        _mm_shuffle_epi8 (_mm_loadu_si128 (chunk), mask));
+    }
+}
+
+static dbus_bool_t
+cpu_has_ssse3 (void)
+{
+  return __builtin_cpu_supports ("ssse3");
+}
+#endif /* DBUS_SWAP_HAVE_SSSE3 */
+
+#ifdef DBUS_SWAP_HAVE_AVX2
+__attribute__ ((target ("avx2")))
+static void
+swap_chunks_avx2 (unsigned char       *data,
+                  int                  n_chunks,
+                  const unsigned char *masks,
+                  int                  n_masks)
+{
+  __m256i *pair = (__m256i *) data;
+  __m256i *end = pair + n_chunks / 2;
+  int i;
+
+  /* vpshufb shuffles within each 128-bit lane, so each 32-byte load
+   * takes two consecutive masks. A single mask is duplicated into both
+   * lanes; any other odd number of masks would not pair up, so that
+   * case is left to the SSSE3 version */
+  if (n_masks == 1)
+    {
+      __m128i half = _mm_loadu_si128 ((const __m128i *) masks);
+      __m256i mask = _mm256_inserti128_si256 (_mm256_castsi128_si256 (half),
+                                              half, 1);
+
+      for (; pair < end; pair++)
+        _mm256_storeu_si256 (pair,
+                             _mm256_shuffle_epi8 (_mm256_loadu_si256 (pair),
+                                                  mask));
+    }
+  else if (n_masks % 2 == 0)
+    {
+      int n_pairs = n_masks / 2;
+
+      for (; end - pair >= n_pairs; pair += n_pairs)
+        {
+          for (i = 0; i < n_pairs; i++)
+            {
+              __m256i mask = _mm256_loadu_si256 ((const __m256i *) (masks + i * 32));
+
+              _mm256_storeu_si256 (pair + i,
+                                   _mm256_shuffle_epi8 (_mm256_loadu_si256 (pair + i),
+                                                        mask));
+            }
+        }
+    }
+  else
+    {
+      swap_chunks_ssse3 (data, n_chunks, masks, n_masks);
+      return;
+    }
+
+  /* Whatever didn't make up a whole period of pairs */
+  i = (pair - (__m256i *) data) * 2;
+  swap_chunks_ssse3 (data + i * 16, n_chunks - i, masks, n_masks);
+}
+
+static dbus_bool_t
+cpu_has_avx2 (void)
+{
+  return __builtin_cpu_supports ("avx2");
+}
+#endif /* DBUS_SWAP_HAVE_AVX2 */
+
+#ifdef DBUS_SWAP_HAVE_NEON
+static void
+swap_chunks_neon (unsigned char       *data,
+                  int                  n_chunks,
+                  const unsigned char *masks,
+                  int                  n_masks)
+{
+  unsigned char *chunk = data;
+  unsigned char *end = data + n_chunks * 16;
+  int i;
+
+  for (; end - chunk >= n_masks * 16; chunk += n_masks * 16)
+    {
+      for (i = 0; i < n_masks; i++)
+        vst1q_u8 (chunk + i * 16, vqtbl1q_u8 (vld1q_u8 (chunk + i * 16),
+                                              vld1q_u8 (masks + i * 16)));
+    }
+
+  for (i = 0; chunk < end; chunk += 16, i++)
+    vst1q_u8 (chunk, vqtbl1q_u8 (vld1q_u8 (chunk), vld1q_u8 (masks + i * 16)));
+}
+#endif /* DBUS_SWAP_HAVE_NEON */
+
+static const struct
+{
+  const char *name;
+  DBusSwapChunksFunction func;
+  dbus_bool_t (* supported) (void);
+} byteswappers[] =
+{
+  /* in order of preference, best last */
+  { "scalar", NULL, NULL },
+#ifdef DBUS_SWAP_HAVE_SSSE3
+  { "ssse3", swap_chunks_ssse3, cpu_has_ssse3 },
+#endif
+#ifdef DBUS_SWAP_HAVE_AVX2
+  { "avx2", swap_chunks_avx2, cpu_has_avx2 },
+#endif
+#ifdef DBUS_SWAP_HAVE_NEON
+  { "neon", swap_chunks_neon, NULL },
+#endif
+};
+
+/* Chosen on first use; every thread would choose the same one */
+static int byteswapper = -1;
+
+static int
+byteswapper_choose_best (void)
+{
+  int i;
+
+  for (i = _DBUS_N_ELEMENTS (byteswappers) - 1; i > 0; i--)
+    {
+      if (byteswappers[i].supported == NULL ||
+          (* byteswappers[i].supported) ())
+        break;
+    }
+
+  return i;
+}
+
+static DBusSwapChunksFunction
+get_swap_chunks_function (void)
+{
+  if (_DBUS_UNLIKELY (byteswapper < 0))
+    byteswapper = byteswapper_choose_best ();
+
+  return byteswappers[byteswapper].func;
+}
+
+/**
+ * Selects the implementation used by _dbus_swap_array() and
+ * _dbus_swap_fixed_layout_array(), for tests and benchmarks. The
+ * implementations are "scalar", and whichever of "ssse3", "avx2" and
+ * "neon" were compiled in. By default the best one that the CPU
+ * supports is used.
+ *
+ * @param name the implementation, or #NULL for the default
+ * @returns #FALSE if the implementation is not available on this CPU
+ */
+dbus_bool_t
+_dbus_marshal_set_byteswapper (const char *name)
+{
+  int i;
+
+  if (name == NULL)
+    {
+      byteswapper = byteswapper_choose_best ();
+      return TRUE;
+    }
+
+  for (i = 0; i < (int) _DBUS_N_ELEMENTS (byteswappers); i++)
+    {
+      if (strcmp (name, byteswappers[i].name) == 0)
+        {
+          if (byteswappers[i].supported != NULL &&
+              !(* byteswappers[i].supported) ())
+            return FALSE;
+
+          byteswapper = i;
+          return TRUE;
+        }
+    }
+
+  return FALSE;
+}
+
+/**
+ * Gets the name of the implementation _dbus_swap_array() is using,
+ * see _dbus_marshal_set_byteswapper().
+ *
+ * @returns the name
+ */
+const char *
+_dbus_marshal_get_byteswapper (void)
+{
+  if (byteswapper < 0)
+    byteswapper = byteswapper_choose_best ();
+
+  return byteswappers[byteswapper].name;
+}
+
 /**
  * Swaps the elements of an array to the opposite byte order
  *
@@ -950,6 +1225,7 @@ _dbus_swap_array (unsigned char *data,
                   int            n_elements,
                   int            alignment)
 {
+  DBusSwapChunksFunction swap_chunks;
   unsigned char *d;
   unsigned char *end;
 
@@ -960,6 +1236,25 @@ _dbus_swap_array (unsigned char *data,
    */
   d = data;
   end = d + (n_elements * alignment);
+
+  swap_chunks = get_swap_chunks_function ();
+
+  if (swap_chunks != NULL && end - d >= 16)
+    {
+      const unsigned char *mask;
+      int n_chunks;
+
+      if (alignment == 8)
+        mask = swap_mask_8;
+      else if (alignment == 4)
+        mask = swap_mask_4;
+      else
+        mask = swap_mask_2;
+
+      n_chunks = (end - d) / 16;
+      (* swap_chunks) (d, n_chunks, mask, 1);
+      d += n_chunks * 16;
+    }
   
   if (alignment == 8)
     {
@@ -993,6 +1288,119 @@ _dbus_swap_array (unsigned char *data,
     }
 }
 
+/* Builds the masks for swapping an array of fixed-layout structs in
+ * 16-byte chunks. The pattern repeats every lcm (stride, 16) bytes;
+ * returns the number of masks, or 0 if that is too many.
+ */
+static int
+fixed_layout_swap_masks (const DBusFixedLayout *layout,
+                         unsigned char         *masks)
+{
+  int period, e, i, j;
+
+  period = layout->stride % 16 == 0 ? layout->stride : layout->stride * 2;
+
+  if (period > SWAP_MAX_MASKS * 16)
+    return 0;
+
+  for (i = 0; i < period; i++)
+    masks[i] = i % 16;
+
+  for (e = 0; e < period; e += layout->stride)
+    {
+      for (i = 0; i < layout->n_members; i++)
+        {
+          int size = _dbus_type_get_alignment (layout->members[i].type);
+          int start = e + layout->members[i].offset;
+
+          for (j = 0; j < size; j++)
+            masks[start + j] = (start + size - 1 - j) % 16;
+        }
+    }
+
+  return period / 16;
+}
+
+/**
+ * Swaps every multi-byte member of an array of fixed-layout structs to
+ * the opposite byte order. The array is len bytes long, a whole number
+ * of elements as described by #DBusFixedLayout.
+ *
+ * @param layout the layout of each element
+ * @param data start of the first element, 8-aligned
+ * @param len length of the array
+ */
+void
+_dbus_swap_fixed_layout_array (const DBusFixedLayout *layout,
+                               unsigned char         *data,
+                               int                    len)
+{
+  DBusSwapChunksFunction swap_chunks;
+  int done;
+  int i;
+
+  _dbus_assert (_DBUS_ALIGN_ADDRESS (data, 8) == data);
+  _dbus_assert (len >= layout->size);
+  _dbus_assert ((len - layout->size) % layout->stride == 0);
+
+  done = 0;
+  swap_chunks = get_swap_chunks_function ();
+
+  if (swap_chunks != NULL && len >= 16)
+    {
+      unsigned char masks[SWAP_MAX_MASKS * 16];
+      int n_masks;
+
+      n_masks = fixed_layout_swap_masks (layout, masks);
+
+      if (n_masks > 0)
+        {
+          (* swap_chunks) (data, len / 16, masks, n_masks);
+          done = (len / 16) * 16;
+        }
+    }
+
+  /* Whatever the kernel didn't reach, a member at a time down the array */
+  for (i = 0; i < layout->n_members; i++)
+    {
+      unsigned char *d = data + layout->members[i].offset;
+      unsigned char *end = data + len - layout->size + layout->members[i].offset;
+
+      if (done > layout->members[i].offset)
+        d += (done - layout->members[i].offset + layout->stride - 1) /
+          layout->stride * layout->stride;
+
+      switch (_dbus_type_get_alignment (layout->members[i].type))
+        {
+        case 1:
+          break;
+
+        case 2:
+          for (; d <= end; d += layout->stride)
+            *((dbus_uint16_t*)d) = DBUS_UINT16_SWAP_LE_BE (*((dbus_uint16_t*)d));
+          break;
+
+        case 4:
+          for (; d <= end; d += layout->stride)
+            *((dbus_uint32_t*)d) = DBUS_UINT32_SWAP_LE_BE (*((dbus_uint32_t*)d));
+          break;
+
+        case 8:
+          for (; d <= end; d += layout->stride)
+#ifdef DBUS_HAVE_INT64
+            *((dbus_uint64_t*)d) = DBUS_UINT64_SWAP_LE_BE (*((dbus_uint64_t*)d));
+#else
+            _dbus_swap_array (d, 1, 8);
+#endif
+          break;
+
+        default:
+          _dbus_assert_not_reached ("unexpected alignment of fixed-layout member");
+          break;
+        }
+    }
+}
+
 static void
 swap_array (DBusString *str,
             int         array_start,
@@ -1499,6 +1907,123 @@ _dbus_first_type_in_signature_c_str (const char       *str,
   return map_type_char_to_type (str[pos]);
 }
 
+static dbus_bool_t
+fixed_layout_add_struct (const unsigned char *sig,
+                         int                  len,
+                         int                 *pos,
+                         int                 *offset,
+                         DBusFixedLayout     *layout)
+{
+  /* *pos is at the opening paren or brace */
+  *offset = _DBUS_ALIGN_VALUE (*offset, 8);
+  *pos += 1;
+
+  while (*pos < len)
+    {
+      int alignment;
+
+      switch (sig[*pos])
+        {
+        case DBUS_STRUCT_END_CHAR:
+        case DBUS_DICT_ENTRY_END_CHAR:
+          *pos += 1;
+          return TRUE;
+
+        case DBUS_STRUCT_BEGIN_CHAR:
+        case DBUS_DICT_ENTRY_BEGIN_CHAR:
+          if (!fixed_layout_add_struct (sig, len, pos, offset, layout))
+            return FALSE;
+          break;
+
+        case DBUS_TYPE_BOOLEAN:
+          layout->has_boolean = TRUE;
+          /* fall through */
+        case DBUS_TYPE_BYTE:
+        case DBUS_TYPE_INT16:
+        case DBUS_TYPE_UINT16:
+        case DBUS_TYPE_INT32:
+        case DBUS_TYPE_UINT32:
+        case DBUS_TYPE_INT64:
+        case DBUS_TYPE_UINT64:
+        case DBUS_TYPE_DOUBLE:
+          if (layout->n_members == DBUS_FIXED_LAYOUT_MAX_MEMBERS)
+            return FALSE;
+
+          alignment = _dbus_type_get_alignment (sig[*pos]);
+          *offset = _DBUS_ALIGN_VALUE (*offset, alignment);
+
+          layout->members[layout->n_members].offset = *offset;
+          layout->members[layout->n_members].type = sig[*pos];
+          layout->n_members += 1;
+
+          *offset += alignment;
+          *pos += 1;
+          break;
+
+        default:
+          /* Variable-size, or a unix fd, which we never want to
+           * treat as plain data */
+          return FALSE;
+        }
+    }
+
+  return FALSE;
+}
+
+/**
+ * Works out whether the struct or dict entry type at type_pos contains
+ * only fixed-size basic types (possibly in nested structs), and if so
+ * where each of them is. Arrays of such types can then be validated,
+ * skipped or byteswapped without a #DBusTypeReader per element.
+ *
+ * Unix fds are not considered fixed-size here, and neither are structs
+ * with more than #DBUS_FIXED_LAYOUT_MAX_MEMBERS members.
+ *
+ * @param type_str string containing the signature
+ * @param type_pos position of the struct or dict entry in type_str
+ * @param layout return location for the layout
+ * @returns #TRUE if the type has a fixed layout
+ */
+dbus_bool_t
+_dbus_type_get_fixed_layout (const DBusString *type_str,
+                             int               type_pos,
+                             DBusFixedLayout  *layout)
+{
+  const unsigned char *sig;
+  int len;
+  int offset;
+  int members_size;
+  int i;
+
+  sig = (const unsigned char *) _dbus_string_get_const_data (type_str);
+  len = _dbus_string_get_length (type_str);
+
+  _dbus_assert (type_pos < len);
+
+  if (sig[type_pos] != DBUS_STRUCT_BEGIN_CHAR &&
+      sig[type_pos] != DBUS_DICT_ENTRY_BEGIN_CHAR)
+    return FALSE;
+
+  layout->n_members = 0;
+  layout->has_boolean = FALSE;
+  offset = 0;
+
+  if (!fixed_layout_add_struct (sig, len, &type_pos, &offset, layout) ||
+      layout->n_members == 0)
+    return FALSE;
+
+  layout->size = offset;
+  layout->stride = _DBUS_ALIGN_VALUE (offset, 8);
+
+  members_size = 0;
+  for (i = 0; i < layout->n_members; i++)
+    members_size += _dbus_type_get_alignment (layout->members[i].type);
+
+  layout->has_padding = members_size != layout->stride;
+
+  return TRUE;
+}
+
 /** @} */
 
 #ifdef DBUS_BUILD_TESTS
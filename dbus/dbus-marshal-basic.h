@@ -234,4 +234,37 @@ void _dbus_swap_array (unsigned char *data,
                        int            n_elements,
                        int            alignment);
 
+/** The most members #_dbus_type_get_fixed_layout() will describe */
+#define DBUS_FIXED_LAYOUT_MAX_MEMBERS 16
+
+/**
+ * Where the members of a struct or dict entry made only of fixed-size
+ * basic types fall, relative to the 8-aligned start of the struct.
+ * Because structs always start on an 8-byte boundary, this is the same
+ * for every element of an array of them.
+ */
+typedef struct
+{
+  int size;           /**< bytes from the start of the struct to the end of its last member */
+  int stride;         /**< distance between consecutive array elements, size rounded up to 8 */
+  int n_members;      /**< number of basic members, nested structs flattened */
+  dbus_bool_t has_padding; /**< TRUE if some bytes within stride belong to no member */
+  dbus_bool_t has_boolean; /**< TRUE if some member is a boolean */
+  struct
+  {
+    int offset;       /**< offset of the member from the start of the struct */
+    int type;         /**< the member's typecode */
+  } members[DBUS_FIXED_LAYOUT_MAX_MEMBERS]; /**< members in marshaling order */
+} DBusFixedLayout;
+
+dbus_bool_t _dbus_type_get_fixed_layout (const DBusString *type_str,
+                                         int               type_pos,
+                                         DBusFixedLayout  *layout);
+void        _dbus_swap_fixed_layout_array (const DBusFixedLayout *layout,
+                                           unsigned char         *data,
+                                           int                    len);
+
+dbus_bool_t _dbus_marshal_set_byteswapper (const char *name);
+const char *_dbus_marshal_get_byteswapper (void);
+
 #endif /* DBUS_MARSHAL_BASIC_H */
@@ -25,9 +25,165 @@
 
 #ifdef DBUS_BUILD_TESTS 
 #include "dbus-marshal-byteswap.h"
+#include "dbus-marshal-basic.h"
 #include "dbus-test.h"
 #include <stdio.h>
 
+static const char * const byteswappers[] = { "ssse3", "avx2", "neon" };
+
+/* Swaps body with each vector implementation available and checks that
+ * they all give the same bytes as the scalar one, and that swapping
+ * back restores the original.
+ */
+static void
+check_byteswappers (const DBusString *signature,
+                    const DBusString *body,
+                    int               byte_order,
+                    int               opposite_order)
+{
+  DBusString expected;
+  DBusString copy;
+  unsigned int i;
+
+  if (!_dbus_string_init (&expected) || !_dbus_string_init (&copy))
+    _dbus_assert_not_reached ("oom");
+
+  if (!_dbus_string_copy (body, 0, &expected, 0))
+    _dbus_assert_not_reached ("oom");
+
+  _dbus_marshal_set_byteswapper ("scalar");
+  _dbus_marshal_byteswap (signature, 0, byte_order, opposite_order,
+                          &expected, 0);
+
+  for (i = 0; i < _DBUS_N_ELEMENTS (byteswappers); i++)
+    {
+      if (!_dbus_marshal_set_byteswapper (byteswappers[i]))
+        continue;
+
+      _dbus_string_set_length (&copy, 0);
+      if (!_dbus_string_copy (body, 0, &copy, 0))
+        _dbus_assert_not_reached ("oom");
+
+      _dbus_marshal_byteswap (signature, 0, byte_order, opposite_order,
+                              &copy, 0);
+
+      if (!_dbus_string_equal (&copy, &expected))
+        {
+          _dbus_verbose_bytes_of_string (signature, 0,
+                                         _dbus_string_get_length (signature));
+          _dbus_verbose_bytes_of_string (&expected, 0,
+                                         _dbus_string_get_length (&expected));
+          _dbus_verbose_bytes_of_string (&copy, 0,
+                                         _dbus_string_get_length (&copy));
+
+          _dbus_warn ("%s byteswapper disagrees with the scalar one\n",
+                      byteswappers[i]);
+          _dbus_assert_not_reached ("test failed");
+        }
+
+      _dbus_marshal_byteswap (signature, 0, opposite_order, byte_order,
+                              &copy, 0);
+
+      if (!_dbus_string_equal (&copy, body))
+        {
+          _dbus_warn ("%s byteswapper did not round-trip\n", byteswappers[i]);
+          _dbus_assert_not_reached ("test failed");
+        }
+    }
+
+  _dbus_marshal_set_byteswapper (NULL);
+
+  _dbus_string_free (&expected);
+  _dbus_string_free (&copy);
+}
+
+/* Arrays long enough for the vector implementations, with arbitrary
+ * bytes in them, after each of the given prefixes so that they start
+ * at different alignments
+ */
+static void
+do_long_array_test (void)
+{
+  static const char * const elements[] = {
+    "n", "q", "b", "i", "u", "x", "t", "d",
+    "(dddd)", "(dd)", "(iiu)", "(yyy)", "(ynd)", "{ud}", "(y(yq)t)",
+    "(qqqqqqqq)", "(yqdbx)"
+  };
+  static const char * const prefixes[] = { "", "y", "q" };
+  DBusString signature;
+  DBusString body;
+  unsigned int random = 1;
+  unsigned int e, f;
+  int n, i;
+
+  if (!_dbus_string_init (&signature) || !_dbus_string_init (&body))
+    _dbus_assert_not_reached ("oom");
+
+  for (e = 0; e < _DBUS_N_ELEMENTS (elements); e++)
+    {
+      for (f = 0; f < _DBUS_N_ELEMENTS (prefixes); f++)
+        {
+          for (n = 0; n < 40; n++)
+            {
+              DBusFixedLayout layout;
+              dbus_uint32_t len;
+              int elem_pos;
+
+              _dbus_string_set_length (&signature, 0);
+              _dbus_string_set_length (&body, 0);
+
+              if (!_dbus_string_append (&signature, prefixes[f]) ||
+                  !_dbus_string_append (&signature, "a"))
+                _dbus_assert_not_reached ("oom");
+
+              elem_pos = _dbus_string_get_length (&signature);
+
+              if (!_dbus_string_append (&signature, elements[e]))
+                _dbus_assert_not_reached ("oom");
+
+              if (_dbus_type_get_fixed_layout (&signature, elem_pos, &layout))
+                len = n == 0 ? 0 : (n - 1) * layout.stride + layout.size;
+              else
+                len = n * _dbus_type_get_alignment (elements[e][0]);
+
+              for (i = 0; prefixes[f][i] != '\0'; i++)
+                {
+                  DBusBasicValue v;
+
+                  v.u16 = 0x1234;
+                  if (!_dbus_marshal_write_basic (&body, _dbus_string_get_length (&body),
+                                                  prefixes[f][i], &v,
+                                                  DBUS_LITTLE_ENDIAN, NULL))
+                    _dbus_assert_not_reached ("oom");
+                }
+
+              if (!_dbus_marshal_write_basic (&body, _dbus_string_get_length (&body),
+                                              DBUS_TYPE_UINT32, &len,
+                                              DBUS_LITTLE_ENDIAN, NULL) ||
+                  !_dbus_string_align_length (&body,
+                                              _dbus_type_get_alignment (_dbus_first_type_in_signature (&signature, elem_pos))))
+                _dbus_assert_not_reached ("oom");
+
+              for (i = 0; i < (int) len; i++)
+                {
+                  random = random * 1103515245 + 12345;
+
+                  if (!_dbus_string_append_byte (&body, random >> 16))
+                    _dbus_assert_not_reached ("oom");
+                }
+
+              check_byteswappers (&signature, &body,
+                                  DBUS_LITTLE_ENDIAN, DBUS_BIG_ENDIAN);
+            }
+        }
+    }
+
+  _dbus_string_free (&signature);
+  _dbus_string_free (&body);
+
+  printf ("  long arrays swapped with each byteswapper\n");
+}
+
 static void
 do_byteswap_test (int byte_order)
 {
@@ -80,6 +236,8 @@ do_byteswap_test (int byte_order)
         }
       
       _dbus_string_free (&copy);
+
+      check_byteswappers (&signature, &body, byte_order, opposite_order);
       
       _dbus_string_set_length (&signature, 0);
       _dbus_string_set_length (&body, 0);
@@ -98,6 +256,7 @@ _dbus_marshal_byteswap_test (void)
 {
   do_byteswap_test (DBUS_LITTLE_ENDIAN);
   do_byteswap_test (DBUS_BIG_ENDIAN);
+  do_long_array_test ();
 
   return TRUE;
 }
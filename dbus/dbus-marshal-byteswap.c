@@ -116,12 +116,24 @@ byteswap_body_helper (DBusTypeReader       *reader,
                 else
                   {
                     DBusTypeReader sub;
+                    DBusFixedLayout scratch;
+                    const DBusFixedLayout *layout;
                     const unsigned char *array_end;
 
                     array_end = p + array_len;
                     
                     _dbus_type_reader_recurse (reader, &sub);
 
+                    if (array_len > 0 &&
+                        (elem_type == DBUS_TYPE_STRUCT ||
+                         elem_type == DBUS_TYPE_DICT_ENTRY) &&
+                        (layout = _dbus_type_reader_get_fixed_layout (&sub,
+                                                                      &scratch)) != NULL)
+                      {
+                        _dbus_swap_fixed_layout_array (layout, p, array_len);
+                        p += array_len;
+                      }
+
                     while (p < array_end)
                       {
                         byteswap_body_helper (&sub,
@@ -240,6 +252,7 @@ _dbus_marshal_byteswap (const DBusString *signature,
   
   _dbus_type_reader_init_types_only (&reader,
                                      signature, signature_start);
+  _dbus_type_reader_use_signature_program (&reader);
 
   byteswap_body_helper (&reader, TRUE,
                         old_byte_order, new_byte_order,
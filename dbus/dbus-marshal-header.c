@@ -443,6 +443,7 @@ _dbus_header_reinit (DBusHeader *header)
   _dbus_string_set_length (&header->data, 0);
 
   header->padding = 0;
+  header->unchecked_fields = 0;
 
   _dbus_header_cache_invalidate_all (header);
 }
@@ -507,6 +508,38 @@ _dbus_header_copy (const DBusHeader *header,
   return TRUE;
 }
 
+/**
+ * Fills in a header that has been initialized or re-initialized with
+ * a copy of another, as _dbus_header_create() would. Unlike
+ * _dbus_header_copy(), this reuses the memory the header already has.
+ * Resets the message serial to 0 on the copy.
+ *
+ * @param header the header
+ * @param template_header header to copy
+ * @returns #FALSE if not enough memory
+ */
+dbus_bool_t
+_dbus_header_create_from (DBusHeader       *header,
+                          const DBusHeader *template_header)
+{
+  int i;
+
+  _dbus_assert (_dbus_string_get_length (&header->data) == 0);
+
+  if (!_dbus_string_copy (&template_header->data, 0, &header->data, 0))
+    return FALSE;
+
+  for (i = 0; i <= DBUS_HEADER_FIELD_LAST; i++)
+    header->fields[i] = template_header->fields[i];
+  header->padding = template_header->padding;
+  header->byte_order = template_header->byte_order;
+  header->unchecked_fields = template_header->unchecked_fields;
+
+  _dbus_header_set_serial (header, 0);
+
+  return TRUE;
+}
+
 /**
  * Fills in the primary fields of the header, so the header is ready
  * for use. #NULL may be specified for some or all of the fields to
@@ -520,17 +553,19 @@ _dbus_header_copy (const DBusHeader *header,
  * @param interface interface field or #NULL
  * @param member member field or #NULL
  * @param error_name error name or #NULL
+ * @param reply_serial reply serial field, or 0
  * @returns #FALSE if not enough memory
  */
 dbus_bool_t
-_dbus_header_create (DBusHeader  *header,
-                     int          byte_order,
-                     int          message_type,
-                     const char  *destination,
-                     const char  *path,
-                     const char  *interface,
-                     const char  *member,
-                     const char  *error_name)
+_dbus_header_create (DBusHeader    *header,
+                     int            byte_order,
+                     int            message_type,
+                     const char    *destination,
+                     const char    *path,
+                     const char    *interface,
+                     const char    *member,
+                     const char    *error_name,
+                     dbus_uint32_t  reply_serial)
 {
   unsigned char v_BYTE;
   dbus_uint32_t v_UINT32;
@@ -635,6 +670,17 @@ _dbus_header_create (DBusHeader  *header,
         goto oom;
     }
 
+  /* written here rather than set afterwards, which would have to find
+   * the end of the fields again */
+  if (reply_serial != 0)
+    {
+      if (!write_basic_field (&array,
+                              DBUS_HEADER_FIELD_REPLY_SERIAL,
+                              DBUS_TYPE_UINT32,
+                              &reply_serial))
+        goto oom;
+    }
+
   if (!_dbus_type_writer_unrecurse (&writer, &array))
     goto oom;
 
@@ -776,10 +822,78 @@ check_mandatory_fields (DBusHeader *header)
   return DBUS_VALID;
 }
 
+/** The fields holding names, whose contents are checked by the
+ * validator for that kind of name rather than for their type; these
+ * are the ones that can be left to be checked when first read.
+ */
+#define NAME_FIELDS \
+  ((1 << DBUS_HEADER_FIELD_DESTINATION) | \
+   (1 << DBUS_HEADER_FIELD_INTERFACE) | \
+   (1 << DBUS_HEADER_FIELD_MEMBER) | \
+   (1 << DBUS_HEADER_FIELD_ERROR_NAME) | \
+   (1 << DBUS_HEADER_FIELD_SENDER))
+
+/* Checks the name in a field that is already in the cache */
+static DBusValidity
+validate_name_field (DBusHeader *header,
+                     int         field)
+{
+  dbus_bool_t (* string_validation_func) (const DBusString *str,
+                                          int start, int len);
+  DBusValidity bad_string_code;
+  int value_pos;
+  dbus_uint32_t len;
+
+  switch (field)
+    {
+    case DBUS_HEADER_FIELD_DESTINATION:
+      string_validation_func = _dbus_validate_bus_name;
+      bad_string_code = DBUS_INVALID_BAD_DESTINATION;
+      break;
+    case DBUS_HEADER_FIELD_INTERFACE:
+      string_validation_func = _dbus_validate_interface;
+      bad_string_code = DBUS_INVALID_BAD_INTERFACE;
+      break;
+    case DBUS_HEADER_FIELD_MEMBER:
+      string_validation_func = _dbus_validate_member;
+      bad_string_code = DBUS_INVALID_BAD_MEMBER;
+      break;
+    case DBUS_HEADER_FIELD_ERROR_NAME:
+      string_validation_func = _dbus_validate_error_name;
+      bad_string_code = DBUS_INVALID_BAD_ERROR_NAME;
+      break;
+    case DBUS_HEADER_FIELD_SENDER:
+      string_validation_func = _dbus_validate_bus_name;
+      bad_string_code = DBUS_INVALID_BAD_SENDER;
+      break;
+    default:
+      _dbus_assert_not_reached ("not a name field");
+      return DBUS_VALIDITY_UNKNOWN;
+    }
+
+  value_pos = header->fields[field].value_pos;
+  _dbus_assert (value_pos >= 0);
+
+  len = _dbus_marshal_read_uint32 (&header->data, value_pos,
+                                   _dbus_header_get_byte_order (header),
+                                   NULL);
+
+#if 0
+  _dbus_verbose ("Validating string header field; code %d if fails\n",
+                 bad_string_code);
+#endif
+  if (!(*string_validation_func) (&header->data,
+                                  _DBUS_ALIGN_VALUE (value_pos, 4) + 4, len))
+    return bad_string_code;
+
+  return DBUS_VALID;
+}
+
 static DBusValidity
 load_and_validate_field (DBusHeader     *header,
                          int             field,
-                         DBusTypeReader *variant_reader)
+                         DBusTypeReader *variant_reader,
+                         dbus_bool_t     defer_names)
 {
   int type;
   int expected_type;
@@ -787,9 +901,6 @@ load_and_validate_field (DBusHeader     *header,
   int value_pos;
   int str_data_pos;
   dbus_uint32_t v_UINT32;
-  int bad_string_code;
-  dbus_bool_t (* string_validation_func) (const DBusString *str,
-                                          int start, int len);
 
   /* Supposed to have been checked already */
   _dbus_assert (field <= DBUS_HEADER_FIELD_LAST);
@@ -819,14 +930,11 @@ load_and_validate_field (DBusHeader     *header,
   _dbus_verbose ("initially caching field %d\n", field);
   _dbus_header_cache_one (header, field, variant_reader);
 
-  string_validation_func = NULL;
-
   /* make compiler happy that all this is initialized */
   v_UINT32 = 0;
   value_str = NULL;
   value_pos = -1;
   str_data_pos = -1;
-  bad_string_code = DBUS_VALID;
 
   if (expected_type == DBUS_TYPE_UINT32)
     {
@@ -848,14 +956,7 @@ load_and_validate_field (DBusHeader     *header,
 
   switch (field)
     {
-    case DBUS_HEADER_FIELD_DESTINATION:
-      string_validation_func = _dbus_validate_bus_name;
-      bad_string_code = DBUS_INVALID_BAD_DESTINATION;
-      break;
     case DBUS_HEADER_FIELD_INTERFACE:
-      string_validation_func = _dbus_validate_interface;
-      bad_string_code = DBUS_INVALID_BAD_INTERFACE;
-
       if (_dbus_string_equal_substring (&_dbus_local_interface_str,
                                         0,
                                         _dbus_string_get_length (&_dbus_local_interface_str),
@@ -866,25 +967,8 @@ load_and_validate_field (DBusHeader     *header,
         }
       break;
 
-    case DBUS_HEADER_FIELD_MEMBER:
-      string_validation_func = _dbus_validate_member;
-      bad_string_code = DBUS_INVALID_BAD_MEMBER;
-      break;
-
-    case DBUS_HEADER_FIELD_ERROR_NAME:
-      string_validation_func = _dbus_validate_error_name;
-      bad_string_code = DBUS_INVALID_BAD_ERROR_NAME;
-      break;
-
-    case DBUS_HEADER_FIELD_SENDER:
-      string_validation_func = _dbus_validate_bus_name;
-      bad_string_code = DBUS_INVALID_BAD_SENDER;
-      break;
-
     case DBUS_HEADER_FIELD_PATH:
       /* OBJECT_PATH was validated generically due to its type */
-      string_validation_func = NULL;
-
       if (_dbus_string_equal_substring (&_dbus_local_path_str,
                                         0,
                                         _dbus_string_get_length (&_dbus_local_path_str),
@@ -903,13 +987,19 @@ load_and_validate_field (DBusHeader     *header,
         }
       break;
 
+    case DBUS_HEADER_FIELD_DESTINATION:
+    case DBUS_HEADER_FIELD_MEMBER:
+    case DBUS_HEADER_FIELD_ERROR_NAME:
+    case DBUS_HEADER_FIELD_SENDER:
+      /* names are checked below */
+      break;
+
     case DBUS_HEADER_FIELD_UNIX_FDS:
       /* Every value makes sense */
       break;
 
     case DBUS_HEADER_FIELD_SIGNATURE:
       /* SIGNATURE validated generically due to its type */
-      string_validation_func = NULL;
       break;
 
     default:
@@ -917,22 +1007,12 @@ load_and_validate_field (DBusHeader     *header,
       break;
     }
 
-  if (string_validation_func)
+  if ((NAME_FIELDS & (1 << field)) != 0)
     {
-      dbus_uint32_t len;
-
-      _dbus_assert (bad_string_code != DBUS_VALID);
-
-      len = _dbus_marshal_read_uint32 (value_str, value_pos,
-                                       _dbus_header_get_byte_order (header),
-                                       NULL);
-
-#if 0
-      _dbus_verbose ("Validating string header field; code %d if fails\n",
-                     bad_string_code);
-#endif
-      if (!(*string_validation_func) (value_str, str_data_pos, len))
-        return bad_string_code;
+      if (defer_names)
+        header->unchecked_fields |= 1 << field;
+      else
+        return validate_name_field (header, field);
     }
 
   return DBUS_VALID;
@@ -952,6 +1032,12 @@ load_and_validate_field (DBusHeader     *header,
  * _dbus_header_have_message_untrusted() is assumed to have been
  * already done.
  *
+ * With #DBUS_VALIDATION_MODE_DEFER_HEADER_NAMES, the header is
+ * checked as for untrusted data except that the names in the
+ * destination, interface, member, error name and sender fields are
+ * left to _dbus_header_check_deferred_fields(), which must be called
+ * before anything reads the fields.
+ *
  * @param header the header (must be initialized)
  * @param mode whether to do validation
  * @param validity return location for invalidity reason
@@ -990,6 +1076,7 @@ _dbus_header_load (DBusHeader        *header,
   _dbus_assert (start == (int) _DBUS_ALIGN_VALUE (start, 8));
   _dbus_assert (header_len <= len);
   _dbus_assert (_dbus_string_get_length (&header->data) == 0);
+  _dbus_assert (header->unchecked_fields == 0);
 
   if (!_dbus_string_copy_len (str, start, header_len, &header->data, 0))
     {
@@ -1147,7 +1234,8 @@ _dbus_header_load (DBusHeader        *header,
       _dbus_assert (_dbus_type_reader_get_current_type (&struct_reader) == DBUS_TYPE_VARIANT);
       _dbus_type_reader_recurse (&struct_reader, &variant_reader);
 
-      v = load_and_validate_field (header, field_code, &variant_reader);
+      v = load_and_validate_field (header, field_code, &variant_reader,
+                                   mode == DBUS_VALIDATION_MODE_DEFER_HEADER_NAMES);
       if (v != DBUS_VALID)
         {
           _dbus_verbose ("Field %d was invalid\n", field_code);
@@ -1184,6 +1272,46 @@ _dbus_header_load (DBusHeader        *header,
   return FALSE;
 }
 
+/**
+ * Checks the names that _dbus_header_load() left unchecked in
+ * #DBUS_VALIDATION_MODE_DEFER_HEADER_NAMES, all at once, so that the
+ * fields can be read. Fields that were already checked, or set since
+ * loading, are skipped.
+ *
+ * @param header the header
+ * @returns #DBUS_VALID, or the code the header would have been
+ *   rejected with when it was loaded
+ */
+DBusValidity
+_dbus_header_check_deferred_fields (DBusHeader *header)
+{
+  int field;
+
+  for (field = 0; header->unchecked_fields != 0; field++)
+    {
+      _dbus_assert (field <= DBUS_HEADER_FIELD_LAST);
+
+      if ((header->unchecked_fields & (1 << field)) == 0)
+        continue;
+
+      if (_dbus_header_cache_check (header, field))
+        {
+          DBusValidity v = validate_name_field (header, field);
+
+          if (v != DBUS_VALID)
+            {
+              _dbus_verbose ("Header field %d was invalid, code %d\n",
+                             field, v);
+              return v;
+            }
+        }
+
+      header->unchecked_fields &= ~(1 << field);
+    }
+
+  return DBUS_VALID;
+}
+
 /**
  * Fills in the correct body length.
  *
@@ -1332,6 +1460,9 @@ _dbus_header_set_field_basic (DBusHeader       *header,
    */
   _dbus_header_cache_invalidate_all (header);
 
+  /* the caller checked the new value */
+  header->unchecked_fields &= ~(1 << field);
+
   return TRUE;
 }
 
@@ -1437,6 +1568,7 @@ _dbus_header_delete_field (DBusHeader *header,
   correct_header_padding (header);
 
   _dbus_header_cache_invalidate_all (header);
+  header->unchecked_fields &= ~(1 << field);
 
   _dbus_assert (!_dbus_header_cache_check (header, field)); /* Expensive assertion ... */
 
@@ -1455,10 +1587,28 @@ void
 _dbus_header_toggle_flag (DBusHeader   *header,
                           dbus_uint32_t flag,
                           dbus_bool_t   value)
+{
+  _dbus_header_toggle_flag_in_data (&header->data, 0, flag, value);
+}
+
+/**
+ * Toggles a message flag bit in header data that is not (or not yet)
+ * in a #DBusHeader, such as a copy of a header about to be sent.
+ *
+ * @param str the string holding the header
+ * @param start where the header starts
+ * @param flag the message flag to toggle
+ * @param value toggle on or off
+ */
+void
+_dbus_header_toggle_flag_in_data (DBusString   *str,
+                                  int           start,
+                                  dbus_uint32_t flag,
+                                  dbus_bool_t   value)
 {
   unsigned char *flags_p;
 
-  flags_p = _dbus_string_get_data_len (&header->data, FLAGS_OFFSET, 1);
+  flags_p = _dbus_string_get_data_len (str, start + FLAGS_OFFSET, 1);
 
   if (value)
     *flags_p |= flag;
@@ -1466,6 +1616,24 @@ _dbus_header_toggle_flag (DBusHeader   *header,
     *flags_p &= ~flag;
 }
 
+/**
+ * Gets a message flag bit from header data that has not been loaded
+ * yet, after _dbus_header_have_message_untrusted() accepted its fixed
+ * part.
+ *
+ * @param str the string holding the header
+ * @param start where the header starts
+ * @param flag the message flag to get
+ * @returns #TRUE if the flag is set
+ */
+dbus_bool_t
+_dbus_header_peek_flag (const DBusString *str,
+                        int               start,
+                        dbus_uint32_t     flag)
+{
+  return (_dbus_string_get_byte (str, start + FLAGS_OFFSET) & flag) != 0;
+}
+
 /**
  * Gets a message flag bit, returning TRUE if the bit is set.
  *
@@ -33,6 +33,14 @@ typedef struct DBusHeaderField DBusHeaderField;
 #define _DBUS_HEADER_FIELD_VALUE_UNKNOWN -1
 #define _DBUS_HEADER_FIELD_VALUE_NONEXISTENT -2
 
+/**
+ * Header flag only ever seen on the wire between peers that agreed
+ * to NEGOTIATE_MEMFD_BODY: the body is not in the stream after the
+ * header, but in a sealed memfd passed after the message's own unix
+ * fds. The loader clears it again.
+ */
+#define _DBUS_HEADER_FLAG_BODY_IN_MEMFD 0x80
+
 /**
  * Cached information about a header field in the message
  */
@@ -57,6 +65,11 @@ struct DBusHeader
 
   dbus_uint32_t padding : 3;        /**< bytes of alignment in header */
   dbus_uint32_t byte_order : 8;     /**< byte order of header */
+
+  dbus_uint32_t unchecked_fields;   /**< Bit (1 << field) set for each name field
+                                     * that was loaded without being validated,
+                                     * until _dbus_header_check_deferred_fields()
+                                     */
 };
 
 dbus_bool_t   _dbus_header_init                   (DBusHeader        *header);
@@ -69,7 +82,10 @@ dbus_bool_t   _dbus_header_create                 (DBusHeader        *header,
                                                    const char        *path,
                                                    const char        *interface,
                                                    const char        *member,
-                                                   const char        *error_name);
+                                                   const char        *error_name,
+                                                   dbus_uint32_t      reply_serial);
+dbus_bool_t   _dbus_header_create_from            (DBusHeader        *header,
+                                                   const DBusHeader  *template_header);
 dbus_bool_t   _dbus_header_copy                   (const DBusHeader  *header,
                                                    DBusHeader        *dest);
 int           _dbus_header_get_message_type       (DBusHeader        *header);
@@ -97,6 +113,13 @@ void          _dbus_header_toggle_flag            (DBusHeader        *header,
                                                    dbus_bool_t        value);
 dbus_bool_t   _dbus_header_get_flag               (DBusHeader        *header,
                                                    dbus_uint32_t      flag);
+void          _dbus_header_toggle_flag_in_data    (DBusString        *str,
+                                                   int                start,
+                                                   dbus_uint32_t      flag,
+                                                   dbus_bool_t        value);
+dbus_bool_t   _dbus_header_peek_flag              (const DBusString  *str,
+                                                   int                start,
+                                                   dbus_uint32_t      flag);
 dbus_bool_t   _dbus_header_ensure_signature       (DBusHeader        *header,
                                                    DBusString       **type_str,
                                                    int               *type_pos);
@@ -119,6 +142,7 @@ dbus_bool_t   _dbus_header_load                   (DBusHeader        *header,
                                                    const DBusString  *str,
                                                    int                start,
                                                    int                len);
+DBusValidity  _dbus_header_check_deferred_fields  (DBusHeader        *header);
 void          _dbus_header_byteswap               (DBusHeader        *header,
                                                    int                new_order);
 char          _dbus_header_get_byte_order         (const DBusHeader  *header);
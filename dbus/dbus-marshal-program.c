@@ -0,0 +1,300 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/* dbus-marshal-program.c  Signatures compiled for the type reader
+ *
+ * Licensed under the Academic Free License version 2.1
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <config.h>
+#include "dbus-marshal-program.h"
+#include "dbus-marshal-recursive.h"
+#include "dbus-marshal-validate.h"
+#include "dbus-internals.h"
+
+#include <string.h>
+
+/**
+ * @addtogroup DBusMarshal
+ * @{
+ */
+
+/** Stop compiling new signatures once this many are cached; a process
+ * that sees more distinct signatures than this is not going to be helped
+ * much by the cache anyway.
+ */
+#define MAX_SIGNATURE_PROGRAMS 256
+
+/** Number of slots in the cache, a power of two at least twice
+ * #MAX_SIGNATURE_PROGRAMS so that probes stay short
+ */
+#define SIGNATURE_PROGRAM_SLOTS 512
+
+/*
+ * The cache is an open-addressed table that only ever grows until
+ * shutdown, and a program never changes once it is in a slot. So with
+ * gcc's __sync builtins a lookup needs no lock: it probes the slots,
+ * and a writer only fills a slot (under the lock) after a barrier that
+ * makes the program it points to visible first. Everything read from
+ * a slot is reached through the pointer in it. Without the builtins,
+ * lookups take the lock too.
+ */
+_DBUS_DEFINE_GLOBAL_LOCK (signature_programs);
+static DBusSignatureProgram * volatile signature_programs[SIGNATURE_PROGRAM_SLOTS];
+static int n_signature_programs = 0;
+static dbus_bool_t signature_programs_disabled = FALSE;
+
+static void
+signature_program_free (DBusSignatureProgram *program)
+{
+  dbus_free (program->layouts);
+  dbus_free (program->ops);
+  dbus_free (program->signature);
+  dbus_free (program);
+}
+
+static void
+signature_programs_shutdown (void *data)
+{
+  int i;
+
+  _DBUS_LOCK (signature_programs);
+
+  for (i = 0; i < SIGNATURE_PROGRAM_SLOTS; i++)
+    {
+      if (signature_programs[i] != NULL)
+        {
+          signature_program_free (signature_programs[i]);
+          signature_programs[i] = NULL;
+        }
+    }
+
+  n_signature_programs = 0;
+
+  _DBUS_UNLOCK (signature_programs);
+}
+
+/*
+ * Finds the slot holding the program for the signature, or else the
+ * empty slot where it would go.
+ */
+static int
+signature_program_find_slot (const char   *signature,
+                             int           len,
+                             unsigned int  hash)
+{
+  int i;
+
+  for (i = hash % SIGNATURE_PROGRAM_SLOTS;
+       ;
+       i = (i + 1) % SIGNATURE_PROGRAM_SLOTS)
+    {
+      DBusSignatureProgram *program = signature_programs[i];
+
+      if (program == NULL ||
+          (program->len == len &&
+           memcmp (program->signature, signature, len) == 0))
+        return i;
+    }
+}
+
+static DBusSignatureProgram *
+signature_program_new (const char *signature,
+                       int         len)
+{
+  DBusSignatureProgram *program;
+  DBusString str;
+  int n_containers;
+  int n_layouts;
+  int i;
+
+  program = dbus_new0 (DBusSignatureProgram, 1);
+  if (program == NULL)
+    return NULL;
+
+  program->len = len;
+  program->signature = _dbus_strdup (signature);
+  program->ops = dbus_new (DBusSignatureOp, len + 1);
+
+  n_containers = 0;
+  for (i = 0; i < len; i++)
+    {
+      if (signature[i] == DBUS_STRUCT_BEGIN_CHAR ||
+          signature[i] == DBUS_DICT_ENTRY_BEGIN_CHAR)
+        n_containers++;
+    }
+
+  if (n_containers > 0)
+    program->layouts = dbus_new (DBusFixedLayout, n_containers);
+
+  if (program->signature == NULL || program->ops == NULL ||
+      (n_containers > 0 && program->layouts == NULL))
+    {
+      signature_program_free (program);
+      return NULL;
+    }
+
+  _dbus_string_init_const_len (&str, program->signature, len);
+
+  n_layouts = 0;
+  for (i = 0; i <= len; i++)
+    {
+      DBusSignatureOp *op = &program->ops[i];
+      int t;
+
+      t = _dbus_string_get_byte (&str, i);
+
+      op->layout = -1;
+
+      if (i == len ||
+          t == DBUS_STRUCT_END_CHAR ||
+          t == DBUS_DICT_ENTRY_END_CHAR)
+        {
+          op->type = t;
+          op->alignment = 1;
+          op->next = 0;
+        }
+      else
+        {
+          int next = i;
+
+          t = _dbus_first_type_in_signature (&str, i);
+          _dbus_type_signature_next (program->signature, &next);
+
+          op->type = t;
+
+          op->alignment = _dbus_type_get_alignment (t);
+          op->next = next - i;
+
+          if ((t == DBUS_TYPE_STRUCT || t == DBUS_TYPE_DICT_ENTRY) &&
+              _dbus_type_get_fixed_layout (&str, i,
+                                           &program->layouts[n_layouts]))
+            op->layout = n_layouts++;
+        }
+    }
+
+  return program;
+}
+
+/**
+ * Gets the compiled form of the signature starting at type_pos, which
+ * must run to a nul byte. Each signature is compiled once per process
+ * and the result shared between all callers.
+ *
+ * Signatures without any arrays, structs or dict entries are not
+ * worth compiling and always get #NULL, as do invalid signatures; so
+ * does everything once the cache is full, or if memory runs out.
+ *
+ * @param type_str string containing the signature
+ * @param type_pos where the signature starts
+ * @returns the program, or #NULL to read the signature directly
+ */
+const DBusSignatureProgram *
+_dbus_signature_program_get (const DBusString *type_str,
+                             int               type_pos)
+{
+  DBusSignatureProgram *program;
+  const char *signature;
+  const char *p;
+  dbus_bool_t compound;
+  unsigned int hash;
+  DBusString str;
+  int len;
+  int slot;
+
+  if (signature_programs_disabled)
+    return NULL;
+
+  signature = _dbus_string_get_const_data (type_str) + type_pos;
+
+  /* the same hash as the string keys of a DBusHashTable */
+  hash = 0;
+  compound = FALSE;
+  for (p = signature; *p != '\0'; p++)
+    {
+      hash = (hash << 5) - hash + *p;
+
+      if (*p == DBUS_TYPE_ARRAY ||
+          *p == DBUS_STRUCT_BEGIN_CHAR ||
+          *p == DBUS_DICT_ENTRY_BEGIN_CHAR)
+        compound = TRUE;
+    }
+
+  if (!compound)
+    return NULL;
+
+  len = p - signature;
+  if (len > DBUS_MAXIMUM_SIGNATURE_LENGTH)
+    return NULL;
+
+#if DBUS_USE_SYNC
+  program = signature_programs[signature_program_find_slot (signature, len,
+                                                            hash)];
+  if (program != NULL)
+    return program;
+#endif
+
+  _DBUS_LOCK (signature_programs);
+
+  /* look again, someone may have got here first */
+  slot = signature_program_find_slot (signature, len, hash);
+  program = signature_programs[slot];
+  if (program != NULL)
+    goto out;
+
+  if (n_signature_programs >= MAX_SIGNATURE_PROGRAMS)
+    goto out;
+
+  _dbus_string_init_const_len (&str, signature, len);
+  if (_dbus_validate_signature_with_reason (&str, 0, len) != DBUS_VALID)
+    goto out;
+
+  if (n_signature_programs == 0 &&
+      !_dbus_register_shutdown_func (signature_programs_shutdown, NULL))
+    goto out;
+
+  program = signature_program_new (signature, len);
+  if (program == NULL)
+    goto out;
+
+#if DBUS_USE_SYNC
+  /* the program must be complete before lock-free readers can see it */
+  __sync_synchronize ();
+#endif
+  signature_programs[slot] = program;
+  n_signature_programs += 1;
+
+ out:
+  _DBUS_UNLOCK (signature_programs);
+
+  return program;
+}
+
+/**
+ * Turns signature compilation off or back on, so the two ways of
+ * reading signatures can be compared. Readers that already have a
+ * program keep using it.
+ *
+ * @param enabled #FALSE to make _dbus_signature_program_get() always
+ *  return #NULL
+ */
+void
+_dbus_signature_program_set_enabled (dbus_bool_t enabled)
+{
+  signature_programs_disabled = !enabled;
+}
+
+/** @} */
@@ -0,0 +1,63 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/* dbus-marshal-program.h  Signatures compiled for the type reader
+ *
+ * Licensed under the Academic Free License version 2.1
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef DBUS_MARSHAL_PROGRAM_H
+#define DBUS_MARSHAL_PROGRAM_H
+
+#include <dbus/dbus-marshal-basic.h>
+
+typedef struct DBusSignatureOp      DBusSignatureOp;
+typedef struct DBusSignatureProgram DBusSignatureProgram;
+
+/**
+ * What the type reader needs to know about one byte of a signature,
+ * worked out once instead of every time the byte is visited.
+ */
+struct DBusSignatureOp
+{
+  unsigned char type;      /**< what _dbus_first_type_in_signature() returns
+                            * here; or the ) or } itself, or nul at the end */
+  unsigned char alignment; /**< alignment of type, or 1 where there is none */
+  unsigned char next;      /**< offset of the complete type after this one,
+                            * or 0 at a closing ) or } and at the end */
+  signed char layout;      /**< index into the program's layouts if this is a
+                            * fixed-layout struct or dict entry, else -1 */
+};
+
+/**
+ * A signature compiled into one #DBusSignatureOp per byte, plus the
+ * #DBusFixedLayout of each struct in it that has one. Programs are
+ * shared by every reader of the same signature in the process, and
+ * never change once built.
+ */
+struct DBusSignatureProgram
+{
+  char *signature;            /**< the signature, nul-terminated */
+  int len;                    /**< length of signature */
+  DBusSignatureOp *ops;       /**< len + 1 ops, the last for the terminating nul */
+  DBusFixedLayout *layouts;   /**< fixed layouts referred to by ops */
+};
+
+const DBusSignatureProgram *_dbus_signature_program_get         (const DBusString *type_str,
+                                                                  int               type_pos);
+void                        _dbus_signature_program_set_enabled (dbus_bool_t       enabled);
+
+#endif /* DBUS_MARSHAL_PROGRAM_H */
@@ -1409,6 +1409,24 @@ run_test_nodes_iteration (void *data)
       _dbus_assert_not_reached ("wrong signature");
     }
 
+  i = 0;
+  while (i < nid->n_nodes)
+    {
+      if (!node_read_value (nid->nodes[i], &reader, i))
+        goto out;
+
+      if (i + 1 == nid->n_nodes)
+        NEXT_EXPECTING_FALSE (&reader);
+      else
+        NEXT_EXPECTING_TRUE (&reader);
+
+      ++i;
+    }
+
+  /* and again with the signature compiled, if it gets a program */
+  data_block_init_reader_writer (nid->block, &reader, NULL);
+  _dbus_type_reader_use_signature_program (&reader);
+
   i = 0;
   while (i < nid->n_nodes)
     {
@@ -2046,9 +2064,158 @@ out:
            TEST_OOM_HANDLING ? "was" : "was not");
 }
 
+/* Walks the types of a signature with two types-only readers, one
+ * with the program and one without, checking they agree at every step
+ */
+static void
+check_types_agree (DBusTypeReader *plain,
+                   DBusTypeReader *compiled)
+{
+  while (TRUE)
+    {
+      const DBusString *plain_str, *compiled_str;
+      int plain_start, compiled_start, plain_len, compiled_len;
+      int t;
+
+      t = _dbus_type_reader_get_current_type (plain);
+      _dbus_assert (t == _dbus_type_reader_get_current_type (compiled));
+
+      if (t == DBUS_TYPE_INVALID)
+        break;
+
+      _dbus_type_reader_get_signature (plain, &plain_str, &plain_start,
+                                       &plain_len);
+      _dbus_type_reader_get_signature (compiled, &compiled_str,
+                                       &compiled_start, &compiled_len);
+      _dbus_assert (plain_start == compiled_start);
+      _dbus_assert (plain_len == compiled_len);
+
+      if (t == DBUS_TYPE_ARRAY)
+        _dbus_assert (_dbus_type_reader_get_element_type (plain) ==
+                      _dbus_type_reader_get_element_type (compiled));
+
+      if (t == DBUS_TYPE_STRUCT || t == DBUS_TYPE_DICT_ENTRY)
+        {
+          DBusFixedLayout plain_scratch, compiled_scratch;
+          const DBusFixedLayout *plain_layout, *compiled_layout;
+
+          plain_layout = _dbus_type_reader_get_fixed_layout (plain,
+                                                             &plain_scratch);
+          compiled_layout = _dbus_type_reader_get_fixed_layout (compiled,
+                                                                &compiled_scratch);
+          _dbus_assert (compiled_layout != &compiled_scratch);
+          _dbus_assert ((plain_layout == NULL) == (compiled_layout == NULL));
+          _dbus_assert (plain_layout == NULL ||
+                        (plain_layout->size == compiled_layout->size &&
+                         plain_layout->n_members == compiled_layout->n_members));
+        }
+
+      if (t == DBUS_TYPE_STRUCT || t == DBUS_TYPE_DICT_ENTRY ||
+          t == DBUS_TYPE_ARRAY)
+        {
+          DBusTypeReader plain_sub, compiled_sub;
+
+          _dbus_type_reader_recurse (plain, &plain_sub);
+          _dbus_type_reader_recurse (compiled, &compiled_sub);
+          check_types_agree (&plain_sub, &compiled_sub);
+        }
+
+      _dbus_assert (_dbus_type_reader_next (plain) ==
+                    _dbus_type_reader_next (compiled));
+      _dbus_assert (plain->type_pos == compiled->type_pos);
+    }
+}
+
+static void
+test_signature_programs (void)
+{
+  static const char * const signatures[] = {
+    "a{sv}",
+    "(oa{sa{sv}})",
+    "sa{sv}as",
+    "a(ii)",
+    "a{ud}(y(yq)t)",
+    "aaa(ydd)aai",
+    "(a(iiu)a{s(bv)}g)",
+    DBUS_HEADER_SIGNATURE
+  };
+  int i;
+
+  for (i = 0; i < (int) _DBUS_N_ELEMENTS (signatures); i++)
+    {
+      DBusString str;
+      DBusTypeReader plain, compiled;
+      const DBusSignatureProgram *program;
+      int pos;
+
+      /* put it somewhere other than the start of the string */
+      if (!_dbus_string_init (&str) ||
+          !_dbus_string_append (&str, "xyz") ||
+          !_dbus_string_append (&str, signatures[i]))
+        _dbus_assert_not_reached ("no memory");
+
+      program = _dbus_signature_program_get (&str, 3);
+      _dbus_assert (program != NULL);
+      _dbus_assert (program == _dbus_signature_program_get (&str, 3));
+      _dbus_assert (strcmp (program->signature, signatures[i]) == 0);
+
+      for (pos = 0; pos <= program->len; pos++)
+        {
+          const DBusSignatureOp *op = &program->ops[pos];
+
+          if (op->next == 0)
+            {
+              _dbus_assert (op->type == _dbus_string_get_byte (&str, 3 + pos));
+            }
+          else
+            {
+              int next = pos;
+
+              _dbus_assert (op->type ==
+                            _dbus_first_type_in_signature (&str, 3 + pos));
+
+              _dbus_type_signature_next (program->signature, &next);
+              _dbus_assert (op->next == next - pos);
+              _dbus_assert (op->alignment ==
+                            _dbus_type_get_alignment (op->type));
+            }
+        }
+
+      _dbus_type_reader_init_types_only (&plain, &str, 3);
+      _dbus_type_reader_init_types_only (&compiled, &str, 3);
+      _dbus_type_reader_use_signature_program (&compiled);
+      _dbus_assert (compiled.program == program);
+
+      check_types_agree (&plain, &compiled);
+
+      _dbus_string_free (&str);
+    }
+
+  {
+    DBusString str;
+
+    /* nothing to gain for these */
+    _dbus_string_init_const (&str, "");
+    _dbus_assert (_dbus_signature_program_get (&str, 0) == NULL);
+    _dbus_string_init_const (&str, "susv");
+    _dbus_assert (_dbus_signature_program_get (&str, 0) == NULL);
+
+    /* and these are not valid */
+    _dbus_string_init_const (&str, "a");
+    _dbus_assert (_dbus_signature_program_get (&str, 0) == NULL);
+    _dbus_string_init_const (&str, "(ii");
+    _dbus_assert (_dbus_signature_program_get (&str, 0) == NULL);
+    _dbus_string_init_const (&str, "a{vs}");
+    _dbus_assert (_dbus_signature_program_get (&str, 0) == NULL);
+  }
+}
+
 dbus_bool_t
 _dbus_marshal_recursive_test (void)
 {
+  /* first, before the node tests fill up the cache */
+  test_signature_programs ();
+
   make_and_run_test_nodes ();
 
   return TRUE;
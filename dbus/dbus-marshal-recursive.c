@@ -27,6 +27,8 @@
 #include "dbus-signature.h"
 #include "dbus-internals.h"
 
+#include <string.h>
+
 /**
  * @addtogroup DBusMarshal
  * @{
@@ -44,6 +46,9 @@ static dbus_bool_t _dbus_type_writer_write_reader_partial (DBusTypeWriter
                                                            int                    start_after_new_len,
                                                            DBusList             **fixups);
 
+static void skip_one_complete_type (const DBusString *type_str,
+                                    int              *type_pos);
+
 /** turn this on to get deluged in TypeReader verbose spam */
 #define RECURSIVE_MARSHAL_READ_TRACE  0
 
@@ -141,6 +146,31 @@ element_type_get_alignment (const DBusString *str,
   return _dbus_type_get_alignment (_dbus_first_type_in_signature (str, pos));
 }
 
+/** the op for the type offset bytes after the reader's position in the
+ * signature; only valid if the reader has a program */
+#define READER_OP(reader, offset) \
+  (&(reader)->program->ops[(reader)->type_pos - (reader)->program_base + (offset)])
+
+static int
+reader_get_type_at (const DBusTypeReader *reader,
+                    int                   offset)
+{
+  if (reader->program != NULL)
+    return READER_OP (reader, offset)->type;
+  else
+    return _dbus_first_type_in_signature (reader->type_str,
+                                          reader->type_pos + offset);
+}
+
+static void
+reader_skip_complete_type (DBusTypeReader *reader)
+{
+  if (reader->program != NULL)
+    reader->type_pos += READER_OP (reader, 0)->next;
+  else
+    skip_one_complete_type (reader->type_str, &reader->type_pos);
+}
+
 static void
 reader_init (DBusTypeReader    *reader,
              int                byte_order,
@@ -155,6 +185,8 @@ reader_init (DBusTypeReader    *reader,
   reader->type_pos = type_pos;
   reader->value_str = value_str;
   reader->value_pos = value_pos;
+  reader->program = NULL;
+  reader->program_base = 0;
 }
 
 static void
@@ -168,6 +200,9 @@ base_reader_recurse (DBusTypeReader *sub,
                parent->type_pos,
                parent->value_str,
                parent->value_pos);
+
+  sub->program = parent->program;
+  sub->program_base = parent->program_base;
 }
 
 static void
@@ -250,8 +285,11 @@ array_reader_recurse (DBusTypeReader *sub,
 
   sub->value_pos += 4; /* for the length */
 
-  alignment = element_type_get_alignment (sub->type_str,
-                                          sub->type_pos);
+  if (sub->program != NULL)
+    alignment = READER_OP (sub, 0)->alignment;
+  else
+    alignment = element_type_get_alignment (sub->type_str,
+                                            sub->type_pos);
 
   sub->value_pos = _DBUS_ALIGN_VALUE (sub->value_pos, alignment);
 
@@ -287,6 +325,7 @@ variant_reader_recurse (DBusTypeReader *sub,
 
   sub->type_str = sub->value_str;
   sub->type_pos = sub->value_pos + 1;
+  sub->program = NULL;
 
   sub->value_pos = sub->type_pos + sig_len + 1;
 
@@ -433,6 +472,33 @@ find_len_of_complete_type (const DBusString *type_str,
   return end - type_pos;
 }
 
+/* With a program, a struct or dict entry can be stepped over without
+ * visiting its members if either there are no values to walk, or the
+ * values have a fixed layout. Returns FALSE if it has to be walked.
+ */
+static dbus_bool_t
+reader_skip_compiled_struct (DBusTypeReader *reader)
+{
+  const DBusSignatureOp *op;
+
+  if (reader->program == NULL)
+    return FALSE;
+
+  op = READER_OP (reader, 0);
+
+  if (!reader->klass->types_only)
+    {
+      if (op->layout < 0)
+        return FALSE;
+
+      reader->value_pos = _DBUS_ALIGN_VALUE (reader->value_pos, 8) +
+        reader->program->layouts[op->layout].size;
+    }
+
+  reader->type_pos += op->next;
+  return TRUE;
+}
+
 static void
 base_reader_next (DBusTypeReader *reader,
                   int             current_type)
@@ -446,6 +512,10 @@ base_reader_next (DBusTypeReader *reader,
       {
         DBusTypeReader sub;
 
+        if (current_type != DBUS_TYPE_VARIANT &&
+            reader_skip_compiled_struct (reader))
+          break;
+
         if (reader->klass->types_only && current_type == DBUS_TYPE_VARIANT)
           ;
         else
@@ -478,12 +548,11 @@ base_reader_next (DBusTypeReader *reader,
       {
         if (!reader->klass->types_only)
           _dbus_marshal_skip_array (reader->value_str,
-                                    _dbus_first_type_in_signature (reader->type_str,
-                                                                   reader->type_pos + 1),
+                                    reader_get_type_at (reader, 1),
                                     reader->byte_order,
                                     &reader->value_pos);
 
-        skip_one_complete_type (reader->type_str, &reader->type_pos);
+        reader_skip_complete_type (reader);
       }
       break;
 
@@ -572,14 +641,23 @@ array_reader_next (DBusTypeReader *reader,
   _dbus_assert (reader->value_pos < end_pos);
   _dbus_assert (reader->value_pos >= reader->u.array.start_pos);
 
-  switch (_dbus_first_type_in_signature (reader->type_str,
-                                         reader->type_pos))
+  switch (reader_get_type_at (reader, 0))
     {
     case DBUS_TYPE_DICT_ENTRY:
     case DBUS_TYPE_STRUCT:
     case DBUS_TYPE_VARIANT:
       {
         DBusTypeReader sub;
+        const DBusSignatureOp *op;
+
+        /* A fixed-layout element can be stepped over in one go */
+        if (reader->program != NULL &&
+            (op = READER_OP (reader, 0))->layout >= 0)
+          {
+            reader->value_pos = _DBUS_ALIGN_VALUE (reader->value_pos, 8) +
+              reader->program->layouts[op->layout].size;
+            break;
+          }
 
         /* Recurse into the struct or variant */
         _dbus_type_reader_recurse (reader, &sub);
@@ -598,8 +676,7 @@ array_reader_next (DBusTypeReader *reader,
     case DBUS_TYPE_ARRAY:
       {
         _dbus_marshal_skip_array (reader->value_str,
-                                  _dbus_first_type_in_signature (reader->type_str,
-                                                           reader->type_pos + 1),
+                                  reader_get_type_at (reader, 1),
                                   reader->byte_order,
                                   &reader->value_pos);
       }
@@ -625,10 +702,7 @@ array_reader_next (DBusTypeReader *reader,
   _dbus_assert (reader->value_pos <= end_pos);
 
   if (reader->value_pos == end_pos)
-    {
-      skip_one_complete_type (reader->type_str,
-                              &reader->type_pos);
-    }
+    reader_skip_complete_type (reader);
 }
 
 static const DBusTypeReaderClass body_reader_class = {
@@ -773,6 +847,29 @@ _dbus_type_reader_init_types_only (DBusTypeReader    *reader,
 #endif
 }
 
+/**
+ * Makes a reader that has just been initialized look its types up in
+ * the compiled form of its signature, from _dbus_signature_program_get(),
+ * rather than decoding the signature again at every step. Readers
+ * recursed from this one inherit the program. If the signature has no
+ * program, nothing changes.
+ *
+ * The signature must run to a nul byte and must not change while the
+ * reader is in use.
+ *
+ * @param reader the reader
+ */
+void
+_dbus_type_reader_use_signature_program (DBusTypeReader *reader)
+{
+  _dbus_assert (reader->klass == &body_reader_class ||
+                reader->klass == &body_types_only_reader_class);
+
+  reader->program = _dbus_signature_program_get (reader->type_str,
+                                                 reader->type_pos);
+  reader->program_base = reader->type_pos;
+}
+
 /**
  * Gets the type of the value the reader is currently pointing to;
  * or for a types-only reader gets the type it's currently pointing to.
@@ -791,8 +888,7 @@ _dbus_type_reader_get_current_type (const DBusTypeReader *reader)
        (* reader->klass->check_finished) (reader)))
     t = DBUS_TYPE_INVALID;
   else
-    t = _dbus_first_type_in_signature (reader->type_str,
-                                       reader->type_pos);
+    t = reader_get_type_at (reader, 0);
 
   _dbus_assert (t != DBUS_STRUCT_END_CHAR);
   _dbus_assert (t != DBUS_STRUCT_BEGIN_CHAR);
@@ -823,8 +919,7 @@ _dbus_type_reader_get_element_type (const DBusTypeReader  *reader)
 
   _dbus_assert (_dbus_type_reader_get_current_type (reader) == DBUS_TYPE_ARRAY);
 
-  element_type = _dbus_first_type_in_signature (reader->type_str,
-                                          reader->type_pos + 1);
+  element_type = reader_get_type_at (reader, 1);
 
   return element_type;
 }
@@ -933,8 +1028,7 @@ _dbus_type_reader_read_fixed_multi (const DBusTypeReader  *reader,
   _dbus_assert (!reader->klass->types_only);
   _dbus_assert (reader->klass == &array_reader_class);
 
-  element_type = _dbus_first_type_in_signature (reader->type_str,
-                                                reader->type_pos);
+  element_type = reader_get_type_at (reader, 0);
 
   _dbus_assert (element_type != DBUS_TYPE_INVALID); /* why we don't use get_current_type() */
   _dbus_assert (dbus_type_is_fixed (element_type));
@@ -972,6 +1066,189 @@ _dbus_type_reader_read_fixed_multi (const DBusTypeReader  *reader,
 #endif
 }
 
+/**
+ * Counts the strings in one value of the type at type_pos, if it is a
+ * string, object path or signature, or a struct or dict entry with only
+ * those as members. These are the array element types that
+ * _dbus_type_reader_read_string_multi() and
+ * _dbus_type_writer_write_string_multi() handle.
+ *
+ * @param type_str string containing the signature
+ * @param type_pos where the type starts
+ * @returns the number of strings, or -1 for any other type
+ */
+int
+_dbus_type_count_string_members (const DBusString *type_str,
+                                 int               type_pos)
+{
+  int t;
+  int n;
+
+  t = _dbus_string_get_byte (type_str, type_pos);
+
+  if (t == DBUS_TYPE_STRING || t == DBUS_TYPE_OBJECT_PATH ||
+      t == DBUS_TYPE_SIGNATURE)
+    return 1;
+
+  if (t != DBUS_STRUCT_BEGIN_CHAR && t != DBUS_DICT_ENTRY_BEGIN_CHAR)
+    return -1;
+
+  n = 0;
+  while (TRUE)
+    {
+      t = _dbus_string_get_byte (type_str, type_pos + 1 + n);
+
+      if (t == DBUS_STRUCT_END_CHAR || t == DBUS_DICT_ENTRY_END_CHAR)
+        return n;
+
+      if (t != DBUS_TYPE_STRING && t != DBUS_TYPE_OBJECT_PATH &&
+          t != DBUS_TYPE_SIGNATURE)
+        return -1;
+
+      n++;
+    }
+}
+
+/**
+ * Finds the strings from the current point in an array to the end of
+ * the array, without copying them. The array's elements must be
+ * strings, object paths or signatures, or structs or dict entries
+ * with only those as members; in the latter case the members of each
+ * element are returned one after another.
+ *
+ * Call first with values and lengths #NULL to count the strings, then
+ * again with arrays that large to fill them in. The strings are
+ * nul-terminated in place, so they are only valid as long as the
+ * value string is not changed.
+ *
+ * @param reader the reader to read from
+ * @param values place to store the start of each string, or #NULL
+ * @param lengths place to store the length of each string, or #NULL
+ * @returns the number of strings, or -1 if the elements are not made
+ *  of strings
+ */
+int
+_dbus_type_reader_read_string_multi (const DBusTypeReader  *reader,
+                                     const char           **values,
+                                     int                   *lengths)
+{
+  const unsigned char *data;
+  const unsigned char *members;
+  dbus_bool_t is_struct;
+  int n_members;
+  int pos, end_pos;
+  int n;
+
+  _dbus_assert (!reader->klass->types_only);
+  _dbus_assert (reader->klass == &array_reader_class);
+
+  n_members = _dbus_type_count_string_members (reader->type_str,
+                                               reader->type_pos);
+  if (n_members < 0)
+    return -1;
+
+  /* the typecode of each string in an element */
+  members = (const unsigned char *) _dbus_string_get_const_data (reader->type_str) +
+    reader->type_pos;
+  is_struct = (*members == DBUS_STRUCT_BEGIN_CHAR ||
+               *members == DBUS_DICT_ENTRY_BEGIN_CHAR);
+  if (is_struct)
+    members++;
+
+  data = (const unsigned char *) _dbus_string_get_const_data (reader->value_str);
+  pos = reader->value_pos;
+  end_pos = reader->u.array.start_pos + array_reader_get_array_len (reader);
+  n = 0;
+
+  while (pos < end_pos)
+    {
+      int i;
+
+      if (is_struct)
+        pos = _DBUS_ALIGN_VALUE (pos, 8);
+
+      for (i = 0; i < n_members; i++)
+        {
+          dbus_uint32_t len;
+
+          if (members[i] == DBUS_TYPE_SIGNATURE)
+            {
+              len = data[pos];
+              pos += 1;
+            }
+          else
+            {
+              pos = _DBUS_ALIGN_VALUE (pos, 4);
+              len = _dbus_unpack_uint32 (reader->byte_order, data + pos);
+              pos += 4;
+            }
+
+          if (values != NULL)
+            values[n] = (const char *) data + pos;
+          if (lengths != NULL)
+            lengths[n] = len;
+
+          n++;
+          pos += len + 1;
+        }
+    }
+
+  _dbus_assert (pos == end_pos);
+
+  return n;
+}
+
+/**
+ * Like _dbus_type_reader_read_fixed_multi(), for arrays of structs or
+ * dict entries that have a #DBusFixedLayout. The first element is at
+ * the returned address and each of the others is stride bytes after
+ * the one before. Does not swap the bytes.
+ *
+ * @param reader the reader to read from
+ * @param value place to return the first element
+ * @param stride place to return the distance between elements
+ * @param n_elements place to return the number of elements
+ * @returns #FALSE if the elements do not have a fixed layout
+ */
+dbus_bool_t
+_dbus_type_reader_read_fixed_struct_multi (const DBusTypeReader  *reader,
+                                           const void           **value,
+                                           int                   *stride,
+                                           int                   *n_elements)
+{
+  DBusFixedLayout scratch;
+  const DBusFixedLayout *layout;
+  int pos, end_pos;
+
+  _dbus_assert (!reader->klass->types_only);
+  _dbus_assert (reader->klass == &array_reader_class);
+
+  layout = _dbus_type_reader_get_fixed_layout (reader, &scratch);
+  if (layout == NULL)
+    return FALSE;
+
+  /* the previous element, if any, did not include its trailing padding */
+  pos = _DBUS_ALIGN_VALUE (reader->value_pos, 8);
+  end_pos = reader->u.array.start_pos + array_reader_get_array_len (reader);
+
+  *stride = layout->stride;
+
+  if (pos >= end_pos)
+    {
+      *value = NULL;
+      *n_elements = 0;
+    }
+  else
+    {
+      *value = _dbus_string_get_const_data_len (reader->value_str, pos,
+                                                end_pos - pos);
+      *n_elements = (end_pos - pos - layout->size) / layout->stride + 1;
+      _dbus_assert ((end_pos - pos - layout->size) % layout->stride == 0);
+    }
+
+  return TRUE;
+}
+
 /**
  * Initialize a new reader pointing to the first type and
  * corresponding value that's a child of the current container. It's
@@ -990,7 +1267,7 @@ _dbus_type_reader_recurse (DBusTypeReader *reader,
 {
   int t;
 
-  t = _dbus_first_type_in_signature (reader->type_str, reader->type_pos);
+  t = reader_get_type_at (reader, 0);
 
   switch (t)
     {
@@ -1126,7 +1403,39 @@ _dbus_type_reader_get_signature (const DBusTypeReader  *reader,
 {
   *str_p = reader->type_str;
   *start_p = reader->type_pos;
-  *len_p = find_len_of_complete_type (reader->type_str, reader->type_pos);
+
+  if (reader->program != NULL)
+    *len_p = READER_OP (reader, 0)->next;
+  else
+    *len_p = find_len_of_complete_type (reader->type_str, reader->type_pos);
+}
+
+/**
+ * Gets the layout of the struct or dict entry the reader is pointing
+ * at, if all its members are fixed-length, as with
+ * _dbus_type_get_fixed_layout(). Readers with a program already know
+ * it; others compute it into scratch.
+ *
+ * @param reader the reader
+ * @param scratch somewhere to compute the layout if necessary
+ * @returns the layout, or #NULL if the struct has no fixed layout
+ */
+const DBusFixedLayout *
+_dbus_type_reader_get_fixed_layout (const DBusTypeReader *reader,
+                                    DBusFixedLayout      *scratch)
+{
+  if (reader->program != NULL)
+    {
+      int layout = READER_OP (reader, 0)->layout;
+
+      return layout >= 0 ? &reader->program->layouts[layout] : NULL;
+    }
+
+  if (_dbus_type_get_fixed_layout (reader->type_str, reader->type_pos,
+                                   scratch))
+    return scratch;
+  else
+    return NULL;
 }
 
 typedef struct
@@ -2391,6 +2700,113 @@ _dbus_type_writer_write_fixed_multi (DBusTypeWriter        *writer,
   return TRUE;
 }
 
+/**
+ * Writes a block of strings into an array whose elements are strings,
+ * object paths or signatures, or structs or dict entries made only of
+ * those; in the latter case the members of each element are taken one
+ * after another from values, so n_values must be a multiple of the
+ * number of members.
+ *
+ * The space for the whole block is worked out first and the value
+ * string lengthened once, instead of once per string.
+ *
+ * @param writer the writer
+ * @param values the strings
+ * @param n_values number of strings
+ * @returns #FALSE if no memory
+ */
+dbus_bool_t
+_dbus_type_writer_write_string_multi (DBusTypeWriter     *writer,
+                                      const char * const *values,
+                                      int                 n_values)
+{
+  const unsigned char *members;
+  unsigned char *data;
+  dbus_bool_t is_struct;
+  int n_members;
+  int start_pos, pos;
+  int i;
+
+  _dbus_assert (writer->container_type == DBUS_TYPE_ARRAY);
+  _dbus_assert (writer->type_pos_is_expectation);
+  _dbus_assert (n_values >= 0);
+
+  n_members = _dbus_type_count_string_members (writer->type_str,
+                                               writer->type_pos);
+  _dbus_assert (n_members > 0);
+  _dbus_assert (n_values % n_members == 0);
+
+  if (!writer->enabled || n_values == 0)
+    return TRUE;
+
+  members = (const unsigned char *) _dbus_string_get_const_data (writer->type_str) +
+    writer->type_pos;
+  is_struct = (*members == DBUS_STRUCT_BEGIN_CHAR ||
+               *members == DBUS_DICT_ENTRY_BEGIN_CHAR);
+  if (is_struct)
+    members++;
+
+  /* the padding is all nul, so only the lengths and the strings
+   * themselves need filling in after inserting the block */
+  start_pos = writer->value_pos;
+  pos = start_pos;
+
+  for (i = 0; i < n_values; i++)
+    {
+      size_t len = strlen (values[i]);
+
+      if (is_struct && i % n_members == 0)
+        pos = _DBUS_ALIGN_VALUE (pos, 8);
+
+      if (members[i % n_members] != DBUS_TYPE_SIGNATURE)
+        pos = _DBUS_ALIGN_VALUE (pos, 4) + 4;
+      else
+        pos += 1;
+
+      /* an array this long could never be sent; treat it like
+       * running out of memory, without overflowing pos */
+      if (pos - start_pos > DBUS_MAXIMUM_ARRAY_LENGTH ||
+          len > (size_t) (DBUS_MAXIMUM_ARRAY_LENGTH - (pos - start_pos)))
+        return FALSE;
+
+      pos += len + 1;
+    }
+
+  if (!_dbus_string_insert_bytes (writer->value_str, start_pos,
+                                  pos - start_pos, '\0'))
+    return FALSE;
+
+  data = (unsigned char *) _dbus_string_get_data (writer->value_str);
+  pos = start_pos;
+
+  for (i = 0; i < n_values; i++)
+    {
+      size_t len = strlen (values[i]);
+
+      if (is_struct && i % n_members == 0)
+        pos = _DBUS_ALIGN_VALUE (pos, 8);
+
+      if (members[i % n_members] != DBUS_TYPE_SIGNATURE)
+        {
+          pos = _DBUS_ALIGN_VALUE (pos, 4);
+          _dbus_pack_uint32 (len, writer->byte_order, data + pos);
+          pos += 4;
+        }
+      else
+        {
+          data[pos] = len;
+          pos += 1;
+        }
+
+      memcpy (data + pos, values[i], len);
+      pos += len + 1;
+    }
+
+  writer->value_pos = pos;
+
+  return TRUE;
+}
+
 static void
 enable_if_after (DBusTypeWriter       *writer,
                  DBusTypeReader       *reader,
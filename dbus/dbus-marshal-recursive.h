@@ -26,6 +26,7 @@
 
 #include <dbus/dbus-protocol.h>
 #include <dbus/dbus-list.h>
+#include <dbus/dbus-marshal-program.h>
 
 typedef struct DBusTypeReader      DBusTypeReader;
 typedef struct DBusTypeWriter      DBusTypeWriter;
@@ -44,12 +45,14 @@ struct DBusTypeReader
                                  * where we don't have another way to tell
                                  */
   dbus_uint32_t array_len_offset : 3; /**< bytes back from start_pos that len ends */
-  const DBusString *type_str;   /**< string containing signature of block */
   int type_pos;                 /**< current position in signature */
+  const DBusString *type_str;   /**< string containing signature of block */
   const DBusString *value_str;  /**< string containing values of block */
   int value_pos;                /**< current position in values */
+  int program_base;             /**< position in type_str of the program's first op */
 
   const DBusTypeReaderClass *klass; /**< the vtable for the reader */
+  const DBusSignatureProgram *program; /**< compiled signature, or #NULL */
   union
   {
     struct {
@@ -105,6 +108,7 @@ void        _dbus_type_reader_init                      (DBusTypeReader        *
 void        _dbus_type_reader_init_types_only           (DBusTypeReader        *reader,
                                                          const DBusString      *type_str,
                                                          int                    type_pos);
+void        _dbus_type_reader_use_signature_program     (DBusTypeReader        *reader);
 int         _dbus_type_reader_get_current_type          (const DBusTypeReader  *reader);
 int         _dbus_type_reader_get_element_type          (const DBusTypeReader  *reader);
 int         _dbus_type_reader_get_value_pos             (const DBusTypeReader  *reader);
@@ -114,6 +118,15 @@ int         _dbus_type_reader_get_array_length          (const DBusTypeReader  *
 void        _dbus_type_reader_read_fixed_multi          (const DBusTypeReader  *reader,
                                                          void                  *value,
                                                          int                   *n_elements);
+int         _dbus_type_count_string_members             (const DBusString      *type_str,
+                                                         int                    type_pos);
+int         _dbus_type_reader_read_string_multi         (const DBusTypeReader  *reader,
+                                                         const char           **values,
+                                                         int                   *lengths);
+dbus_bool_t _dbus_type_reader_read_fixed_struct_multi   (const DBusTypeReader  *reader,
+                                                         const void           **value,
+                                                         int                   *stride,
+                                                         int                   *n_elements);
 void        _dbus_type_reader_read_raw                  (const DBusTypeReader  *reader,
                                                          const unsigned char  **value_location);
 void        _dbus_type_reader_recurse                   (DBusTypeReader        *reader,
@@ -124,6 +137,8 @@ void        _dbus_type_reader_get_signature             (const DBusTypeReader  *
                                                          const DBusString     **str_p,
                                                          int                   *start_p,
                                                          int                   *len_p);
+const DBusFixedLayout *_dbus_type_reader_get_fixed_layout (const DBusTypeReader *reader,
+                                                           DBusFixedLayout      *scratch);
 dbus_bool_t _dbus_type_reader_set_basic                 (DBusTypeReader        *reader,
                                                          const void            *value,
                                                          const DBusTypeReader  *realign_root);
@@ -163,6 +178,9 @@ dbus_bool_t _dbus_type_writer_write_fixed_multi    (DBusTypeWriter        *write
                                                     int                    element_type,
                                                     const void            *value,
                                                     int                    n_elements);
+dbus_bool_t _dbus_type_writer_write_string_multi   (DBusTypeWriter        *writer,
+                                                    const char * const    *values,
+                                                    int                    n_values);
 dbus_bool_t _dbus_type_writer_recurse              (DBusTypeWriter        *writer,
                                                     int                    container_type,
                                                     const DBusString      *contained_type,
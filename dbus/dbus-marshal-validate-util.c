@@ -29,9 +29,12 @@
 #include "dbus-internals.h"
 #include "dbus-marshal-validate.h"
 #include "dbus-marshal-recursive.h"
+#include "dbus-marshal-basic.h"
+#include "dbus-marshal-byteswap.h"
 
 #include "dbus-test.h"
 #include <stdio.h>
+#include <string.h>
 
 typedef struct
 {
@@ -102,6 +105,219 @@ static const ValidityTest signature_tests[] = {
   /* { "a{isi}", DBUS_INVALID_DICT_ENTRY_HAS_TOO_MANY_FIELDS }, */
 };
 
+/* Marshals an array of n_elements structs with the given member
+ * typecodes into an empty body, every member a different value.
+ */
+static void
+build_struct_array (DBusString *body,
+                    const char *members,
+                    int         n_elements,
+                    int         byte_order)
+{
+  dbus_uint32_t len = 0;
+  int i, j;
+
+  _dbus_assert (_dbus_string_get_length (body) == 0);
+
+  if (!_dbus_marshal_write_basic (body, 0, DBUS_TYPE_UINT32, &len,
+                                  byte_order, NULL) ||
+      !_dbus_string_align_length (body, 8))
+    _dbus_assert_not_reached ("no memory");
+
+  for (i = 0; i < n_elements; i++)
+    {
+      if (!_dbus_string_align_length (body, 8))
+        _dbus_assert_not_reached ("no memory");
+
+      for (j = 0; members[j] != '\0'; j++)
+        {
+          DBusBasicValue v;
+          int k;
+
+          for (k = 0; k < 8; k++)
+            v.bytes[k] = (i * 16 + j * 8 + k) | 0x80;
+
+          if (members[j] == DBUS_TYPE_BOOLEAN)
+            v.bool_val = (i + j) % 2;
+
+          if (!_dbus_marshal_write_basic (body, _dbus_string_get_length (body),
+                                          members[j], &v, byte_order, NULL))
+            _dbus_assert_not_reached ("no memory");
+        }
+    }
+
+  _dbus_marshal_set_uint32 (body, 0, _dbus_string_get_length (body) - 8,
+                            byte_order);
+}
+
+static DBusValidity
+validate_struct_array (const char *members,
+                       DBusString *body,
+                       int         byte_order)
+{
+  DBusString signature;
+  char buf[DBUS_FIXED_LAYOUT_MAX_MEMBERS + 4];
+
+  _dbus_assert (strlen (members) <= DBUS_FIXED_LAYOUT_MAX_MEMBERS);
+  sprintf (buf, "a(%s)", members);
+  _dbus_string_init_const (&signature, buf);
+
+  return _dbus_validate_body_with_reason (&signature, 0, byte_order, NULL,
+                                          body, 0,
+                                          _dbus_string_get_length (body));
+}
+
+static void
+test_fixed_layout (void)
+{
+  static const struct
+  {
+    const char *signature;
+    int size;
+    int stride;
+    int n_members;
+    dbus_bool_t has_padding;
+    dbus_bool_t has_boolean;
+  } layouts[] = {
+    { "(dddd)", 32, 32, 4, FALSE, FALSE },
+    { "(iiu)", 12, 16, 3, TRUE, FALSE },
+    { "(yyy)", 3, 8, 3, TRUE, FALSE },
+    { "(ib)", 8, 8, 2, FALSE, TRUE },
+    { "{ud}", 16, 16, 2, TRUE, FALSE },
+    { "(y(yq)t)", 24, 24, 4, TRUE, FALSE },
+    { "(si)", -1 },
+    { "(ih)", -1 },
+    { "(iai)", -1 },
+    { "(yyyyyyyyyyyyyyyyy)", -1 },
+    { "i", -1 }
+  };
+  static const char * const members[] = { "dddd", "iiu", "yyy", "ib", "y", "yqdbx" };
+  static const int byte_orders[] = { DBUS_LITTLE_ENDIAN, DBUS_BIG_ENDIAN };
+  DBusString str;
+  DBusFixedLayout layout;
+  unsigned int i, o;
+
+  for (i = 0; i < _DBUS_N_ELEMENTS (layouts); i++)
+    {
+      dbus_bool_t fixed;
+
+      _dbus_string_init_const (&str, layouts[i].signature);
+      fixed = _dbus_type_get_fixed_layout (&str, 0, &layout);
+
+      if (fixed != (layouts[i].size >= 0) ||
+          (fixed &&
+           (layout.size != layouts[i].size ||
+            layout.stride != layouts[i].stride ||
+            layout.n_members != layouts[i].n_members ||
+            layout.has_padding != layouts[i].has_padding ||
+            layout.has_boolean != layouts[i].has_boolean)))
+        {
+          _dbus_warn ("wrong fixed layout for %s\n", layouts[i].signature);
+          _dbus_assert_not_reached ("test failed");
+        }
+    }
+
+  _dbus_string_init_const (&str, "(y(yq)t)");
+  if (!_dbus_type_get_fixed_layout (&str, 0, &layout) ||
+      layout.members[1].offset != 8 || layout.members[2].offset != 10 ||
+      layout.members[3].offset != 16 ||
+      layout.members[3].type != DBUS_TYPE_UINT64)
+    _dbus_assert_not_reached ("wrong offsets in nested struct");
+
+  if (!_dbus_string_init (&str))
+    _dbus_assert_not_reached ("no memory");
+
+  for (o = 0; o < _DBUS_N_ELEMENTS (byte_orders); o++)
+    {
+      int byte_order = byte_orders[o];
+
+      for (i = 0; i < _DBUS_N_ELEMENTS (members); i++)
+        {
+          DBusValidity v;
+          int n;
+
+          for (n = 1; n <= 5; n += 4)
+            {
+              _dbus_string_set_length (&str, 0);
+              build_struct_array (&str, members[i], n, byte_order);
+
+              v = validate_struct_array (members[i], &str, byte_order);
+              if (v != DBUS_VALID)
+                {
+                  _dbus_warn ("a(%s) of %d elements invalid: %s\n", members[i],
+                              n, _dbus_validity_to_error_message (v));
+                  _dbus_assert_not_reached ("test failed");
+                }
+
+              /* one element too many or too few bytes */
+              _dbus_marshal_set_uint32 (&str, 0, _dbus_string_get_length (&str) - 9,
+                                        byte_order);
+              if (validate_struct_array (members[i], &str, byte_order) == DBUS_VALID)
+                _dbus_assert_not_reached ("short array validated");
+
+              if (!_dbus_string_append_byte (&str, '\0'))
+                _dbus_assert_not_reached ("no memory");
+              _dbus_marshal_set_uint32 (&str, 0, _dbus_string_get_length (&str) - 8,
+                                        byte_order);
+              if (validate_struct_array (members[i], &str, byte_order) == DBUS_VALID)
+                _dbus_assert_not_reached ("long array validated");
+            }
+        }
+
+      /* padding within and between elements, and booleans, are checked */
+      _dbus_string_set_length (&str, 0);
+      build_struct_array (&str, "yyy", 3, byte_order);
+      _dbus_string_set_byte (&str, 8 + 8 + 3, 1);
+      if (validate_struct_array ("yyy", &str, byte_order) !=
+          DBUS_INVALID_ALIGNMENT_PADDING_NOT_NUL)
+        _dbus_assert_not_reached ("padding between elements not checked");
+
+      _dbus_string_set_length (&str, 0);
+      build_struct_array (&str, "yqdbx", 3, byte_order);
+      _dbus_string_set_byte (&str, 8 + 32 + 1, 1);
+      if (validate_struct_array ("yqdbx", &str, byte_order) !=
+          DBUS_INVALID_ALIGNMENT_PADDING_NOT_NUL)
+        _dbus_assert_not_reached ("padding within elements not checked");
+
+      _dbus_string_set_length (&str, 0);
+      build_struct_array (&str, "yqdbx", 3, byte_order);
+      _dbus_string_set_byte (&str, 8 + 64 + 16 + (byte_order == DBUS_LITTLE_ENDIAN ? 1 : 2), 1);
+      if (validate_struct_array ("yqdbx", &str, byte_order) !=
+          DBUS_INVALID_BOOLEAN_NOT_ZERO_OR_ONE)
+        _dbus_assert_not_reached ("boolean not checked");
+    }
+
+  /* byteswapping in bulk gives what marshaling in the other order does */
+  for (i = 0; i < _DBUS_N_ELEMENTS (members); i++)
+    {
+      DBusString signature;
+      DBusString other;
+      char buf[DBUS_FIXED_LAYOUT_MAX_MEMBERS + 4];
+
+      sprintf (buf, "a(%s)", members[i]);
+      _dbus_string_init_const (&signature, buf);
+
+      if (!_dbus_string_init (&other))
+        _dbus_assert_not_reached ("no memory");
+
+      _dbus_string_set_length (&str, 0);
+      build_struct_array (&str, members[i], 7, DBUS_LITTLE_ENDIAN);
+      build_struct_array (&other, members[i], 7, DBUS_BIG_ENDIAN);
+
+      _dbus_marshal_byteswap (&signature, 0, DBUS_LITTLE_ENDIAN,
+                              DBUS_BIG_ENDIAN, &str, 0);
+      if (!_dbus_string_equal (&str, &other))
+        {
+          _dbus_warn ("a(%s) byteswapped wrongly\n", members[i]);
+          _dbus_assert_not_reached ("test failed");
+        }
+
+      _dbus_string_free (&other);
+    }
+
+  _dbus_string_free (&str);
+}
+
 dbus_bool_t
 _dbus_marshal_validate_test (void)
 {
@@ -480,6 +696,8 @@ _dbus_marshal_validate_test (void)
   if (_dbus_validate_signature (&str, 0, 4))
     _dbus_assert_not_reached ("validated too-long signature");
 
+  test_fixed_layout ();
+
   /* Validate string exceeding max name length */
   if (!_dbus_string_init (&str))
     _dbus_assert_not_reached ("no memory");
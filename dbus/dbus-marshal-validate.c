@@ -291,6 +291,65 @@ out:
   return result;
 }
 
+/* Checks an array of fixed-layout structs starting at the 8-aligned p:
+ * the length must be a whole number of elements, padding must be nul and
+ * booleans 0 or 1. Returns FALSE if anything is wrong, and leaves it to
+ * the element-by-element path to work out exactly what.
+ */
+static dbus_bool_t
+validate_fixed_layout_array (const DBusFixedLayout *layout,
+                             int                    byte_order,
+                             const unsigned char   *p,
+                             dbus_uint32_t          len)
+{
+  const unsigned char *last;
+
+  if (len < (dbus_uint32_t) layout->size ||
+      (len - layout->size) % layout->stride != 0)
+    return FALSE;
+
+  if (!layout->has_padding && !layout->has_boolean)
+    return TRUE;
+
+  last = p + len - layout->size;
+
+  while (TRUE)
+    {
+      int pos = 0;
+      int i;
+
+      for (i = 0; i < layout->n_members; i++)
+        {
+          for (; pos < layout->members[i].offset; pos++)
+            {
+              if (p[pos] != '\0')
+                return FALSE;
+            }
+
+          if (layout->members[i].type == DBUS_TYPE_BOOLEAN)
+            {
+              dbus_uint32_t v = _dbus_unpack_uint32 (byte_order, p + pos);
+
+              if (!(v == 0 || v == 1))
+                return FALSE;
+            }
+
+          pos += _dbus_type_get_alignment (layout->members[i].type);
+        }
+
+      if (p == last)
+        return TRUE;
+
+      for (; pos < layout->stride; pos++)
+        {
+          if (p[pos] != '\0')
+            return FALSE;
+        }
+
+      p += layout->stride;
+    }
+}
+
 /* note: this function is also used to validate the header's values,
  * since the header is a valid body with a particular signature.
  */
@@ -441,6 +500,8 @@ validate_body_helper (DBusTypeReader       *reader,
               {
                 DBusTypeReader sub;
                 DBusValidity validity;
+                DBusFixedLayout scratch;
+                const DBusFixedLayout *layout;
                 const unsigned char *array_end;
                 int array_elem_type;
 
@@ -487,6 +548,20 @@ validate_body_helper (DBusTypeReader       *reader,
                       }
                   }
 
+                /* likewise for structs of fixed-size elements, as long as
+                 * the whole array checks out; if it doesn't, the slow path
+                 * finds the first problem
+                 */
+                else if ((array_elem_type == DBUS_TYPE_STRUCT ||
+                          array_elem_type == DBUS_TYPE_DICT_ENTRY) &&
+                         (layout = _dbus_type_reader_get_fixed_layout (&sub,
+                                                                       &scratch)) != NULL &&
+                         validate_fixed_layout_array (layout, byte_order,
+                                                      p, claimed_len))
+                  {
+                    p = array_end;
+                  }
+
                 else
                   {
                     while (p < array_end)
@@ -724,6 +799,7 @@ _dbus_validate_body_with_reason (const DBusString *expected_signature,
 
   _dbus_type_reader_init_types_only (&reader,
                                      expected_signature, expected_signature_start);
+  _dbus_type_reader_use_signature_program (&reader);
 
   p = _dbus_string_get_const_data_len (value_str, value_pos, len);
   end = p + len;
@@ -746,24 +822,58 @@ _dbus_validate_body_with_reason (const DBusString *expected_signature,
     }
 }
 
+/* Character classes for the name validators, so that each character
+ * costs one table lookup instead of a chain of range comparisons.
+ */
+#define NAME_CHAR_INITIAL     (1 << 0) /**< may start a name */
+#define NAME_CHAR_LATER       (1 << 1) /**< may follow the first character of a name */
+#define NAME_CHAR_BUS_INITIAL (1 << 2) /**< may start a bus name element */
+#define NAME_CHAR_BUS_LATER   (1 << 3) /**< may follow the first character of a bus name element */
+
+#define NAME_CHAR_ALPHA (NAME_CHAR_INITIAL | NAME_CHAR_LATER | \
+                         NAME_CHAR_BUS_INITIAL | NAME_CHAR_BUS_LATER)
+#define NAME_CHAR_DIGIT (NAME_CHAR_LATER | NAME_CHAR_BUS_LATER)
+#define NAME_CHAR_DASH  (NAME_CHAR_BUS_INITIAL | NAME_CHAR_BUS_LATER)
+
+#define A NAME_CHAR_ALPHA
+#define D NAME_CHAR_DIGIT
+#define H NAME_CHAR_DASH
+static const unsigned char name_char_classes[256] =
+{
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  /* 0x00 */
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  /* 0x10 */
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, H, 0, 0,  /* 0x20 */
+  D, D, D, D, D, D, D, D, D, D, 0, 0, 0, 0, 0, 0,  /* 0x30 */
+  0, A, A, A, A, A, A, A, A, A, A, A, A, A, A, A,  /* 0x40 */
+  A, A, A, A, A, A, A, A, A, A, A, 0, 0, 0, 0, A,  /* 0x50 */
+  0, A, A, A, A, A, A, A, A, A, A, A, A, A, A, A,  /* 0x60 */
+  A, A, A, A, A, A, A, A, A, A, A, 0, 0, 0, 0, 0,  /* 0x70 */
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  /* 0x80 */
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  /* 0x90 */
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  /* 0xa0 */
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  /* 0xb0 */
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  /* 0xc0 */
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  /* 0xd0 */
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  /* 0xe0 */
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0   /* 0xf0 */
+};
+#undef A
+#undef D
+#undef H
+
 /**
  * Determine wether the given character is valid as the first character
  * in a name.
  */
 #define VALID_INITIAL_NAME_CHARACTER(c)         \
-  ( ((c) >= 'A' && (c) <= 'Z') ||               \
-    ((c) >= 'a' && (c) <= 'z') ||               \
-    ((c) == '_') )
+  (name_char_classes[(unsigned char) (c)] & NAME_CHAR_INITIAL)
 
 /**
  * Determine wether the given character is valid as a second or later
  * character in a name
  */
 #define VALID_NAME_CHARACTER(c)                 \
-  ( ((c) >= '0' && (c) <= '9') ||               \
-    ((c) >= 'A' && (c) <= 'Z') ||               \
-    ((c) >= 'a' && (c) <= 'z') ||               \
-    ((c) == '_') )
+  (name_char_classes[(unsigned char) (c)] & NAME_CHAR_LATER)
 
 /**
  * Checks that the given range of the string is a valid object path
@@ -899,6 +1009,7 @@ _dbus_validity_to_error_message (DBusValidity validity)
     case DBUS_INVALID_DICT_ENTRY_NOT_INSIDE_ARRAY:                 return "Dict entry not inside array";
     case DBUS_INVALID_DICT_KEY_MUST_BE_BASIC_TYPE:                 return "Dict key must be basic type";
     case DBUS_INVALID_NESTED_TOO_DEEPLY:                           return "Variants cannot be used to create a hugely recursive tree of values";
+    case DBUS_INVALID_BAD_BODY_MEMFD:                              return "Message body memfd missing, not sealed or of the wrong size";
     default:
       return "Invalid";
     }
@@ -1068,19 +1179,14 @@ _dbus_validate_error_name (const DBusString  *str,
  * in a bus name.
  */
 #define VALID_INITIAL_BUS_NAME_CHARACTER(c)         \
-  ( ((c) >= 'A' && (c) <= 'Z') ||               \
-    ((c) >= 'a' && (c) <= 'z') ||               \
-    ((c) == '_') || ((c) == '-'))
+  (name_char_classes[(unsigned char) (c)] & NAME_CHAR_BUS_INITIAL)
 
 /**
  * Determine wether the given character is valid as a second or later
  * character in a bus name
  */
 #define VALID_BUS_NAME_CHARACTER(c)                 \
-  ( ((c) >= '0' && (c) <= '9') ||               \
-    ((c) >= 'A' && (c) <= 'Z') ||               \
-    ((c) >= 'a' && (c) <= 'z') ||               \
-    ((c) == '_') || ((c) == '-'))
+  (name_char_classes[(unsigned char) (c)] & NAME_CHAR_BUS_LATER)
 
 static dbus_bool_t
 _dbus_validate_bus_name_full (const DBusString  *str,
@@ -36,7 +36,8 @@
 typedef enum
 {
   DBUS_VALIDATION_MODE_WE_TRUST_THIS_DATA_ABSOLUTELY,
-  DBUS_VALIDATION_MODE_DATA_IS_UNTRUSTED
+  DBUS_VALIDATION_MODE_DATA_IS_UNTRUSTED,
+  DBUS_VALIDATION_MODE_DEFER_HEADER_NAMES /**< as untrusted, but names in header fields are checked when read */
 } DBusValidationMode;
 
 /**
@@ -113,6 +114,7 @@ typedef enum
   DBUS_INVALID_DICT_KEY_MUST_BE_BASIC_TYPE = 55,
   DBUS_INVALID_MISSING_UNIX_FDS = 56,
   DBUS_INVALID_NESTED_TOO_DEEPLY = 57,
+  DBUS_INVALID_BAD_BODY_MEMFD = 58,
   DBUS_VALIDITY_LAST
 } DBusValidity;
 
@@ -30,6 +30,11 @@
 
 DBUS_BEGIN_DECLS
 
+#if defined(HAVE_UNIX_FD_PASSING) && defined(HAVE_MEMFD_CREATE)
+/** Large message bodies can be passed in sealed memfds */
+#define DBUS_HAVE_MEMFD_BODIES 1
+#endif
+
 #ifdef DBUS_ENABLE_VERBOSE_MODE
 void _dbus_message_trace_ref (DBusMessage *message,
                               int          old_refcount,
@@ -53,6 +58,9 @@ void _dbus_message_get_network_data  (DBusMessage       *message,
 void _dbus_message_get_unix_fds      (DBusMessage *message,
                                       const int **fds,
                                       unsigned *n_fds);
+#ifdef DBUS_HAVE_MEMFD_BODIES
+int  _dbus_message_get_body_memfd    (DBusMessage *message);
+#endif
 
 void        _dbus_message_lock                  (DBusMessage  *message);
 void        _dbus_message_unlock                (DBusMessage  *message);
@@ -62,6 +70,7 @@ void        _dbus_message_add_counter_link      (DBusMessage  *message,
                                                  DBusList     *link);
 void        _dbus_message_remove_counter        (DBusMessage  *message,
                                                  DBusCounter  *counter);
+DBusValidity _dbus_message_check_deferred_fields (DBusMessage *message);
 
 DBusMessageLoader* _dbus_message_loader_new                   (void);
 DBusMessageLoader* _dbus_message_loader_ref                   (DBusMessageLoader  *loader);
@@ -88,6 +97,8 @@ void               _dbus_message_loader_putback_message_link  (DBusMessageLoader
                                                                DBusList           *link);
 
 dbus_bool_t        _dbus_message_loader_get_is_corrupted      (DBusMessageLoader  *loader);
+void               _dbus_message_loader_set_corrupted         (DBusMessageLoader  *loader,
+                                                               DBusValidity        reason);
 DBusValidity       _dbus_message_loader_get_corruption_reason (DBusMessageLoader  *loader);
 
 void               _dbus_message_loader_set_max_message_size  (DBusMessageLoader  *loader,
@@ -98,6 +109,17 @@ void               _dbus_message_loader_set_max_message_unix_fds(DBusMessageLoad
                                                                  long                n);
 long               _dbus_message_loader_get_max_message_unix_fds(DBusMessageLoader  *loader);
 
+void               _dbus_message_loader_set_trust_bodies      (DBusMessageLoader  *loader,
+                                                               dbus_bool_t         trust);
+dbus_bool_t        _dbus_message_loader_get_trust_bodies      (DBusMessageLoader  *loader);
+
+#ifdef DBUS_HAVE_MEMFD_BODIES
+void               _dbus_message_loader_set_memfd_bodies      (DBusMessageLoader  *loader,
+                                                               dbus_bool_t         enabled);
+void               _dbus_message_loader_set_spill_bodies      (DBusMessageLoader  *loader,
+                                                               dbus_bool_t         spill);
+#endif
+
 typedef struct DBusInitialFDs DBusInitialFDs;
 DBusInitialFDs *_dbus_check_fdleaks_enter (void);
 void            _dbus_check_fdleaks_leave (DBusInitialFDs *fds);
@@ -74,6 +74,16 @@ struct DBusMessageLoader
 
   unsigned int buffer_outstanding : 1; /**< Someone is using the buffer to read */
 
+  unsigned int trust_bodies : 1; /**< Message bodies were validated by the sender and are not checked again */
+
+#ifdef DBUS_HAVE_MEMFD_BODIES
+  unsigned int memfd_bodies : 1; /**< The peer may send bodies in memfds */
+  unsigned int spill_bodies : 1; /**< Large bodies are moved into a memfd as they arrive */
+
+  int spill_fd;        /**< memfd holding the body of the message being read, or -1 */
+  int spill_len;       /**< How much of that body is in the memfd so far */
+#endif
+
 #ifdef HAVE_UNIX_FD_PASSING
   unsigned int unix_fds_outstanding : 1; /**< Someone is using the unix fd array to read */
 
@@ -102,7 +112,11 @@ struct DBusMessage
 
   DBusString body;   /**< Body network data. */
 
+  DBusMessage *shared; /**< Message whose body and unix fds this one borrows until it is modified, or #NULL */
+  DBusMessage *retired; /**< Bodies that copies were still reading when this message was modified, or #NULL */
+
   unsigned int locked : 1; /**< Message being sent, no modifications allowed. */
+  unsigned int body_borrowed : 1; /**< Copies are reading the body and unix fds of this unlocked message */
 
 #ifndef DBUS_DISABLE_CHECKS
   unsigned int in_cache : 1; /**< Has been "freed" since it's in the cache (this is a debug feature) */
@@ -129,6 +143,11 @@ struct DBusMessage
 
   long unix_fd_counter_delta; /**< Size we incremented the unix fd counter by */
 #endif
+
+#ifdef DBUS_HAVE_MEMFD_BODIES
+  int body_memfd; /**< Sealed memfd the body was received in, or -1 */
+  const void *body_map; /**< Read-only mapping of body_memfd that body points into, or #NULL */
+#endif
 };
 
 dbus_bool_t _dbus_message_iter_get_args_valist (DBusMessageIter *iter,
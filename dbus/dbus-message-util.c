@@ -31,6 +31,10 @@
 #ifdef HAVE_UNIX_FD_PASSING
 #include "dbus-sysdeps-unix.h"
 #endif
+#ifdef DBUS_HAVE_MEMFD_BODIES
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
 
 #ifdef __linux__
 /* Necessary for the Linux-specific fd leak checking code only */
@@ -1003,6 +1007,1172 @@ verify_test_message (DBusMessage *message)
     _dbus_assert_not_reached ("Didn't reach end of arguments");
 }
 
+static void
+append_string_dict_entry (DBusMessageIter *dict,
+                          const char      *key,
+                          const char      *value)
+{
+  DBusMessageIter entry;
+
+  if (!dbus_message_iter_open_container (dict, DBUS_TYPE_DICT_ENTRY, NULL,
+                                         &entry) ||
+      !dbus_message_iter_append_basic (&entry, DBUS_TYPE_STRING, &key) ||
+      !dbus_message_iter_append_basic (&entry, DBUS_TYPE_STRING, &value) ||
+      !dbus_message_iter_close_container (dict, &entry))
+    _dbus_assert_not_reached ("no memory");
+}
+
+static DBusMessage *
+bulk_read_test_message (void)
+{
+  static const char * const strings[] = { "Foo", "bar", "", "woo woo woo woo" };
+  static const char * const signatures[] = { "", "a{sv}", "(iiu)" };
+  DBusMessage *message;
+  DBusMessageIter iter, array, element;
+  const char *v_STRING;
+  dbus_int32_t v_INT32;
+  dbus_uint32_t v_UINT32;
+  unsigned char v_BYTE;
+  unsigned int i;
+
+  message = dbus_message_new_method_call ("org.freedesktop.DBus.TestService",
+                                          "/org/freedesktop/TestPath",
+                                          "Foo.TestInterface",
+                                          "BulkRead");
+  if (message == NULL)
+    _dbus_assert_not_reached ("no memory");
+
+  dbus_message_iter_init_append (message, &iter);
+
+  /* as */
+  if (!dbus_message_iter_open_container (&iter, DBUS_TYPE_ARRAY, "s", &array))
+    _dbus_assert_not_reached ("no memory");
+  for (i = 0; i < _DBUS_N_ELEMENTS (strings); i++)
+    {
+      if (!dbus_message_iter_append_basic (&array, DBUS_TYPE_STRING, &strings[i]))
+        _dbus_assert_not_reached ("no memory");
+    }
+  if (!dbus_message_iter_close_container (&iter, &array))
+    _dbus_assert_not_reached ("no memory");
+
+  /* a{ss} */
+  if (!dbus_message_iter_open_container (&iter, DBUS_TYPE_ARRAY, "{ss}", &array))
+    _dbus_assert_not_reached ("no memory");
+  append_string_dict_entry (&array, "a", "1");
+  append_string_dict_entry (&array, "bc", "");
+  append_string_dict_entry (&array, "", "456");
+  if (!dbus_message_iter_close_container (&iter, &array))
+    _dbus_assert_not_reached ("no memory");
+
+  /* ag */
+  if (!dbus_message_iter_open_container (&iter, DBUS_TYPE_ARRAY, "g", &array))
+    _dbus_assert_not_reached ("no memory");
+  for (i = 0; i < _DBUS_N_ELEMENTS (signatures); i++)
+    {
+      if (!dbus_message_iter_append_basic (&array, DBUS_TYPE_SIGNATURE,
+                                           &signatures[i]))
+        _dbus_assert_not_reached ("no memory");
+    }
+  if (!dbus_message_iter_close_container (&iter, &array))
+    _dbus_assert_not_reached ("no memory");
+
+  /* a(iiu) */
+  if (!dbus_message_iter_open_container (&iter, DBUS_TYPE_ARRAY, "(iiu)", &array))
+    _dbus_assert_not_reached ("no memory");
+  for (i = 0; i < 5; i++)
+    {
+      v_INT32 = -(dbus_int32_t) i;
+      v_UINT32 = 0x10000 * i;
+
+      if (!dbus_message_iter_open_container (&array, DBUS_TYPE_STRUCT, NULL,
+                                             &element) ||
+          !dbus_message_iter_append_basic (&element, DBUS_TYPE_INT32, &v_INT32) ||
+          !dbus_message_iter_append_basic (&element, DBUS_TYPE_INT32, &v_INT32) ||
+          !dbus_message_iter_append_basic (&element, DBUS_TYPE_UINT32, &v_UINT32) ||
+          !dbus_message_iter_close_container (&array, &element))
+        _dbus_assert_not_reached ("no memory");
+    }
+  if (!dbus_message_iter_close_container (&iter, &array))
+    _dbus_assert_not_reached ("no memory");
+
+  /* a(ys), whose elements do not have a fixed layout */
+  if (!dbus_message_iter_open_container (&iter, DBUS_TYPE_ARRAY, "(ys)", &array))
+    _dbus_assert_not_reached ("no memory");
+  v_BYTE = 42;
+  v_STRING = "not fixed";
+  if (!dbus_message_iter_open_container (&array, DBUS_TYPE_STRUCT, NULL,
+                                         &element) ||
+      !dbus_message_iter_append_basic (&element, DBUS_TYPE_BYTE, &v_BYTE) ||
+      !dbus_message_iter_append_basic (&element, DBUS_TYPE_STRING, &v_STRING) ||
+      !dbus_message_iter_close_container (&array, &element))
+    _dbus_assert_not_reached ("no memory");
+  if (!dbus_message_iter_close_container (&iter, &array))
+    _dbus_assert_not_reached ("no memory");
+
+  /* empty ao */
+  if (!dbus_message_iter_open_container (&iter, DBUS_TYPE_ARRAY, "o", &array) ||
+      !dbus_message_iter_close_container (&iter, &array))
+    _dbus_assert_not_reached ("no memory");
+
+  return message;
+}
+
+static void
+check_string_array (DBusMessageIter    *array,
+                    const char * const *expected,
+                    int                 n_expected)
+{
+  const char **values;
+  int *lengths;
+  int n, i;
+
+  if (!dbus_message_iter_get_string_array (array, &values, &lengths, &n))
+    _dbus_assert_not_reached ("no memory");
+
+  _dbus_assert (n == n_expected);
+  _dbus_assert ((values == NULL) == (n == 0));
+
+  for (i = 0; i < n; i++)
+    {
+      _dbus_assert (lengths[i] == (int) strlen (expected[i]));
+      _dbus_assert (strcmp (values[i], expected[i]) == 0);
+    }
+
+  dbus_free (values);
+}
+
+static void
+check_bulk_readers (DBusMessage *message)
+{
+  static const char * const strings[] = { "Foo", "bar", "", "woo woo woo woo" };
+  static const char * const dict[] = { "a", "1", "bc", "", "", "456" };
+  static const char * const signatures[] = { "", "a{sv}", "(iiu)" };
+  DBusMessageIter iter, array;
+  const unsigned char *elements;
+  const void *value;
+  int stride, n, i;
+
+  dbus_message_iter_init (message, &iter);
+
+  /* as, all of it and then from the third element */
+  dbus_message_iter_recurse (&iter, &array);
+  check_string_array (&array, strings, _DBUS_N_ELEMENTS (strings));
+  dbus_message_iter_next (&array);
+  dbus_message_iter_next (&array);
+  check_string_array (&array, strings + 2, _DBUS_N_ELEMENTS (strings) - 2);
+  dbus_message_iter_next (&iter);
+
+  /* a{ss}, flattened, and after the first entry */
+  dbus_message_iter_recurse (&iter, &array);
+  check_string_array (&array, dict, _DBUS_N_ELEMENTS (dict));
+  dbus_message_iter_next (&array);
+  check_string_array (&array, dict + 2, _DBUS_N_ELEMENTS (dict) - 2);
+  dbus_message_iter_next (&iter);
+
+  /* ag */
+  dbus_message_iter_recurse (&iter, &array);
+  check_string_array (&array, signatures, _DBUS_N_ELEMENTS (signatures));
+  dbus_message_iter_next (&iter);
+
+  /* a(iiu), all of it and then from the second element */
+  dbus_message_iter_recurse (&iter, &array);
+  if (!dbus_message_iter_get_fixed_struct_array (&array, &value, &stride, &n))
+    _dbus_assert_not_reached ("(iiu) has no fixed layout");
+  _dbus_assert (stride == 16);
+  _dbus_assert (n == 5);
+
+  elements = value;
+  for (i = 0; i < n; i++)
+    {
+      const unsigned char *element = elements + i * stride;
+
+      _dbus_assert (*(const dbus_int32_t *) element == -i);
+      _dbus_assert (*(const dbus_int32_t *) (element + 4) == -i);
+      _dbus_assert (*(const dbus_uint32_t *) (element + 8) ==
+                    (dbus_uint32_t) 0x10000 * i);
+    }
+
+  dbus_message_iter_next (&array);
+  if (!dbus_message_iter_get_fixed_struct_array (&array, &value, &stride, &n))
+    _dbus_assert_not_reached ("(iiu) has no fixed layout");
+  _dbus_assert (n == 4);
+  _dbus_assert (value == elements + stride);
+  dbus_message_iter_next (&iter);
+
+  /* a(ys) */
+  dbus_message_iter_recurse (&iter, &array);
+  _dbus_assert (!dbus_message_iter_get_fixed_struct_array (&array, &value,
+                                                           &stride, &n));
+  dbus_message_iter_next (&iter);
+
+  /* empty ao */
+  dbus_message_iter_recurse (&iter, &array);
+  check_string_array (&array, NULL, 0);
+}
+
+static void
+bulk_read_test (void)
+{
+  DBusMessage *message, *copy;
+  char *data;
+  int len;
+
+  message = bulk_read_test_message ();
+  check_bulk_readers (message);
+
+  dbus_message_set_serial (message, 1);
+  if (!dbus_message_marshal (message, &data, &len))
+    _dbus_assert_not_reached ("no memory");
+
+  copy = dbus_message_demarshal (data, len, NULL);
+  _dbus_assert (copy != NULL);
+  check_bulk_readers (copy);
+
+  dbus_message_unref (copy);
+  dbus_free (data);
+  dbus_message_unref (message);
+}
+
+/* Appends the values one element at a time; n_members strings make
+ * up each element */
+static void
+append_strings_one_by_one (DBusMessageIter    *array,
+                           int                 element_type,
+                           const char         *members,
+                           const char * const *values,
+                           int                 n_values)
+{
+  int n_members = strlen (members);
+  int i, j;
+
+  for (i = 0; i < n_values; i += n_members)
+    {
+      DBusMessageIter element, *sub;
+
+      if (n_members == 1)
+        {
+          sub = array;
+        }
+      else
+        {
+          sub = &element;
+          if (!dbus_message_iter_open_container (array, element_type,
+                                                 NULL, sub))
+            _dbus_assert_not_reached ("no memory");
+        }
+
+      for (j = 0; j < n_members; j++)
+        {
+          if (!dbus_message_iter_append_basic (sub, members[j], &values[i + j]))
+            _dbus_assert_not_reached ("no memory");
+        }
+
+      if (sub != array && !dbus_message_iter_close_container (array, sub))
+        _dbus_assert_not_reached ("no memory");
+    }
+}
+
+static DBusMessage *
+bulk_append_test_message (const char         *element_signature,
+                          const char         *members,
+                          const char * const *values,
+                          int                 n_values,
+                          int                 n_bulk,
+                          int                 reserve)
+{
+  DBusMessage *message;
+  DBusMessageIter iter, array;
+  const char *before = "x";
+  unsigned char after = 1;
+  int n_members = strlen (members);
+  int element_type;
+
+  if (element_signature[0] == DBUS_DICT_ENTRY_BEGIN_CHAR)
+    element_type = DBUS_TYPE_DICT_ENTRY;
+  else
+    element_type = DBUS_TYPE_STRUCT;
+
+  message = dbus_message_new_method_call ("org.freedesktop.DBus.TestService",
+                                          "/org/freedesktop/TestPath",
+                                          "Foo.TestInterface",
+                                          "BulkAppend");
+  if (message == NULL)
+    _dbus_assert_not_reached ("no memory");
+
+  if (reserve > 0 && !dbus_message_reserve_body (message, reserve))
+    _dbus_assert_not_reached ("no memory");
+
+  dbus_message_iter_init_append (message, &iter);
+
+  if (!dbus_message_iter_append_basic (&iter, DBUS_TYPE_STRING, &before) ||
+      !dbus_message_iter_open_container (&iter, DBUS_TYPE_ARRAY,
+                                         element_signature, &array))
+    _dbus_assert_not_reached ("no memory");
+
+  /* the first element one at a time, then n_bulk values in one go, then
+   * the rest one at a time again */
+  append_strings_one_by_one (&array, element_type, members, values,
+                             n_members);
+
+  if (!dbus_message_iter_append_string_array (&array, values + n_members,
+                                              n_bulk))
+    _dbus_assert_not_reached ("no memory");
+
+  append_strings_one_by_one (&array, element_type, members,
+                             values + n_members + n_bulk,
+                             n_values - n_members - n_bulk);
+
+  if (!dbus_message_iter_close_container (&iter, &array) ||
+      !dbus_message_iter_append_basic (&iter, DBUS_TYPE_BYTE, &after))
+    _dbus_assert_not_reached ("no memory");
+
+  dbus_message_set_serial (message, 1);
+
+  return message;
+}
+
+static void
+check_bulk_append (const char         *element_signature,
+                   const char         *members,
+                   const char * const *values,
+                   int                 n_values)
+{
+  int n_members = strlen (members);
+  int n_bulk;
+
+  for (n_bulk = 0; n_bulk <= n_values - n_members; n_bulk += n_members)
+    {
+      DBusMessage *expected, *message;
+      char *expected_data, *data;
+      int expected_len, len;
+      DBusMessageIter iter, array;
+      const char **read_values;
+      int *lengths;
+      int n, i;
+
+      expected = bulk_append_test_message (element_signature, members,
+                                           values, n_values, 0, 0);
+      message = bulk_append_test_message (element_signature, members,
+                                          values, n_values, n_bulk,
+                                          n_bulk == 0 ? 0 : 4096);
+
+      if (!dbus_message_marshal (expected, &expected_data, &expected_len) ||
+          !dbus_message_marshal (message, &data, &len))
+        _dbus_assert_not_reached ("no memory");
+
+      _dbus_assert (len == expected_len);
+      _dbus_assert (memcmp (data, expected_data, len) == 0);
+
+      dbus_message_iter_init (message, &iter);
+      dbus_message_iter_next (&iter);
+      dbus_message_iter_recurse (&iter, &array);
+
+      if (!dbus_message_iter_get_string_array (&array, &read_values,
+                                               &lengths, &n))
+        _dbus_assert_not_reached ("no memory");
+
+      _dbus_assert (n == n_values);
+      for (i = 0; i < n; i++)
+        _dbus_assert (strcmp (read_values[i], values[i]) == 0);
+
+      dbus_free (read_values);
+      dbus_free (data);
+      dbus_free (expected_data);
+      dbus_message_unref (message);
+      dbus_message_unref (expected);
+    }
+}
+
+static void
+bulk_append_test (void)
+{
+  static const char * const strings[] = {
+    "Foo", "bar", "", "woo woo woo woo", "\xc3\xa9t\xc3\xa9", "x"
+  };
+  static const char * const paths[] = {
+    "/", "/org/freedesktop/DBus", "/a", "/a/b/c"
+  };
+  static const char * const signatures[] = {
+    "", "a{sv}", "(iiu)", "s"
+  };
+  static const char * const dict[] = {
+    "a", "1", "bc", "", "", "456", "key", "value"
+  };
+  static const char * const mixed[] = {
+    "one", "/one", "s", "two", "/two", "", "", "/", "a(ss)"
+  };
+
+  check_bulk_append ("s", "s", strings, _DBUS_N_ELEMENTS (strings));
+  check_bulk_append ("o", "o", paths, _DBUS_N_ELEMENTS (paths));
+  check_bulk_append ("g", "g", signatures, _DBUS_N_ELEMENTS (signatures));
+  check_bulk_append ("{ss}", "ss", dict, _DBUS_N_ELEMENTS (dict));
+  check_bulk_append ("(ss)", "ss", dict, _DBUS_N_ELEMENTS (dict));
+  check_bulk_append ("(sog)", "sog", mixed, _DBUS_N_ELEMENTS (mixed));
+}
+
+static void
+check_same_message (DBusMessage *a,
+                    DBusMessage *b)
+{
+  char *a_data, *b_data;
+  int a_len, b_len;
+
+  dbus_message_set_serial (a, 1);
+  dbus_message_set_serial (b, 1);
+
+  if (!dbus_message_marshal (a, &a_data, &a_len) ||
+      !dbus_message_marshal (b, &b_data, &b_len))
+    _dbus_assert_not_reached ("no memory");
+
+  _dbus_assert (a_len == b_len);
+  _dbus_assert (memcmp (a_data, b_data, a_len) == 0);
+
+  dbus_free (a_data);
+  dbus_free (b_data);
+}
+
+static DBusMessage *
+template_test_method_call (void)
+{
+  DBusMessage *message;
+
+  message = dbus_message_new_method_call ("org.freedesktop.DBus.TestService",
+                                          "/org/freedesktop/TestPath",
+                                          "Foo.TestInterface",
+                                          "TestMethod");
+  if (message == NULL || !dbus_message_set_sender (message, ":1.42"))
+    _dbus_assert_not_reached ("no memory");
+
+  dbus_message_set_auto_start (message, FALSE);
+
+  return message;
+}
+
+static void
+template_test (void)
+{
+  DBusMessage *template_message, *message, *expected, *call;
+  dbus_uint32_t v_UINT32 = 0x12345678;
+  const char *v_STRING = "oops";
+  int i;
+
+  template_message = dbus_message_new_signal ("/org/freedesktop/TestPath",
+                                              "Foo.TestInterface",
+                                              "TestSignal");
+  _dbus_assert (template_message != NULL);
+
+  /* the template has been sent before, and is used more than once */
+  dbus_message_set_serial (template_message, 1234);
+  dbus_message_lock (template_message);
+
+  for (i = 0; i < 3; i++)
+    {
+      message = dbus_message_new_from_template (template_message);
+      expected = dbus_message_new_signal ("/org/freedesktop/TestPath",
+                                          "Foo.TestInterface",
+                                          "TestSignal");
+      _dbus_assert (message != NULL && expected != NULL);
+
+      _dbus_assert (dbus_message_get_serial (message) == 0);
+      _dbus_assert (dbus_message_get_no_reply (message));
+      _dbus_assert (dbus_message_has_member (message, "TestSignal"));
+      _dbus_assert (strcmp (dbus_message_get_signature (message), "") == 0);
+
+      v_UINT32 += i;
+      if (!dbus_message_append_args (message, DBUS_TYPE_UINT32, &v_UINT32,
+                                     DBUS_TYPE_INVALID) ||
+          !dbus_message_append_args (expected, DBUS_TYPE_UINT32, &v_UINT32,
+                                     DBUS_TYPE_INVALID))
+        _dbus_assert_not_reached ("no memory");
+
+      check_same_message (message, expected);
+
+      dbus_message_unref (message);
+      dbus_message_unref (expected);
+    }
+
+  dbus_message_unref (template_message);
+
+  /* every header field comes across */
+  template_message = template_test_method_call ();
+  message = dbus_message_new_from_template (template_message);
+  _dbus_assert (message != NULL);
+  _dbus_assert (dbus_message_get_type (message) == DBUS_MESSAGE_TYPE_METHOD_CALL);
+  _dbus_assert (dbus_message_has_destination (message,
+                                              "org.freedesktop.DBus.TestService"));
+  _dbus_assert (dbus_message_has_path (message, "/org/freedesktop/TestPath"));
+  _dbus_assert (dbus_message_has_interface (message, "Foo.TestInterface"));
+  _dbus_assert (dbus_message_has_sender (message, ":1.42"));
+  _dbus_assert (!dbus_message_get_auto_start (message));
+  expected = template_test_method_call ();
+  check_same_message (message, expected);
+  dbus_message_unref (message);
+  dbus_message_unref (expected);
+  dbus_message_unref (template_message);
+
+  /* replies carry the reply serial from the start; they come out the
+   * same as setting it afterwards */
+  call = template_test_method_call ();
+  dbus_message_set_serial (call, 77);
+
+  message = dbus_message_new_method_return (call);
+  expected = dbus_message_new (DBUS_MESSAGE_TYPE_METHOD_RETURN);
+  _dbus_assert (message != NULL && expected != NULL);
+  if (!dbus_message_set_destination (expected, ":1.42") ||
+      !dbus_message_set_reply_serial (expected, 77))
+    _dbus_assert_not_reached ("no memory");
+  dbus_message_set_no_reply (expected, TRUE);
+  _dbus_assert (dbus_message_get_reply_serial (message) == 77);
+  check_same_message (message, expected);
+  dbus_message_unref (message);
+  dbus_message_unref (expected);
+
+  message = dbus_message_new_error (call, DBUS_ERROR_FAILED, v_STRING);
+  expected = dbus_message_new (DBUS_MESSAGE_TYPE_ERROR);
+  _dbus_assert (message != NULL && expected != NULL);
+  if (!dbus_message_set_destination (expected, ":1.42") ||
+      !dbus_message_set_error_name (expected, DBUS_ERROR_FAILED) ||
+      !dbus_message_set_reply_serial (expected, 77) ||
+      !dbus_message_append_args (expected, DBUS_TYPE_STRING, &v_STRING,
+                                 DBUS_TYPE_INVALID))
+    _dbus_assert_not_reached ("no memory");
+  dbus_message_set_no_reply (expected, TRUE);
+  _dbus_assert (dbus_message_get_reply_serial (message) == 77);
+  check_same_message (message, expected);
+  dbus_message_unref (message);
+  dbus_message_unref (expected);
+
+  dbus_message_unref (call);
+}
+
+static void
+check_shared_copy_body (DBusMessage         *message,
+                        const unsigned char *expected,
+                        int                  expected_len)
+{
+  const unsigned char *bytes;
+  int n_bytes;
+
+  if (!dbus_message_get_args (message, NULL,
+                              DBUS_TYPE_ARRAY, DBUS_TYPE_BYTE, &bytes, &n_bytes,
+                              DBUS_TYPE_INVALID))
+    _dbus_assert_not_reached ("could not read the body");
+
+  _dbus_assert (n_bytes == expected_len);
+  _dbus_assert (memcmp (bytes, expected, n_bytes) == 0);
+}
+
+static void
+shared_copy_test (void)
+{
+  DBusMessage *original, *copy, *copy_of_copy, *small;
+  unsigned char bytes[8192];
+  const unsigned char *v_BYTES = bytes;
+  dbus_uint32_t v_UINT32 = 42;
+  int body_len;
+  int i;
+#ifdef HAVE_UNIX_FD_PASSING
+  int v_UNIX_FD = 1;
+  int fd;
+#endif
+
+  for (i = 0; i < (int) sizeof (bytes); i++)
+    bytes[i] = i % 251;
+
+  original = dbus_message_new_signal ("/org/freedesktop/TestPath",
+                                      "Foo.TestInterface",
+                                      "TestSignal");
+  if (original == NULL ||
+      !dbus_message_append_args (original,
+                                 DBUS_TYPE_ARRAY, DBUS_TYPE_BYTE,
+                                 &v_BYTES, (int) sizeof (bytes),
+#ifdef HAVE_UNIX_FD_PASSING
+                                 DBUS_TYPE_UNIX_FD, &v_UNIX_FD,
+#endif
+                                 DBUS_TYPE_INVALID))
+    _dbus_assert_not_reached ("no memory");
+
+  /* unlocked messages, such as received ones, are shared too; if the
+   * original changes first, it moves to a body of its own */
+  copy = dbus_message_copy (original);
+  _dbus_assert (copy != NULL);
+  _dbus_assert (copy->shared == original);
+  _dbus_assert (original->body_borrowed);
+  body_len = _dbus_string_get_length (&original->body);
+
+  if (!dbus_message_append_args (original, DBUS_TYPE_UINT32, &v_UINT32,
+                                 DBUS_TYPE_INVALID))
+    _dbus_assert_not_reached ("no memory");
+  _dbus_assert (!original->body_borrowed);
+  _dbus_assert (original->retired != NULL);
+  _dbus_assert (copy->shared == original);
+  _dbus_assert (_dbus_string_get_const_data (&copy->body) ==
+                _dbus_string_get_const_data (&original->retired->body));
+  _dbus_assert (_dbus_string_get_length (&copy->body) == body_len);
+  check_shared_copy_body (copy, bytes, sizeof (bytes));
+#ifdef HAVE_UNIX_FD_PASSING
+  _dbus_assert (copy->n_unix_fds == 1);
+  _dbus_assert (copy->unix_fds[0] != original->unix_fds[0]);
+#endif
+
+  /* a copy of the copy reads the old body too */
+  copy_of_copy = dbus_message_copy (copy);
+  _dbus_assert (copy_of_copy != NULL);
+  _dbus_assert (copy_of_copy->shared == original);
+  _dbus_assert (_dbus_string_get_const_data (&copy_of_copy->body) ==
+                _dbus_string_get_const_data (&copy->body));
+  dbus_message_unref (copy);
+  check_shared_copy_body (copy_of_copy, bytes, sizeof (bytes));
+  dbus_message_unref (copy_of_copy);
+  dbus_message_unref (original);
+
+  original = dbus_message_new_signal ("/org/freedesktop/TestPath",
+                                      "Foo.TestInterface",
+                                      "TestSignal");
+  if (original == NULL ||
+      !dbus_message_append_args (original,
+                                 DBUS_TYPE_ARRAY, DBUS_TYPE_BYTE,
+                                 &v_BYTES, (int) sizeof (bytes),
+#ifdef HAVE_UNIX_FD_PASSING
+                                 DBUS_TYPE_UNIX_FD, &v_UNIX_FD,
+#endif
+                                 DBUS_TYPE_INVALID))
+    _dbus_assert_not_reached ("no memory");
+
+  dbus_message_set_serial (original, 1);
+  dbus_message_lock (original);
+  body_len = _dbus_string_get_length (&original->body);
+
+  copy = dbus_message_copy (original);
+  _dbus_assert (copy != NULL);
+  _dbus_assert (copy->shared == original);
+  _dbus_assert (_dbus_string_get_const_data (&copy->body) ==
+                _dbus_string_get_const_data (&original->body));
+  _dbus_assert (!copy->locked);
+  _dbus_assert (dbus_message_get_serial (copy) == 0);
+
+  /* copies of a copy share the original */
+  copy_of_copy = dbus_message_copy (copy);
+  _dbus_assert (copy_of_copy != NULL);
+  _dbus_assert (copy_of_copy->shared == original);
+
+  /* changing the header doesn't need a body of its own */
+  if (!dbus_message_set_destination (copy, "org.freedesktop.DBus.TestService"))
+    _dbus_assert_not_reached ("no memory");
+  dbus_message_set_serial (copy, 2);
+  _dbus_assert (copy->shared == original);
+  _dbus_assert (!dbus_message_has_destination (original,
+                                               "org.freedesktop.DBus.TestService"));
+  check_shared_copy_body (copy, bytes, sizeof (bytes));
+
+  /* appending does, and leaves the original alone */
+  if (!dbus_message_append_args (copy, DBUS_TYPE_UINT32, &v_UINT32,
+                                 DBUS_TYPE_INVALID))
+    _dbus_assert_not_reached ("no memory");
+  _dbus_assert (copy->shared == NULL);
+  _dbus_assert (_dbus_string_get_const_data (&copy->body) !=
+                _dbus_string_get_const_data (&original->body));
+  _dbus_assert (_dbus_string_get_length (&original->body) == body_len);
+  _dbus_assert (_dbus_string_get_length (&copy->body) > body_len);
+  check_shared_copy_body (copy, bytes, sizeof (bytes));
+#ifdef HAVE_UNIX_FD_PASSING
+  _dbus_assert (strcmp (dbus_message_get_signature (original), "ayh") == 0);
+  _dbus_assert (strcmp (dbus_message_get_signature (copy), "ayhu") == 0);
+#else
+  _dbus_assert (strcmp (dbus_message_get_signature (original), "ay") == 0);
+  _dbus_assert (strcmp (dbus_message_get_signature (copy), "ayu") == 0);
+#endif
+
+  /* the original is kept alive until the last copy sharing it goes */
+  dbus_message_unref (original);
+  dbus_message_unref (copy);
+  check_shared_copy_body (copy_of_copy, bytes, sizeof (bytes));
+
+#ifdef HAVE_UNIX_FD_PASSING
+  {
+    DBusMessageIter iter;
+
+    dbus_message_iter_init (copy_of_copy, &iter);
+    dbus_message_iter_next (&iter);
+    _dbus_assert (dbus_message_iter_get_arg_type (&iter) == DBUS_TYPE_UNIX_FD);
+    dbus_message_iter_get_basic (&iter, &fd);
+    _dbus_assert (fd >= 0);
+    _dbus_close (fd, NULL);
+  }
+#endif
+
+  if (!dbus_message_reserve_body (copy_of_copy, 64))
+    _dbus_assert_not_reached ("no memory");
+  _dbus_assert (copy_of_copy->shared == NULL);
+  check_shared_copy_body (copy_of_copy, bytes, sizeof (bytes));
+  dbus_message_unref (copy_of_copy);
+
+  /* small bodies are cheaper to copy than to share */
+  small = dbus_message_new_signal ("/org/freedesktop/TestPath",
+                                   "Foo.TestInterface",
+                                   "TestSignal");
+  if (small == NULL ||
+      !dbus_message_append_args (small, DBUS_TYPE_UINT32, &v_UINT32,
+                                 DBUS_TYPE_INVALID))
+    _dbus_assert_not_reached ("no memory");
+  dbus_message_lock (small);
+  copy = dbus_message_copy (small);
+  _dbus_assert (copy != NULL);
+  _dbus_assert (copy->shared == NULL);
+  dbus_message_unref (copy);
+  dbus_message_unref (small);
+}
+
+/* Feeds data to a loader and returns why it was rejected, or DBUS_VALID */
+static DBusValidity
+load_with_trust (const DBusString  *data,
+                 dbus_bool_t        trust,
+                 DBusMessage      **loaded)
+{
+  DBusMessageLoader *loader;
+  DBusMessage *message;
+  DBusString *buffer;
+  DBusValidity validity;
+
+  loader = _dbus_message_loader_new ();
+  if (loader == NULL)
+    _dbus_assert_not_reached ("no memory");
+
+  _dbus_assert (!_dbus_message_loader_get_trust_bodies (loader));
+  _dbus_message_loader_set_trust_bodies (loader, trust);
+  _dbus_assert (_dbus_message_loader_get_trust_bodies (loader) == trust);
+
+  _dbus_message_loader_get_buffer (loader, &buffer);
+  if (!_dbus_string_copy (data, 0, buffer, _dbus_string_get_length (buffer)))
+    _dbus_assert_not_reached ("no memory");
+  _dbus_message_loader_return_buffer (loader, buffer,
+                                      _dbus_string_get_length (data));
+
+  if (!_dbus_message_loader_queue_messages (loader))
+    _dbus_assert_not_reached ("no memory");
+
+  if (_dbus_message_loader_get_is_corrupted (loader))
+    {
+      validity = _dbus_message_loader_get_corruption_reason (loader);
+      _dbus_assert (validity != DBUS_VALID);
+    }
+  else
+    {
+      message = _dbus_message_loader_pop_message (loader);
+      _dbus_assert (message != NULL);
+
+      if (loaded != NULL)
+        *loaded = message;
+      else
+        dbus_message_unref (message);
+
+      validity = DBUS_VALID;
+    }
+
+  _dbus_message_loader_unref (loader);
+
+  return validity;
+}
+
+static void
+trusted_body_test (void)
+{
+  DBusMessage *message;
+  DBusString data;
+  const char *v_STRING = "hello";
+  char *marshalled;
+  int len;
+  int pos;
+
+  message = dbus_message_new_signal ("/org/freedesktop/TestPath",
+                                     "Foo.TestInterface",
+                                     "TestSignal");
+  if (message == NULL ||
+      !dbus_message_append_args (message, DBUS_TYPE_STRING, &v_STRING,
+                                 DBUS_TYPE_INVALID))
+    _dbus_assert_not_reached ("no memory");
+  dbus_message_set_serial (message, 1);
+
+  if (!dbus_message_marshal (message, &marshalled, &len) ||
+      !_dbus_string_init (&data) ||
+      !_dbus_string_append_len (&data, marshalled, len))
+    _dbus_assert_not_reached ("no memory");
+  dbus_free (marshalled);
+  dbus_message_unref (message);
+
+  _dbus_assert (load_with_trust (&data, FALSE, NULL) == DBUS_VALID);
+  _dbus_assert (load_with_trust (&data, TRUE, NULL) == DBUS_VALID);
+
+  /* a bad body is only caught when validating bodies */
+  _dbus_assert (_dbus_string_get_byte (&data, len - 2) == 'o');
+  _dbus_string_set_byte (&data, len - 2, 0xff);
+  _dbus_assert (load_with_trust (&data, FALSE, NULL) ==
+                DBUS_INVALID_BAD_UTF8_IN_STRING);
+  _dbus_assert (load_with_trust (&data, TRUE, NULL) == DBUS_VALID);
+  _dbus_string_set_byte (&data, len - 2, 'o');
+
+  /* headers are always validated */
+  if (!_dbus_string_find (&data, 0, "/org/freedesktop/TestPath", &pos))
+    _dbus_assert_not_reached ("path not found");
+  _dbus_string_set_byte (&data, pos + 1, '/');
+  _dbus_assert (load_with_trust (&data, FALSE, NULL) == DBUS_INVALID_BAD_PATH);
+  _dbus_assert (load_with_trust (&data, TRUE, NULL) == DBUS_INVALID_BAD_PATH);
+  _dbus_string_set_byte (&data, pos + 1, 'o');
+
+  /* but names are only checked when read if the peer is trusted */
+  if (!_dbus_string_find (&data, 0, "TestSignal", &pos))
+    _dbus_assert_not_reached ("member not found");
+  _dbus_string_set_byte (&data, pos + 4, '-');
+  _dbus_assert (load_with_trust (&data, FALSE, NULL) == DBUS_INVALID_BAD_MEMBER);
+  _dbus_assert (load_with_trust (&data, TRUE, &message) == DBUS_VALID);
+
+  _dbus_assert (strcmp (dbus_message_get_path (message),
+                        "/org/freedesktop/TestPath") == 0);
+  _dbus_assert (strcmp (dbus_message_get_interface (message),
+                        "Foo.TestInterface") == 0);
+  /* the check reports the bad name, however often it is asked */
+  _dbus_assert (_dbus_message_check_deferred_fields (message) ==
+                DBUS_INVALID_BAD_MEMBER);
+  _dbus_assert (_dbus_message_check_deferred_fields (message) ==
+                DBUS_INVALID_BAD_MEMBER);
+
+  /* setting the field replaces the bad value */
+  if (!dbus_message_set_member (message, "TestSignal"))
+    _dbus_assert_not_reached ("no memory");
+  _dbus_assert (_dbus_message_check_deferred_fields (message) == DBUS_VALID);
+  _dbus_assert (dbus_message_has_member (message, "TestSignal"));
+  _dbus_assert (strcmp (dbus_message_get_interface (message),
+                        "Foo.TestInterface") == 0);
+  dbus_message_unref (message);
+
+  _dbus_string_free (&data);
+}
+
+#ifdef DBUS_HAVE_MEMFD_BODIES
+/* Feeds a header flagged as having its body in a memfd to a loader,
+ * with the given fd (if any) after it, and returns why it was
+ * rejected, or DBUS_VALID */
+static DBusValidity
+load_with_body_memfd (const DBusString  *header,
+                      int                body_fd,
+                      DBusMessage      **loaded)
+{
+  DBusMessageLoader *loader;
+  DBusMessage *message;
+  DBusString *buffer;
+  DBusValidity validity;
+  int start;
+  int *fds;
+  unsigned max_n_fds;
+
+  loader = _dbus_message_loader_new ();
+  if (loader == NULL)
+    _dbus_assert_not_reached ("no memory");
+
+  _dbus_message_loader_set_memfd_bodies (loader, TRUE);
+
+  _dbus_message_loader_get_buffer (loader, &buffer);
+  start = _dbus_string_get_length (buffer);
+  if (!_dbus_string_copy (header, 0, buffer, start))
+    _dbus_assert_not_reached ("no memory");
+  _dbus_header_toggle_flag_in_data (buffer, start,
+                                    _DBUS_HEADER_FLAG_BODY_IN_MEMFD, TRUE);
+  _dbus_message_loader_return_buffer (loader, buffer,
+                                      _dbus_string_get_length (header));
+
+  if (!_dbus_message_loader_get_unix_fds (loader, &fds, &max_n_fds))
+    _dbus_assert_not_reached ("no memory");
+  _dbus_assert (max_n_fds > 0);
+
+  if (body_fd >= 0)
+    {
+      fds[0] = _dbus_dup (body_fd, NULL);
+      _dbus_assert (fds[0] >= 0);
+    }
+
+  _dbus_message_loader_return_unix_fds (loader, fds, body_fd >= 0 ? 1 : 0);
+
+  if (!_dbus_message_loader_queue_messages (loader))
+    _dbus_assert_not_reached ("no memory");
+
+  if (_dbus_message_loader_get_is_corrupted (loader))
+    {
+      validity = _dbus_message_loader_get_corruption_reason (loader);
+      _dbus_assert (validity != DBUS_VALID);
+    }
+  else
+    {
+      message = _dbus_message_loader_pop_message (loader);
+      _dbus_assert (message != NULL);
+
+      if (loaded != NULL)
+        *loaded = message;
+      else
+        dbus_message_unref (message);
+
+      validity = DBUS_VALID;
+    }
+
+  _dbus_message_loader_unref (loader);
+
+  return validity;
+}
+
+static void
+memfd_body_test (void)
+{
+  DBusMessage *message, *copy;
+  DBusCounter *counter;
+  DBusError error = DBUS_ERROR_INIT;
+  const DBusString *header;
+  const DBusString *body;
+  DBusString header_copy;
+  unsigned char bytes[8192];
+  const unsigned char *v_BYTES = bytes;
+  const unsigned char *loaded_bytes;
+  int n_loaded_bytes;
+  int body_len;
+  int fd;
+  int i;
+
+  for (i = 0; i < (int) sizeof (bytes); i++)
+    bytes[i] = i * 3;
+
+  message = dbus_message_new_signal ("/org/freedesktop/TestPath",
+                                     "Foo.TestInterface",
+                                     "TestSignal");
+  if (message == NULL ||
+      !dbus_message_append_args (message,
+                                 DBUS_TYPE_ARRAY, DBUS_TYPE_BYTE,
+                                 &v_BYTES, (int) sizeof (bytes),
+                                 DBUS_TYPE_INVALID))
+    _dbus_assert_not_reached ("no memory");
+  dbus_message_set_serial (message, 1);
+  dbus_message_lock (message);
+
+  _dbus_message_get_network_data (message, &header, &body);
+  body_len = _dbus_string_get_length (body);
+
+  if (!_dbus_string_init (&header_copy) ||
+      !_dbus_string_copy (header, 0, &header_copy, 0))
+    _dbus_assert_not_reached ("no memory");
+
+  /* the body must come as a sealed memfd of exactly its size */
+  _dbus_assert (load_with_body_memfd (&header_copy, -1, NULL) ==
+                DBUS_INVALID_MISSING_UNIX_FDS);
+
+  fd = _dbus_memfd_new_sealed (body, 0, body_len - 8, &error);
+  if (fd < 0)
+    _dbus_assert_not_reached (error.message);
+  _dbus_assert (load_with_body_memfd (&header_copy, fd, NULL) ==
+                DBUS_INVALID_BAD_BODY_MEMFD);
+  _dbus_close (fd, NULL);
+
+  fd = memfd_create ("dbus-test", MFD_CLOEXEC);
+  _dbus_assert (fd >= 0);
+  if (write (fd, _dbus_string_get_const_data (body), body_len) != body_len)
+    _dbus_assert_not_reached ("could not fill memfd");
+  _dbus_assert (load_with_body_memfd (&header_copy, fd, NULL) ==
+                DBUS_INVALID_BAD_BODY_MEMFD);
+  _dbus_close (fd, NULL);
+
+  fd = _dbus_memfd_new_sealed (body, 0, body_len, &error);
+  if (fd < 0)
+    _dbus_assert_not_reached (error.message);
+  dbus_message_unref (message);
+
+  _dbus_assert (load_with_body_memfd (&header_copy, fd, &message) ==
+                DBUS_VALID);
+  _dbus_close (fd, NULL);
+
+  /* the body is a mapping of the memfd, which is kept to pass on */
+  _dbus_assert (message->body_map != NULL);
+  _dbus_assert (_dbus_message_get_body_memfd (message) >= 0);
+  _dbus_assert (!_dbus_header_get_flag (&message->header,
+                                        _DBUS_HEADER_FLAG_BODY_IN_MEMFD));
+  _dbus_assert (dbus_message_has_member (message, "TestSignal"));
+
+  /* and the memfd counts against the limit on unix fds */
+  counter = _dbus_counter_new ();
+  if (counter == NULL || !_dbus_message_add_counter (message, counter))
+    _dbus_assert_not_reached ("no memory");
+  _dbus_assert (_dbus_counter_get_unix_fd_value (counter) == 1);
+  _dbus_message_remove_counter (message, counter);
+  _dbus_assert (_dbus_counter_get_unix_fd_value (counter) == 0);
+  _dbus_counter_unref (counter);
+
+  if (!dbus_message_get_args (message, NULL,
+                              DBUS_TYPE_ARRAY, DBUS_TYPE_BYTE,
+                              &loaded_bytes, &n_loaded_bytes,
+                              DBUS_TYPE_INVALID))
+    _dbus_assert_not_reached ("could not read memfd body");
+  _dbus_assert (n_loaded_bytes == sizeof (bytes));
+  _dbus_assert (memcmp (loaded_bytes, bytes, sizeof (bytes)) == 0);
+
+  /* copies of it once locked share the memfd too */
+  dbus_message_lock (message);
+  copy = dbus_message_copy (message);
+  _dbus_assert (copy != NULL);
+  _dbus_assert (_dbus_message_get_body_memfd (copy) ==
+                _dbus_message_get_body_memfd (message));
+  dbus_message_unref (message);
+
+  /* and writing to the body gives it its own copy */
+  if (!dbus_message_reserve_body (copy, 64))
+    _dbus_assert_not_reached ("no memory");
+  _dbus_assert (_dbus_message_get_body_memfd (copy) < 0);
+
+  if (!dbus_message_get_args (copy, NULL,
+                              DBUS_TYPE_ARRAY, DBUS_TYPE_BYTE,
+                              &loaded_bytes, &n_loaded_bytes,
+                              DBUS_TYPE_INVALID))
+    _dbus_assert_not_reached ("could not read copied body");
+  _dbus_assert (n_loaded_bytes == sizeof (bytes));
+  _dbus_assert (memcmp (loaded_bytes, bytes, sizeof (bytes)) == 0);
+  dbus_message_unref (copy);
+
+  _dbus_string_free (&header_copy);
+}
+
+#define SPILL_TEST_BODY_SIZE (2 * 1024 * 1024)
+#define SPILL_TEST_CHUNK_SIZE 4096
+/* the loader writes the body out 256 KiB at a time */
+#define SPILL_TEST_MAX_BUFFERED (256 * 1024 + SPILL_TEST_CHUNK_SIZE)
+
+static void
+spill_body_test (void)
+{
+  DBusMessageLoader *loader;
+  DBusMessage *message, *small;
+  const DBusString *header;
+  const DBusString *body;
+  DBusString data;
+  DBusString *buffer;
+  unsigned char *bytes;
+  const unsigned char *loaded_bytes;
+  int n_loaded_bytes;
+  int header_len;
+  int pos;
+  int i;
+
+  bytes = dbus_malloc (SPILL_TEST_BODY_SIZE);
+  if (bytes == NULL)
+    _dbus_assert_not_reached ("no memory");
+
+  for (i = 0; i < SPILL_TEST_BODY_SIZE; i++)
+    bytes[i] = i * 5;
+
+  /* a big message, then a small one behind it in the same stream */
+  message = dbus_message_new_signal ("/org/freedesktop/TestPath",
+                                     "Foo.TestInterface",
+                                     "TestSignal");
+  small = dbus_message_new_signal ("/org/freedesktop/TestPath",
+                                   "Foo.TestInterface",
+                                   "SmallSignal");
+  if (message == NULL || small == NULL ||
+      !dbus_message_append_args (message,
+                                 DBUS_TYPE_ARRAY, DBUS_TYPE_BYTE,
+                                 &bytes, SPILL_TEST_BODY_SIZE,
+                                 DBUS_TYPE_INVALID))
+    _dbus_assert_not_reached ("no memory");
+  dbus_message_set_serial (message, 1);
+  dbus_message_set_serial (small, 2);
+  dbus_message_lock (message);
+  dbus_message_lock (small);
+
+  if (!_dbus_string_init (&data))
+    _dbus_assert_not_reached ("no memory");
+
+  _dbus_message_get_network_data (message, &header, &body);
+  header_len = _dbus_string_get_length (header);
+  if (!_dbus_string_copy (header, 0, &data, _dbus_string_get_length (&data)) ||
+      !_dbus_string_copy (body, 0, &data, _dbus_string_get_length (&data)))
+    _dbus_assert_not_reached ("no memory");
+
+  _dbus_message_get_network_data (small, &header, &body);
+  if (!_dbus_string_copy (header, 0, &data, _dbus_string_get_length (&data)) ||
+      !_dbus_string_copy (body, 0, &data, _dbus_string_get_length (&data)))
+    _dbus_assert_not_reached ("no memory");
+
+  dbus_message_unref (message);
+  dbus_message_unref (small);
+
+  /* loaders only spill when asked to */
+  loader = _dbus_message_loader_new ();
+  if (loader == NULL)
+    _dbus_assert_not_reached ("no memory");
+
+  _dbus_message_loader_get_buffer (loader, &buffer);
+  if (!_dbus_string_copy_len (&data, 0, header_len + SPILL_TEST_MAX_BUFFERED,
+                              buffer, _dbus_string_get_length (buffer)))
+    _dbus_assert_not_reached ("no memory");
+  _dbus_message_loader_return_buffer (loader, buffer,
+                                      header_len + SPILL_TEST_MAX_BUFFERED);
+
+  if (!_dbus_message_loader_queue_messages (loader))
+    _dbus_assert_not_reached ("no memory");
+  _dbus_assert (loader->spill_fd < 0);
+  _dbus_assert (_dbus_string_get_length (&loader->data) ==
+                header_len + SPILL_TEST_MAX_BUFFERED);
+  _dbus_message_loader_unref (loader);
+
+  loader = _dbus_message_loader_new ();
+  if (loader == NULL)
+    _dbus_assert_not_reached ("no memory");
+
+  _dbus_message_loader_set_spill_bodies (loader, TRUE);
+
+  /* only the header and the last chunk are ever buffered */
+  for (pos = 0; pos < _dbus_string_get_length (&data);
+       pos += SPILL_TEST_CHUNK_SIZE)
+    {
+      int len = MIN (SPILL_TEST_CHUNK_SIZE,
+                     _dbus_string_get_length (&data) - pos);
+
+      _dbus_message_loader_get_buffer (loader, &buffer);
+      if (!_dbus_string_copy_len (&data, pos, len,
+                                  buffer, _dbus_string_get_length (buffer)))
+        _dbus_assert_not_reached ("no memory");
+      _dbus_message_loader_return_buffer (loader, buffer, len);
+
+      if (!_dbus_message_loader_queue_messages (loader))
+        _dbus_assert_not_reached ("no memory");
+
+      _dbus_assert (!_dbus_message_loader_get_is_corrupted (loader));
+      _dbus_assert (_dbus_string_get_length (&loader->data) <=
+                    header_len + SPILL_TEST_MAX_BUFFERED);
+    }
+
+  message = _dbus_message_loader_pop_message (loader);
+  _dbus_assert (message != NULL);
+  _dbus_assert (message->body_map != NULL);
+  _dbus_assert (_dbus_message_get_body_memfd (message) >= 0);
+  _dbus_assert (dbus_message_has_member (message, "TestSignal"));
+
+  if (!dbus_message_get_args (message, NULL,
+                              DBUS_TYPE_ARRAY, DBUS_TYPE_BYTE,
+                              &loaded_bytes, &n_loaded_bytes,
+                              DBUS_TYPE_INVALID))
+    _dbus_assert_not_reached ("could not read spilled body");
+  _dbus_assert (n_loaded_bytes == SPILL_TEST_BODY_SIZE);
+  _dbus_assert (memcmp (loaded_bytes, bytes, SPILL_TEST_BODY_SIZE) == 0);
+  dbus_message_unref (message);
+
+  small = _dbus_message_loader_pop_message (loader);
+  _dbus_assert (small != NULL);
+  _dbus_assert (_dbus_message_get_body_memfd (small) < 0);
+  _dbus_assert (dbus_message_has_member (small, "SmallSignal"));
+  dbus_message_unref (small);
+
+  _dbus_assert (_dbus_message_loader_pop_message (loader) == NULL);
+  _dbus_assert (_dbus_string_get_length (&loader->data) == 0);
+
+  _dbus_message_loader_unref (loader);
+  _dbus_string_free (&data);
+  dbus_free (bytes);
+}
+#endif /* DBUS_HAVE_MEMFD_BODIES */
+
 /**
  * @ingroup DBusMessageInternals
  * Unit test for DBusMessage.
@@ -1489,6 +2659,16 @@ _dbus_message_test (const char *test_data_dir)
 
   dbus_message_unref (message);
 
+  bulk_read_test ();
+  bulk_append_test ();
+  template_test ();
+  shared_copy_test ();
+  trusted_body_test ();
+#ifdef DBUS_HAVE_MEMFD_BODIES
+  memfd_body_test ();
+  spill_body_test ();
+#endif
+
   /* Load all the sample messages from the message factory */
   {
     DBusMessageDataIter diter;
@@ -171,6 +171,13 @@ _dbus_message_byteswap (DBusMessage *message)
   if (byte_order == DBUS_COMPILER_BYTE_ORDER)
     return;
 
+  /* only bodies already in our byte order are ever shared or mapped */
+  _dbus_assert (message->shared == NULL);
+  _dbus_assert (!message->body_borrowed);
+#ifdef DBUS_HAVE_MEMFD_BODIES
+  _dbus_assert (message->body_map == NULL);
+#endif
+
   _dbus_verbose ("Swapping message into compiler byte order\n");
   
   get_const_signature (&message->header, &type_str, &type_pos);
@@ -295,6 +302,13 @@ _dbus_message_add_counter_link (DBusMessage  *message,
       message->unix_fd_counter_delta = message->n_unix_fds;
 #endif
 
+#ifdef DBUS_HAVE_MEMFD_BODIES
+      /* the memfd a received body is mapped from stays open as long
+       * as the message does, like its unix fds */
+      if (message->body_memfd >= 0)
+        message->unix_fd_counter_delta += 1;
+#endif
+
 #if 0
       _dbus_verbose ("message has size %ld\n",
                      message->size_counter_delta);
@@ -369,6 +383,22 @@ _dbus_message_remove_counter (DBusMessage  *message,
   _dbus_counter_unref (counter);
 }
 
+/**
+ * Checks the header names of a received message that a trusting
+ * loader left unchecked, see _dbus_header_check_deferred_fields().
+ * The connection does this once, before handing the message to
+ * anything that might read them.
+ *
+ * @param message the message
+ * @returns #DBUS_VALID, or why the message would have been rejected
+ *   when it was loaded
+ */
+DBusValidity
+_dbus_message_check_deferred_fields (DBusMessage *message)
+{
+  return _dbus_header_check_deferred_fields (&message->header);
+}
+
 /**
  * Locks a message. Allows checking that applications don't keep a
  * reference to a message in the outgoing queue and change it
@@ -654,10 +684,43 @@ dbus_message_cache_or_finalize (DBusMessage *message)
                       free_counter, message);
   _dbus_list_clear (&message->counters);
 
+  /* the body belongs to another message, so can't be reused; nor can
+   * a message still holding bodies its copies were reading */
+  if (message->shared != NULL || message->retired != NULL)
+    {
+      dbus_message_finalize (message);
+      return;
+    }
+
+#ifdef DBUS_HAVE_MEMFD_BODIES
+  /* nor can a body that is a mapping of a memfd */
+  if (message->body_map != NULL)
+    {
+      dbus_message_finalize (message);
+      return;
+    }
+#endif
+
 #ifdef HAVE_UNIX_FD_PASSING
   close_unix_fds(message->unix_fds, &message->n_unix_fds);
 #endif
 
+  /* too big to cache at all; there is no point compacting it first */
+  if ((_dbus_string_get_length (&message->header.data) +
+       _dbus_string_get_length (&message->body)) >
+      MAX_MESSAGE_SIZE_TO_CACHE)
+    {
+      dbus_message_finalize (message);
+      return;
+    }
+
+  /* don't keep a large reserved body around in the cache */
+  if (!_dbus_string_compact (&message->body, MAX_MESSAGE_SIZE_TO_CACHE))
+    {
+      dbus_message_finalize (message);
+      return;
+    }
+
   was_cached = FALSE;
 
   _DBUS_LOCK (message_cache);
@@ -684,11 +747,6 @@ dbus_message_cache_or_finalize (DBusMessage *message)
   if (!_dbus_enable_message_cache ())
     goto out;
 
-  if ((_dbus_string_get_length (&message->header.data) +
-       _dbus_string_get_length (&message->body)) >
-      MAX_MESSAGE_SIZE_TO_CACHE)
-    goto out;
-
   if (message_cache_count >= MAX_MESSAGE_CACHE_SIZE)
     goto out;
 
@@ -1097,6 +1155,49 @@ dbus_message_get_reply_serial  (DBusMessage *message)
     return 0;
 }
 
+#ifdef DBUS_HAVE_MEMFD_BODIES
+/* Unmaps a body that was received in a memfd and closes the memfd;
+ * the body string must not be read after this */
+static void
+free_body_memfd (DBusMessage *message)
+{
+  if (message->body_map != NULL)
+    {
+      _dbus_memfd_unmap (message->body_map,
+                         _dbus_string_get_length (&message->body));
+      message->body_map = NULL;
+    }
+
+  if (message->body_memfd >= 0)
+    {
+      _dbus_close (message->body_memfd, NULL);
+      message->body_memfd = -1;
+    }
+}
+#endif
+
+/* Frees the bodies that were retired by retire_body() */
+static void
+free_retired_bodies (DBusMessage *message)
+{
+  while (message->retired != NULL)
+    {
+      DBusMessage *retired = message->retired;
+
+      message->retired = retired->retired;
+
+#ifdef DBUS_HAVE_MEMFD_BODIES
+      free_body_memfd (retired);
+#endif
+      _dbus_string_free (&retired->body);
+#ifdef HAVE_UNIX_FD_PASSING
+      close_unix_fds (retired->unix_fds, &retired->n_unix_fds);
+      dbus_free (retired->unix_fds);
+#endif
+      dbus_free (retired);
+    }
+}
+
 static void
 dbus_message_finalize (DBusMessage *message)
 {
@@ -1109,8 +1210,23 @@ dbus_message_finalize (DBusMessage *message)
                       free_counter, message);
   _dbus_list_clear (&message->counters);
 
+#ifdef DBUS_HAVE_MEMFD_BODIES
+  free_body_memfd (message);
+#endif
+
   _dbus_header_free (&message->header);
   _dbus_string_free (&message->body);
+  free_retired_bodies (message);
+
+  if (message->shared != NULL)
+    {
+      /* the unix fds belong to the shared message too */
+#ifdef HAVE_UNIX_FD_PASSING
+      message->unix_fds = NULL;
+      message->n_unix_fds = 0;
+#endif
+      dbus_message_unref (message->shared);
+    }
 
 #ifdef HAVE_UNIX_FD_PASSING
   close_unix_fds(message->unix_fds, &message->n_unix_fds);
@@ -1155,6 +1271,7 @@ dbus_message_new_empty_header (void)
   _dbus_message_trace_ref (message, 0, 1, "new_empty_header");
 
   message->locked = FALSE;
+  message->body_borrowed = FALSE;
 #ifndef DBUS_DISABLE_CHECKS
   message->in_cache = FALSE;
 #endif
@@ -1168,6 +1285,11 @@ dbus_message_new_empty_header (void)
   message->unix_fd_counter_delta = 0;
 #endif
 
+#ifdef DBUS_HAVE_MEMFD_BODIES
+  message->body_memfd = -1;
+  message->body_map = NULL;
+#endif
+
   if (!from_cache)
     _dbus_data_slot_list_init (&message->slot_list);
 
@@ -1221,7 +1343,7 @@ dbus_message_new (int message_type)
   if (!_dbus_header_create (&message->header,
                             DBUS_COMPILER_BYTE_ORDER,
                             message_type,
-                            NULL, NULL, NULL, NULL, NULL))
+                            NULL, NULL, NULL, NULL, NULL, 0))
     {
       dbus_message_unref (message);
       return NULL;
@@ -1275,7 +1397,7 @@ dbus_message_new_method_call (const char *destination,
   if (!_dbus_header_create (&message->header,
                             DBUS_COMPILER_BYTE_ORDER,
                             DBUS_MESSAGE_TYPE_METHOD_CALL,
-                            destination, path, interface, method, NULL))
+                            destination, path, interface, method, NULL, 0))
     {
       dbus_message_unref (message);
       return NULL;
@@ -1298,6 +1420,7 @@ dbus_message_new_method_return (DBusMessage *method_call)
   const char *sender;
 
   _dbus_return_val_if_fail (method_call != NULL, NULL);
+  _dbus_return_val_if_fail (dbus_message_get_serial (method_call) != 0, NULL);
 
   sender = dbus_message_get_sender (method_call);
 
@@ -1310,7 +1433,8 @@ dbus_message_new_method_return (DBusMessage *method_call)
   if (!_dbus_header_create (&message->header,
                             DBUS_COMPILER_BYTE_ORDER,
                             DBUS_MESSAGE_TYPE_METHOD_RETURN,
-                            sender, NULL, NULL, NULL, NULL))
+                            sender, NULL, NULL, NULL, NULL,
+                            dbus_message_get_serial (method_call)))
     {
       dbus_message_unref (message);
       return NULL;
@@ -1318,13 +1442,6 @@ dbus_message_new_method_return (DBusMessage *method_call)
 
   dbus_message_set_no_reply (message, TRUE);
 
-  if (!dbus_message_set_reply_serial (message,
-                                      dbus_message_get_serial (method_call)))
-    {
-      dbus_message_unref (message);
-      return NULL;
-    }
-
   return message;
 }
 
@@ -1363,7 +1480,7 @@ dbus_message_new_signal (const char *path,
   if (!_dbus_header_create (&message->header,
                             DBUS_COMPILER_BYTE_ORDER,
                             DBUS_MESSAGE_TYPE_SIGNAL,
-                            NULL, path, interface, name, NULL))
+                            NULL, path, interface, name, NULL, 0))
     {
       dbus_message_unref (message);
       return NULL;
@@ -1374,6 +1491,56 @@ dbus_message_new_signal (const char *path,
   return message;
 }
 
+/**
+ * Constructs a new message with the same header as template_message,
+ * and no arguments. This is a faster way to make the same signal, or
+ * any other message, over and over with different arguments: the
+ * template's header is copied as it is, rather than being built up
+ * field by field and having each field checked as
+ * dbus_message_new_signal() and similar functions do.
+ *
+ * Everything in the header is copied: the type, path, interface,
+ * member, error name, destination, sender, reply serial and flags.
+ * The new message's serial is 0, as for any other new message.
+ *
+ * The template must not have any arguments. It is not changed, so
+ * one template may be used from several threads at once, as long as
+ * none of them modifies it.
+ *
+ * @code
+ * template = dbus_message_new_signal (path, interface, "Changed");
+ * ...
+ * message = dbus_message_new_from_template (template);
+ * dbus_message_append_args (message, DBUS_TYPE_UINT32, &value,
+ *                           DBUS_TYPE_INVALID);
+ * @endcode
+ *
+ * @param template_message a message with no arguments
+ * @returns a new DBusMessage, free with dbus_message_unref()
+ */
+DBusMessage*
+dbus_message_new_from_template (DBusMessage *template_message)
+{
+  DBusMessage *message;
+
+  _dbus_return_val_if_fail (template_message != NULL, NULL);
+  _dbus_return_val_if_fail (_dbus_string_get_length (&template_message->body) == 0,
+                            NULL);
+
+  message = dbus_message_new_empty_header ();
+  if (message == NULL)
+    return NULL;
+
+  if (!_dbus_header_create_from (&message->header,
+                                 &template_message->header))
+    {
+      dbus_message_unref (message);
+      return NULL;
+    }
+
+  return message;
+}
+
 /**
  * Creates a new message that is an error reply to another message.
  * Error replies are most common in response to method calls, but
@@ -1400,6 +1567,7 @@ dbus_message_new_error (DBusMessage *reply_to,
   _dbus_return_val_if_fail (reply_to != NULL, NULL);
   _dbus_return_val_if_fail (error_name != NULL, NULL);
   _dbus_return_val_if_fail (_dbus_check_is_valid_error_name (error_name), NULL);
+  _dbus_return_val_if_fail (dbus_message_get_serial (reply_to) != 0, NULL);
 
   sender = dbus_message_get_sender (reply_to);
 
@@ -1414,7 +1582,8 @@ dbus_message_new_error (DBusMessage *reply_to,
   if (!_dbus_header_create (&message->header,
                             DBUS_COMPILER_BYTE_ORDER,
                             DBUS_MESSAGE_TYPE_ERROR,
-                            sender, NULL, NULL, NULL, error_name))
+                            sender, NULL, NULL, NULL, error_name,
+                            dbus_message_get_serial (reply_to)))
     {
       dbus_message_unref (message);
       return NULL;
@@ -1422,13 +1591,6 @@ dbus_message_new_error (DBusMessage *reply_to,
 
   dbus_message_set_no_reply (message, TRUE);
 
-  if (!dbus_message_set_reply_serial (message,
-                                      dbus_message_get_serial (reply_to)))
-    {
-      dbus_message_unref (message);
-      return NULL;
-    }
-
   if (error_message != NULL)
     {
       dbus_message_iter_init_append (message, &iter);
@@ -1492,6 +1654,249 @@ dbus_message_new_error_printf (DBusMessage *reply_to,
   return message;
 }
 
+/** Bodies smaller than this are copied, which is about as cheap as
+ * sharing them and doesn't keep the original message alive */
+#define MIN_BODY_SIZE_TO_SHARE (4 * _DBUS_ONE_KILOBYTE)
+
+#ifdef DBUS_HAVE_MEMFD_BODIES
+/**
+ * Gives a message whose body is a mapping of the memfd it was
+ * received in a copy of the body in memory of its own, and lets go of
+ * the memfd.
+ *
+ * @param message the message
+ * @returns #FALSE if not enough memory
+ */
+static dbus_bool_t
+unmap_body (DBusMessage *message)
+{
+  const char *data;
+  int len;
+
+  data = _dbus_string_get_const_data (&message->body);
+  len = _dbus_string_get_length (&message->body);
+
+  if (!_dbus_string_init_preallocated (&message->body, len))
+    {
+      _dbus_string_init_const_len (&message->body, data, len);
+      return FALSE;
+    }
+
+  /* can't fail, the space is already there */
+  if (!_dbus_string_append_len (&message->body, data, len))
+    _dbus_assert_not_reached ("preallocated body was too short");
+
+  _dbus_memfd_unmap (data, len);
+  message->body_map = NULL;
+
+  _dbus_close (message->body_memfd, NULL);
+  message->body_memfd = -1;
+
+  return TRUE;
+}
+
+/**
+ * Gets the sealed memfd that a message's body was received in, so
+ * that it can be passed on instead of the body's bytes. A copy made
+ * by dbus_message_copy() that still reads the body of the original
+ * has the original's memfd.
+ *
+ * @param message the message
+ * @returns the memfd, or -1 if the body is not in one
+ */
+int
+_dbus_message_get_body_memfd (DBusMessage *message)
+{
+  if (message->shared != NULL)
+    message = message->shared;
+
+  return message->body_memfd;
+}
+#endif
+
+#ifdef HAVE_UNIX_FD_PASSING
+/* Gives the message duplicates of its unix fds in an array of its own,
+ * leaving the fds and array it had alone */
+static dbus_bool_t
+dup_unix_fds (DBusMessage *message)
+{
+  int *fds = NULL;
+  unsigned n;
+
+  if (message->n_unix_fds > 0)
+    {
+      fds = dbus_new (int, message->n_unix_fds);
+      if (fds == NULL)
+        return FALSE;
+
+      for (n = 0; n < message->n_unix_fds; n++)
+        {
+          fds[n] = _dbus_dup (message->unix_fds[n], NULL);
+
+          if (fds[n] < 0)
+            {
+              close_unix_fds (fds, &n);
+              dbus_free (fds);
+              return FALSE;
+            }
+        }
+    }
+
+  message->unix_fds = fds;
+  message->n_unix_fds_allocated = message->n_unix_fds;
+  return TRUE;
+}
+#endif
+
+/**
+ * Gives an unlocked message whose body is being read by copies made
+ * with dbus_message_copy() a body and unix fds of its own to modify.
+ * The old ones are left exactly as they are for the copies, and freed
+ * with the message.
+ *
+ * @param message the message
+ * @returns #FALSE if not enough memory or unix fds
+ */
+static dbus_bool_t
+retire_body (DBusMessage *message)
+{
+  DBusMessage *retired;
+  const char *data;
+  int len;
+
+  _dbus_assert (message->body_borrowed);
+  _dbus_assert (message->shared == NULL);
+
+  retired = dbus_new0 (DBusMessage, 1);
+  if (retired == NULL)
+    return FALSE;
+
+  data = _dbus_string_get_const_data (&message->body);
+  len = _dbus_string_get_length (&message->body);
+  retired->body = message->body;
+
+#ifdef HAVE_UNIX_FD_PASSING
+  retired->unix_fds = message->unix_fds;
+  retired->n_unix_fds = message->n_unix_fds;
+  retired->n_unix_fds_allocated = message->n_unix_fds_allocated;
+
+  if (!dup_unix_fds (message))
+    goto failed;
+#endif
+
+  if (!_dbus_string_init_preallocated (&message->body, len))
+    goto failed;
+
+  /* can't fail, the space is already there */
+  if (!_dbus_string_append_len (&message->body, data, len))
+    _dbus_assert_not_reached ("preallocated body was too short");
+
+#ifdef DBUS_HAVE_MEMFD_BODIES
+  retired->body_memfd = message->body_memfd;
+  retired->body_map = message->body_map;
+  message->body_memfd = -1;
+  message->body_map = NULL;
+#endif
+
+  retired->retired = message->retired;
+  message->retired = retired;
+  message->body_borrowed = FALSE;
+
+  return TRUE;
+
+ failed:
+  message->body = retired->body;
+
+#ifdef HAVE_UNIX_FD_PASSING
+  if (message->unix_fds != retired->unix_fds)
+    {
+      close_unix_fds (message->unix_fds, &message->n_unix_fds);
+      dbus_free (message->unix_fds);
+    }
+
+  message->unix_fds = retired->unix_fds;
+  message->n_unix_fds = retired->n_unix_fds;
+  message->n_unix_fds_allocated = retired->n_unix_fds_allocated;
+#endif
+
+  dbus_free (retired);
+  return FALSE;
+}
+
+/**
+ * Makes the body and unix fds of a message safe to modify. A copy
+ * made by dbus_message_copy() gets its own instead of those of the
+ * message it was copied from; a message that copies are reading gets
+ * new ones, leaving the old ones to the copies; and a body that is a
+ * mapping of a memfd is copied into memory. Must be called before
+ * anything modifies the body or the unix fds; does nothing if there
+ * is no need.
+ *
+ * @param message the message
+ * @returns #FALSE if not enough memory or unix fds
+ */
+static dbus_bool_t
+unshare_body (DBusMessage *message)
+{
+  DBusMessage *shared = message->shared;
+  const char *data;
+  int len;
+#ifdef HAVE_UNIX_FD_PASSING
+  int *shared_fds;
+  unsigned n_shared_fds;
+#endif
+
+  if (message->body_borrowed)
+    return retire_body (message);
+
+#ifdef DBUS_HAVE_MEMFD_BODIES
+  if (message->body_map != NULL)
+    return unmap_body (message);
+#endif
+
+  if (shared == NULL)
+    return TRUE;
+
+  data = _dbus_string_get_const_data (&message->body);
+  len = _dbus_string_get_length (&message->body);
+
+#ifdef HAVE_UNIX_FD_PASSING
+  shared_fds = message->unix_fds;
+  n_shared_fds = message->n_unix_fds;
+
+  if (!dup_unix_fds (message))
+    {
+      message->unix_fds = shared_fds;
+      message->n_unix_fds_allocated = 0;
+      return FALSE;
+    }
+#endif
+
+  if (!_dbus_string_init_preallocated (&message->body, len))
+    goto failed;
+
+  /* can't fail, the space is already there */
+  if (!_dbus_string_append_len (&message->body, data, len))
+    _dbus_assert_not_reached ("preallocated body was too short");
+
+  message->shared = NULL;
+  dbus_message_unref (shared);
+
+  return TRUE;
+
+ failed:
+  _dbus_string_init_const_len (&message->body, data, len);
+
+#ifdef HAVE_UNIX_FD_PASSING
+  close_unix_fds (message->unix_fds, &message->n_unix_fds);
+  dbus_free (message->unix_fds);
+  message->unix_fds = shared_fds;
+  message->n_unix_fds = n_shared_fds;
+  message->n_unix_fds_allocated = 0;
+#endif
+
+  return FALSE;
+}
 
 /**
  * Creates a new message that is an exact replica of the message
@@ -1500,6 +1905,14 @@ dbus_message_new_error_printf (DBusMessage *reply_to,
  * outgoing message queue and thus not modifiable) the new message
  * will not be locked.
  *
+ * Copying a message with a large body takes the same time however
+ * large the body is: the copy gets its own header, but reads the body
+ * and unix fds of the original until the copy is appended to, and
+ * keeps a reference to the original until then. If the original is
+ * not locked and is appended to first, it moves to a new body of its
+ * own and leaves the old one to its copies. The messages can be used
+ * from different threads like any others.
+ *
  * @todo This function can't be used in programs that try to recover from OOM errors.
  *
  * @param message the message
@@ -1509,6 +1922,7 @@ DBusMessage *
 dbus_message_copy (const DBusMessage *message)
 {
   DBusMessage *retval;
+  DBusMessage *shared;
 
   _dbus_return_val_if_fail (message != NULL, NULL);
 
@@ -1522,6 +1936,10 @@ dbus_message_copy (const DBusMessage *message)
 #ifndef DBUS_DISABLE_CHECKS
   retval->generation = message->generation;
 #endif
+#ifdef DBUS_HAVE_MEMFD_BODIES
+  retval->body_memfd = -1;
+  retval->body_map = NULL;
+#endif
 
   if (!_dbus_header_copy (&message->header, &retval->header))
     {
@@ -1529,6 +1947,39 @@ dbus_message_copy (const DBusMessage *message)
       return NULL;
     }
 
+  /* Only bodies already in our byte order are shared, since nothing
+   * will swap them. A locked message's body never changes again; an
+   * unlocked one that is about to change moves to a new body, see
+   * retire_body(). Copies of copies read the same body as the copy,
+   * and keep the same original alive.
+   */
+  if (message->shared != NULL)
+    shared = message->shared;
+  else if (_dbus_header_get_byte_order (&message->header) == DBUS_COMPILER_BYTE_ORDER &&
+           _dbus_string_get_length (&message->body) >= MIN_BODY_SIZE_TO_SHARE)
+    shared = (DBusMessage *) message;
+  else
+    shared = NULL;
+
+  if (shared != NULL)
+    {
+      if (shared == message && !message->locked)
+        shared->body_borrowed = TRUE;
+
+      retval->shared = dbus_message_ref (shared);
+      _dbus_string_init_const_len (&retval->body,
+                                   _dbus_string_get_const_data (&message->body),
+                                   _dbus_string_get_length (&message->body));
+#ifdef HAVE_UNIX_FD_PASSING
+      retval->unix_fds = message->unix_fds;
+      retval->n_unix_fds = message->n_unix_fds;
+      retval->n_unix_fds_allocated = 0;
+#endif
+
+      _dbus_message_trace_ref (retval, 0, 1, "copy");
+      return retval;
+    }
+
   if (!_dbus_string_init_preallocated (&retval->body,
                                        _dbus_string_get_length (&message->body)))
     {
@@ -1648,6 +2099,34 @@ dbus_message_get_type (DBusMessage *message)
   return _dbus_header_get_message_type (&message->header);
 }
 
+/**
+ * Makes room in the message body for n_bytes more bytes of arguments,
+ * so that appending that much does not have to grow the body again.
+ * This is only a hint: appending more than was reserved still works,
+ * and appending less wastes the rest until the message is freed.
+ *
+ * Callers building large messages whose size they know roughly in
+ * advance can use this to avoid repeatedly reallocating and copying
+ * the body as it grows.
+ *
+ * @param message the message
+ * @param n_bytes how many more bytes to make room for
+ * @returns #FALSE if not enough memory
+ */
+dbus_bool_t
+dbus_message_reserve_body (DBusMessage *message,
+                           int          n_bytes)
+{
+  _dbus_return_val_if_fail (message != NULL, FALSE);
+  _dbus_return_val_if_fail (!message->locked, FALSE);
+  _dbus_return_val_if_fail (n_bytes >= 0, FALSE);
+
+  if (!unshare_body (message))
+    return FALSE;
+
+  return _dbus_string_alloc_space (&message->body, n_bytes);
+}
+
 /**
  * Appends fields to a message given a variable argument list. The
  * variable argument list should contain the type of each argument
@@ -1806,24 +2285,17 @@ dbus_message_append_args_valist (DBusMessage *message,
               const char ***value_p;
               const char **value;
               int n_elements;
-              int i;
-              
+
               value_p = va_arg (var_args, const char***);
               n_elements = va_arg (var_args, int);
 
               value = *value_p;
-              
-              i = 0;
-              while (i < n_elements)
-                {
-                  if (!dbus_message_iter_append_basic (&array,
-                                                       element_type,
-                                                       &value[i])) {
-                    dbus_message_iter_abandon_container (&iter, &array);
-                    goto failed;
-                  }
-                  ++i;
-                }
+
+              if (!dbus_message_iter_append_string_array (&array, value,
+                                                          n_elements)) {
+                dbus_message_iter_abandon_container (&iter, &array);
+                goto failed;
+              }
             }
           else
             {
@@ -2003,6 +2475,7 @@ dbus_message_iter_init (DBusMessage     *message,
                           type_str, type_pos,
                           &message->body,
                           0);
+  _dbus_type_reader_use_signature_program (&real->u.reader);
 
   return _dbus_type_reader_get_current_type (&real->u.reader) != DBUS_TYPE_INVALID;
 }
@@ -2328,6 +2801,118 @@ dbus_message_iter_get_fixed_array (DBusMessageIter  *iter,
                                       value, n_elements);
 }
 
+/**
+ * Reads the strings from the current position in an array to the end
+ * of the array, without copying them. The array's elements must be
+ * strings, object paths or signatures, or structs or dict entries
+ * whose members are all strings, object paths or signatures. For the
+ * latter, the members of each element come one after another, so an
+ * array of type a{ss} gives key, value, key, value and so on. Calling
+ * this on any other array is a programming error, checked like the
+ * other preconditions, rather than a failure the caller has to handle.
+ *
+ * As with dbus_message_iter_get_fixed_array(), the message iter should
+ * be "in" the array.
+ *
+ * The strings themselves are not copied: they point into the message
+ * and remain valid until the message is freed. Only the table of
+ * pointers and lengths is allocated; it is a single block, to be freed
+ * with dbus_free() on *values. The lengths do not include the nul
+ * terminator. For an empty array, *values and *lengths are set to
+ * #NULL and *n_elements to 0.
+ *
+ * This is much faster than walking the array with an iterator and
+ * calling dbus_message_iter_get_basic() on each element, and unlike
+ * dbus_message_get_args() it does not copy every string.
+ *
+ * @param iter the iterator
+ * @param values location to store the table of strings
+ * @param lengths location to store the length of each string
+ * @param n_elements location to store the number of strings
+ * @returns #FALSE if not enough memory, which is the only failure
+ */
+dbus_bool_t
+dbus_message_iter_get_string_array (DBusMessageIter   *iter,
+                                    const char      ***values,
+                                    int              **lengths,
+                                    int               *n_elements)
+{
+  DBusMessageRealIter *real = (DBusMessageRealIter *)iter;
+  const char **table;
+  int n;
+
+  _dbus_return_val_if_fail (_dbus_message_iter_check (real), FALSE);
+  _dbus_return_val_if_fail (values != NULL, FALSE);
+  _dbus_return_val_if_fail (lengths != NULL, FALSE);
+  _dbus_return_val_if_fail (n_elements != NULL, FALSE);
+
+  *values = NULL;
+  *lengths = NULL;
+  *n_elements = 0;
+
+  n = _dbus_type_reader_read_string_multi (&real->u.reader, NULL, NULL);
+  _dbus_return_val_if_fail (n >= 0, FALSE);
+
+  /* with checks disabled, the wrong kind of array reads as empty */
+  if (n <= 0)
+    return TRUE;
+
+  /* the lengths go after the pointers, which are at least as aligned */
+  table = dbus_malloc (n * (sizeof (const char *) + sizeof (int)));
+  if (table == NULL)
+    return FALSE;
+
+  *values = table;
+  *lengths = (int *) (table + n);
+  *n_elements = _dbus_type_reader_read_string_multi (&real->u.reader,
+                                                     *values, *lengths);
+  _dbus_assert (*n_elements == n);
+
+  return TRUE;
+}
+
+/**
+ * Reads a block of structs or dict entries from the message iterator,
+ * in place, like dbus_message_iter_get_fixed_array() does for basic
+ * types. The elements must contain only fixed-length basic types
+ * other than #DBUS_TYPE_UNIX_FD, possibly in nested structs; the
+ * returned block covers the current position in the array to the end
+ * of the array.
+ *
+ * The members of each element are laid out as they are marshaled:
+ * each member is aligned to its own size, counting from the start of
+ * the element, and booleans take 4 bytes. Elements start stride bytes
+ * apart, which is the size of one element rounded up to a multiple of
+ * 8. So an a(iiu) gives 16-byte elements with the three members at
+ * offsets 0, 4 and 8, and an a{yd} gives 16-byte elements with the
+ * double at offset 8. The values are in the machine's byte order.
+ *
+ * The block is not copied, remains valid until the message is freed,
+ * and should not be freed.
+ *
+ * @param iter the iterator
+ * @param value location to store the first element
+ * @param stride location to store the distance between elements
+ * @param n_elements location to store the number of elements
+ * @returns #FALSE if the elements are not all fixed-length
+ */
+dbus_bool_t
+dbus_message_iter_get_fixed_struct_array (DBusMessageIter  *iter,
+                                          const void      **value,
+                                          int              *stride,
+                                          int              *n_elements)
+{
+  DBusMessageRealIter *real = (DBusMessageRealIter *)iter;
+
+  _dbus_return_val_if_fail (_dbus_message_iter_check (real), FALSE);
+  _dbus_return_val_if_fail (value != NULL, FALSE);
+  _dbus_return_val_if_fail (stride != NULL, FALSE);
+  _dbus_return_val_if_fail (n_elements != NULL, FALSE);
+
+  return _dbus_type_reader_read_fixed_struct_multi (&real->u.reader, value,
+                                                    stride, n_elements);
+}
+
 /**
  * Initializes a #DBusMessageIter for appending arguments to the end
  * of a message.
@@ -2385,6 +2970,10 @@ _dbus_message_iter_open_signature (DBusMessageRealIter *real)
       return TRUE;
     }
 
+  /* all writes to the body and unix fds come through here first */
+  if (!unshare_body (real->message))
+    return FALSE;
+
   str = dbus_new (DBusString, 1);
   if (str == NULL)
     return FALSE;
@@ -2746,6 +3335,87 @@ dbus_message_iter_append_fixed_array (DBusMessageIter *iter,
   return ret;
 }
 
+/**
+ * Appends a block of strings to an array, like
+ * dbus_message_iter_append_fixed_array() does for fixed-length values.
+ * The array's elements must be strings, object paths or signatures, or
+ * structs or dict entries whose members are all strings, object paths
+ * or signatures. For the latter, the members of each element are taken
+ * one after another from values, so to append an a{ss} you pass key,
+ * value, key, value and so on, and n_values must be a multiple of the
+ * number of members. This is the layout
+ * dbus_message_iter_get_string_array() returns.
+ *
+ * You must call dbus_message_iter_open_container() to open the array
+ * first, and may call this function multiple times (and intermixed
+ * with appending elements one at a time) for the same array.
+ *
+ * The size of the whole block is worked out before anything is
+ * written, so the message body grows once rather than once per
+ * string; this is much faster than calling
+ * dbus_message_iter_append_basic() for each element. For the same
+ * reason, if it fails nothing has been appended, and the message can
+ * still be used.
+ *
+ * @param iter the append iterator
+ * @param values the strings
+ * @param n_values the number of strings
+ * @returns #FALSE if not enough memory
+ */
+dbus_bool_t
+dbus_message_iter_append_string_array (DBusMessageIter    *iter,
+                                       const char * const *values,
+                                       int                 n_values)
+{
+  DBusMessageRealIter *real = (DBusMessageRealIter *)iter;
+  int n_members;
+
+  _dbus_return_val_if_fail (_dbus_message_iter_append_check (real), FALSE);
+  _dbus_return_val_if_fail (real->iter_type == DBUS_MESSAGE_ITER_TYPE_WRITER, FALSE);
+  _dbus_return_val_if_fail (real->u.writer.container_type == DBUS_TYPE_ARRAY, FALSE);
+  _dbus_return_val_if_fail (values != NULL || n_values == 0, FALSE);
+  _dbus_return_val_if_fail (n_values >= 0, FALSE);
+
+  n_members = _dbus_type_count_string_members (real->u.writer.type_str,
+                                               real->u.writer.type_pos);
+  _dbus_return_val_if_fail (n_members > 0, FALSE);
+  _dbus_return_val_if_fail (n_values % n_members == 0, FALSE);
+
+#ifndef DBUS_DISABLE_CHECKS
+  {
+    const char *members;
+    int i;
+
+    members = _dbus_string_get_const_data (real->u.writer.type_str) +
+      real->u.writer.type_pos;
+    if (*members == DBUS_STRUCT_BEGIN_CHAR ||
+        *members == DBUS_DICT_ENTRY_BEGIN_CHAR)
+      members++;
+
+    for (i = 0; i < n_values; i++)
+      {
+        switch (members[i % n_members])
+          {
+          case DBUS_TYPE_STRING:
+            _dbus_return_val_if_fail (_dbus_check_is_valid_utf8 (values[i]), FALSE);
+            break;
+
+          case DBUS_TYPE_OBJECT_PATH:
+            _dbus_return_val_if_fail (_dbus_check_is_valid_path (values[i]), FALSE);
+            break;
+
+          default:
+            _dbus_return_val_if_fail (_dbus_check_is_valid_signature (values[i]), FALSE);
+            break;
+          }
+      }
+  }
+#endif
+
+  return _dbus_type_writer_write_string_multi (&real->u.writer, values,
+                                               n_values);
+}
+
 /**
  * Appends a container-typed value to the message; you are required to
  * append the contents of the container using the returned
@@ -3775,6 +4445,22 @@ dbus_message_contains_unix_fds(DBusMessage *message)
  */
 #define INITIAL_LOADER_DATA_LEN 32
 
+#ifdef DBUS_HAVE_MEMFD_BODIES
+/**
+ * Bodies at least this long that arrive in pieces are written to a
+ * memfd as they come in, on loaders that have had
+ * _dbus_message_loader_set_spill_bodies(), instead of growing the
+ * loader's buffer until the whole message is there.
+ */
+#define MIN_BODY_SIZE_FOR_SPILL (1024 * 1024)
+
+/**
+ * How much of a spilled body is buffered before it is written out in
+ * one go; the last piece of the body is written whatever its size.
+ */
+#define SPILL_CHUNK_SIZE (256 * 1024)
+#endif
+
 /**
  * Creates a new message loader. Returns #NULL if memory can't
  * be allocated.
@@ -3820,6 +4506,12 @@ _dbus_message_loader_new (void)
   loader->unix_fds_outstanding = FALSE;
 #endif
 
+#ifdef DBUS_HAVE_MEMFD_BODIES
+  loader->spill_bodies = FALSE;
+  loader->spill_fd = -1;
+  loader->spill_len = 0;
+#endif
+
   return loader;
 }
 
@@ -3852,6 +4544,10 @@ _dbus_message_loader_unref (DBusMessageLoader *loader)
 #ifdef HAVE_UNIX_FD_PASSING
       close_unix_fds(loader->unix_fds, &loader->n_unix_fds);
       dbus_free(loader->unix_fds);
+#endif
+#ifdef DBUS_HAVE_MEMFD_BODIES
+      if (loader->spill_fd >= 0)
+        _dbus_close (loader->spill_fd, NULL);
 #endif
       _dbus_list_foreach (&loader->messages,
                           (DBusForeachFunction) dbus_message_unref,
@@ -3928,6 +4624,8 @@ _dbus_message_loader_get_unix_fds(DBusMessageLoader  *loader,
                                   unsigned           *max_n_fds)
 {
 #ifdef HAVE_UNIX_FD_PASSING
+  unsigned n;
+
   _dbus_assert (!loader->unix_fds_outstanding);
 
   /* Allocate space where we can put the fds we read. We allocate
@@ -3938,16 +4636,24 @@ _dbus_message_loader_get_unix_fds(DBusMessageLoader  *loader,
      beginning. This sucks a bit, however unless SCM_RIGHTS is fixed
      there is no better way. */
 
-  if (loader->n_unix_fds_allocated < loader->max_message_unix_fds)
+  n = loader->max_message_unix_fds;
+
+#ifdef DBUS_HAVE_MEMFD_BODIES
+  /* and one more for the body */
+  if (loader->memfd_bodies)
+    n++;
+#endif
+
+  if (loader->n_unix_fds_allocated < n)
     {
       int *a = dbus_realloc(loader->unix_fds,
-                            loader->max_message_unix_fds * sizeof(loader->unix_fds[0]));
+                            n * sizeof(loader->unix_fds[0]));
 
       if (!a)
         return FALSE;
 
       loader->unix_fds = a;
-      loader->n_unix_fds_allocated = loader->max_message_unix_fds;
+      loader->n_unix_fds_allocated = n;
     }
 
   *fds = loader->unix_fds + loader->n_unix_fds;
@@ -4020,7 +4726,8 @@ load_message (DBusMessageLoader *loader,
               int                byte_order,
               int                fields_array_len,
               int                header_len,
-              int                body_len)
+              int                body_len,
+              dbus_bool_t        body_in_memfd)
 {
   dbus_bool_t oom;
   DBusValidity validity;
@@ -4028,8 +4735,19 @@ load_message (DBusMessageLoader *loader,
   int type_pos;
   DBusValidationMode mode;
   dbus_uint32_t n_unix_fds = 0;
+  const DBusString *body_str;
+  int body_start;
+  int body_wire_len;
+#ifdef DBUS_HAVE_MEMFD_BODIES
+  DBusString mapped_body;
+  const void *map = NULL;
+  int memfd = -1;
+#endif
 
-  mode = DBUS_VALIDATION_MODE_DATA_IS_UNTRUSTED;
+  if (loader->trust_bodies)
+    mode = DBUS_VALIDATION_MODE_DEFER_HEADER_NAMES;
+  else
+    mode = DBUS_VALIDATION_MODE_DATA_IS_UNTRUSTED;
   
   oom = FALSE;
 
@@ -4037,9 +4755,12 @@ load_message (DBusMessageLoader *loader,
   _dbus_verbose_bytes_of_string (&loader->data, 0, header_len /* + body_len */);
 #endif
 
+  /* a body in a memfd takes no space in the stream */
+  body_wire_len = body_in_memfd ? 0 : body_len;
+
   /* 1. VALIDATE AND COPY OVER HEADER */
   _dbus_assert (_dbus_string_get_length (&message->header.data) == 0);
-  _dbus_assert ((header_len + body_len) <= _dbus_string_get_length (&loader->data));
+  _dbus_assert ((header_len + body_wire_len) <= _dbus_string_get_length (&loader->data));
 
   if (!_dbus_header_load (&message->header,
                           mode,
@@ -4069,7 +4790,73 @@ load_message (DBusMessageLoader *loader,
 
   _dbus_assert (validity == DBUS_VALID);
 
+  _dbus_header_get_field_basic(&message->header,
+                               DBUS_HEADER_FIELD_UNIX_FDS,
+                               DBUS_TYPE_UINT32,
+                               &n_unix_fds);
+
+  body_str = &loader->data;
+  body_start = header_len;
+
+#ifdef DBUS_HAVE_MEMFD_BODIES
+  if (body_in_memfd)
+    {
+      DBusError error = DBUS_ERROR_INIT;
+
+      if (loader->spill_fd >= 0)
+        {
+          /* we wrote this one ourselves as the body arrived */
+          memfd = loader->spill_fd;
+
+          if (!_dbus_memfd_seal (memfd, &error))
+            {
+              _dbus_verbose ("Failed to seal spilled body: %s\n",
+                             error.message);
+              dbus_error_free (&error);
+              oom = TRUE;
+              goto failed;
+            }
+        }
+      /* the memfd was sent after the message's own fds */
+      else if (n_unix_fds >= loader->n_unix_fds)
+        {
+          _dbus_verbose ("Message body memfd was not sent\n");
+
+          loader->corrupted = TRUE;
+          loader->corruption_reason = DBUS_INVALID_MISSING_UNIX_FDS;
+          goto failed;
+        }
+      else
+        {
+          memfd = loader->unix_fds[n_unix_fds];
+        }
+
+      map = _dbus_memfd_map_sealed (memfd, body_len, &error);
+
+      if (map == NULL)
+        {
+          _dbus_verbose ("Failed to map message body: %s\n", error.message);
+          dbus_error_free (&error);
+
+          loader->corrupted = TRUE;
+          loader->corruption_reason = DBUS_INVALID_BAD_BODY_MEMFD;
+          goto failed;
+        }
+
+      _dbus_string_init_const_len (&mapped_body, map, body_len);
+      body_str = &mapped_body;
+      body_start = 0;
+
+      /* nobody past the loader needs to know how it got here */
+      _dbus_header_toggle_flag (&message->header,
+                                _DBUS_HEADER_FLAG_BODY_IN_MEMFD, FALSE);
+    }
+#endif
+
   /* 2. VALIDATE BODY */
+  if (loader->trust_bodies)
+    mode = DBUS_VALIDATION_MODE_WE_TRUST_THIS_DATA_ABSOLUTELY;
+
   if (mode != DBUS_VALIDATION_MODE_WE_TRUST_THIS_DATA_ABSOLUTELY)
     {
       get_const_signature (&message->header, &type_str, &type_pos);
@@ -4081,8 +4868,8 @@ load_message (DBusMessageLoader *loader,
                                                   type_pos,
                                                   byte_order,
                                                   NULL,
-                                                  &loader->data,
-                                                  header_len,
+                                                  body_str,
+                                                  body_start,
                                                   body_len);
       if (validity != DBUS_VALID)
         {
@@ -4096,11 +4883,6 @@ load_message (DBusMessageLoader *loader,
     }
 
   /* 3. COPY OVER UNIX FDS */
-  _dbus_header_get_field_basic(&message->header,
-                               DBUS_HEADER_FIELD_UNIX_FDS,
-                               DBUS_TYPE_UINT32,
-                               &n_unix_fds);
-
 #ifdef HAVE_UNIX_FD_PASSING
 
   if (n_unix_fds > loader->n_unix_fds)
@@ -4129,7 +4911,8 @@ load_message (DBusMessageLoader *loader,
 
       message->n_unix_fds_allocated = message->n_unix_fds = n_unix_fds;
       loader->n_unix_fds -= n_unix_fds;
-      memmove(loader->unix_fds + n_unix_fds, loader->unix_fds, loader->n_unix_fds);
+      memmove (loader->unix_fds, loader->unix_fds + n_unix_fds,
+               loader->n_unix_fds * sizeof (loader->unix_fds[0]));
     }
   else
     message->unix_fds = NULL;
@@ -4159,16 +4942,56 @@ load_message (DBusMessageLoader *loader,
 
   _dbus_assert (_dbus_string_get_length (&message->body) == 0);
   _dbus_assert (_dbus_string_get_length (&loader->data) >=
-                (header_len + body_len));
+                (header_len + body_wire_len));
 
-  if (!_dbus_string_copy_len (&loader->data, header_len, body_len, &message->body, 0))
+#ifdef DBUS_HAVE_MEMFD_BODIES
+  /* keep the mapping as the body, unless it has to be swapped */
+  if (body_in_memfd && byte_order == DBUS_COMPILER_BYTE_ORDER)
+    {
+      _dbus_string_free (&message->body);
+      _dbus_string_init_const_len (&message->body, map, body_len);
+      message->body_map = map;
+      /* not counted yet, _dbus_message_add_counter_link() counts it */
+      _dbus_assert (message->counters == NULL);
+      message->body_memfd = memfd;
+      map = NULL;
+    }
+  else
+#endif
+  if (!_dbus_string_copy_len (body_str, body_start, body_len, &message->body, 0))
     {
       _dbus_verbose ("Failed to move body into new message\n");
       oom = TRUE;
       goto failed;
     }
 
-  _dbus_string_delete (&loader->data, 0, header_len + body_len);
+#ifdef DBUS_HAVE_MEMFD_BODIES
+  if (body_in_memfd)
+    {
+      if (loader->spill_fd >= 0)
+        {
+          _dbus_assert (loader->spill_fd == memfd);
+          loader->spill_fd = -1;
+          loader->spill_len = 0;
+        }
+      else
+        {
+          /* the message's own fds were taken off the front already */
+          _dbus_assert (loader->unix_fds[0] == memfd);
+          loader->n_unix_fds -= 1;
+          memmove (loader->unix_fds, loader->unix_fds + 1,
+                   loader->n_unix_fds * sizeof (loader->unix_fds[0]));
+        }
+
+      if (map != NULL)
+        {
+          _dbus_memfd_unmap (map, body_len);
+          _dbus_close (memfd, NULL);
+        }
+    }
+#endif
+
+  _dbus_string_delete (&loader->data, 0, header_len + body_wire_len);
 
   /* don't waste more than 2k of memory */
   _dbus_string_compact (&loader->data, 2048);
@@ -4189,6 +5012,13 @@ load_message (DBusMessageLoader *loader,
 
   /* Clean up */
 
+#ifdef DBUS_HAVE_MEMFD_BODIES
+  /* the memfd itself stays with the loader's other fds, or as the
+   * loader's spill_fd */
+  if (map != NULL)
+    _dbus_memfd_unmap (map, body_len);
+#endif
+
   /* does nothing if the message isn't in the list */
   _dbus_list_remove_last (&loader->messages, message);
   
@@ -4202,6 +5032,62 @@ load_message (DBusMessageLoader *loader,
   return FALSE;
 }
 
+#ifdef DBUS_HAVE_MEMFD_BODIES
+/*
+ * Moves what has arrived of the body of the message at the start of
+ * loader->data into loader->spill_fd, once there is at least
+ * SPILL_CHUNK_SIZE of it or it is the rest of the body, so that only
+ * the header and less than a chunk of the body are ever buffered. The
+ * memfd is created on the first write. If it cannot be created,
+ * spilling is turned off and the body is buffered as usual.
+ *
+ * Returns FALSE if the bytes could not be written, leaving them in
+ * loader->data to be tried again.
+ */
+static dbus_bool_t
+spill_body (DBusMessageLoader *loader,
+            int                header_len,
+            int                body_len)
+{
+  DBusError error = DBUS_ERROR_INIT;
+  int len;
+
+  len = _dbus_string_get_length (&loader->data) - header_len;
+  len = MIN (len, body_len - loader->spill_len);
+
+  if (len < SPILL_CHUNK_SIZE && len < body_len - loader->spill_len)
+    return TRUE;
+
+  if (loader->spill_fd < 0)
+    {
+      loader->spill_fd = _dbus_memfd_new (&error);
+
+      if (loader->spill_fd < 0)
+        {
+          _dbus_verbose ("Not spilling message bodies: %s\n", error.message);
+          dbus_error_free (&error);
+          loader->spill_bodies = FALSE;
+          return TRUE;
+        }
+    }
+
+  if (!_dbus_memfd_write (loader->spill_fd, loader->spill_len,
+                          &loader->data, header_len, len, &error))
+    {
+      _dbus_verbose ("Failed to spill message body: %s\n", error.message);
+      dbus_error_free (&error);
+      return FALSE;
+    }
+
+  /* the buffer keeps its size for the next chunk; load_message()
+   * compacts it once the message is complete */
+  loader->spill_len += len;
+  _dbus_string_delete (&loader->data, header_len, len);
+
+  return TRUE;
+}
+#endif
+
 /**
  * Converts buffered data into messages, if we have enough data.  If
  * we don't have enough data, does nothing.
@@ -4224,15 +5110,54 @@ _dbus_message_loader_queue_messages (DBusMessageLoader *loader)
     {
       DBusValidity validity;
       int byte_order, fields_array_len, header_len, body_len;
+      dbus_bool_t have_message;
+      dbus_bool_t body_in_memfd;
+
+      have_message =
+        _dbus_header_have_message_untrusted (loader->max_message_size,
+                                             &validity,
+                                             &byte_order,
+                                             &fields_array_len,
+                                             &header_len,
+                                             &body_len,
+                                             &loader->data, 0,
+                                             _dbus_string_get_length (&loader->data));
+      body_in_memfd = FALSE;
+
+#ifdef DBUS_HAVE_MEMFD_BODIES
+      /* only the header is in the stream then */
+      if (validity == DBUS_VALID && loader->memfd_bodies &&
+          loader->spill_fd < 0 &&
+          _dbus_header_peek_flag (&loader->data, 0,
+                                  _DBUS_HEADER_FLAG_BODY_IN_MEMFD))
+        {
+          body_in_memfd = TRUE;
+          have_message = header_len <= _dbus_string_get_length (&loader->data);
+        }
+      else if (loader->spill_fd >= 0 ||
+               (validity == DBUS_VALID && !have_message &&
+                loader->spill_bodies &&
+                body_len >= MIN_BODY_SIZE_FOR_SPILL &&
+                header_len + SPILL_CHUNK_SIZE <=
+                _dbus_string_get_length (&loader->data)))
+        {
+          /* what follows the header is only the part of the body that
+           * has not been spilled yet, so the length check above means
+           * nothing once spilling has started */
+          _dbus_assert (validity == DBUS_VALID);
+
+          if (!spill_body (loader, header_len, body_len))
+            return FALSE;
+
+          if (loader->spill_fd >= 0)
+            {
+              body_in_memfd = TRUE;
+              have_message = loader->spill_len == body_len;
+            }
+        }
+#endif
 
-      if (_dbus_header_have_message_untrusted (loader->max_message_size,
-                                               &validity,
-                                               &byte_order,
-                                               &fields_array_len,
-                                               &header_len,
-                                               &body_len,
-                                               &loader->data, 0,
-                                               _dbus_string_get_length (&loader->data)))
+      if (have_message)
         {
           DBusMessage *message;
 
@@ -4244,7 +5169,7 @@ _dbus_message_loader_queue_messages (DBusMessageLoader *loader)
 
           if (!load_message (loader, message,
                              byte_order, fields_array_len,
-                             header_len, body_len))
+                             header_len, body_len, body_in_memfd))
             {
               dbus_message_unref (message);
               /* load_message() returns false if corrupted or OOM; if
@@ -4346,6 +5271,28 @@ _dbus_message_loader_get_is_corrupted (DBusMessageLoader *loader)
   return loader->corrupted;
 }
 
+/**
+ * Marks the loader as corrupted because a message it already returned
+ * turned out to be invalid when checked later, so that it loads
+ * nothing more and reports the reason as if it had rejected the
+ * message itself.
+ *
+ * @param loader the loader
+ * @param reason why the message was invalid
+ */
+void
+_dbus_message_loader_set_corrupted (DBusMessageLoader *loader,
+                                    DBusValidity       reason)
+{
+  _dbus_assert (reason != DBUS_VALID);
+
+  if (loader->corrupted)
+    return;
+
+  loader->corrupted = TRUE;
+  loader->corruption_reason = reason;
+}
+
 /**
  * Checks what kind of bad data confused the loader.
  *
@@ -4423,6 +5370,78 @@ _dbus_message_loader_get_max_message_unix_fds (DBusMessageLoader  *loader)
   return loader->max_message_unix_fds;
 }
 
+/**
+ * Sets whether the bodies of loaded messages are validated. Headers
+ * are always validated, so the loader still splits the data into
+ * messages correctly and never reads outside them; but a malformed
+ * body is then only noticed, if at all, by assertions when it is read.
+ * Only use this for data from a peer that has already validated the
+ * bodies itself and can be trusted not to hand over corrupt ones.
+ *
+ * A trusting loader also leaves the bus names, interface, member and
+ * error name in each header unchecked (see
+ * #DBUS_VALIDATION_MODE_DEFER_HEADER_NAMES). The connection checks
+ * them with _dbus_message_check_deferred_fields() as each message
+ * leaves its incoming queue, so the work is done by the thread that
+ * takes the message rather than the one reading from the socket.
+ *
+ * @param loader the loader
+ * @param trust #TRUE to skip validating bodies
+ */
+void
+_dbus_message_loader_set_trust_bodies (DBusMessageLoader *loader,
+                                       dbus_bool_t        trust)
+{
+  loader->trust_bodies = trust != FALSE;
+}
+
+/**
+ * Gets whether the bodies of loaded messages are validated.
+ *
+ * @param loader the loader
+ * @returns #TRUE if bodies are not validated
+ */
+dbus_bool_t
+_dbus_message_loader_get_trust_bodies (DBusMessageLoader *loader)
+{
+  return loader->trust_bodies;
+}
+
+#ifdef DBUS_HAVE_MEMFD_BODIES
+/**
+ * Sets whether the peer agreed to send large message bodies in
+ * sealed memfds, so that a header flagged with
+ * #_DBUS_HEADER_FLAG_BODY_IN_MEMFD has no body in the stream after
+ * it. Otherwise the flag is ignored like any unknown flag.
+ *
+ * @param loader the loader
+ * @param enabled #TRUE if bodies may come in memfds
+ */
+void
+_dbus_message_loader_set_memfd_bodies (DBusMessageLoader *loader,
+                                       dbus_bool_t        enabled)
+{
+  loader->memfd_bodies = enabled != FALSE;
+}
+
+/**
+ * Sets whether bodies of at least #MIN_BODY_SIZE_FOR_SPILL bytes are
+ * written to a memfd as they arrive, rather than buffered until the
+ * whole message is there. The memfd becomes the message's body memfd
+ * and counts against the receiver's unix fd limits like one sent by
+ * the peer. Off by default.
+ *
+ * @param loader the loader
+ * @param spill #TRUE to spill large bodies
+ */
+void
+_dbus_message_loader_set_spill_bodies (DBusMessageLoader *loader,
+                                       dbus_bool_t        spill)
+{
+  loader->spill_bodies = spill != FALSE;
+}
+#endif
+
 static DBusDataSlotAllocator slot_allocator;
 _DBUS_DEFINE_GLOBAL_LOCK (message_slots);
 
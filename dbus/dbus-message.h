@@ -80,6 +80,8 @@ DBusMessage* dbus_message_new_signal        (const char  *path,
                                              const char  *interface,
                                              const char  *name);
 DBUS_EXPORT
+DBusMessage* dbus_message_new_from_template (DBusMessage *template_message);
+DBUS_EXPORT
 DBusMessage* dbus_message_new_error         (DBusMessage *reply_to,
                                              const char  *error_name,
                                              const char  *error_message);
@@ -186,6 +188,9 @@ dbus_bool_t   dbus_message_get_path_decomposed (DBusMessage   *message,
                                                 char        ***path);
 
 DBUS_EXPORT
+dbus_bool_t dbus_message_reserve_body         (DBusMessage     *message,
+                                               int              n_bytes);
+DBUS_EXPORT
 dbus_bool_t dbus_message_append_args          (DBusMessage     *message,
 					       int              first_arg_type,
 					       ...);
@@ -237,6 +242,16 @@ DBUS_EXPORT
 void        dbus_message_iter_get_fixed_array  (DBusMessageIter *iter,
                                                 void            *value,
                                                 int             *n_elements);
+DBUS_EXPORT
+dbus_bool_t dbus_message_iter_get_string_array   (DBusMessageIter   *iter,
+                                                  const char      ***values,
+                                                  int              **lengths,
+                                                  int               *n_elements);
+DBUS_EXPORT
+dbus_bool_t dbus_message_iter_get_fixed_struct_array (DBusMessageIter  *iter,
+                                                      const void      **value,
+                                                      int              *stride,
+                                                      int              *n_elements);
 
 
 DBUS_EXPORT
@@ -252,6 +267,10 @@ dbus_bool_t dbus_message_iter_append_fixed_array (DBusMessageIter *iter,
                                                   const void      *value,
                                                   int              n_elements);
 DBUS_EXPORT
+dbus_bool_t dbus_message_iter_append_string_array (DBusMessageIter    *iter,
+                                                   const char * const *values,
+                                                   int                 n_values);
+DBUS_EXPORT
 dbus_bool_t dbus_message_iter_open_container     (DBusMessageIter *iter,
                                                   int              type,
                                                   const char      *contained_signature,
@@ -60,8 +60,30 @@ struct DBusObjectTree
   DBusConnection     *connection; /**< Connection this tree belongs to */
 
   DBusObjectSubtree  *root;       /**< Root of the tree ("/" node) */
+
+  DBusHashTable      *path_cache;       /**< Object path string to #DBusObjectPathCacheEntry */
+  unsigned int        cache_generation; /**< Bumped whenever the shape of the tree changes */
+  int                 cache_key_bytes;  /**< Total length of the paths in path_cache */
 };
 
+/**
+ * What find_handler() returned for one object path, remembered so
+ * that dispatching to the same path again needs neither a decomposed
+ * path nor a walk down the tree. Only valid while its generation
+ * matches the tree's.
+ */
+typedef struct
+{
+  unsigned int        generation;  /**< Tree's cache_generation when this was filled in */
+  DBusObjectSubtree  *subtree;     /**< Deepest subtree covering the path, or #NULL */
+  dbus_bool_t         exact_match; /**< Whether subtree is at the path itself */
+} DBusObjectPathCacheEntry;
+
+/** Most object paths remembered at once; the cache starts again when full */
+#define PATH_CACHE_MAX_ENTRIES 16384
+/** Most bytes of object paths remembered at once, likewise */
+#define PATH_CACHE_MAX_KEY_BYTES (256 * 1024)
+
 /**
  * Struct representing a single registered subtree handler, or node
  * that's a parent of a registered subtree handler. If
@@ -108,12 +130,20 @@ _dbus_object_tree_new (DBusConnection *connection)
   if (tree->root == NULL)
     goto oom;
   tree->root->invoke_as_fallback = TRUE;
+
+  tree->path_cache = _dbus_hash_table_new (DBUS_HASH_STRING,
+                                           dbus_free, dbus_free);
+  if (tree->path_cache == NULL)
+    goto oom;
   
   return tree;
 
  oom:
   if (tree)
     {
+      if (tree->root)
+        _dbus_object_subtree_unref (tree->root);
+
       dbus_free (tree);
     }
 
@@ -150,6 +180,7 @@ _dbus_object_tree_unref (DBusObjectTree *tree)
     {
       _dbus_object_tree_free_all_unlocked (tree);
 
+      _dbus_hash_table_unref (tree->path_cache);
       dbus_free (tree);
     }
 }
@@ -363,6 +394,118 @@ find_handler (DBusObjectTree *tree,
   return find_subtree_recurse (tree->root, path, FALSE, NULL, exact_match);
 }
 
+/*
+ * Forgets every cached lookup. Entries are checked against the
+ * generation as they are used, so this costs the same however many
+ * paths are cached.
+ */
+static void
+invalidate_path_cache (DBusObjectTree *tree)
+{
+  tree->cache_generation += 1;
+
+  /* in case it wraps round to the generation of a stale entry */
+  if (tree->cache_generation == 0)
+    {
+      _dbus_hash_table_remove_all (tree->path_cache);
+      tree->cache_key_bytes = 0;
+    }
+}
+
+/*
+ * Whether dispatching to a path that find_handler() answered with
+ * subtree and exact_match would run any handler at all.
+ */
+static dbus_bool_t
+subtree_has_handler (DBusObjectSubtree *subtree,
+                     dbus_bool_t        exact_match)
+{
+  while (subtree != NULL)
+    {
+      if (subtree->message_function != NULL &&
+          (exact_match || subtree->invoke_as_fallback))
+        return TRUE;
+
+      exact_match = FALSE;
+      subtree = subtree->parent;
+    }
+
+  return FALSE;
+}
+
+/*
+ * Like find_handler(), but for the path of a message, and remembers
+ * the answer for next time if some handler covers the path, so that
+ * messages to made-up paths cannot fill the cache. Returns #FALSE if
+ * there was no memory to decompose the path; failing to remember it
+ * is not an error.
+ */
+static dbus_bool_t
+find_handler_cached (DBusObjectTree      *tree,
+                     DBusMessage         *message,
+                     const char          *path,
+                     DBusObjectSubtree  **subtree_p,
+                     dbus_bool_t         *exact_match)
+{
+  DBusObjectPathCacheEntry *entry;
+  char **decomposed;
+  char *key;
+  int key_len;
+
+  entry = _dbus_hash_table_lookup_string (tree->path_cache, path);
+  if (entry != NULL && entry->generation == tree->cache_generation)
+    {
+      *subtree_p = entry->subtree;
+      *exact_match = entry->exact_match;
+      return TRUE;
+    }
+
+  if (!dbus_message_get_path_decomposed (message, &decomposed))
+    return FALSE;
+
+  _dbus_assert (decomposed != NULL);
+
+  *subtree_p = find_handler (tree, (const char **) decomposed, exact_match);
+  dbus_free_string_array (decomposed);
+
+  if (entry == NULL)
+    {
+      if (!subtree_has_handler (*subtree_p, *exact_match))
+        return TRUE;
+
+      key_len = strlen (path) + 1;
+
+      if (_dbus_hash_table_get_n_entries (tree->path_cache) >=
+          PATH_CACHE_MAX_ENTRIES ||
+          tree->cache_key_bytes + key_len > PATH_CACHE_MAX_KEY_BYTES)
+        {
+          _dbus_hash_table_remove_all (tree->path_cache);
+          tree->cache_key_bytes = 0;
+        }
+
+      entry = dbus_new (DBusObjectPathCacheEntry, 1);
+      if (entry == NULL)
+        return TRUE;
+
+      key = _dbus_strdup (path);
+      if (key == NULL ||
+          !_dbus_hash_table_insert_string (tree->path_cache, key, entry))
+        {
+          dbus_free (key);
+          dbus_free (entry);
+          return TRUE;
+        }
+
+      tree->cache_key_bytes += key_len;
+    }
+
+  entry->generation = tree->cache_generation;
+  entry->subtree = *subtree_p;
+  entry->exact_match = *exact_match;
+
+  return TRUE;
+}
+
 static DBusObjectSubtree*
 ensure_subtree (DBusObjectTree *tree,
                 const char    **path)
@@ -401,6 +544,9 @@ _dbus_object_tree_register (DBusObjectTree              *tree,
   _dbus_assert (vtable->message_function != NULL);
   _dbus_assert (path != NULL);
 
+  /* ensure_subtree() may add nodes even if we go on to fail */
+  invalidate_path_cache (tree);
+
   subtree = ensure_subtree (tree, path);
   if (subtree == NULL)
     {
@@ -472,6 +618,8 @@ _dbus_object_tree_unregister_and_unlock (DBusObjectTree          *tree,
   _dbus_assert (subtree->parent == NULL ||
                 (i >= 0 && subtree->parent->subtrees[i] == subtree));
 
+  invalidate_path_cache (tree);
+
   subtree->message_function = NULL;
 
   unregister_function = subtree->unregister_function;
@@ -562,6 +710,8 @@ free_subtree_recurse (DBusConnection    *connection,
 void
 _dbus_object_tree_free_all_unlocked (DBusObjectTree *tree)
 {
+  invalidate_path_cache (tree);
+
   if (tree->root)
     free_subtree_recurse (tree->connection,
                           tree->root);
@@ -614,11 +764,11 @@ _dbus_object_tree_list_registered_unlocked (DBusObjectTree *tree,
 
 static DBusHandlerResult
 handle_default_introspect_and_unlock (DBusObjectTree          *tree,
-                                      DBusMessage             *message,
-                                      const char             **path)
+                                      DBusMessage             *message)
 {
   DBusString xml;
   DBusHandlerResult result;
+  char **path;
   char **children;
   int i;
   DBusMessage *reply;
@@ -666,8 +816,18 @@ handle_default_introspect_and_unlock (DBusObjectTree          *tree,
 
   result = DBUS_HANDLER_RESULT_NEED_MEMORY;
 
+  path = NULL;
   children = NULL;
-  if (!_dbus_object_tree_list_registered_unlocked (tree, path, &children))
+
+  /* only now, since dispatch works from the path cache */
+  if (!dbus_message_get_path_decomposed (message, &path))
+    goto out;
+
+  _dbus_assert (path != NULL);
+
+  if (!_dbus_object_tree_list_registered_unlocked (tree,
+                                                   (const char **) path,
+                                                   &children))
     goto out;
 
   if (!_dbus_string_append (&xml, DBUS_INTROSPECT_1_0_XML_DOCTYPE_DECL_NODE))
@@ -723,6 +883,7 @@ handle_default_introspect_and_unlock (DBusObjectTree          *tree,
     }
   
   _dbus_string_free (&xml);
+  dbus_free_string_array (path);
   dbus_free_string_array (children);
   if (reply)
     dbus_message_unref (reply);
@@ -737,6 +898,10 @@ handle_default_introspect_and_unlock (DBusObjectTree          *tree,
  * number of path elements; that is, message to /foo/bar/baz would go
  * to the handler for /foo/bar before the one for /foo.
  *
+ * Which handlers cover a path is cached by the full path string, so
+ * repeated calls to one object neither decompose the path nor search
+ * the tree again until an object is registered or unregistered.
+ *
  * @todo thread problems
  *
  * @param tree the global object tree
@@ -748,7 +913,7 @@ _dbus_object_tree_dispatch_and_unlock (DBusObjectTree          *tree,
                                        DBusMessage             *message,
                                        dbus_bool_t             *found_object)
 {
-  char **path;
+  const char *path;
   dbus_bool_t exact_match;
   DBusList *list;
   DBusList *link;
@@ -759,8 +924,8 @@ _dbus_object_tree_dispatch_and_unlock (DBusObjectTree          *tree,
   _dbus_verbose ("Dispatch of message by object path\n");
 #endif
   
-  path = NULL;
-  if (!dbus_message_get_path_decomposed (message, &path))
+  path = dbus_message_get_path (message);
+  if (path == NULL)
     {
 #ifdef DBUS_BUILD_TESTS
       if (tree->connection)
@@ -770,12 +935,12 @@ _dbus_object_tree_dispatch_and_unlock (DBusObjectTree          *tree,
           _dbus_connection_unlock (tree->connection);
         }
       
-      _dbus_verbose ("No memory to get decomposed path\n");
-
-      return DBUS_HANDLER_RESULT_NEED_MEMORY;
+      _dbus_verbose ("No path field in message\n");
+      return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
     }
-
-  if (path == NULL)
+  
+  /* Find the deepest path that covers the path in the message */
+  if (!find_handler_cached (tree, message, path, &subtree, &exact_match))
     {
 #ifdef DBUS_BUILD_TESTS
       if (tree->connection)
@@ -785,13 +950,11 @@ _dbus_object_tree_dispatch_and_unlock (DBusObjectTree          *tree,
           _dbus_connection_unlock (tree->connection);
         }
       
-      _dbus_verbose ("No path field in message\n");
-      return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+      _dbus_verbose ("No memory to get decomposed path\n");
+
+      return DBUS_HANDLER_RESULT_NEED_MEMORY;
     }
   
-  /* Find the deepest path that covers the path in the message */
-  subtree = find_handler (tree, (const char**) path, &exact_match);
-  
   if (found_object)
     *found_object = !!subtree;
 
@@ -881,8 +1044,7 @@ _dbus_object_tree_dispatch_and_unlock (DBusObjectTree          *tree,
     {
       /* This hardcoded default handler does a minimal Introspect()
        */
-      result = handle_default_introspect_and_unlock (tree, message,
-                                                     (const char**) path);
+      result = handle_default_introspect_and_unlock (tree, message);
     }
   else
     {
@@ -901,8 +1063,6 @@ _dbus_object_tree_dispatch_and_unlock (DBusObjectTree          *tree,
       _dbus_object_subtree_unref (link->data);
       _dbus_list_remove_link (&list, link);
     }
-  
-  dbus_free_string_array (path);
 
   return result;
 }
@@ -1932,6 +2092,47 @@ object_tree_test_iteration (void *data)
     goto out;
   if (!do_test_dispatch (tree, path8, 8, tree_test_data, _DBUS_N_ELEMENTS (tree_test_data)))
     goto out;
+
+  /* Again, with the lookups now cached */
+  if (!do_test_dispatch (tree, path3, 3, tree_test_data, _DBUS_N_ELEMENTS (tree_test_data)))
+    goto out;
+
+  /* Changes to the tree are seen by the next dispatch to a cached path;
+   * only the handlers up to path2 are checked, since path3 is gone */
+  _dbus_object_tree_unregister_and_unlock (tree, path3);
+  tree_test_data[3].message_handled = FALSE;
+  if (!do_test_dispatch (tree, path3, 2, tree_test_data, 3))
+    goto out;
+  _dbus_assert (!tree_test_data[3].message_handled);
+
+  if (!do_register (tree, path3, TRUE, 3, tree_test_data))
+    goto out;
+  if (!do_test_dispatch (tree, path3, 3, tree_test_data, _DBUS_N_ELEMENTS (tree_test_data)))
+    goto out;
+
+  /* Paths that no handler covers are not remembered */
+  _dbus_object_tree_unregister_and_unlock (tree, path0);
+  {
+    DBusMessage *message;
+    int n_cached;
+
+    message = dbus_message_new_method_call (NULL, "/nowhere",
+                                            "org.freedesktop.TestInterface",
+                                            "Foo");
+    if (message == NULL)
+      goto out;
+
+    n_cached = _dbus_hash_table_get_n_entries (tree->path_cache);
+    if (_dbus_object_tree_dispatch_and_unlock (tree, message, NULL) ==
+        DBUS_HANDLER_RESULT_NEED_MEMORY)
+      {
+        dbus_message_unref (message);
+        goto out;
+      }
+    _dbus_assert (_dbus_hash_table_get_n_entries (tree->path_cache) ==
+                  n_cached);
+    dbus_message_unref (message);
+  }
   
  out:
   if (tree)
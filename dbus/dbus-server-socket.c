@@ -25,6 +25,7 @@
 #include "dbus-internals.h"
 #include "dbus-server-socket.h"
 #include "dbus-transport-socket.h"
+#include "dbus-transport-shm.h"
 #include "dbus-connection-internal.h"
 #include "dbus-memory.h"
 #include "dbus-nonce.h"
@@ -55,8 +56,17 @@ struct DBusServerSocket
   DBusWatch **watch; /**< File descriptor watch. */
   char *socket_name; /**< Name of domain socket, to unlink if appropriate */
   DBusNonceFile *noncefile; /**< Nonce file used to authenticate clients */
+  dbus_bool_t use_shm; /**< Clients send messages through shared memory */
 };
 
+/**
+ * How many clients to accept each time a listening socket becomes
+ * readable, so that a burst of clients connecting at once is not
+ * drained one main loop iteration at a time, but other work is not
+ * held up indefinitely either.
+ */
+#define MAX_ACCEPTS_PER_WAKEUP 32
+
 static void
 socket_finalize (DBusServer *server)
 {
@@ -81,7 +91,8 @@ socket_finalize (DBusServer *server)
   dbus_free (server);
 }
 
-/* Return value is just for memory, not other failures. */
+/* Return value is just for memory, not other failures.
+ * client_fd must already be nonblocking. */
 static dbus_bool_t
 handle_new_client_fd_and_unlock (DBusServer *server,
                                  int         client_fd)
@@ -95,13 +106,13 @@ handle_new_client_fd_and_unlock (DBusServer *server,
 
   HAVE_LOCK_CHECK (server);
 
-  if (!_dbus_set_fd_nonblocking (client_fd, NULL))
-    {
-      SERVER_UNLOCK (server);
-      return TRUE;
-    }
-
-  transport = _dbus_transport_new_for_socket (client_fd, &server->guid_hex, FALSE);
+#ifdef DBUS_HAVE_SHM_CHANNEL
+  if (((DBusServerSocket *) server)->use_shm)
+    transport = _dbus_transport_new_for_shm (client_fd, NULL,
+                                             &server->guid_hex, NULL);
+  else
+#endif
+    transport = _dbus_transport_new_for_socket (client_fd, &server->guid_hex, FALSE);
   if (transport == NULL)
     {
       _dbus_close_socket (client_fd, NULL);
@@ -182,33 +193,67 @@ socket_handle_watch (DBusWatch    *watch,
 
   if (flags & DBUS_WATCH_READABLE)
     {
-      int client_fd;
       int listen_fd;
+      int n_accepted;
 
       listen_fd = dbus_watch_get_socket (watch);
 
-      if (socket_server->noncefile)
-          client_fd = _dbus_accept_with_noncefile (listen_fd, socket_server->noncefile);
-      else 
-          client_fd = _dbus_accept (listen_fd);
+      /* handle_new_client_fd_and_unlock() runs the new connection
+       * function, which might drop the last reference to the server
+       */
+      _dbus_server_ref_unlocked (server);
 
-      if (client_fd < 0)
+      /* The listening socket is nonblocking, so this stops as soon as
+       * the backlog is empty.
+       */
+      for (n_accepted = 0; n_accepted < MAX_ACCEPTS_PER_WAKEUP; n_accepted++)
         {
-          /* EINTR handled for us */
+          int client_fd;
 
-          if (_dbus_get_is_errno_eagain_or_ewouldblock ())
-            _dbus_verbose ("No client available to accept after all\n");
+          if (server->disconnected || !dbus_watch_get_enabled (watch))
+            break;
+
+          if (socket_server->noncefile)
+            {
+              client_fd = _dbus_accept_with_noncefile (listen_fd, socket_server->noncefile);
+
+              if (client_fd >= 0 && !_dbus_set_fd_nonblocking (client_fd, NULL))
+                {
+                  _dbus_close_socket (client_fd, NULL);
+                  continue;
+                }
+            }
           else
-            _dbus_verbose ("Failed to accept a client connection: %s\n",
-                           _dbus_strerror_from_errno ());
+            {
+              client_fd = _dbus_accept_nonblocking (listen_fd);
+            }
+
+          if (client_fd < 0)
+            {
+              /* EINTR handled for us */
+
+              if (_dbus_get_is_errno_eagain_or_ewouldblock ())
+                _dbus_verbose ("No more clients to accept after %d\n",
+                               n_accepted);
+              else
+                _dbus_verbose ("Failed to accept a client connection: %s\n",
+                               _dbus_strerror_from_errno ());
+
+              break;
+            }
 
-          SERVER_UNLOCK (server);
-        }
-      else
-        {
           if (!handle_new_client_fd_and_unlock (server, client_fd))
             _dbus_verbose ("Rejected client connection due to lack of memory\n");
+
+          SERVER_LOCK (server);
         }
+
+      SERVER_UNLOCK (server);
+      dbus_server_unref (server);
+    }
+  else
+    {
+      SERVER_UNLOCK (server);
     }
 
   if (flags & DBUS_WATCH_ERROR)
@@ -581,6 +626,22 @@ _dbus_server_socket_own_filename (DBusServer *server,
   socket_server->socket_name = filename;
 }
 
+#ifdef DBUS_HAVE_SHM_CHANNEL
+/**
+ * Makes the server create connections that exchange messages through
+ * shared memory once authenticated; see _dbus_transport_new_for_shm().
+ *
+ * @param server a socket server
+ */
+void
+_dbus_server_socket_use_shm (DBusServer *server)
+{
+  DBusServerSocket *socket_server = (DBusServerSocket*) server;
+
+  socket_server->use_shm = TRUE;
+}
+#endif
+
 
 /** @} */
 
@@ -26,6 +26,7 @@
 #include <dbus/dbus-internals.h>
 #include <dbus/dbus-server-protected.h>
 #include <dbus/dbus-nonce.h>
+#include <dbus/dbus-shm-channel.h>
 
 DBUS_BEGIN_DECLS
 
@@ -48,6 +49,9 @@ DBusServerListenResult _dbus_server_listen_socket (DBusAddressEntry  *entry,
 
 void _dbus_server_socket_own_filename (DBusServer *server,
                                        char       *filename);
+#ifdef DBUS_HAVE_SHM_CHANNEL
+void _dbus_server_socket_use_shm      (DBusServer *server);
+#endif
 
 DBUS_END_DECLS
 
@@ -39,6 +39,11 @@
  * @{
  */
 
+static DBusServer* new_for_domain_socket (const char  *method,
+                                          const char  *path,
+                                          dbus_bool_t  abstract,
+                                          DBusError   *error);
+
 /**
  * Tries to interpret the address entry in a platform-specific
  * way, creating a platform-specific server type if appropriate.
@@ -56,12 +61,24 @@ _dbus_server_listen_platform_specific (DBusAddressEntry *entry,
                                        DBusError        *error)
 {
   const char *method;
+  dbus_bool_t use_shm = FALSE;
+  dbus_bool_t use_seqpacket = FALSE;
 
   *server_p = NULL;
 
   method = dbus_address_entry_get_method (entry);
 
-  if (strcmp (method, "unix") == 0)
+#ifdef DBUS_HAVE_SHM_CHANNEL
+  /* listens like unix:, but connections use shared memory */
+  use_shm = strcmp (method, "shm") == 0;
+#endif
+
+#ifdef DBUS_HAVE_SEQPACKET
+  /* listens like unix:, but each message is a packet of its own */
+  use_seqpacket = strcmp (method, "unixpacket") == 0;
+#endif
+
+  if (strcmp (method, "unix") == 0 || use_shm || use_seqpacket)
     {
       const char *path = dbus_address_entry_get_value (entry, "path");
       const char *tmpdir = dbus_address_entry_get_value (entry, "tmpdir");
@@ -69,7 +86,7 @@ _dbus_server_listen_platform_specific (DBusAddressEntry *entry,
 
       if (path == NULL && tmpdir == NULL && abstract == NULL)
         {
-          _dbus_set_bad_address(error, "unix",
+          _dbus_set_bad_address(error, method,
                                 "path or tmpdir or abstract",
                                 NULL);
           return DBUS_SERVER_LISTEN_BAD_ADDRESS;
@@ -117,13 +134,14 @@ _dbus_server_listen_platform_specific (DBusAddressEntry *entry,
           /* Always use abstract namespace if possible with tmpdir */
 
           *server_p =
-            _dbus_server_new_for_domain_socket (_dbus_string_get_const_data (&full_path),
+            new_for_domain_socket (method,
+                                   _dbus_string_get_const_data (&full_path),
 #ifdef HAVE_ABSTRACT_SOCKETS
-                                                TRUE,
+                                   TRUE,
 #else
-                                                FALSE,
+                                   FALSE,
 #endif
-                                                error);
+                                   error);
 
           _dbus_string_free (&full_path);
           _dbus_string_free (&filename);
@@ -131,14 +149,18 @@ _dbus_server_listen_platform_specific (DBusAddressEntry *entry,
       else
         {
           if (path)
-            *server_p = _dbus_server_new_for_domain_socket (path, FALSE, error);
+            *server_p = new_for_domain_socket (method, path, FALSE, error);
           else
-            *server_p = _dbus_server_new_for_domain_socket (abstract, TRUE, error);
+            *server_p = new_for_domain_socket (method, abstract, TRUE, error);
         }
 
       if (*server_p != NULL)
         {
           _DBUS_ASSERT_ERROR_IS_CLEAR(error);
+#ifdef DBUS_HAVE_SHM_CHANNEL
+          if (use_shm)
+            _dbus_server_socket_use_shm (*server_p);
+#endif
           return DBUS_SERVER_LISTEN_OK;
         }
       else
@@ -225,6 +247,15 @@ DBusServer*
 _dbus_server_new_for_domain_socket (const char     *path,
                                     dbus_bool_t     abstract,
                                     DBusError      *error)
+{
+  return new_for_domain_socket ("unix", path, abstract, error);
+}
+
+static DBusServer*
+new_for_domain_socket (const char  *method,
+                       const char  *path,
+                       dbus_bool_t  abstract,
+                       DBusError   *error)
 {
   DBusServer *server;
   int listen_fd;
@@ -241,10 +272,8 @@ _dbus_server_new_for_domain_socket (const char     *path,
     }
 
   _dbus_string_init_const (&path_str, path);
-  if ((abstract &&
-       !_dbus_string_append (&address, "unix:abstract=")) ||
-      (!abstract &&
-       !_dbus_string_append (&address, "unix:path=")) ||
+  if (!_dbus_string_append (&address, method) ||
+      !_dbus_string_append (&address, abstract ? ":abstract=" : ":path=") ||
       !_dbus_address_append_escaped (&address, &path_str))
     {
       dbus_set_error (error, DBUS_ERROR_NO_MEMORY, NULL);
@@ -265,7 +294,12 @@ _dbus_server_new_for_domain_socket (const char     *path,
         }
     }
 
-  listen_fd = _dbus_listen_unix_socket (path, abstract, error);
+#ifdef DBUS_HAVE_SEQPACKET
+  if (strcmp (method, "unixpacket") == 0)
+    listen_fd = _dbus_listen_unix_seqpacket_socket (path, abstract, error);
+  else
+#endif
+    listen_fd = _dbus_listen_unix_socket (path, abstract, error);
 
   if (listen_fd < 0)
     {
@@ -145,6 +145,10 @@ _dbus_server_init_base (DBusServer             *server,
   _dbus_rmutex_new_at_location (&server->mutex);
   if (server->mutex == NULL)
     goto failed;
+
+#ifdef DBUS_ENABLE_STATS
+  _dbus_rmutex_set_profile_name (server->mutex, "server");
+#endif
   
   server->watches = _dbus_watch_list_new ();
   if (server->watches == NULL)
@@ -0,0 +1,682 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/* dbus-shm-channel.c  Ring buffers in memory shared between two processes
+ *
+ * Licensed under the Academic Free License version 2.1
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <config.h>
+#include "dbus-shm-channel.h"
+
+#ifdef DBUS_HAVE_SHM_CHANNEL
+
+#include "dbus-sysdeps-unix.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+
+/**
+ * @defgroup DBusShmChannel Shared memory channel
+ * @ingroup  DBusInternals
+ * @brief A pair of byte rings in memory shared with the other end
+ *
+ * The client side of a connection creates a sealed memfd holding one
+ * single-producer, single-consumer ring for each direction, and two
+ * eventfds, and passes all three to the server over the socket it
+ * authenticates on. Each side then copies bytes into the ring it
+ * produces and out of the ring it consumes, and writes to the other
+ * side's eventfd only when the other side has said it is about to
+ * sleep, so a busy link does not need a system call per message.
+ *
+ * Neither side trusts anything the other can write: the peer's index
+ * is checked against the ring size every time it is read, data is
+ * copied out before anything looks at it, and the memfd is sealed
+ * against shrinking so that the mapping cannot be pulled out from
+ * under us.
+ *
+ * @{
+ */
+
+/** Bytes of data in each direction; must be a power of two */
+#define RING_SIZE (256 * 1024)
+/** Bytes at the start of the memfd holding the two ring headers */
+#define CONTROL_SIZE 4096
+/** Total size of the memfd */
+#define CHANNEL_SIZE (CONTROL_SIZE + 2 * RING_SIZE)
+/** The memfd, the client's eventfd and the server's eventfd */
+#define N_SETUP_FDS 3
+
+/**
+ * The shared header of one ring. Each half is written only by one
+ * side, and they are kept on separate cache lines.
+ */
+typedef struct
+{
+  volatile dbus_uint32_t head;             /**< Bytes ever written, by the producer */
+  volatile dbus_uint32_t producer_waiting; /**< Producer will sleep until there is space */
+  unsigned char padding1[56];              /**< Keeps the consumer's half apart */
+  volatile dbus_uint32_t tail;             /**< Bytes ever read, by the consumer */
+  volatile dbus_uint32_t consumer_waiting; /**< Consumer will sleep until there is data */
+  unsigned char padding2[56];              /**< Keeps the next ring apart */
+} RingControl;
+
+/**
+ * One side's view of one ring.
+ */
+typedef struct
+{
+  RingControl *control;  /**< Shared header */
+  unsigned char *data;   /**< Shared data, RING_SIZE bytes */
+  dbus_uint32_t index;   /**< Our own copy of the index we advance */
+} Ring;
+
+/**
+ * Implementation details of DBusShmChannel. All members are private.
+ */
+struct DBusShmChannel
+{
+  int memfd;             /**< The shared memory */
+  int wakeup_fd;         /**< eventfd the other side wakes us with */
+  int peer_wakeup_fd;    /**< eventfd we wake the other side with */
+  unsigned char *map;    /**< Our mapping of memfd */
+  Ring out;              /**< The ring we produce */
+  Ring in;               /**< The ring we consume */
+};
+
+_DBUS_STATIC_ASSERT (sizeof (RingControl) * 2 <= CONTROL_SIZE);
+_DBUS_STATIC_ASSERT ((RING_SIZE & (RING_SIZE - 1)) == 0);
+
+static DBusShmChannel *
+channel_new_for_fds (const int   *fds,
+                     dbus_bool_t  is_client,
+                     DBusError   *error)
+{
+  DBusShmChannel *channel;
+  int ring_out, ring_in;
+
+  channel = dbus_new0 (DBusShmChannel, 1);
+  if (channel == NULL)
+    {
+      dbus_set_error (error, DBUS_ERROR_NO_MEMORY, NULL);
+      return NULL;
+    }
+
+  channel->map = mmap (NULL, CHANNEL_SIZE, PROT_READ | PROT_WRITE,
+                       MAP_SHARED, fds[0], 0);
+  if (channel->map == MAP_FAILED)
+    {
+      dbus_set_error (error, _dbus_error_from_errno (errno),
+                      "Could not map shared memory: %s",
+                      _dbus_strerror (errno));
+      dbus_free (channel);
+      return NULL;
+    }
+
+  /* ring 0 carries data from the client to the server */
+  ring_out = is_client ? 0 : 1;
+  ring_in = is_client ? 1 : 0;
+
+  channel->memfd = fds[0];
+  channel->wakeup_fd = is_client ? fds[1] : fds[2];
+  channel->peer_wakeup_fd = is_client ? fds[2] : fds[1];
+
+  channel->out.control = ((RingControl *) channel->map) + ring_out;
+  channel->out.data = channel->map + CONTROL_SIZE + ring_out * RING_SIZE;
+  channel->out.index = channel->out.control->head;
+
+  channel->in.control = ((RingControl *) channel->map) + ring_in;
+  channel->in.data = channel->map + CONTROL_SIZE + ring_in * RING_SIZE;
+  channel->in.index = channel->in.control->tail;
+
+  return channel;
+}
+
+static void
+close_fds (int *fds,
+           int  n_fds)
+{
+  int i;
+
+  for (i = 0; i < n_fds; i++)
+    {
+      if (fds[i] >= 0)
+        _dbus_close (fds[i], NULL);
+    }
+}
+
+/* An eventfd is an anonymous inode that /proc names after its kind.
+ * Anything else the client passed instead could block us when we
+ * write to it, or never wake us. */
+static dbus_bool_t
+is_eventfd (int fd)
+{
+  static const char expected[] = "anon_inode:[eventfd]";
+  char path[64];
+  char target[sizeof (expected)];
+  struct stat sb;
+  ssize_t len;
+
+  /* not S_ISREG(): some kernels give anonymous inodes that type */
+  if (fstat (fd, &sb) < 0 || S_ISDIR (sb.st_mode) ||
+      S_ISFIFO (sb.st_mode) || S_ISSOCK (sb.st_mode) ||
+      S_ISCHR (sb.st_mode) || S_ISBLK (sb.st_mode))
+    return FALSE;
+
+  snprintf (path, sizeof (path), "/proc/self/fd/%d", fd);
+  len = readlink (path, target, sizeof (target));
+
+  return len == sizeof (expected) - 1 &&
+    memcmp (target, expected, len) == 0;
+}
+
+/**
+ * Creates the client side of a channel: the sealed memfd and both
+ * eventfds, which _dbus_shm_channel_send() then passes to the server.
+ *
+ * @param error return location for the reason it failed
+ * @returns the new channel, or #NULL on failure
+ */
+DBusShmChannel *
+_dbus_shm_channel_new (DBusError *error)
+{
+  DBusShmChannel *channel;
+  int fds[N_SETUP_FDS] = { -1, -1, -1 };
+
+  fds[0] = memfd_create ("dbus-shm", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+  if (fds[0] < 0)
+    goto failed;
+
+  if (ftruncate (fds[0], CHANNEL_SIZE) < 0 ||
+      fcntl (fds[0], F_ADD_SEALS,
+             F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) < 0)
+    goto failed;
+
+  fds[1] = eventfd (0, EFD_CLOEXEC | EFD_NONBLOCK);
+  if (fds[1] < 0)
+    goto failed;
+
+  fds[2] = eventfd (0, EFD_CLOEXEC | EFD_NONBLOCK);
+  if (fds[2] < 0)
+    goto failed;
+
+  channel = channel_new_for_fds (fds, TRUE, error);
+  if (channel == NULL)
+    {
+      close_fds (fds, N_SETUP_FDS);
+      return NULL;
+    }
+
+  return channel;
+
+ failed:
+  dbus_set_error (error, _dbus_error_from_errno (errno),
+                  "Could not create shared memory channel: %s",
+                  _dbus_strerror (errno));
+  close_fds (fds, N_SETUP_FDS);
+  return NULL;
+}
+
+/**
+ * Passes the memfd and eventfds to the server, as ancillary data on
+ * a single nul byte. This must be the first thing written to the
+ * socket, so that the server reads the byte on its own and cannot
+ * lose the file descriptors by reading them along with other data.
+ *
+ * @param channel the channel from _dbus_shm_channel_new()
+ * @param socket_fd the connected socket
+ * @param error return location for the reason it failed
+ * @returns #FALSE on failure
+ */
+dbus_bool_t
+_dbus_shm_channel_send (DBusShmChannel *channel,
+                        int             socket_fd,
+                        DBusError      *error)
+{
+  char byte = '\0';
+  struct iovec iov;
+  struct msghdr m;
+  union
+  {
+    struct cmsghdr header;
+    char buffer[CMSG_SPACE (N_SETUP_FDS * sizeof (int))];
+  } control;
+  struct cmsghdr *cm;
+  int fds[N_SETUP_FDS];
+
+  fds[0] = channel->memfd;
+  fds[1] = channel->wakeup_fd;
+  fds[2] = channel->peer_wakeup_fd;
+
+  _DBUS_ZERO (iov);
+  iov.iov_base = &byte;
+  iov.iov_len = 1;
+
+  _DBUS_ZERO (control);
+  _DBUS_ZERO (m);
+  m.msg_iov = &iov;
+  m.msg_iovlen = 1;
+  m.msg_control = control.buffer;
+  m.msg_controllen = sizeof (control.buffer);
+
+  cm = CMSG_FIRSTHDR (&m);
+  cm->cmsg_level = SOL_SOCKET;
+  cm->cmsg_type = SCM_RIGHTS;
+  cm->cmsg_len = CMSG_LEN (sizeof (fds));
+  memcpy (CMSG_DATA (cm), fds, sizeof (fds));
+
+ again:
+  if (sendmsg (socket_fd, &m, MSG_NOSIGNAL) < 1)
+    {
+      if (errno == EINTR)
+        goto again;
+
+      dbus_set_error (error, _dbus_error_from_errno (errno),
+                      "Failed to send shared memory to server: %s",
+                      _dbus_strerror (errno));
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+/**
+ * Reads the byte sent by _dbus_shm_channel_send() and sets up the
+ * server side of the channel from the file descriptors on it, after
+ * checking that the memory is the right size and sealed and that the
+ * other two really are eventfds.
+ *
+ * @param socket_fd the nonblocking socket
+ * @param error return location for the reason it failed
+ * @returns the channel, or #NULL with @p error unset if there is
+ *  nothing to read yet, or #NULL with @p error set on failure
+ */
+DBusShmChannel *
+_dbus_shm_channel_receive (int        socket_fd,
+                           DBusError *error)
+{
+  DBusShmChannel *channel;
+  char byte;
+  struct iovec iov;
+  struct msghdr m;
+  union
+  {
+    struct cmsghdr header;
+    char buffer[CMSG_SPACE (N_SETUP_FDS * sizeof (int))];
+  } control;
+  struct cmsghdr *cm;
+  struct stat sb;
+  int fds[N_SETUP_FDS] = { -1, -1, -1 };
+  int n_fds = 0;
+  int bytes_read;
+  int seals;
+
+  _DBUS_ZERO (iov);
+  iov.iov_base = &byte;
+  iov.iov_len = 1;
+
+  _DBUS_ZERO (control);
+  _DBUS_ZERO (m);
+  m.msg_iov = &iov;
+  m.msg_iovlen = 1;
+  m.msg_control = control.buffer;
+  m.msg_controllen = sizeof (control.buffer);
+
+ again:
+  bytes_read = recvmsg (socket_fd, &m, MSG_CMSG_CLOEXEC);
+
+  if (bytes_read < 0)
+    {
+      if (errno == EINTR)
+        goto again;
+
+      if (errno == EAGAIN || errno == EWOULDBLOCK)
+        return NULL;
+
+      dbus_set_error (error, _dbus_error_from_errno (errno),
+                      "Failed to receive shared memory from client: %s",
+                      _dbus_strerror (errno));
+      return NULL;
+    }
+
+  for (cm = CMSG_FIRSTHDR (&m); cm != NULL; cm = CMSG_NXTHDR (&m, cm))
+    {
+      if (cm->cmsg_level == SOL_SOCKET && cm->cmsg_type == SCM_RIGHTS)
+        {
+          n_fds = (cm->cmsg_len - CMSG_LEN (0)) / sizeof (int);
+          if (n_fds > N_SETUP_FDS)
+            n_fds = N_SETUP_FDS;
+          memcpy (fds, CMSG_DATA (cm), n_fds * sizeof (int));
+        }
+    }
+
+  if (bytes_read == 0 || byte != '\0' || n_fds != N_SETUP_FDS ||
+      (m.msg_flags & MSG_CTRUNC))
+    {
+      dbus_set_error (error, DBUS_ERROR_FAILED,
+                      "Client did not send shared memory");
+      goto failed;
+    }
+
+  seals = fcntl (fds[0], F_GET_SEALS);
+
+  if (fstat (fds[0], &sb) < 0 || sb.st_size != CHANNEL_SIZE ||
+      seals < 0 || !(seals & F_SEAL_SHRINK))
+    {
+      dbus_set_error (error, DBUS_ERROR_FAILED,
+                      "Client sent unsuitable shared memory");
+      goto failed;
+    }
+
+  if (!is_eventfd (fds[1]) || !is_eventfd (fds[2]))
+    {
+      dbus_set_error (error, DBUS_ERROR_FAILED,
+                      "Client sent something other than an eventfd");
+      goto failed;
+    }
+
+  /* we must never block writing to the client's eventfd */
+  if (!_dbus_set_fd_nonblocking (fds[1], error) ||
+      !_dbus_set_fd_nonblocking (fds[2], error))
+    goto failed;
+
+  channel = channel_new_for_fds (fds, FALSE, error);
+  if (channel == NULL)
+    goto failed;
+
+  return channel;
+
+ failed:
+  close_fds (fds, N_SETUP_FDS);
+  return NULL;
+}
+
+/**
+ * Unmaps the shared memory and closes the file descriptors.
+ *
+ * @param channel the channel
+ */
+void
+_dbus_shm_channel_free (DBusShmChannel *channel)
+{
+  int fds[N_SETUP_FDS];
+
+  munmap (channel->map, CHANNEL_SIZE);
+
+  fds[0] = channel->memfd;
+  fds[1] = channel->wakeup_fd;
+  fds[2] = channel->peer_wakeup_fd;
+  close_fds (fds, N_SETUP_FDS);
+
+  dbus_free (channel);
+}
+
+/**
+ * Gets the file descriptor that becomes readable when the other side
+ * has written data we were waiting for, or read data to make the
+ * space we were waiting for.
+ *
+ * @param channel the channel
+ * @returns the eventfd to watch
+ */
+int
+_dbus_shm_channel_get_wakeup_fd (DBusShmChannel *channel)
+{
+  return channel->wakeup_fd;
+}
+
+/**
+ * Resets the wakeup file descriptor so that it is not readable until
+ * the next wakeup. Call this before looking at the rings, so that a
+ * wakeup sent while we do cannot be lost.
+ *
+ * @param channel the channel
+ */
+void
+_dbus_shm_channel_clear_wakeup (DBusShmChannel *channel)
+{
+  dbus_uint64_t value;
+
+  while (read (channel->wakeup_fd, &value, sizeof (value)) < 0 &&
+         errno == EINTR)
+    ;
+}
+
+static void
+wake (int fd)
+{
+  dbus_uint64_t value = 1;
+
+  /* EAGAIN means the counter is full, so it is readable anyway */
+  while (write (fd, &value, sizeof (value)) < 0 && errno == EINTR)
+    ;
+}
+
+/**
+ * Makes our own wakeup file descriptor readable, for when we stop
+ * reading with data still in the ring and need to be called again.
+ *
+ * @param channel the channel
+ */
+void
+_dbus_shm_channel_wake_self (DBusShmChannel *channel)
+{
+  wake (channel->wakeup_fd);
+}
+
+/**
+ * Copies up to @p count bytes out of the incoming ring onto the end
+ * of @p buffer.
+ *
+ * @param channel the channel
+ * @param buffer the buffer to append to
+ * @param count the most bytes to read
+ * @returns the number of bytes read, 0 if the ring is empty, or -1
+ *  with errno set to ENOMEM if the buffer could not grow or EPROTO if
+ *  the other side corrupted the ring
+ */
+int
+_dbus_shm_channel_read (DBusShmChannel *channel,
+                        DBusString     *buffer,
+                        int             count)
+{
+  Ring *ring = &channel->in;
+  dbus_uint32_t available, offset, first;
+  unsigned char *dest;
+  int start;
+
+  available = ring->control->head - ring->index;
+  /* don't read the data before the index that says it is there */
+  __sync_synchronize ();
+
+  if (available > RING_SIZE)
+    {
+      errno = EPROTO;
+      return -1;
+    }
+
+  if (available == 0)
+    return 0;
+
+  if (available > (dbus_uint32_t) count)
+    available = count;
+
+  start = _dbus_string_get_length (buffer);
+  if (!_dbus_string_lengthen (buffer, available))
+    {
+      errno = ENOMEM;
+      return -1;
+    }
+
+  dest = (unsigned char *) _dbus_string_get_data_len (buffer, start, available);
+  offset = ring->index & (RING_SIZE - 1);
+  first = MIN (available, RING_SIZE - offset);
+
+  memcpy (dest, ring->data + offset, first);
+  memcpy (dest + first, ring->data, available - first);
+
+  /* finish copying before handing the space back */
+  __sync_synchronize ();
+  ring->index += available;
+  ring->control->tail = ring->index;
+
+  return available;
+}
+
+/**
+ * Copies as much of the given part of @p buffer as fits into the
+ * outgoing ring.
+ *
+ * @param channel the channel
+ * @param buffer the data to write
+ * @param start the offset of the first byte to write
+ * @param len the number of bytes to write
+ * @returns the number of bytes written, 0 if the ring is full, or -1
+ *  with errno set to EPROTO if the other side corrupted the ring
+ */
+int
+_dbus_shm_channel_write (DBusShmChannel   *channel,
+                         const DBusString *buffer,
+                         int               start,
+                         int               len)
+{
+  Ring *ring = &channel->out;
+  dbus_uint32_t used, space, offset, first;
+  const unsigned char *src;
+
+  used = ring->index - ring->control->tail;
+  /* don't overwrite data the consumer may still be copying */
+  __sync_synchronize ();
+
+  if (used > RING_SIZE)
+    {
+      errno = EPROTO;
+      return -1;
+    }
+
+  space = RING_SIZE - used;
+  if (space == 0 || len == 0)
+    return 0;
+
+  if (space > (dbus_uint32_t) len)
+    space = len;
+
+  src = (const unsigned char *) _dbus_string_get_const_data_len (buffer, start, space);
+  offset = ring->index & (RING_SIZE - 1);
+  first = MIN (space, RING_SIZE - offset);
+
+  memcpy (ring->data + offset, src, first);
+  memcpy (ring->data, src + first, space - first);
+
+  /* finish copying before publishing the data */
+  __sync_synchronize ();
+  ring->index += space;
+  ring->control->head = ring->index;
+
+  return space;
+}
+
+/**
+ * Tells the other side to wake us when it writes more data, after
+ * finding the incoming ring empty. Data may have arrived in between,
+ * in which case the caller should read again instead of sleeping.
+ *
+ * @param channel the channel
+ * @returns #TRUE if there is data to read after all
+ */
+dbus_bool_t
+_dbus_shm_channel_wait_for_data (DBusShmChannel *channel)
+{
+  Ring *ring = &channel->in;
+
+  ring->control->consumer_waiting = 1;
+  __sync_synchronize ();
+
+  if (ring->control->head != ring->index)
+    {
+      ring->control->consumer_waiting = 0;
+      return TRUE;
+    }
+
+  return FALSE;
+}
+
+/**
+ * Tells the other side to wake us when it reads some data, after
+ * finding the outgoing ring full. Space may have been freed in
+ * between, in which case the caller should write again instead of
+ * sleeping.
+ *
+ * @param channel the channel
+ * @returns #TRUE if there is space to write after all
+ */
+dbus_bool_t
+_dbus_shm_channel_wait_for_space (DBusShmChannel *channel)
+{
+  Ring *ring = &channel->out;
+
+  ring->control->producer_waiting = 1;
+  __sync_synchronize ();
+
+  if (ring->index - ring->control->tail < RING_SIZE)
+    {
+      ring->control->producer_waiting = 0;
+      return TRUE;
+    }
+
+  return FALSE;
+}
+
+/**
+ * Wakes the other side if it is waiting for data we have written or
+ * space we have made. Call this after a batch of reads or writes.
+ *
+ * @param channel the channel
+ */
+void
+_dbus_shm_channel_notify (DBusShmChannel *channel)
+{
+  dbus_bool_t need_wake = FALSE;
+
+  /* order our index updates before looking at the flags, pairing with
+   * the barrier in _dbus_shm_channel_wait_for_data() and
+   * _dbus_shm_channel_wait_for_space() */
+  __sync_synchronize ();
+
+  if (channel->out.control->consumer_waiting &&
+      __sync_bool_compare_and_swap (&channel->out.control->consumer_waiting,
+                                    1, 0))
+    need_wake = TRUE;
+
+  if (channel->in.control->producer_waiting &&
+      __sync_bool_compare_and_swap (&channel->in.control->producer_waiting,
+                                    1, 0))
+    need_wake = TRUE;
+
+  if (need_wake)
+    wake (channel->peer_wakeup_fd);
+}
+
+/** @} */
+
+#endif /* DBUS_HAVE_SHM_CHANNEL */
@@ -0,0 +1,64 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/* dbus-shm-channel.h  Ring buffers in memory shared between two processes
+ *
+ * Licensed under the Academic Free License version 2.1
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+#ifndef DBUS_SHM_CHANNEL_H
+#define DBUS_SHM_CHANNEL_H
+
+#include <dbus/dbus-internals.h>
+#include <dbus/dbus-string.h>
+
+#if defined(HAVE_MEMFD_CREATE) && defined(HAVE_EVENTFD) && defined(__GNUC__)
+#define DBUS_HAVE_SHM_CHANNEL 1
+#endif
+
+#ifdef DBUS_HAVE_SHM_CHANNEL
+
+DBUS_BEGIN_DECLS
+
+typedef struct DBusShmChannel DBusShmChannel;
+
+DBusShmChannel* _dbus_shm_channel_new             (DBusError        *error);
+dbus_bool_t     _dbus_shm_channel_send            (DBusShmChannel   *channel,
+                                                   int               socket_fd,
+                                                   DBusError        *error);
+DBusShmChannel* _dbus_shm_channel_receive         (int               socket_fd,
+                                                   DBusError        *error);
+void            _dbus_shm_channel_free            (DBusShmChannel   *channel);
+
+int             _dbus_shm_channel_get_wakeup_fd   (DBusShmChannel   *channel);
+void            _dbus_shm_channel_clear_wakeup    (DBusShmChannel   *channel);
+void            _dbus_shm_channel_wake_self       (DBusShmChannel   *channel);
+
+int             _dbus_shm_channel_read            (DBusShmChannel   *channel,
+                                                   DBusString       *buffer,
+                                                   int               count);
+int             _dbus_shm_channel_write           (DBusShmChannel   *channel,
+                                                   const DBusString *buffer,
+                                                   int               start,
+                                                   int               len);
+dbus_bool_t     _dbus_shm_channel_wait_for_data   (DBusShmChannel   *channel);
+dbus_bool_t     _dbus_shm_channel_wait_for_space  (DBusShmChannel   *channel);
+void            _dbus_shm_channel_notify          (DBusShmChannel   *channel);
+
+DBUS_END_DECLS
+
+#endif /* DBUS_HAVE_SHM_CHANNEL */
+
+#endif /* DBUS_SHM_CHANNEL_H */
@@ -313,13 +313,22 @@ socket_set_epoll_poll (DBusSocketSet   *set,
   return n_ready;
 }
 
+static int
+socket_set_epoll_get_fd (DBusSocketSet *set)
+{
+  DBusSocketSetEpoll *self = socket_set_epoll_cast (set);
+
+  return self->epfd;
+}
+
 DBusSocketSetClass _dbus_socket_set_epoll_class = {
     socket_set_epoll_free,
     socket_set_epoll_add,
     socket_set_epoll_remove,
     socket_set_epoll_enable,
     socket_set_epoll_disable,
-    socket_set_epoll_poll
+    socket_set_epoll_poll,
+    socket_set_epoll_get_fd
 };
 
 #ifdef TEST_BEHAVIOUR_OF_EPOLLET
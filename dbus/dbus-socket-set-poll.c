@@ -308,13 +308,20 @@ socket_set_poll_poll (DBusSocketSet   *set,
   return n_events;
 }
 
+static int
+socket_set_poll_get_fd (DBusSocketSet *set)
+{
+  return -1;
+}
+
 DBusSocketSetClass _dbus_socket_set_poll_class = {
     socket_set_poll_free,
     socket_set_poll_add,
     socket_set_poll_remove,
     socket_set_poll_enable,
     socket_set_poll_disable,
-    socket_set_poll_poll
+    socket_set_poll_poll,
+    socket_set_poll_get_fd
 };
 
 #endif /* !DOXYGEN_SHOULD_SKIP_THIS */
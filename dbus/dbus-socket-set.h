@@ -55,6 +55,7 @@ struct DBusSocketSetClass {
                                  DBusSocketEvent *revents,
                                  int              max_events,
                                  int              timeout_ms);
+    int             (*get_fd)   (DBusSocketSet   *self);
 };
 
 struct DBusSocketSet {
@@ -110,6 +111,14 @@ _dbus_socket_set_poll (DBusSocketSet    *self,
   return (self->cls->poll) (self, revents, max_events, timeout_ms);
 }
 
+/* an fd that polls readable when any fd in the set is ready, or -1 if
+ * the implementation has none */
+static inline int
+_dbus_socket_set_get_fd (DBusSocketSet *self)
+{
+  return (self->cls->get_fd) (self);
+}
+
 /* concrete implementations, not necessarily built on all platforms */
 
 extern DBusSocketSetClass _dbus_socket_set_poll_class;
@@ -37,6 +37,26 @@
 /* for DBUS_VA_COPY */
 #include "dbus-sysdeps.h"
 
+/* Vector implementations of the ASCII fast-forward in
+ * _dbus_string_validate_utf8(). SSE2 is part of the x86-64 baseline;
+ * AVX2 is compiled in with a target attribute and only used if the CPU
+ * has it. NEON is part of the aarch64 baseline.
+ */
+#if defined(__GNUC__) && defined(__SSE2__) && \
+  (defined(__x86_64__) || defined(__i386__))
+#define DBUS_UTF8_HAVE_SSE2 1
+#include <emmintrin.h>
+#if defined(__clang__) || __GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)
+#define DBUS_UTF8_HAVE_AVX2 1
+#include <immintrin.h>
+#endif
+#endif
+
+#if defined(__GNUC__) && defined(__aarch64__) && defined(__ARM_NEON)
+#define DBUS_UTF8_HAVE_NEON 1
+#include <arm_neon.h>
+#endif
+
 /**
  * @defgroup DBusString DBusString class
  * @ingroup  DBusInternals
@@ -2541,6 +2561,222 @@ _dbus_string_toupper_ascii (const DBusString *str,
     }
 }
 
+/*
+ * The ASCII fast-forward used by _dbus_string_validate_utf8(). Each
+ * implementation returns the first byte in [p, end) that is either a
+ * nul or not ASCII, or end if there is none. Most strings in D-Bus
+ * messages are entirely ASCII, so this is where validation spends
+ * its time.
+ */
+typedef const unsigned char *(* DBusUtf8SkipAsciiFunction) (const unsigned char *p,
+                                                            const unsigned char *end);
+
+static const unsigned char *
+skip_ascii_bytewise (const unsigned char *p,
+                     const unsigned char *end)
+{
+  while (p < end && *p != '\0' && *p < 128)
+    ++p;
+
+  return p;
+}
+
+/* A word at a time: a byte is nul or >= 0x80 exactly when the high bit
+ * of (byte - 1) | byte is set. Borrows can only set high bits above a
+ * byte that already matched, so the first match is always found. */
+#define WORD_ONES  (((unsigned long) -1) / 0xff)
+#define WORD_HIGHS (WORD_ONES * 0x80)
+
+static const unsigned char *
+skip_ascii_word (const unsigned char *p,
+                 const unsigned char *end)
+{
+  while (end - p >= (int) sizeof (unsigned long))
+    {
+      unsigned long word;
+
+      memcpy (&word, p, sizeof (word));
+
+      if (((word - WORD_ONES) | word) & WORD_HIGHS)
+        break;
+
+      p += sizeof (word);
+    }
+
+  return skip_ascii_bytewise (p, end);
+}
+
+#ifdef DBUS_UTF8_HAVE_SSE2
+static const unsigned char *
+skip_ascii_sse2 (const unsigned char *p,
+                 const unsigned char *end)
+{
+  const __m128i zero = _mm_setzero_si128 ();
+
+  while (end - p >= 16)
+    {
+      __m128i chunk = _mm_loadu_si128 ((const __m128i *) p);
+      int mask;
+
+      mask = _mm_movemask_epi8 (chunk) |
+        _mm_movemask_epi8 (_mm_cmpeq_epi8 (chunk, zero));
+
+      if (mask != 0)
+        return p + __builtin_ctz (mask);
+
+      p += 16;
+    }
+
+  return skip_ascii_word (p, end);
+}
+#endif /* DBUS_UTF8_HAVE_SSE2 */
+
+#ifdef DBUS_UTF8_HAVE_AVX2
+__attribute__ ((target ("avx2")))
+static const unsigned char *
+skip_ascii_avx2 (const unsigned char *p,
+                 const unsigned char *end)
+{
+  const __m256i zero = _mm256_setzero_si256 ();
+
+  while (end - p >= 32)
+    {
+      __m256i chunk = _mm256_loadu_si256 ((const __m256i *) p);
+      unsigned int mask;
+
+      mask = (unsigned int) _mm256_movemask_epi8 (chunk) |
+        (unsigned int) _mm256_movemask_epi8 (_mm256_cmpeq_epi8 (chunk, zero));
+
+      if (mask != 0)
+        return p + __builtin_ctz (mask);
+
+      p += 32;
+    }
+
+  return skip_ascii_sse2 (p, end);
+}
+
+static dbus_bool_t
+cpu_has_avx2 (void)
+{
+  return __builtin_cpu_supports ("avx2");
+}
+#endif /* DBUS_UTF8_HAVE_AVX2 */
+
+#ifdef DBUS_UTF8_HAVE_NEON
+static const unsigned char *
+skip_ascii_neon (const unsigned char *p,
+                 const unsigned char *end)
+{
+  const uint8x16_t one = vdupq_n_u8 (1);
+
+  while (end - p >= 16)
+    {
+      /* nul wraps around to 0xff, so one unsigned comparison finds
+       * both nul and non-ASCII bytes */
+      uint8x16_t chunk = vsubq_u8 (vld1q_u8 (p), one);
+
+      if (vmaxvq_u8 (chunk) >= 0x7f)
+        break;
+
+      p += 16;
+    }
+
+  return skip_ascii_bytewise (p, end);
+}
+#endif /* DBUS_UTF8_HAVE_NEON */
+
+static const struct
+{
+  const char *name;
+  DBusUtf8SkipAsciiFunction func;
+  dbus_bool_t (* supported) (void);
+} utf8_validators[] =
+{
+  /* in order of preference, best last */
+  { "bytewise", skip_ascii_bytewise, NULL },
+  { "word", skip_ascii_word, NULL },
+#ifdef DBUS_UTF8_HAVE_SSE2
+  { "sse2", skip_ascii_sse2, NULL },
+#endif
+#ifdef DBUS_UTF8_HAVE_AVX2
+  { "avx2", skip_ascii_avx2, cpu_has_avx2 },
+#endif
+#ifdef DBUS_UTF8_HAVE_NEON
+  { "neon", skip_ascii_neon, NULL },
+#endif
+};
+
+/* Chosen on first use; every thread would choose the same one */
+static int utf8_validator = -1;
+
+static int
+utf8_validator_choose_best (void)
+{
+  int i;
+
+  for (i = _DBUS_N_ELEMENTS (utf8_validators) - 1; i > 0; i--)
+    {
+      if (utf8_validators[i].supported == NULL ||
+          (* utf8_validators[i].supported) ())
+        break;
+    }
+
+  return i;
+}
+
+/**
+ * Selects the implementation of the ASCII fast path used by
+ * _dbus_string_validate_utf8(), for tests and benchmarks. The
+ * implementations are "bytewise", "word", and whichever of "sse2",
+ * "avx2" and "neon" were compiled in. By default the best one that
+ * the CPU supports is used.
+ *
+ * @param name the implementation, or #NULL for the default
+ * @returns #FALSE if the implementation is not available on this CPU
+ */
+dbus_bool_t
+_dbus_string_set_utf8_validator (const char *name)
+{
+  int i;
+
+  if (name == NULL)
+    {
+      utf8_validator = utf8_validator_choose_best ();
+      return TRUE;
+    }
+
+  for (i = 0; i < (int) _DBUS_N_ELEMENTS (utf8_validators); i++)
+    {
+      if (strcmp (name, utf8_validators[i].name) == 0)
+        {
+          if (utf8_validators[i].supported != NULL &&
+              !(* utf8_validators[i].supported) ())
+            return FALSE;
+
+          utf8_validator = i;
+          return TRUE;
+        }
+    }
+
+  return FALSE;
+}
+
+/**
+ * Gets the name of the implementation _dbus_string_validate_utf8()
+ * is using, see _dbus_string_set_utf8_validator().
+ *
+ * @returns the name
+ */
+const char *
+_dbus_string_get_utf8_validator (void)
+{
+  if (utf8_validator < 0)
+    utf8_validator = utf8_validator_choose_best ();
+
+  return utf8_validators[utf8_validator].name;
+}
+
 /**
  * Checks that the given range of the string is valid UTF-8. If the
  * given range is not entirely contained in the string, returns
@@ -2563,6 +2799,7 @@ _dbus_string_validate_utf8  (const DBusString *str,
 {
   const unsigned char *p;
   const unsigned char *end;
+  DBusUtf8SkipAsciiFunction skip_ascii;
   DBUS_CONST_STRING_PREAMBLE (str);
   _dbus_assert (start >= 0);
   _dbus_assert (start <= real->len);
@@ -2581,7 +2818,12 @@ _dbus_string_validate_utf8  (const DBusString *str,
   
   p = real->str + start;
   end = p + len;
-  
+
+  if (_DBUS_UNLIKELY (utf8_validator < 0))
+    utf8_validator = utf8_validator_choose_best ();
+
+  skip_ascii = utf8_validators[utf8_validator].func;
+
   while (p < end)
     {
       int i, mask, char_len;
@@ -2595,11 +2837,12 @@ _dbus_string_validate_utf8  (const DBusString *str,
        * D-Bus profiles where we are typically validating
        * function names and such. We have to know that
        * all following checks will pass for ASCII though,
-       * comments follow ...
+       * comments follow ... Runs of ASCII are skipped in
+       * bulk, stopping at the next nul or non-ASCII byte.
        */      
       if (*p < 128)
         {
-          ++p;
+          p = (* skip_ascii) (p + 1, end);
           continue;
         }
       
@@ -284,6 +284,8 @@ dbus_bool_t   _dbus_string_validate_utf8         (const DBusString  *str,
 dbus_bool_t   _dbus_string_validate_nul          (const DBusString  *str,
                                                   int                start,
                                                   int                len);
+dbus_bool_t   _dbus_string_set_utf8_validator    (const char        *name);
+const char *  _dbus_string_get_utf8_validator    (void);
 void          _dbus_string_zero                  (DBusString        *str);
 
 
@@ -28,13 +28,305 @@
 
 #include <sys/time.h>
 #include <pthread.h>
+#include <signal.h>
 #include <string.h>
 
 #ifdef HAVE_ERRNO_H
 #include <errno.h>
 #endif
 
-#include <config.h>
+#ifdef DBUS_ENABLE_FUTEX
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#ifdef DBUS_ENABLE_FUTEX
+
+/*
+ * Futex-based locks for Linux, after "Futexes Are Tricky" by Ulrich
+ * Drepper. Uncontended lock and unlock are a single atomic operation
+ * each, and most critical sections in libdbus are short enough that a
+ * waiter is better off spinning briefly than sleeping in the kernel.
+ */
+
+/** Upper bound on the number of spins before sleeping */
+#define FUTEX_MAX_SPINS 200
+
+/* Whether spinning can possibly help, i.e. there is more than one CPU.
+ * This is initialized once in check_spinning below.
+ */
+static dbus_bool_t spinning_helps = FALSE;
+
+/* Its address identifies the current thread as the owner of a
+ * recursive mutex.
+ */
+static __thread char this_thread;
+
+struct DBusCMutex {
+  volatile int state; /**< 0 unlocked, 1 locked, 2 locked with possible waiters */
+  int spins;          /**< running estimate of the spins needed to acquire it */
+};
+
+struct DBusRMutex {
+  DBusCMutex lock;       /**< the underlying lock */
+  void * volatile owner; /**< &this_thread of the holder, or #NULL */
+  int depth;             /**< recursion depth of the holder */
+};
+
+struct DBusCondVar {
+  volatile int seq;     /**< incremented on every wake-up */
+  volatile int waiters; /**< number of threads waiting */
+};
+
+static long
+futex_wait (volatile int          *addr,
+            int                    val,
+            const struct timespec *timeout)
+{
+  return syscall (SYS_futex, addr, FUTEX_WAIT_PRIVATE, val, timeout, NULL, 0);
+}
+
+static void
+futex_wake (volatile int *addr,
+            int           n_waiters)
+{
+  syscall (SYS_futex, addr, FUTEX_WAKE_PRIVATE, n_waiters, NULL, NULL, 0);
+}
+
+static void
+cpu_relax (void)
+{
+#if defined(__i386__) || defined(__x86_64__)
+  __builtin_ia32_pause ();
+#elif defined(__aarch64__)
+  __asm__ __volatile__ ("yield" ::: "memory");
+#else
+  __sync_synchronize ();
+#endif
+}
+
+static dbus_bool_t
+futex_trylock (DBusCMutex *mutex)
+{
+  return __sync_val_compare_and_swap (&mutex->state, 0, 1) == 0;
+}
+
+static void
+futex_lock (DBusCMutex *mutex)
+{
+  int c;
+
+  c = __sync_val_compare_and_swap (&mutex->state, 0, 1);
+  if (c == 0)
+    return;
+
+  /* Spin for a while, adapting the limit to how long it took to get
+   * this mutex recently, like glibc's adaptive mutexes.
+   */
+  if (spinning_helps)
+    {
+      int max_spins, n;
+
+      max_spins = MIN (FUTEX_MAX_SPINS, mutex->spins * 2 + 10);
+
+      for (n = 0; n < max_spins; n++)
+        {
+          cpu_relax ();
+
+          if (mutex->state == 0 && futex_trylock (mutex))
+            {
+              mutex->spins += (n - mutex->spins) / 8;
+              return;
+            }
+        }
+
+      mutex->spins += (max_spins - mutex->spins) / 8;
+    }
+
+  if (c != 2)
+    c = __sync_lock_test_and_set (&mutex->state, 2);
+
+  while (c != 0)
+    {
+      futex_wait (&mutex->state, 2, NULL);
+      c = __sync_lock_test_and_set (&mutex->state, 2);
+    }
+}
+
+static void
+futex_unlock (DBusCMutex *mutex)
+{
+  if (__sync_fetch_and_sub (&mutex->state, 1) != 1)
+    {
+      __sync_lock_release (&mutex->state);
+      futex_wake (&mutex->state, 1);
+    }
+}
+
+DBusCMutex *
+_dbus_platform_cmutex_new (void)
+{
+  return dbus_new0 (DBusCMutex, 1);
+}
+
+DBusRMutex *
+_dbus_platform_rmutex_new (void)
+{
+  return dbus_new0 (DBusRMutex, 1);
+}
+
+void
+_dbus_platform_cmutex_free (DBusCMutex *mutex)
+{
+  _dbus_assert (mutex->state == 0);
+  dbus_free (mutex);
+}
+
+void
+_dbus_platform_rmutex_free (DBusRMutex *mutex)
+{
+  _dbus_assert (mutex->owner == NULL);
+  dbus_free (mutex);
+}
+
+void
+_dbus_platform_cmutex_lock (DBusCMutex *mutex)
+{
+  futex_lock (mutex);
+}
+
+void
+_dbus_platform_rmutex_lock (DBusRMutex *mutex)
+{
+  if (mutex->owner == &this_thread)
+    {
+      mutex->depth += 1;
+      return;
+    }
+
+  futex_lock (&mutex->lock);
+  mutex->owner = &this_thread;
+  mutex->depth = 1;
+}
+
+dbus_bool_t
+_dbus_platform_cmutex_trylock (DBusCMutex *mutex)
+{
+  return futex_trylock (mutex);
+}
+
+dbus_bool_t
+_dbus_platform_rmutex_trylock (DBusRMutex *mutex)
+{
+  if (mutex->owner == &this_thread)
+    {
+      mutex->depth += 1;
+      return TRUE;
+    }
+
+  if (!futex_trylock (&mutex->lock))
+    return FALSE;
+
+  mutex->owner = &this_thread;
+  mutex->depth = 1;
+  return TRUE;
+}
+
+void
+_dbus_platform_cmutex_unlock (DBusCMutex *mutex)
+{
+  futex_unlock (mutex);
+}
+
+void
+_dbus_platform_rmutex_unlock (DBusRMutex *mutex)
+{
+  _dbus_assert (mutex->owner == &this_thread);
+
+  mutex->depth -= 1;
+
+  if (mutex->depth == 0)
+    {
+      mutex->owner = NULL;
+      futex_unlock (&mutex->lock);
+    }
+}
+
+DBusCondVar *
+_dbus_platform_condvar_new (void)
+{
+  return dbus_new0 (DBusCondVar, 1);
+}
+
+void
+_dbus_platform_condvar_free (DBusCondVar *cond)
+{
+  _dbus_assert (cond->waiters == 0);
+  dbus_free (cond);
+}
+
+static dbus_bool_t
+futex_condvar_wait (DBusCondVar           *cond,
+                    DBusCMutex            *mutex,
+                    const struct timespec *timeout)
+{
+  int seq;
+  dbus_bool_t timed_out;
+
+  /* Both happen with the mutex held, so a waker that holds it too
+   * either sees us counted as a waiter or changes seq before we sleep.
+   */
+  __sync_fetch_and_add (&cond->waiters, 1);
+  seq = cond->seq;
+
+  futex_unlock (mutex);
+  timed_out = (futex_wait (&cond->seq, seq, timeout) != 0 &&
+               errno == ETIMEDOUT);
+  __sync_fetch_and_sub (&cond->waiters, 1);
+  futex_lock (mutex);
+
+  return !timed_out;
+}
+
+void
+_dbus_platform_condvar_wait (DBusCondVar *cond,
+                             DBusCMutex  *mutex)
+{
+  futex_condvar_wait (cond, mutex, NULL);
+}
+
+dbus_bool_t
+_dbus_platform_condvar_wait_timeout (DBusCondVar               *cond,
+                                     DBusCMutex                *mutex,
+                                     int                        timeout_milliseconds)
+{
+  struct timespec timeout;
+
+  /* FUTEX_WAIT takes a relative timeout, which is what we were given */
+  timeout.tv_sec = timeout_milliseconds / 1000;
+  timeout.tv_nsec = (timeout_milliseconds % 1000) * 1000 * 1000;
+
+  /* return true if we did not time out */
+  return futex_condvar_wait (cond, mutex, &timeout);
+}
+
+void
+_dbus_platform_condvar_wake_one (DBusCondVar *cond)
+{
+  __sync_fetch_and_add (&cond->seq, 1);
+
+  if (cond->waiters > 0)
+    futex_wake (&cond->seq, 1);
+}
+
+static void
+check_spinning (void)
+{
+  spinning_helps = sysconf (_SC_NPROCESSORS_ONLN) > 1;
+}
+
+#else /* !DBUS_ENABLE_FUTEX */
 
 /* Whether we have a "monotonic" clock; i.e. a clock not affected by
  * changes in system time.
@@ -156,6 +448,18 @@ _dbus_platform_rmutex_lock (DBusRMutex *mutex)
   PTHREAD_CHECK ("pthread_mutex_lock", pthread_mutex_lock (&mutex->lock));
 }
 
+dbus_bool_t
+_dbus_platform_cmutex_trylock (DBusCMutex *mutex)
+{
+  return pthread_mutex_trylock (&mutex->lock) == 0;
+}
+
+dbus_bool_t
+_dbus_platform_rmutex_trylock (DBusRMutex *mutex)
+{
+  return pthread_mutex_trylock (&mutex->lock) == 0;
+}
+
 void
 _dbus_platform_cmutex_unlock (DBusCMutex *mutex)
 {
@@ -239,7 +543,7 @@ _dbus_platform_condvar_wait_timeout (DBusCondVar               *cond,
   
   end_time.tv_sec = time_now.tv_sec + timeout_milliseconds / 1000;
   end_time.tv_nsec = (time_now.tv_usec + (timeout_milliseconds % 1000) * 1000) * 1000;
-  if (end_time.tv_nsec > 1000*1000*1000)
+  if (end_time.tv_nsec >= 1000*1000*1000)
     {
       end_time.tv_sec += 1;
       end_time.tv_nsec -= 1000*1000*1000;
@@ -272,6 +576,71 @@ check_monotonic_clock (void)
 #endif
 }
 
+#endif /* !DBUS_ENABLE_FUTEX */
+
+typedef struct
+{
+  DBusThreadFunction  func;
+  void               *data;
+} DBusThreadStart;
+
+static void *
+thread_start_trampoline (void *arg)
+{
+  DBusThreadStart start = *(DBusThreadStart *) arg;
+
+  dbus_free (arg);
+  (* start.func) (start.data);
+
+  return NULL;
+}
+
+dbus_bool_t
+_dbus_platform_thread_start (DBusThreadFunction  func,
+                             void               *data)
+{
+  DBusThreadStart *start;
+  pthread_attr_t attr;
+  pthread_t thread;
+  sigset_t all_signals, old_signals;
+  int result;
+
+  start = dbus_new (DBusThreadStart, 1);
+  if (start == NULL)
+    return FALSE;
+
+  start->func = func;
+  start->data = data;
+
+  if (pthread_attr_init (&attr) != 0)
+    {
+      dbus_free (start);
+      return FALSE;
+    }
+
+  pthread_attr_setdetachstate (&attr, PTHREAD_CREATE_DETACHED);
+
+  /* Library threads must not steal signals meant for the application,
+   * so start with everything blocked; the new thread inherits our mask.
+   */
+  sigfillset (&all_signals);
+  pthread_sigmask (SIG_SETMASK, &all_signals, &old_signals);
+
+  result = pthread_create (&thread, &attr, thread_start_trampoline, start);
+
+  pthread_sigmask (SIG_SETMASK, &old_signals, NULL);
+  pthread_attr_destroy (&attr);
+
+  if (result != 0)
+    {
+      _dbus_verbose ("pthread_create failed: %s\n", strerror (result));
+      dbus_free (start);
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
 dbus_bool_t
 _dbus_threads_init_platform_specific (void)
 {
@@ -279,7 +648,11 @@ _dbus_threads_init_platform_specific (void)
    * where dbus_threads_init() has been called and when it hasn't;
    * so initialize them before any threads are allowed to enter.
    */
+#ifdef DBUS_ENABLE_FUTEX
+  check_spinning ();
+#else
   check_monotonic_clock ();
+#endif
   (void) _dbus_check_setuid ();
   return dbus_threads_init (NULL);
 }
@@ -130,6 +130,18 @@ _dbus_platform_rmutex_lock (DBusRMutex *mutex)
   WaitForSingleObject ((HANDLE *) mutex, INFINITE);
 }
 
+dbus_bool_t
+_dbus_platform_cmutex_trylock (DBusCMutex *mutex)
+{
+  return WaitForSingleObject ((HANDLE *) mutex, 0) == WAIT_OBJECT_0;
+}
+
+dbus_bool_t
+_dbus_platform_rmutex_trylock (DBusRMutex *mutex)
+{
+  return WaitForSingleObject ((HANDLE *) mutex, 0) == WAIT_OBJECT_0;
+}
+
 void
 _dbus_platform_cmutex_unlock (DBusCMutex *mutex)
 {
@@ -256,6 +268,49 @@ _dbus_platform_condvar_wake_one (DBusCondVar *cond)
   LeaveCriticalSection (&cond->lock);
 }
 
+typedef struct
+{
+  DBusThreadFunction  func;
+  void               *data;
+} DBusThreadStart;
+
+static DWORD WINAPI
+thread_start_trampoline (LPVOID arg)
+{
+  DBusThreadStart start = *(DBusThreadStart *) arg;
+
+  dbus_free (arg);
+  (* start.func) (start.data);
+
+  return 0;
+}
+
+dbus_bool_t
+_dbus_platform_thread_start (DBusThreadFunction  func,
+                             void               *data)
+{
+  DBusThreadStart *start;
+  HANDLE thread;
+
+  start = dbus_new (DBusThreadStart, 1);
+  if (start == NULL)
+    return FALSE;
+
+  start->func = func;
+  start->data = data;
+
+  thread = CreateThread (NULL, 0, thread_start_trampoline, start, 0, NULL);
+  if (thread == NULL)
+    {
+      dbus_free (start);
+      return FALSE;
+    }
+
+  /* Nobody joins the thread, so don't keep it around after it exits */
+  CloseHandle (thread);
+  return TRUE;
+}
+
 dbus_bool_t
 _dbus_threads_init_platform_specific (void)
 {
@@ -76,6 +76,9 @@
 #ifdef HAVE_ADT
 #include <bsm/adt.h>
 #endif
+#ifdef HAVE_MEMFD_CREATE
+#include <sys/mman.h>
+#endif
 
 #include "sd-daemon.h"
 
@@ -172,16 +175,27 @@ _dbus_open_socket (int              *fd_p,
  * This will set FD_CLOEXEC for the socket returned
  *
  * @param fd return location for socket descriptor
+ * @param type SOCK_STREAM or SOCK_SEQPACKET
  * @param error return location for an error
  * @returns #FALSE if error is set
  */
 static dbus_bool_t
 _dbus_open_unix_socket (int              *fd,
+                        int               type,
                         DBusError        *error)
 {
-  return _dbus_open_socket(fd, PF_UNIX, SOCK_STREAM, 0, error);
+  return _dbus_open_socket(fd, PF_UNIX, type, 0, error);
 }
 
+static int connect_unix_socket (const char  *path,
+                                dbus_bool_t  abstract,
+                                int          type,
+                                DBusError   *error);
+static int listen_unix_socket  (const char  *path,
+                                dbus_bool_t  abstract,
+                                int          type,
+                                DBusError   *error);
+
 /**
  * Closes a socket. Should not be used on non-socket
  * file descriptors or handles.
@@ -385,6 +399,71 @@ _dbus_read_socket_with_unix_fds (int               fd,
 #endif
 }
 
+#ifdef DBUS_HAVE_SEQPACKET
+/**
+ * Checks whether a socket keeps the boundaries between what is
+ * written in each call, so that it must be read a whole packet at a
+ * time with _dbus_read_socket_packet().
+ *
+ * @param fd the socket
+ * @returns #TRUE for a SOCK_SEQPACKET socket
+ */
+dbus_bool_t
+_dbus_socket_is_seqpacket (int fd)
+{
+  int type;
+  socklen_t len = sizeof (type);
+
+  if (getsockopt (fd, SOL_SOCKET, SO_TYPE, &type, &len) < 0)
+    return FALSE;
+
+  return type == SOCK_SEQPACKET;
+}
+
+/**
+ * Reads the next packet from a SOCK_SEQPACKET socket, with the unix
+ * fds that came with it if @p fds is not #NULL. Reading a packet
+ * into too little space would drop the rest of it, so this peeks at
+ * its size first and makes room for all of it, however big.
+ *
+ * Returns like _dbus_read_socket_with_unix_fds(): 0 means the other
+ * end hung up, since nothing sends empty packets.
+ *
+ * @param fd the socket
+ * @param buffer string to append the packet to
+ * @param fds array to put the unix fds in, or #NULL
+ * @param n_fds how many fds the array has room for; how many were read
+ * @returns number of bytes appended to the string, or -1 with errno set
+ */
+int
+_dbus_read_socket_packet (int         fd,
+                          DBusString *buffer,
+                          int        *fds,
+                          int        *n_fds)
+{
+  int size;
+
+ again:
+  size = recv (fd, NULL, 0, MSG_PEEK | MSG_TRUNC);
+
+  if (size < 0 && errno == EINTR)
+    goto again;
+
+  if (size <= 0)
+    {
+      if (fds != NULL)
+        *n_fds = 0;
+
+      return size;
+    }
+
+  if (fds != NULL)
+    return _dbus_read_socket_with_unix_fds (fd, buffer, size, fds, n_fds);
+  else
+    return _dbus_read_socket (fd, buffer, size);
+}
+#endif
+
 int
 _dbus_write_socket_with_unix_fds(int               fd,
                                  const DBusString *buffer,
@@ -786,6 +865,35 @@ int
 _dbus_connect_unix_socket (const char     *path,
                            dbus_bool_t     abstract,
                            DBusError      *error)
+{
+  return connect_unix_socket (path, abstract, SOCK_STREAM, error);
+}
+
+#ifdef DBUS_HAVE_SEQPACKET
+/**
+ * Like _dbus_connect_unix_socket(), but for a socket that keeps the
+ * boundaries between what is written in each call, as created by
+ * _dbus_listen_unix_seqpacket_socket().
+ *
+ * @param path the path to UNIX domain socket
+ * @param abstract #TRUE to use abstract namespace
+ * @param error return location for error code
+ * @returns connection file descriptor or -1 on error
+ */
+int
+_dbus_connect_unix_seqpacket_socket (const char     *path,
+                                     dbus_bool_t     abstract,
+                                     DBusError      *error)
+{
+  return connect_unix_socket (path, abstract, SOCK_SEQPACKET, error);
+}
+#endif
+
+static int
+connect_unix_socket (const char     *path,
+                     dbus_bool_t     abstract,
+                     int             type,
+                     DBusError      *error)
 {
   int fd;
   size_t path_len;
@@ -797,7 +905,7 @@ _dbus_connect_unix_socket (const char     *path,
                  path, abstract);
 
 
-  if (!_dbus_open_unix_socket (&fd, error))
+  if (!_dbus_open_unix_socket (&fd, type, error))
     {
       _DBUS_ASSERT_ERROR_IS_SET(error);
       return -1;
@@ -1010,6 +1118,35 @@ int
 _dbus_listen_unix_socket (const char     *path,
                           dbus_bool_t     abstract,
                           DBusError      *error)
+{
+  return listen_unix_socket (path, abstract, SOCK_STREAM, error);
+}
+
+#ifdef DBUS_HAVE_SEQPACKET
+/**
+ * Like _dbus_listen_unix_socket(), but each connection keeps the
+ * boundaries between what is written in each call, so that each
+ * D-Bus message can go in a packet of its own.
+ *
+ * @param path the socket name
+ * @param abstract #TRUE to use abstract namespace
+ * @param error return location for errors
+ * @returns the listening file descriptor or -1 on error
+ */
+int
+_dbus_listen_unix_seqpacket_socket (const char     *path,
+                                    dbus_bool_t     abstract,
+                                    DBusError      *error)
+{
+  return listen_unix_socket (path, abstract, SOCK_SEQPACKET, error);
+}
+#endif
+
+static int
+listen_unix_socket (const char     *path,
+                    dbus_bool_t     abstract,
+                    int             type,
+                    DBusError      *error)
 {
   int listen_fd;
   struct sockaddr_un addr;
@@ -1044,7 +1181,7 @@ _dbus_listen_unix_socket (const char     *path,
     }
 #else
 
-  if (!_dbus_open_unix_socket (&listen_fd, error))
+  if (!_dbus_open_unix_socket (&listen_fd, type, error))
     {
       _DBUS_ASSERT_ERROR_IS_SET(error);
       return -1;
@@ -1130,7 +1267,7 @@ _dbus_listen_unix_socket (const char     *path,
 
 #endif  /* android init managed sockets */
 
-  if (listen (listen_fd, 30 /* backlog */) < 0)
+  if (listen (listen_fd, SOMAXCONN /* backlog */) < 0)
     {
       dbus_set_error (error, _dbus_error_from_errno (errno),
                       "Failed to listen on socket \"%s\": %s",
@@ -1487,7 +1624,7 @@ _dbus_listen_tcp_socket (const char     *host,
           goto failed;
         }
 
-      if (listen (fd, 30 /* backlog */) < 0)
+      if (listen (fd, SOMAXCONN /* backlog */) < 0)
         {
           saved_errno = errno;
           _dbus_close (fd, NULL);
@@ -1939,22 +2076,85 @@ _dbus_send_credentials_socket  (int              server_fd,
 }
 
 /**
- * Accepts a connection on a listening socket.
- * Handles EINTR for you.
- *
- * This will enable FD_CLOEXEC for the returned socket.
+ * Gets the user that the process at the other end of a connected
+ * socket was running as when the connection was made, without
+ * reading or writing anything. Unlike _dbus_read_credentials_socket(),
+ * this works from the connecting side too; it is only supported where
+ * the kernel can tell us without the peer's cooperation.
  *
- * @param listen_fd the listen file descriptor
- * @returns the connection fd of the client, or -1 on error
+ * @param fd the connected socket
+ * @param uid return location for the peer's user
+ * @returns #FALSE if the peer's user can't be found out
  */
-int
-_dbus_accept  (int listen_fd)
+dbus_bool_t
+_dbus_read_peer_unix_user (int         fd,
+                           dbus_uid_t *uid)
+{
+#ifdef SO_PEERCRED
+#ifdef __OpenBSD__
+  struct sockpeercred cr;
+#else
+  struct ucred cr;
+#endif
+  socklen_t cr_len = sizeof (cr);
+
+  if (getsockopt (fd, SOL_SOCKET, SO_PEERCRED, &cr, &cr_len) == 0 &&
+      cr_len == sizeof (cr))
+    {
+      *uid = cr.uid;
+      return TRUE;
+    }
+
+  _dbus_verbose ("Failed to getsockopt() peer credentials: %s\n",
+                 _dbus_strerror (errno));
+  return FALSE;
+#elif defined(HAVE_GETPEEREID)
+  uid_t euid;
+  gid_t egid;
+
+  if (getpeereid (fd, &euid, &egid) == 0)
+    {
+      *uid = euid;
+      return TRUE;
+    }
+
+  _dbus_verbose ("Failed to getpeereid() credentials: %s\n",
+                 _dbus_strerror (errno));
+  return FALSE;
+#elif defined(HAVE_GETPEERUCRED)
+  ucred_t *ucred = NULL;
+  dbus_bool_t ret = FALSE;
+
+  if (getpeerucred (fd, &ucred) == 0)
+    {
+      *uid = ucred_geteuid (ucred);
+      ret = TRUE;
+    }
+  else
+    {
+      _dbus_verbose ("Failed to getpeerucred() credentials: %s\n",
+                     _dbus_strerror (errno));
+    }
+
+  if (ucred != NULL)
+    ucred_free (ucred);
+
+  return ret;
+#else
+  _dbus_verbose ("Peer credentials not supported on this OS\n");
+  return FALSE;
+#endif
+}
+
+static int
+accept_socket (int         listen_fd,
+               dbus_bool_t nonblocking)
 {
   int client_fd;
   struct sockaddr addr;
   socklen_t addrlen;
 #ifdef HAVE_ACCEPT4
-  dbus_bool_t cloexec_done;
+  dbus_bool_t flags_done;
 #endif
 
   addrlen = sizeof (addr);
@@ -1962,9 +2162,11 @@ _dbus_accept  (int listen_fd)
  retry:
 
 #ifdef HAVE_ACCEPT4
-  /* We assume that if accept4 is available SOCK_CLOEXEC is too */
-  client_fd = accept4 (listen_fd, &addr, &addrlen, SOCK_CLOEXEC);
-  cloexec_done = client_fd >= 0;
+  /* We assume that if accept4 is available SOCK_CLOEXEC and
+   * SOCK_NONBLOCK are too */
+  client_fd = accept4 (listen_fd, &addr, &addrlen,
+                       SOCK_CLOEXEC | (nonblocking ? SOCK_NONBLOCK : 0));
+  flags_done = client_fd >= 0;
 
   if (client_fd < 0 && errno == ENOSYS)
 #endif
@@ -1976,20 +2178,57 @@ _dbus_accept  (int listen_fd)
     {
       if (errno == EINTR)
         goto retry;
+
+      return client_fd;
     }
 
   _dbus_verbose ("client fd %d accepted\n", client_fd);
 
 #ifdef HAVE_ACCEPT4
-  if (!cloexec_done)
+  if (!flags_done)
 #endif
     {
       _dbus_fd_set_close_on_exec(client_fd);
+
+      if (nonblocking && !_dbus_set_fd_nonblocking (client_fd, NULL))
+        {
+          _dbus_close (client_fd, NULL);
+          return -1;
+        }
     }
 
   return client_fd;
 }
 
+/**
+ * Accepts a connection on a listening socket.
+ * Handles EINTR for you.
+ *
+ * This will enable FD_CLOEXEC for the returned socket.
+ *
+ * @param listen_fd the listen file descriptor
+ * @returns the connection fd of the client, or -1 on error
+ */
+int
+_dbus_accept  (int listen_fd)
+{
+  return accept_socket (listen_fd, FALSE);
+}
+
+/**
+ * Like _dbus_accept(), but the returned socket is also nonblocking.
+ * Where accept4() is available this costs no more system calls than
+ * _dbus_accept().
+ *
+ * @param listen_fd the listen file descriptor
+ * @returns the connection fd of the client, or -1 on error
+ */
+int
+_dbus_accept_nonblocking (int listen_fd)
+{
+  return accept_socket (listen_fd, TRUE);
+}
+
 /**
  * Checks to make sure the given directory is
  * private to the user
@@ -3017,6 +3256,205 @@ _dbus_set_fd_nonblocking (int             fd,
   return TRUE;
 }
 
+#ifdef HAVE_MEMFD_CREATE
+/**
+ * Creates a new, empty memfd that can be sealed later.
+ *
+ * @param error return location for the reason it failed
+ * @returns the memfd, or -1 on failure
+ */
+int
+_dbus_memfd_new (DBusError *error)
+{
+  int fd;
+
+  _DBUS_ASSERT_ERROR_IS_CLEAR (error);
+
+  fd = memfd_create ("dbus-body", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+  if (fd < 0)
+    {
+      dbus_set_error (error, _dbus_error_from_errno (errno),
+                      "Could not create memfd: %s",
+                      _dbus_strerror (errno));
+      return -1;
+    }
+
+  return fd;
+}
+
+/**
+ * Writes part of a string into a memfd that is not sealed yet, at the
+ * given offset. Writing the same bytes again after a failure is
+ * harmless.
+ *
+ * @param fd the memfd
+ * @param offset where in the memfd to write
+ * @param str the string
+ * @param start where to start copying
+ * @param len how many bytes to copy
+ * @param error return location for the reason it failed
+ * @returns #FALSE on failure
+ */
+dbus_bool_t
+_dbus_memfd_write (int               fd,
+                   int               offset,
+                   const DBusString *str,
+                   int               start,
+                   int               len,
+                   DBusError        *error)
+{
+  const char *data;
+  int written;
+
+  _DBUS_ASSERT_ERROR_IS_CLEAR (error);
+
+  data = _dbus_string_get_const_data_len (str, start, len);
+  written = 0;
+
+  while (written < len)
+    {
+      int n = pwrite (fd, data + written, len - written, offset + written);
+
+      if (n < 0 && errno == EINTR)
+        continue;
+
+      if (n < 0)
+        {
+          dbus_set_error (error, _dbus_error_from_errno (errno),
+                          "Could not write to memfd: %s",
+                          _dbus_strerror (errno));
+          return FALSE;
+        }
+
+      written += n;
+    }
+
+  return TRUE;
+}
+
+/**
+ * Seals a memfd so that nothing can change it from then on, so that
+ * whoever receives it can map it instead of copying it. Sealing a
+ * memfd that is already sealed succeeds.
+ *
+ * @param fd the memfd
+ * @param error return location for the reason it failed
+ * @returns #FALSE on failure
+ */
+dbus_bool_t
+_dbus_memfd_seal (int        fd,
+                  DBusError *error)
+{
+  const int seals = F_SEAL_WRITE | F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL;
+  int current;
+
+  _DBUS_ASSERT_ERROR_IS_CLEAR (error);
+
+  current = fcntl (fd, F_GET_SEALS);
+
+  if (current >= 0 && (current & seals) == seals)
+    return TRUE;
+
+  if (current < 0 || fcntl (fd, F_ADD_SEALS, seals) < 0)
+    {
+      dbus_set_error (error, _dbus_error_from_errno (errno),
+                      "Could not seal memfd: %s",
+                      _dbus_strerror (errno));
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+/**
+ * Copies part of a string into a new sealed memfd.
+ *
+ * @param str the string
+ * @param start where to start copying
+ * @param len how many bytes to copy
+ * @param error return location for the reason it failed
+ * @returns the memfd, or -1 on failure
+ */
+int
+_dbus_memfd_new_sealed (const DBusString *str,
+                        int               start,
+                        int               len,
+                        DBusError        *error)
+{
+  int fd;
+
+  fd = _dbus_memfd_new (error);
+  if (fd < 0)
+    return -1;
+
+  if (!_dbus_memfd_write (fd, 0, str, start, len, error) ||
+      !_dbus_memfd_seal (fd, error))
+    {
+      _dbus_close (fd, NULL);
+      return -1;
+    }
+
+  return fd;
+}
+
+/**
+ * Maps a memfd read-only, after checking that it is exactly @p len
+ * bytes long and sealed so that the sender can neither change it nor
+ * shrink it underneath us.
+ *
+ * @param fd the memfd
+ * @param len the size it must be
+ * @param error return location for the reason it failed
+ * @returns the mapping, or #NULL on failure
+ */
+const void *
+_dbus_memfd_map_sealed (int        fd,
+                        int        len,
+                        DBusError *error)
+{
+  struct stat sb;
+  void *map;
+  int seals;
+
+  _DBUS_ASSERT_ERROR_IS_CLEAR (error);
+
+  seals = fcntl (fd, F_GET_SEALS);
+
+  if (len <= 0 || seals < 0 ||
+      (seals & (F_SEAL_WRITE | F_SEAL_SHRINK)) != (F_SEAL_WRITE | F_SEAL_SHRINK) ||
+      fstat (fd, &sb) < 0 || sb.st_size != len)
+    {
+      dbus_set_error (error, DBUS_ERROR_FAILED,
+                      "File descriptor %d is not a sealed memfd of %d bytes",
+                      fd, len);
+      return NULL;
+    }
+
+  map = mmap (NULL, len, PROT_READ, MAP_SHARED, fd, 0);
+  if (map == MAP_FAILED)
+    {
+      dbus_set_error (error, _dbus_error_from_errno (errno),
+                      "Could not map memfd: %s", _dbus_strerror (errno));
+      return NULL;
+    }
+
+  return map;
+}
+
+/**
+ * Unmaps memory mapped by _dbus_memfd_map_sealed().
+ *
+ * @param map the mapping
+ * @param len its length
+ */
+void
+_dbus_memfd_unmap (const void *map,
+                   int         len)
+{
+  munmap ((void *) map, len);
+}
+#endif /* HAVE_MEMFD_CREATE */
+
 /**
  * On GNU libc systems, print a crude backtrace to stderr.  On other
  * systems, print "no backtrace support" and block for possible gdb
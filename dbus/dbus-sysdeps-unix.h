@@ -31,6 +31,11 @@
 #error "Don't include this on Windows"
 #endif
 
+#ifdef __linux__
+/** Unix sockets that keep message boundaries, for unixpacket: addresses */
+#define DBUS_HAVE_SEQPACKET 1
+#endif
+
 DBUS_BEGIN_DECLS
 
 /**
@@ -63,6 +68,27 @@ _dbus_write_two (int               fd,
                  int               start2,
                  int               len2);
 
+#ifdef HAVE_MEMFD_CREATE
+int         _dbus_memfd_new        (DBusError        *error);
+dbus_bool_t _dbus_memfd_write      (int               fd,
+                                    int               offset,
+                                    const DBusString *str,
+                                    int               start,
+                                    int               len,
+                                    DBusError        *error);
+dbus_bool_t _dbus_memfd_seal       (int               fd,
+                                    DBusError        *error);
+int         _dbus_memfd_new_sealed (const DBusString *str,
+                                    int               start,
+                                    int               len,
+                                    DBusError        *error);
+const void *_dbus_memfd_map_sealed (int               fd,
+                                    int               len,
+                                    DBusError        *error);
+void        _dbus_memfd_unmap      (const void       *map,
+                                    int               len);
+#endif
+
 int _dbus_connect_unix_socket (const char     *path,
                                dbus_bool_t     abstract,
                                DBusError      *error);
@@ -70,6 +96,20 @@ int _dbus_listen_unix_socket  (const char     *path,
                                dbus_bool_t     abstract,
                                DBusError      *error);
 
+#ifdef DBUS_HAVE_SEQPACKET
+int         _dbus_connect_unix_seqpacket_socket (const char  *path,
+                                                 dbus_bool_t  abstract,
+                                                 DBusError   *error);
+int         _dbus_listen_unix_seqpacket_socket  (const char  *path,
+                                                 dbus_bool_t  abstract,
+                                                 DBusError   *error);
+dbus_bool_t _dbus_socket_is_seqpacket           (int          fd);
+int         _dbus_read_socket_packet            (int          fd,
+                                                 DBusString  *buffer,
+                                                 int         *fds,
+                                                 int         *n_fds);
+#endif
+
 int _dbus_connect_exec (const char     *path,
                         char *const    argv[],
                         DBusError      *error);
@@ -82,6 +122,8 @@ dbus_bool_t _dbus_read_credentials (int               client_fd,
                                     DBusError        *error);
 dbus_bool_t _dbus_send_credentials (int              server_fd,
                                     DBusError       *error);
+dbus_bool_t _dbus_read_peer_unix_user (int              fd,
+                                       dbus_uid_t      *uid);
 
 dbus_bool_t _dbus_lookup_launchd_socket (DBusString *socket_path,
                                          const char *launchd_env_var,
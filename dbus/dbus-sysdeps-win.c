@@ -1596,6 +1596,29 @@ _dbus_accept  (int listen_fd)
   return client_fd;
 }
 
+/**
+ * Like _dbus_accept(), but the returned socket is also nonblocking.
+ *
+ * @param listen_fd the listen file descriptor
+ * @returns the connection fd of the client, or -1 on error
+ */
+int
+_dbus_accept_nonblocking (int listen_fd)
+{
+  int client_fd;
+
+  client_fd = _dbus_accept (listen_fd);
+
+  if (!DBUS_SOCKET_IS_INVALID (client_fd) &&
+      !_dbus_set_fd_nonblocking (client_fd, NULL))
+    {
+      _dbus_close_socket (client_fd, NULL);
+      return -1;
+    }
+
+  return client_fd;
+}
+
 
 
 
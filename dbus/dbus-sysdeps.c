@@ -759,6 +759,16 @@ _dbus_get_is_errno_epipe (void)
   return errno == EPIPE;
 }
 
+/**
+ * See if errno is EMSGSIZE
+ * @returns #TRUE if errno == EMSGSIZE
+ */
+dbus_bool_t
+_dbus_get_is_errno_emsgsize (void)
+{
+  return errno == EMSGSIZE;
+}
+
 /**
  * Get error message from errno
  * @returns _dbus_strerror(errno)
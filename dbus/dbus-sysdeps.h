@@ -182,6 +182,7 @@ int _dbus_listen_tcp_socket   (const char     *host,
                                int           **fds_p,
                                DBusError      *error);
 int _dbus_accept              (int             listen_fd);
+int _dbus_accept_nonblocking  (int             listen_fd);
 
 
 dbus_bool_t _dbus_read_credentials_socket (int               client_fd,
@@ -373,6 +374,7 @@ dbus_bool_t _dbus_get_is_errno_eagain_or_ewouldblock (void);
 dbus_bool_t _dbus_get_is_errno_enomem                (void);
 dbus_bool_t _dbus_get_is_errno_eintr                 (void);
 dbus_bool_t _dbus_get_is_errno_epipe                 (void);
+dbus_bool_t _dbus_get_is_errno_emsgsize              (void);
 const char* _dbus_strerror_from_errno                (void);
 
 void _dbus_disable_sigpipe (void);
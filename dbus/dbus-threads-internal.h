@@ -44,6 +44,11 @@ typedef struct DBusRMutex DBusRMutex;
  */
 typedef struct DBusCMutex DBusCMutex;
 
+/**
+ * A function to run in a new thread.
+ */
+typedef void (* DBusThreadFunction) (void *data);
+
 /** @} */
 
 DBUS_BEGIN_DECLS
@@ -69,16 +74,50 @@ void         _dbus_condvar_wake_one          (DBusCondVar       *cond);
 void         _dbus_condvar_new_at_location   (DBusCondVar      **location_p);
 void         _dbus_condvar_free_at_location  (DBusCondVar      **location_p);
 
+dbus_bool_t  _dbus_thread_start              (DBusThreadFunction  func,
+                                              void              *data);
+
+/**
+ * Contention statistics for one class of lock, such as the global
+ * "list" lock or the mutex of every #DBusConnection. Times are in
+ * microseconds.
+ */
+typedef struct
+{
+  const char    *name;          /**< lock class name */
+  dbus_uint64_t  acquisitions;  /**< outermost acquisitions */
+  dbus_uint64_t  contended;     /**< acquisitions that had to wait */
+  dbus_uint64_t  wait_total;    /**< total time spent waiting */
+  dbus_uint64_t  wait_max;      /**< longest single wait */
+  dbus_uint64_t  hold_total;    /**< total time the lock was held */
+  dbus_uint64_t  hold_max;      /**< longest single hold */
+} DBusLockProfile;
+
+/* if DBUS_ENABLE_STATS */
+void         _dbus_lock_profile_enable       (void);
+dbus_bool_t  _dbus_lock_profile_is_enabled   (void);
+void         _dbus_rmutex_set_profile_name   (DBusRMutex        *mutex,
+                                              const char        *name);
+void         _dbus_cmutex_set_profile_name   (DBusCMutex        *mutex,
+                                              const char        *name);
+int          _dbus_lock_profile_get_n_classes (void);
+dbus_bool_t  _dbus_lock_profile_get          (int                i,
+                                              DBusLockProfile   *profile);
+void         _dbus_lock_profile_reset        (void);
+void         _dbus_lock_profile_dump         (void);
+
 /* Private to threading implementations and dbus-threads.c */
 
 DBusRMutex  *_dbus_platform_rmutex_new       (void);
 void         _dbus_platform_rmutex_free      (DBusRMutex       *mutex);
 void         _dbus_platform_rmutex_lock      (DBusRMutex       *mutex);
+dbus_bool_t  _dbus_platform_rmutex_trylock   (DBusRMutex       *mutex);
 void         _dbus_platform_rmutex_unlock    (DBusRMutex       *mutex);
 
 DBusCMutex  *_dbus_platform_cmutex_new       (void);
 void         _dbus_platform_cmutex_free      (DBusCMutex       *mutex);
 void         _dbus_platform_cmutex_lock      (DBusCMutex       *mutex);
+dbus_bool_t  _dbus_platform_cmutex_trylock   (DBusCMutex       *mutex);
 void         _dbus_platform_cmutex_unlock    (DBusCMutex       *mutex);
 
 DBusCondVar* _dbus_platform_condvar_new      (void);
@@ -90,6 +129,9 @@ dbus_bool_t  _dbus_platform_condvar_wait_timeout (DBusCondVar   *cond,
                                               int                timeout_milliseconds);
 void         _dbus_platform_condvar_wake_one (DBusCondVar       *cond);
 
+dbus_bool_t  _dbus_platform_thread_start     (DBusThreadFunction  func,
+                                              void              *data);
+
 DBUS_END_DECLS
 
 #endif /* DBUS_THREADS_INTERNAL_H */
@@ -26,6 +26,13 @@
 #include "dbus-threads-internal.h"
 #include "dbus-list.h"
 
+#ifdef DBUS_ENABLE_STATS
+#include "dbus-sysdeps.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#endif
+
 static int thread_init_generation = 0;
  
 static DBusList *uninitialized_rmutex_list = NULL;
@@ -40,6 +47,354 @@ static DBusList *uninitialized_condvar_list = NULL;
 /** This is used for the no-op default mutex pointer, just to be distinct from #NULL */
 #define _DBUS_DUMMY_CONDVAR ((DBusCondVar*)0xABCDEF2)
 
+#ifdef DBUS_ENABLE_STATS
+/*
+ * Lock profiling. In a stats build every mutex is wrapped in a
+ * ProfiledMutex, so that the lock functions never have to guess what
+ * they were given. Those created while profiling is in effect are
+ * marked as profiled, and the lock functions account for the time
+ * spent waiting for and holding them; the others are passed straight
+ * through to the platform mutex.
+ *
+ * The counters of a ProfiledMutex are only written by the thread that
+ * holds the wrapped mutex, so they need no locking of their own. They
+ * are folded into their LockClass when the mutex is freed; reports add
+ * up the class totals and the counters of the live instances.
+ */
+
+#define MAX_LOCK_CLASSES 32
+
+typedef struct ProfiledMutex ProfiledMutex;
+
+typedef struct
+{
+  DBusLockProfile totals;     /**< counters of freed instances */
+  ProfiledMutex *instances;   /**< live instances */
+} LockClass;
+
+struct ProfiledMutex
+{
+  void *real;                 /**< the platform DBusRMutex or DBusCMutex */
+  dbus_bool_t recursive;      /**< #TRUE if real is a DBusRMutex */
+  dbus_bool_t profiled;       /**< #TRUE if profiling was in effect at creation */
+  int depth;                  /**< recursion depth of the current holder */
+  dbus_uint64_t held_since;   /**< when the current holder acquired it */
+  DBusLockProfile counters;   /**< this instance's counters */
+  LockClass *klass;           /**< the class this instance reports to */
+  ProfiledMutex *prev;        /**< previous instance of klass */
+  ProfiledMutex *next;        /**< next instance of klass */
+};
+
+static dbus_bool_t lock_profile_requested = FALSE;
+static dbus_bool_t lock_profiling = FALSE;
+static dbus_bool_t lock_profile_dump_registered = FALSE;
+
+/* Protects lock_classes and the instance lists; it is a bare platform
+ * mutex so that it is never profiled itself.
+ */
+static DBusRMutex *lock_classes_mutex = NULL;
+static LockClass lock_classes[MAX_LOCK_CLASSES] = { { { "unnamed" } } };
+static int n_lock_classes = 1;
+
+static void
+lock_classes_lock (void)
+{
+  if (lock_classes_mutex != NULL)
+    _dbus_platform_rmutex_lock (lock_classes_mutex);
+}
+
+static void
+lock_classes_unlock (void)
+{
+  if (lock_classes_mutex != NULL)
+    _dbus_platform_rmutex_unlock (lock_classes_mutex);
+}
+
+static dbus_uint64_t
+lock_profile_now (void)
+{
+  long tv_sec, tv_usec;
+
+  _dbus_get_monotonic_time (&tv_sec, &tv_usec);
+
+  return (dbus_uint64_t) tv_sec * 1000000 + tv_usec;
+}
+
+static void
+lock_profile_add (DBusLockProfile       *to,
+                  const DBusLockProfile *from)
+{
+  to->acquisitions += from->acquisitions;
+  to->contended += from->contended;
+  to->wait_total += from->wait_total;
+  to->wait_max = MAX (to->wait_max, from->wait_max);
+  to->hold_total += from->hold_total;
+  to->hold_max = MAX (to->hold_max, from->hold_max);
+}
+
+static void
+lock_profile_clear (DBusLockProfile *profile)
+{
+  const char *name = profile->name;
+
+  _DBUS_ZERO (*profile);
+  profile->name = name;
+}
+
+/* Called with lock_classes_mutex held; name must be a static string */
+static LockClass *
+lock_class_lookup (const char *name)
+{
+  int i;
+
+  for (i = 0; i < n_lock_classes; i++)
+    {
+      if (strcmp (lock_classes[i].totals.name, name) == 0)
+        return &lock_classes[i];
+    }
+
+  if (n_lock_classes == MAX_LOCK_CLASSES)
+    return &lock_classes[0];
+
+  lock_classes[n_lock_classes].totals.name = name;
+  return &lock_classes[n_lock_classes++];
+}
+
+/* Called with lock_classes_mutex held */
+static void
+profiled_mutex_link (ProfiledMutex *pm,
+                     LockClass     *klass)
+{
+  pm->klass = klass;
+  pm->prev = NULL;
+  pm->next = klass->instances;
+
+  if (klass->instances != NULL)
+    klass->instances->prev = pm;
+
+  klass->instances = pm;
+}
+
+/* Called with lock_classes_mutex held */
+static void
+profiled_mutex_unlink (ProfiledMutex *pm)
+{
+  if (pm->prev != NULL)
+    pm->prev->next = pm->next;
+  else
+    pm->klass->instances = pm->next;
+
+  if (pm->next != NULL)
+    pm->next->prev = pm->prev;
+
+  pm->klass = NULL;
+  pm->prev = NULL;
+  pm->next = NULL;
+}
+
+static void
+profiled_mutex_set_class (ProfiledMutex *pm,
+                          const char    *name)
+{
+  if (!pm->profiled)
+    return;
+
+  lock_classes_lock ();
+  profiled_mutex_unlink (pm);
+  profiled_mutex_link (pm, lock_class_lookup (name));
+  lock_classes_unlock ();
+}
+
+static void *
+profiled_mutex_new (void        *real,
+                    dbus_bool_t  recursive)
+{
+  ProfiledMutex *pm;
+
+  pm = dbus_new0 (ProfiledMutex, 1);
+  if (pm == NULL)
+    {
+      if (recursive)
+        _dbus_platform_rmutex_free (real);
+      else
+        _dbus_platform_cmutex_free (real);
+
+      return NULL;
+    }
+
+  pm->real = real;
+  pm->recursive = recursive;
+  pm->profiled = lock_profiling;
+
+  if (pm->profiled)
+    {
+      lock_classes_lock ();
+      profiled_mutex_link (pm, &lock_classes[0]);
+      lock_classes_unlock ();
+    }
+
+  return pm;
+}
+
+static void
+profiled_mutex_free (ProfiledMutex *pm)
+{
+  if (pm->profiled)
+    {
+      lock_classes_lock ();
+      lock_profile_add (&pm->klass->totals, &pm->counters);
+      profiled_mutex_unlink (pm);
+      lock_classes_unlock ();
+    }
+
+  if (pm->recursive)
+    _dbus_platform_rmutex_free (pm->real);
+  else
+    _dbus_platform_cmutex_free (pm->real);
+
+  dbus_free (pm);
+}
+
+static void
+profiled_mutex_begin_hold (ProfiledMutex *pm,
+                           dbus_uint64_t  now)
+{
+  pm->depth = 1;
+  pm->held_since = now;
+}
+
+static void
+profiled_mutex_end_hold (ProfiledMutex *pm)
+{
+  dbus_uint64_t held;
+
+  held = lock_profile_now () - pm->held_since;
+  pm->counters.hold_total += held;
+  pm->counters.hold_max = MAX (pm->counters.hold_max, held);
+  pm->depth = 0;
+}
+
+static void
+profiled_mutex_lock (ProfiledMutex *pm)
+{
+  dbus_uint64_t start, now, waited;
+  dbus_bool_t acquired;
+
+  if (!pm->profiled)
+    {
+      if (pm->recursive)
+        _dbus_platform_rmutex_lock (pm->real);
+      else
+        _dbus_platform_cmutex_lock (pm->real);
+
+      return;
+    }
+
+  start = lock_profile_now ();
+
+  if (pm->recursive)
+    acquired = _dbus_platform_rmutex_trylock (pm->real);
+  else
+    acquired = _dbus_platform_cmutex_trylock (pm->real);
+
+  if (!acquired)
+    {
+      if (pm->recursive)
+        _dbus_platform_rmutex_lock (pm->real);
+      else
+        _dbus_platform_cmutex_lock (pm->real);
+    }
+
+  /* From here on we own the mutex, and with it the counters */
+  if (pm->depth > 0)
+    {
+      pm->depth += 1;
+      return;
+    }
+
+  now = acquired ? start : lock_profile_now ();
+  pm->counters.acquisitions += 1;
+
+  if (!acquired)
+    {
+      waited = now - start;
+      pm->counters.contended += 1;
+      pm->counters.wait_total += waited;
+      pm->counters.wait_max = MAX (pm->counters.wait_max, waited);
+    }
+
+  profiled_mutex_begin_hold (pm, now);
+}
+
+static void
+profiled_mutex_unlock (ProfiledMutex *pm)
+{
+  if (!pm->profiled)
+    ;
+  else if (pm->depth == 1)
+    profiled_mutex_end_hold (pm);
+  else
+    pm->depth -= 1;
+
+  if (pm->recursive)
+    _dbus_platform_rmutex_unlock (pm->real);
+  else
+    _dbus_platform_cmutex_unlock (pm->real);
+}
+#endif /* DBUS_ENABLE_STATS */
+
+static DBusRMutex *
+rmutex_new (void)
+{
+  DBusRMutex *mutex;
+
+  mutex = _dbus_platform_rmutex_new ();
+
+#ifdef DBUS_ENABLE_STATS
+  if (mutex != NULL)
+    mutex = profiled_mutex_new (mutex, TRUE);
+#endif
+
+  return mutex;
+}
+
+static DBusCMutex *
+cmutex_new (void)
+{
+  DBusCMutex *mutex;
+
+  mutex = _dbus_platform_cmutex_new ();
+
+#ifdef DBUS_ENABLE_STATS
+  if (mutex != NULL)
+    mutex = profiled_mutex_new (mutex, FALSE);
+#endif
+
+  return mutex;
+}
+
+static void
+rmutex_free (DBusRMutex *mutex)
+{
+#ifdef DBUS_ENABLE_STATS
+  profiled_mutex_free ((ProfiledMutex *) mutex);
+  return;
+#endif
+
+  _dbus_platform_rmutex_free (mutex);
+}
+
+static void
+cmutex_free (DBusCMutex *mutex)
+{
+#ifdef DBUS_ENABLE_STATS
+  profiled_mutex_free ((ProfiledMutex *) mutex);
+  return;
+#endif
+
+  _dbus_platform_cmutex_free (mutex);
+}
+
 /**
  * @defgroup DBusThreadsInternals Thread functions
  * @ingroup  DBusInternals
@@ -73,7 +428,7 @@ _dbus_rmutex_new_at_location (DBusRMutex **location_p)
 
   if (thread_init_generation == _dbus_current_generation)
     {
-      *location_p = _dbus_platform_rmutex_new ();
+      *location_p = rmutex_new ();
     }
   else
     {
@@ -106,7 +461,7 @@ _dbus_cmutex_new_at_location (DBusCMutex **location_p)
 
   if (thread_init_generation == _dbus_current_generation)
     {
-      *location_p = _dbus_platform_cmutex_new ();
+      *location_p = cmutex_new ();
     }
   else
     {
@@ -130,7 +485,7 @@ _dbus_rmutex_free_at_location (DBusRMutex **location_p)
   if (thread_init_generation == _dbus_current_generation)
     {
       if (*location_p != NULL)
-        _dbus_platform_rmutex_free (*location_p);
+        rmutex_free (*location_p);
     }
   else
     {
@@ -154,7 +509,7 @@ _dbus_cmutex_free_at_location (DBusCMutex **location_p)
   if (thread_init_generation == _dbus_current_generation)
     {
       if (*location_p != NULL)
-        _dbus_platform_cmutex_free (*location_p);
+        cmutex_free (*location_p);
     }
   else
     {
@@ -173,7 +528,14 @@ void
 _dbus_rmutex_lock (DBusRMutex *mutex)
 {
   if (mutex && thread_init_generation == _dbus_current_generation)
-    _dbus_platform_rmutex_lock (mutex);
+    {
+#ifdef DBUS_ENABLE_STATS
+      profiled_mutex_lock ((ProfiledMutex *) mutex);
+      return;
+#endif
+
+      _dbus_platform_rmutex_lock (mutex);
+    }
 }
 
 /**
@@ -185,7 +547,14 @@ void
 _dbus_cmutex_lock (DBusCMutex *mutex)
 {
   if (mutex && thread_init_generation == _dbus_current_generation)
-    _dbus_platform_cmutex_lock (mutex);
+    {
+#ifdef DBUS_ENABLE_STATS
+      profiled_mutex_lock ((ProfiledMutex *) mutex);
+      return;
+#endif
+
+      _dbus_platform_cmutex_lock (mutex);
+    }
 }
 
 /**
@@ -197,7 +566,14 @@ void
 _dbus_rmutex_unlock (DBusRMutex *mutex)
 {
   if (mutex && thread_init_generation == _dbus_current_generation)
-    _dbus_platform_rmutex_unlock (mutex);
+    {
+#ifdef DBUS_ENABLE_STATS
+      profiled_mutex_unlock ((ProfiledMutex *) mutex);
+      return;
+#endif
+
+      _dbus_platform_rmutex_unlock (mutex);
+    }
 }
 
 /**
@@ -209,7 +585,14 @@ void
 _dbus_cmutex_unlock (DBusCMutex *mutex)
 {
   if (mutex && thread_init_generation == _dbus_current_generation)
-    _dbus_platform_cmutex_unlock (mutex);
+    {
+#ifdef DBUS_ENABLE_STATS
+      profiled_mutex_unlock ((ProfiledMutex *) mutex);
+      return;
+#endif
+
+      _dbus_platform_cmutex_unlock (mutex);
+    }
 }
 
 /**
@@ -305,7 +688,25 @@ _dbus_condvar_wait (DBusCondVar *cond,
                     DBusCMutex  *mutex)
 {
   if (cond && mutex && thread_init_generation == _dbus_current_generation)
-    _dbus_platform_condvar_wait (cond, mutex);
+    {
+#ifdef DBUS_ENABLE_STATS
+      ProfiledMutex *pm = (ProfiledMutex *) mutex;
+
+      if (!pm->profiled)
+        {
+          _dbus_platform_condvar_wait (cond, pm->real);
+          return;
+        }
+
+      /* waiting for the condition is not time spent holding the lock */
+      profiled_mutex_end_hold (pm);
+      _dbus_platform_condvar_wait (cond, pm->real);
+      profiled_mutex_begin_hold (pm, lock_profile_now ());
+      return;
+#endif
+
+      _dbus_platform_condvar_wait (cond, mutex);
+    }
 }
 
 /**
@@ -325,8 +726,25 @@ _dbus_condvar_wait_timeout (DBusCondVar               *cond,
                             int                        timeout_milliseconds)
 {
   if (cond && mutex && thread_init_generation == _dbus_current_generation)
-    return _dbus_platform_condvar_wait_timeout (cond, mutex,
-                                                timeout_milliseconds);
+    {
+#ifdef DBUS_ENABLE_STATS
+      ProfiledMutex *pm = (ProfiledMutex *) mutex;
+      dbus_bool_t woken;
+
+      if (!pm->profiled)
+        return _dbus_platform_condvar_wait_timeout (cond, pm->real,
+                                                    timeout_milliseconds);
+
+      profiled_mutex_end_hold (pm);
+      woken = _dbus_platform_condvar_wait_timeout (cond, pm->real,
+                                                   timeout_milliseconds);
+      profiled_mutex_begin_hold (pm, lock_profile_now ());
+      return woken;
+#endif
+
+      return _dbus_platform_condvar_wait_timeout (cond, mutex,
+                                                  timeout_milliseconds);
+    }
   else
     return TRUE;
 }
@@ -343,6 +761,25 @@ _dbus_condvar_wake_one (DBusCondVar *cond)
     _dbus_platform_condvar_wake_one (cond);
 }
 
+/**
+ * Runs func(data) in a new, detached thread. Threads must already
+ * have been initialized, since the caller is about to share data
+ * with the new thread.
+ *
+ * @param func the function to run
+ * @param data argument for func
+ * @returns #FALSE if threads are not initialized or on OOM
+ */
+dbus_bool_t
+_dbus_thread_start (DBusThreadFunction  func,
+                    void               *data)
+{
+  if (thread_init_generation != _dbus_current_generation)
+    return FALSE;
+
+  return _dbus_platform_thread_start (func, data);
+}
+
 static void
 shutdown_global_locks (void *data)
 {
@@ -353,7 +790,7 @@ shutdown_global_locks (void *data)
   while (i < _DBUS_N_GLOBAL_LOCKS)
     {
       if (*(locks[i]) != NULL)
-        _dbus_platform_rmutex_free (*(locks[i]));
+        rmutex_free (*(locks[i]));
 
       *(locks[i]) = NULL;
       ++i;
@@ -385,7 +822,7 @@ init_uninitialized_locks (void)
       mp = link->data;
       _dbus_assert (*mp == _DBUS_DUMMY_RMUTEX);
 
-      *mp = _dbus_platform_rmutex_new ();
+      *mp = rmutex_new ();
       if (*mp == NULL)
         goto fail_mutex;
 
@@ -400,7 +837,7 @@ init_uninitialized_locks (void)
       mp = link->data;
       _dbus_assert (*mp == _DBUS_DUMMY_CMUTEX);
 
-      *mp = _dbus_platform_cmutex_new ();
+      *mp = cmutex_new ();
       if (*mp == NULL)
         goto fail_mutex;
 
@@ -457,7 +894,7 @@ init_uninitialized_locks (void)
       mp = link->data;
 
       if (*mp != _DBUS_DUMMY_RMUTEX && *mp != NULL)
-        _dbus_platform_rmutex_free (*mp);
+        rmutex_free (*mp);
 
       *mp = _DBUS_DUMMY_RMUTEX;
 
@@ -472,7 +909,7 @@ init_uninitialized_locks (void)
       mp = link->data;
 
       if (*mp != _DBUS_DUMMY_CMUTEX && *mp != NULL)
-        _dbus_platform_cmutex_free (*mp);
+        cmutex_free (*mp);
 
       *mp = _DBUS_DUMMY_CMUTEX;
 
@@ -482,13 +919,70 @@ init_uninitialized_locks (void)
   return FALSE;
 }
 
+#ifdef DBUS_ENABLE_STATS
+static void
+dump_lock_profile_at_exit (void)
+{
+  _dbus_lock_profile_dump ();
+}
+
+static void
+shutdown_lock_profiling (void *data)
+{
+  if (lock_classes_mutex != NULL)
+    _dbus_platform_rmutex_free (lock_classes_mutex);
+
+  lock_classes_mutex = NULL;
+  lock_profiling = FALSE;
+}
+
+static dbus_bool_t
+init_lock_profiling (void)
+{
+  const char *env;
+
+  env = _dbus_getenv ("DBUS_LOCK_PROFILE");
+
+  if (env != NULL && *env != '\0')
+    {
+      lock_profile_requested = TRUE;
+
+      if (!lock_profile_dump_registered)
+        lock_profile_dump_registered = (atexit (dump_lock_profile_at_exit) == 0);
+    }
+
+  if (!lock_profile_requested || lock_classes_mutex != NULL)
+    return TRUE;
+
+  lock_classes_mutex = _dbus_platform_rmutex_new ();
+  if (lock_classes_mutex == NULL)
+    return FALSE;
+
+  /* registered before the global locks, so it runs after they are freed */
+  if (!_dbus_register_shutdown_func (shutdown_lock_profiling, NULL))
+    {
+      _dbus_platform_rmutex_free (lock_classes_mutex);
+      lock_classes_mutex = NULL;
+      return FALSE;
+    }
+
+  lock_profiling = TRUE;
+  return TRUE;
+}
+#endif /* DBUS_ENABLE_STATS */
+
 static dbus_bool_t
 init_locks (void)
 {
   int i;
   DBusRMutex ***dynamic_global_locks;
-  DBusRMutex **global_locks[] = {
-#define LOCK_ADDR(name) (& _dbus_lock_##name)
+  /* Each lock is listed with its own name, so that the two cannot get
+   * out of step when a lock is added */
+  const struct {
+    DBusRMutex **location;
+    const char *name;
+  } global_locks[] = {
+#define LOCK_ADDR(name) { & _dbus_lock_##name, #name }
     LOCK_ADDR (win_fds),
     LOCK_ADDR (sid_atom_cache),
     LOCK_ADDR (list),
@@ -505,7 +999,8 @@ init_locks (void)
     LOCK_ADDR (system_users),
     LOCK_ADDR (message_cache),
     LOCK_ADDR (shared_connections),
-    LOCK_ADDR (machine_uuid)
+    LOCK_ADDR (machine_uuid),
+    LOCK_ADDR (signature_programs)
 #undef LOCK_ADDR
   };
 
@@ -513,6 +1008,11 @@ init_locks (void)
                 _DBUS_N_GLOBAL_LOCKS);
 
   i = 0;
+
+#ifdef DBUS_ENABLE_STATS
+  if (!init_lock_profiling ())
+    return FALSE;
+#endif
   
   dynamic_global_locks = dbus_new (DBusRMutex**, _DBUS_N_GLOBAL_LOCKS);
   if (dynamic_global_locks == NULL)
@@ -520,12 +1020,17 @@ init_locks (void)
   
   while (i < _DBUS_N_ELEMENTS (global_locks))
     {
-      *global_locks[i] = _dbus_platform_rmutex_new ();
+      *global_locks[i].location = rmutex_new ();
 
-      if (*global_locks[i] == NULL)
+      if (*global_locks[i].location == NULL)
         goto failed;
 
-      dynamic_global_locks[i] = global_locks[i];
+#ifdef DBUS_ENABLE_STATS
+      profiled_mutex_set_class ((ProfiledMutex *) *global_locks[i].location,
+                                global_locks[i].name);
+#endif
+
+      dynamic_global_locks[i] = global_locks[i].location;
 
       ++i;
     }
@@ -544,12 +1049,175 @@ init_locks (void)
                                      
   for (i = i - 1; i >= 0; i--)
     {
-      _dbus_platform_rmutex_free (*global_locks[i]);
-      *global_locks[i] = NULL;
+      rmutex_free (*global_locks[i].location);
+      *global_locks[i].location = NULL;
     }
   return FALSE;
 }
 
+#ifdef DBUS_ENABLE_STATS
+/**
+ * Requests lock profiling, which takes effect the next time threads
+ * are initialized. Setting the environment variable DBUS_LOCK_PROFILE
+ * has the same effect, and also prints a report to stderr at exit.
+ *
+ * Only mutexes created while profiling is in effect are profiled.
+ */
+void
+_dbus_lock_profile_enable (void)
+{
+  lock_profile_requested = TRUE;
+}
+
+/**
+ * Checks whether locks are currently being profiled.
+ *
+ * @returns #TRUE if lock profiling is in effect
+ */
+dbus_bool_t
+_dbus_lock_profile_is_enabled (void)
+{
+  return lock_profiling &&
+    thread_init_generation == _dbus_current_generation;
+}
+
+/**
+ * Attributes a mutex to a lock class in profiling reports. Does
+ * nothing if lock profiling is not in effect; mutexes that are never
+ * named are reported together as "unnamed".
+ *
+ * @param mutex the mutex, or #NULL
+ * @param name the class name, which must be a static string
+ */
+void
+_dbus_rmutex_set_profile_name (DBusRMutex *mutex,
+                               const char *name)
+{
+  if (mutex != NULL && mutex != _DBUS_DUMMY_RMUTEX)
+    profiled_mutex_set_class ((ProfiledMutex *) mutex, name);
+}
+
+/**
+ * Attributes a mutex to a lock class in profiling reports, like
+ * _dbus_rmutex_set_profile_name().
+ *
+ * @param mutex the mutex, or #NULL
+ * @param name the class name, which must be a static string
+ */
+void
+_dbus_cmutex_set_profile_name (DBusCMutex *mutex,
+                               const char *name)
+{
+  if (mutex != NULL && mutex != _DBUS_DUMMY_CMUTEX)
+    profiled_mutex_set_class ((ProfiledMutex *) mutex, name);
+}
+
+/**
+ * Gets the number of lock classes seen so far, for use with
+ * _dbus_lock_profile_get().
+ *
+ * @returns the number of lock classes
+ */
+int
+_dbus_lock_profile_get_n_classes (void)
+{
+  int n;
+
+  lock_classes_lock ();
+  n = n_lock_classes;
+  lock_classes_unlock ();
+
+  return n;
+}
+
+/**
+ * Gets the accumulated statistics of one lock class, including
+ * locks that have been freed. Counters of locks that are in use by
+ * other threads may be slightly behind.
+ *
+ * @param i index of the class, less than _dbus_lock_profile_get_n_classes()
+ * @param profile return location for the statistics
+ * @returns #FALSE if i is out of range
+ */
+dbus_bool_t
+_dbus_lock_profile_get (int              i,
+                        DBusLockProfile *profile)
+{
+  ProfiledMutex *pm;
+
+  lock_classes_lock ();
+
+  if (i < 0 || i >= n_lock_classes)
+    {
+      lock_classes_unlock ();
+      return FALSE;
+    }
+
+  *profile = lock_classes[i].totals;
+
+  for (pm = lock_classes[i].instances; pm != NULL; pm = pm->next)
+    lock_profile_add (profile, &pm->counters);
+
+  lock_classes_unlock ();
+
+  return TRUE;
+}
+
+/**
+ * Zeroes the statistics of every lock class.
+ */
+void
+_dbus_lock_profile_reset (void)
+{
+  ProfiledMutex *pm;
+  int i;
+
+  lock_classes_lock ();
+
+  for (i = 0; i < n_lock_classes; i++)
+    {
+      lock_profile_clear (&lock_classes[i].totals);
+
+      for (pm = lock_classes[i].instances; pm != NULL; pm = pm->next)
+        lock_profile_clear (&pm->counters);
+    }
+
+  lock_classes_unlock ();
+}
+
+/**
+ * Prints the statistics of every lock class that has been acquired
+ * to stderr.
+ */
+void
+_dbus_lock_profile_dump (void)
+{
+  DBusLockProfile profile;
+  int i;
+
+  fprintf (stderr, "lock profile for process %lu (times in usec):\n",
+           _dbus_pid_for_log ());
+  fprintf (stderr, "  %-24s %12s %12s %14s %10s %14s %10s\n",
+           "lock", "acquired", "contended", "wait", "max wait",
+           "held", "max held");
+
+  for (i = 0; _dbus_lock_profile_get (i, &profile); i++)
+    {
+      if (profile.acquisitions == 0)
+        continue;
+
+      fprintf (stderr, "  %-24s %12llu %12llu %14llu %10llu %14llu %10llu\n",
+               profile.name,
+               (unsigned long long) profile.acquisitions,
+               (unsigned long long) profile.contended,
+               (unsigned long long) profile.wait_total,
+               (unsigned long long) profile.wait_max,
+               (unsigned long long) profile.hold_total,
+               (unsigned long long) profile.hold_max);
+    }
+}
+#endif /* DBUS_ENABLE_STATS */
+
 /** @} */ /* end of internals */
 
 /**
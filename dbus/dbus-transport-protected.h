@@ -124,6 +124,7 @@ dbus_bool_t _dbus_transport_init_base     (DBusTransport             *transport,
                                            const DBusString          *server_guid,
                                            const DBusString          *address);
 void        _dbus_transport_finalize_base (DBusTransport             *transport);
+dbus_bool_t _dbus_transport_below_live_messages_limits (DBusTransport *transport);
 
 
 typedef enum
@@ -141,6 +142,9 @@ DBusTransportOpenResult _dbus_transport_open_platform_specific (DBusAddressEntry
 #define DBUS_TRANSPORT_CAN_SEND_UNIX_FD(x)      \
   _dbus_auth_get_unix_fd_negotiated((x)->auth)
 
+#define DBUS_TRANSPORT_CAN_SEND_MEMFD_BODY(x)   \
+  _dbus_auth_get_memfd_body_negotiated((x)->auth)
+
 DBUS_END_DECLS
 
 #endif /* DBUS_TRANSPORT_PROTECTED_H */
@@ -0,0 +1,787 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/* dbus-transport-shm.c  Transport sending messages through shared memory
+ *
+ * Licensed under the Academic Free License version 2.1
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <config.h>
+#include "dbus-transport-shm.h"
+
+#ifdef DBUS_HAVE_SHM_CHANNEL
+
+#include "dbus-internals.h"
+#include "dbus-connection-internal.h"
+#include "dbus-transport-socket.h"
+#include "dbus-watch.h"
+#include "dbus-sysdeps-unix.h"
+
+/**
+ * @defgroup DBusTransportShm DBusTransport implementation for shared memory
+ * @ingroup  DBusInternals
+ * @brief Implementation details of the shm: DBusTransport
+ *
+ * A shm: transport connects and authenticates like a unix: one, and
+ * then sends and receives messages through a #DBusShmChannel.
+ *
+ * @{
+ */
+
+/**
+ * Opaque object representing a shared memory transport.
+ */
+typedef struct DBusTransportShm DBusTransportShm;
+
+/**
+ * Implementation details of DBusTransportShm. All members are private.
+ */
+struct DBusTransportShm
+{
+  DBusTransportSocket base;             /**< Parent instance, which
+                                         *   authenticates over the socket
+                                         */
+  DBusShmChannel *channel;              /**< Rings that messages go through
+                                         *   once authenticated, or #NULL
+                                         */
+  DBusWatch *wakeup_watch;              /**< Watch for the other side waking us. */
+  unsigned int setup_pending : 1;       /**< Channel not sent or received yet */
+  unsigned int started : 1;             /**< Looked at the rings since
+                                         *   authenticating
+                                         */
+  unsigned int read_stalled : 1;        /**< Stopped reading at the live
+                                         *   messages limit
+                                         */
+  unsigned int peer_hung_up : 1;        /**< Socket closed, disconnect once
+                                         *   the ring is empty
+                                         */
+};
+
+/** How much to copy out of the rings at once before doing other work */
+#define SHM_MAX_BYTES_READ_PER_ITERATION (256 * 1024)
+
+static void
+do_io_error (DBusTransport *transport)
+{
+  _dbus_transport_ref (transport);
+  _dbus_transport_disconnect (transport);
+  _dbus_transport_unref (transport);
+}
+
+static void
+free_wakeup_watch (DBusTransport *transport)
+{
+  DBusTransportShm *shm_transport = (DBusTransportShm*) transport;
+
+  if (shm_transport->wakeup_watch)
+    {
+      if (transport->connection)
+        _dbus_connection_remove_watch_unlocked (transport->connection,
+                                                shm_transport->wakeup_watch);
+      _dbus_watch_invalidate (shm_transport->wakeup_watch);
+      _dbus_watch_unref (shm_transport->wakeup_watch);
+      shm_transport->wakeup_watch = NULL;
+    }
+}
+
+/* FALSE on OOM. The watch starts disabled, and shm_check_watches()
+ * enables it once authenticated. */
+static dbus_bool_t
+add_wakeup_watch (DBusTransport *transport)
+{
+  DBusTransportShm *shm_transport = (DBusTransportShm*) transport;
+
+  shm_transport->wakeup_watch =
+    _dbus_watch_new (_dbus_shm_channel_get_wakeup_fd (shm_transport->channel),
+                     DBUS_WATCH_READABLE, FALSE, NULL, NULL, NULL);
+  if (shm_transport->wakeup_watch == NULL)
+    return FALSE;
+
+  _dbus_watch_set_handler (shm_transport->wakeup_watch,
+                           _dbus_connection_handle_watch,
+                           transport->connection, NULL);
+
+  if (!_dbus_connection_add_watch_unlocked (transport->connection,
+                                            shm_transport->wakeup_watch))
+    {
+      _dbus_watch_invalidate (shm_transport->wakeup_watch);
+      _dbus_watch_unref (shm_transport->wakeup_watch);
+      shm_transport->wakeup_watch = NULL;
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+/* Returns whether the channel has now been passed over the socket */
+static dbus_bool_t
+exchange_channel (DBusTransport *transport)
+{
+  DBusTransportShm *shm_transport = (DBusTransportShm*) transport;
+  DBusError error = DBUS_ERROR_INIT;
+
+  if (transport->is_server)
+    {
+      shm_transport->channel = _dbus_shm_channel_receive (shm_transport->base.fd,
+                                                          &error);
+      if (shm_transport->channel == NULL)
+        {
+          if (dbus_error_is_set (&error))
+            {
+              _dbus_verbose ("Failed to receive shared memory: %s\n",
+                             error.message);
+              dbus_error_free (&error);
+              do_io_error (transport);
+            }
+
+          return FALSE;
+        }
+
+      /* like the credentials, treat running out of memory here as
+       * fatal rather than trying to get back to a state where we
+       * could retry */
+      if (!add_wakeup_watch (transport))
+        {
+          _dbus_verbose ("No memory to watch shared memory\n");
+          do_io_error (transport);
+          return FALSE;
+        }
+    }
+  else if (!_dbus_shm_channel_send (shm_transport->channel,
+                                    shm_transport->base.fd, &error))
+    {
+      _dbus_verbose ("Failed to send shared memory: %s\n", error.message);
+      dbus_error_free (&error);
+      do_io_error (transport);
+      return FALSE;
+    }
+
+  shm_transport->setup_pending = FALSE;
+  return TRUE;
+}
+
+/* The client passes the shared memory on a byte of its own before
+ * the credentials byte. */
+static dbus_bool_t
+shm_setup (DBusTransport *transport,
+           dbus_bool_t    do_reading,
+           dbus_bool_t    do_writing)
+{
+  DBusTransportShm *shm_transport = (DBusTransportShm*) transport;
+
+  if (!shm_transport->setup_pending)
+    return TRUE;
+
+  if (!(transport->is_server ? do_reading : do_writing) ||
+      !exchange_channel (transport))
+    return FALSE;
+
+  /* the credentials byte may not have arrived yet, and reading it
+   * must not block */
+  return !transport->is_server;
+}
+
+static dbus_bool_t
+shm_check_watches (DBusTransport *transport)
+{
+  DBusTransportShm *shm_transport = (DBusTransportShm*) transport;
+
+  if (!shm_transport->started)
+    {
+      shm_transport->started = TRUE;
+
+      /* The other side wakes us for space to write as well as for
+       * data to read, so this stays enabled at the live messages
+       * limit too */
+      _dbus_connection_toggle_watch_unlocked (transport->connection,
+                                              shm_transport->wakeup_watch,
+                                              TRUE);
+
+      /* it may have filled the ring before we were ready to look at
+       * it, without waking us */
+      _dbus_shm_channel_wake_self (shm_transport->channel);
+    }
+
+  /* Messages come through the rings, and the socket is only watched
+   * for the other side hanging up */
+  return !shm_transport->peer_hung_up;
+}
+
+static const DBusTransportSocketHooks shm_hooks = {
+  shm_setup,
+  shm_check_watches
+};
+
+/* returns false on out-of-memory */
+static dbus_bool_t
+do_reading (DBusTransport *transport,
+            int           *bytes_read_p)
+{
+  DBusTransportShm *shm_transport = (DBusTransportShm*) transport;
+  DBusString *buffer;
+  int bytes_read;
+  int total;
+  dbus_bool_t oom;
+
+  oom = FALSE;
+  total = 0;
+
+  while (!transport->disconnected)
+    {
+      if (!_dbus_transport_below_live_messages_limits (transport))
+        {
+          /* shm_live_messages_changed() wakes us up again */
+          shm_transport->read_stalled = TRUE;
+          break;
+        }
+
+      if (total > SHM_MAX_BYTES_READ_PER_ITERATION)
+        {
+          _dbus_verbose ("%d bytes exceeds %d bytes read per iteration, returning\n",
+                         total, SHM_MAX_BYTES_READ_PER_ITERATION);
+          _dbus_shm_channel_wake_self (shm_transport->channel);
+          break;
+        }
+
+      _dbus_message_loader_get_buffer (transport->loader, &buffer);
+
+      /* in pieces no bigger than we would read from the socket: the
+       * loader moves what is left down after each message it takes */
+      bytes_read = _dbus_shm_channel_read (shm_transport->channel, buffer,
+                                           shm_transport->base.max_bytes_read_per_iteration);
+
+      _dbus_message_loader_return_buffer (transport->loader,
+                                          buffer,
+                                          bytes_read < 0 ? 0 : bytes_read);
+
+      if (bytes_read < 0)
+        {
+          if (_dbus_get_is_errno_enomem ())
+            {
+              _dbus_verbose ("Out of memory reading from shared memory\n");
+              oom = TRUE;
+            }
+          else
+            {
+              _dbus_verbose ("Remote app corrupted shared memory\n");
+              do_io_error (transport);
+            }
+          break;
+        }
+      else if (bytes_read == 0)
+        {
+          if (shm_transport->peer_hung_up)
+            {
+              _dbus_verbose ("Disconnected from remote app\n");
+              do_io_error (transport);
+              break;
+            }
+
+          /* sleep unless something came in while we were looking */
+          if (!_dbus_shm_channel_wait_for_data (shm_transport->channel))
+            break;
+        }
+      else
+        {
+          _dbus_verbose (" read %d bytes from shared memory\n", bytes_read);
+
+          total += bytes_read;
+
+          if (!_dbus_transport_queue_messages (transport))
+            {
+              _dbus_verbose (" out of memory when queueing messages we just read in the transport\n");
+              oom = TRUE;
+              break;
+            }
+        }
+    }
+
+  if (!transport->disconnected)
+    {
+      /* the wakeup that brought us here has been used up, so make
+       * sure we come back to whatever we could not read */
+      if (oom)
+        _dbus_shm_channel_wake_self (shm_transport->channel);
+
+      _dbus_shm_channel_notify (shm_transport->channel);
+    }
+
+  if (bytes_read_p)
+    *bytes_read_p = total;
+
+  return !oom;
+}
+
+static void
+do_writing (DBusTransport *transport)
+{
+  DBusTransportShm *shm_transport = (DBusTransportShm*) transport;
+  int *message_bytes_written = &shm_transport->base.message_bytes_written;
+
+  while (!transport->disconnected &&
+         _dbus_connection_has_messages_to_send_unlocked (transport->connection))
+    {
+      DBusMessage *message;
+      const DBusString *header;
+      const DBusString *body;
+      int header_len, body_len;
+      int bytes_written;
+
+      message = _dbus_connection_get_message_to_send (transport->connection);
+      _dbus_assert (message != NULL);
+      dbus_message_lock (message);
+
+      _dbus_message_get_network_data (message, &header, &body);
+
+      header_len = _dbus_string_get_length (header);
+      body_len = _dbus_string_get_length (body);
+
+      if (*message_bytes_written < header_len)
+        bytes_written =
+          _dbus_shm_channel_write (shm_transport->channel,
+                                   header,
+                                   *message_bytes_written,
+                                   header_len - *message_bytes_written);
+      else
+        bytes_written =
+          _dbus_shm_channel_write (shm_transport->channel,
+                                   body,
+                                   *message_bytes_written - header_len,
+                                   body_len -
+                                   (*message_bytes_written - header_len));
+
+      if (bytes_written < 0)
+        {
+          _dbus_verbose ("Remote app corrupted shared memory\n");
+          do_io_error (transport);
+          break;
+        }
+
+      *message_bytes_written += bytes_written;
+
+      if (*message_bytes_written == header_len + body_len)
+        {
+          *message_bytes_written = 0;
+
+          _dbus_connection_message_sent_unlocked (transport->connection,
+                                                  message);
+        }
+      else if (bytes_written == 0)
+        {
+          /* the ring is full; sleep unless the other side made space
+           * while we were looking */
+          if (!_dbus_shm_channel_wait_for_space (shm_transport->channel))
+            break;
+        }
+    }
+
+  if (!transport->disconnected)
+    _dbus_shm_channel_notify (shm_transport->channel);
+}
+
+/* returns false on out-of-memory */
+static dbus_bool_t
+handle_wakeup (DBusTransport *transport)
+{
+  DBusTransportShm *shm_transport = (DBusTransportShm*) transport;
+
+  _dbus_shm_channel_clear_wakeup (shm_transport->channel);
+
+  if (!do_reading (transport, NULL))
+    return FALSE;
+
+  do_writing (transport);
+  return TRUE;
+}
+
+/* Nothing more should come through the socket once the rings are in
+ * use, so this is the other side going away (or misbehaving, which
+ * we treat the same). Read what it left in the ring first. */
+static void
+handle_hangup (DBusTransport *transport)
+{
+  DBusTransportShm *shm_transport = (DBusTransportShm*) transport;
+
+  _dbus_verbose ("Socket readable or hung up while using shared memory\n");
+
+  shm_transport->peer_hung_up = TRUE;
+  _dbus_transport_socket_check_read_watch (transport);
+  _dbus_shm_channel_wake_self (shm_transport->channel);
+}
+
+static void
+shm_finalize (DBusTransport *transport)
+{
+  DBusTransportShm *shm_transport = (DBusTransportShm*) transport;
+
+  _dbus_verbose ("\n");
+
+  free_wakeup_watch (transport);
+
+  /* kept until now rather than freed on disconnection, so that
+   * nothing reading or writing the rings can find them gone */
+  if (shm_transport->channel)
+    _dbus_shm_channel_free (shm_transport->channel);
+
+  (* _dbus_transport_socket_vtable.finalize) (transport);
+}
+
+static dbus_bool_t
+shm_handle_watch (DBusTransport *transport,
+                  DBusWatch     *watch,
+                  unsigned int   flags)
+{
+  DBusTransportShm *shm_transport = (DBusTransportShm*) transport;
+
+  if (watch == shm_transport->wakeup_watch)
+    {
+      if (!(flags & DBUS_WATCH_READABLE))
+        return TRUE;
+
+      return handle_wakeup (transport);
+    }
+
+  if (watch == shm_transport->base.read_watch &&
+      _dbus_transport_get_is_authenticated (transport))
+    {
+      handle_hangup (transport);
+      return TRUE;
+    }
+
+  return (* _dbus_transport_socket_vtable.handle_watch) (transport, watch,
+                                                         flags);
+}
+
+static void
+shm_disconnect (DBusTransport *transport)
+{
+  _dbus_verbose ("\n");
+
+  free_wakeup_watch (transport);
+
+  (* _dbus_transport_socket_vtable.disconnect) (transport);
+}
+
+static dbus_bool_t
+shm_connection_set (DBusTransport *transport)
+{
+  DBusTransportShm *shm_transport = (DBusTransportShm*) transport;
+
+  if (!(* _dbus_transport_socket_vtable.connection_set) (transport))
+    return FALSE;
+
+  /* on the server side, the channel arrives later */
+  if (shm_transport->channel && !add_wakeup_watch (transport))
+    {
+      _dbus_connection_remove_watch_unlocked (transport->connection,
+                                              shm_transport->base.write_watch);
+      _dbus_connection_remove_watch_unlocked (transport->connection,
+                                              shm_transport->base.read_watch);
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+static void
+shm_do_iteration (DBusTransport *transport,
+                  unsigned int   flags,
+                  int            timeout_milliseconds)
+{
+  DBusTransportShm *shm_transport = (DBusTransportShm*) transport;
+  DBusPollFD poll_fds[2];
+  int bytes_read;
+  int poll_res;
+
+  if (!_dbus_transport_get_is_authenticated (transport))
+    {
+      (* _dbus_transport_socket_vtable.do_iteration) (transport, flags,
+                                                      timeout_milliseconds);
+      return;
+    }
+
+  /* Copying to and from the rings never blocks, so do that first
+   * and only poll if that did not get us anywhere */
+  bytes_read = 0;
+
+  if (flags & DBUS_ITERATION_DO_WRITING)
+    do_writing (transport);
+
+  if ((flags & DBUS_ITERATION_DO_READING) &&
+      !do_reading (transport, &bytes_read))
+    return;
+
+  if (!(flags & DBUS_ITERATION_BLOCK) ||
+      transport->disconnected ||
+      bytes_read > 0)
+    return;
+
+  if (!(flags & DBUS_ITERATION_DO_READING) &&
+      !_dbus_connection_has_messages_to_send_unlocked (transport->connection))
+    return;
+
+  poll_fds[0].fd = _dbus_shm_channel_get_wakeup_fd (shm_transport->channel);
+  poll_fds[0].events = _DBUS_POLLIN;
+  poll_fds[1].fd = shm_transport->base.fd;
+  poll_fds[1].events = shm_transport->peer_hung_up ? 0 : _DBUS_POLLIN;
+
+  /* See socket_do_iteration() */
+  _dbus_verbose ("unlock pre poll\n");
+  _dbus_connection_unlock (transport->connection);
+
+ again:
+  poll_res = _dbus_poll (poll_fds, _DBUS_N_ELEMENTS (poll_fds),
+                         timeout_milliseconds);
+
+  if (poll_res < 0 && _dbus_get_is_errno_eintr ())
+    goto again;
+
+  _dbus_verbose ("lock post poll\n");
+  _dbus_connection_lock (transport->connection);
+
+  if (poll_res < 0)
+    {
+      _dbus_verbose ("Error from _dbus_poll(): %s\n",
+                     _dbus_strerror_from_errno ());
+      return;
+    }
+
+  if (poll_res == 0 || transport->disconnected)
+    return;
+
+  if (poll_fds[1].revents)
+    handle_hangup (transport);
+
+  handle_wakeup (transport);
+}
+
+static void
+shm_live_messages_changed (DBusTransport *transport)
+{
+  DBusTransportShm *shm_transport = (DBusTransportShm*) transport;
+
+  if (shm_transport->read_stalled &&
+      !transport->disconnected &&
+      _dbus_transport_below_live_messages_limits (transport))
+    {
+      shm_transport->read_stalled = FALSE;
+      _dbus_shm_channel_wake_self (shm_transport->channel);
+    }
+
+  (* _dbus_transport_socket_vtable.live_messages_changed) (transport);
+}
+
+static dbus_bool_t
+shm_get_socket_fd (DBusTransport *transport,
+                   int           *fd_p)
+{
+  return (* _dbus_transport_socket_vtable.get_socket_fd) (transport, fd_p);
+}
+
+static const DBusTransportVTable shm_vtable = {
+  shm_finalize,
+  shm_handle_watch,
+  shm_disconnect,
+  shm_connection_set,
+  shm_do_iteration,
+  shm_live_messages_changed,
+  shm_get_socket_fd
+};
+
+/**
+ * Creates a new transport that authenticates over the given socket
+ * like _dbus_transport_new_for_socket(), then sends and receives
+ * messages through a #DBusShmChannel instead. The client passes the
+ * channel to the server before its credentials. Messages sent this
+ * way cannot carry unix fds.
+ *
+ * @param fd the file descriptor
+ * @param channel on the client side, the channel to pass to the
+ *  server, which the transport takes over; #NULL on the server side
+ * @param server_guid non-#NULL if this transport is on the server side of a connection
+ * @param address the transport's address
+ * @returns the new transport, or #NULL if no memory.
+ */
+DBusTransport*
+_dbus_transport_new_for_shm (int               fd,
+                             DBusShmChannel   *channel,
+                             const DBusString *server_guid,
+                             const DBusString *address)
+{
+  DBusTransportShm *shm_transport;
+
+  _dbus_assert ((channel == NULL) == (server_guid != NULL));
+
+  shm_transport = dbus_new0 (DBusTransportShm, 1);
+  if (shm_transport == NULL)
+    return NULL;
+
+  if (!_dbus_transport_socket_init (&shm_transport->base,
+                                    &shm_vtable, &shm_hooks,
+                                    fd, server_guid, address))
+    {
+      dbus_free (shm_transport);
+      return NULL;
+    }
+
+  _dbus_auth_set_unix_fd_possible (shm_transport->base.base.auth, FALSE);
+#ifdef DBUS_HAVE_MEMFD_BODIES
+  _dbus_auth_set_memfd_body_possible (shm_transport->base.base.auth, FALSE);
+#endif
+
+  shm_transport->channel = channel;
+  shm_transport->setup_pending = TRUE;
+
+  return (DBusTransport*) shm_transport;
+}
+
+static DBusTransport*
+new_for_domain_socket (const char     *path,
+                       dbus_bool_t     abstract,
+                       DBusError      *error)
+{
+  int fd;
+  DBusTransport *transport;
+  DBusString address;
+  DBusShmChannel *channel;
+
+  _DBUS_ASSERT_ERROR_IS_CLEAR (error);
+
+  if (!_dbus_string_init (&address))
+    {
+      dbus_set_error (error, DBUS_ERROR_NO_MEMORY, NULL);
+      return NULL;
+    }
+
+  channel = NULL;
+  fd = -1;
+
+  if (!_dbus_string_append (&address, abstract ? "shm:abstract=" : "shm:path=") ||
+      !_dbus_string_append (&address, path))
+    {
+      dbus_set_error (error, DBUS_ERROR_NO_MEMORY, NULL);
+      goto failed_0;
+    }
+
+  channel = _dbus_shm_channel_new (error);
+  if (channel == NULL)
+    {
+      _DBUS_ASSERT_ERROR_IS_SET (error);
+      goto failed_0;
+    }
+
+  fd = _dbus_connect_unix_socket (path, abstract, error);
+  if (fd < 0)
+    {
+      _DBUS_ASSERT_ERROR_IS_SET (error);
+      goto failed_0;
+    }
+
+  _dbus_verbose ("Successfully connected to unix socket %s\n",
+                 path);
+
+  transport = _dbus_transport_new_for_shm (fd, channel, NULL, &address);
+  if (transport == NULL)
+    {
+      dbus_set_error (error, DBUS_ERROR_NO_MEMORY, NULL);
+      goto failed_1;
+    }
+
+  _dbus_string_free (&address);
+
+  return transport;
+
+ failed_1:
+  _dbus_close_socket (fd, NULL);
+ failed_0:
+  if (channel != NULL)
+    _dbus_shm_channel_free (channel);
+  _dbus_string_free (&address);
+  return NULL;
+}
+
+/**
+ * Opens a shm: transport, which connects to a unix socket given as
+ * for a unix: address.
+ *
+ * @param entry the address entry to try opening as a shm transport.
+ * @param transport_p return location for the opened transport
+ * @param error error to be set
+ * @returns result of the attempt
+ */
+DBusTransportOpenResult
+_dbus_transport_open_shm (DBusAddressEntry  *entry,
+                          DBusTransport    **transport_p,
+                          DBusError         *error)
+{
+  const char *method;
+  const char *path;
+  const char *tmpdir;
+  const char *abstract;
+
+  method = dbus_address_entry_get_method (entry);
+  _dbus_assert (method != NULL);
+
+  if (strcmp (method, "shm") != 0)
+    {
+      _DBUS_ASSERT_ERROR_IS_CLEAR (error);
+      return DBUS_TRANSPORT_OPEN_NOT_HANDLED;
+    }
+
+  path = dbus_address_entry_get_value (entry, "path");
+  tmpdir = dbus_address_entry_get_value (entry, "tmpdir");
+  abstract = dbus_address_entry_get_value (entry, "abstract");
+
+  if (tmpdir != NULL)
+    {
+      _dbus_set_bad_address (error, NULL, NULL,
+                             "cannot use the \"tmpdir\" option for an address to connect to, only in an address to listen on");
+      return DBUS_TRANSPORT_OPEN_BAD_ADDRESS;
+    }
+
+  if (path == NULL && abstract == NULL)
+    {
+      _dbus_set_bad_address (error, method, "path or abstract", NULL);
+      return DBUS_TRANSPORT_OPEN_BAD_ADDRESS;
+    }
+
+  if (path != NULL && abstract != NULL)
+    {
+      _dbus_set_bad_address (error, NULL, NULL,
+                             "can't specify both \"path\" and \"abstract\" options in an address");
+      return DBUS_TRANSPORT_OPEN_BAD_ADDRESS;
+    }
+
+  if (path)
+    *transport_p = new_for_domain_socket (path, FALSE, error);
+  else
+    *transport_p = new_for_domain_socket (abstract, TRUE, error);
+
+  if (*transport_p == NULL)
+    {
+      _DBUS_ASSERT_ERROR_IS_SET (error);
+      return DBUS_TRANSPORT_OPEN_DID_NOT_CONNECT;
+    }
+  else
+    {
+      _DBUS_ASSERT_ERROR_IS_CLEAR (error);
+      return DBUS_TRANSPORT_OPEN_OK;
+    }
+}
+
+/** @} */
+
+#endif /* DBUS_HAVE_SHM_CHANNEL */
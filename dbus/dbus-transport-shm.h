@@ -0,0 +1,43 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/* dbus-transport-shm.h  Transport sending messages through shared memory
+ *
+ * Licensed under the Academic Free License version 2.1
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+#ifndef DBUS_TRANSPORT_SHM_H
+#define DBUS_TRANSPORT_SHM_H
+
+#include <dbus/dbus-transport-protected.h>
+#include <dbus/dbus-shm-channel.h>
+
+#ifdef DBUS_HAVE_SHM_CHANNEL
+
+DBUS_BEGIN_DECLS
+
+DBusTransport*          _dbus_transport_new_for_shm (int                fd,
+                                                     DBusShmChannel    *channel,
+                                                     const DBusString  *server_guid,
+                                                     const DBusString  *address);
+DBusTransportOpenResult _dbus_transport_open_shm    (DBusAddressEntry  *entry,
+                                                     DBusTransport    **transport_p,
+                                                     DBusError         *error);
+
+DBUS_END_DECLS
+
+#endif /* DBUS_HAVE_SHM_CHANNEL */
+
+#endif /* DBUS_TRANSPORT_SHM_H */
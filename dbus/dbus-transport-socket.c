@@ -29,6 +29,10 @@
 #include "dbus-transport-protected.h"
 #include "dbus-watch.h"
 #include "dbus-credentials.h"
+#include "dbus-marshal-header.h"
+#ifdef DBUS_UNIX
+#include "dbus-sysdeps-unix.h"
+#endif
 
 /**
  * @defgroup DBusTransportSocket DBusTransport implementations for sockets
@@ -38,35 +42,21 @@
  * @{
  */
 
-/**
- * Opaque object representing a socket file descriptor transport.
- */
-typedef struct DBusTransportSocket DBusTransportSocket;
+/** Bodies at least this big go in a memfd, if the peer agreed to it;
+ * below this, creating and mapping one costs more than the copies it
+ * saves */
+#define MIN_BODY_SIZE_FOR_MEMFD (64 * 1024)
 
-/**
- * Implementation details of DBusTransportSocket. All members are private.
- */
-struct DBusTransportSocket
-{
-  DBusTransport base;                   /**< Parent instance */
-  int fd;                               /**< File descriptor. */
-  DBusWatch *read_watch;                /**< Watch for readability. */
-  DBusWatch *write_watch;               /**< Watch for writability. */
-
-  int max_bytes_read_per_iteration;     /**< To avoid blocking too long. */
-  int max_bytes_written_per_iteration;  /**< To avoid blocking too long. */
-
-  int message_bytes_written;            /**< Number of bytes of current
-                                         *   outgoing message that have
-                                         *   been written.
-                                         */
-  DBusString encoded_outgoing;          /**< Encoded version of current
-                                         *   outgoing message.
-                                         */
-  DBusString encoded_incoming;          /**< Encoded version of current
-                                         *   incoming data.
-                                         */
-};
+#ifdef DBUS_HAVE_SEQPACKET
+/** Messages up to this size go in one packet on a seqpacket socket;
+ * bigger ones are split, and put back together by the loader at the
+ * other end as they would be on a stream */
+#define MAX_PACKET_SIZE (64 * 1024)
+
+/** Smallest packet to fall back to if the socket's send buffer is too
+ * small for MAX_PACKET_SIZE */
+#define MIN_PACKET_SIZE 1024
+#endif
 
 static void
 free_watches (DBusTransport *transport)
@@ -98,6 +88,62 @@ free_watches (DBusTransport *transport)
   _dbus_verbose ("end\n");
 }
 
+#ifdef DBUS_HAVE_MEMFD_BODIES
+/* Prepares to send the body of a message that is about to be written
+ * in a memfd: the one it was received in if any, so that a relayed
+ * body is never copied, or else a new one. Falls back to writing the
+ * body in the stream if no memfd can be made. Returns FALSE on OOM. */
+static dbus_bool_t
+prepare_body_memfd (DBusTransportSocket *socket_transport,
+                    DBusMessage         *message,
+                    const DBusString    *header,
+                    const DBusString    *body)
+{
+  DBusError error = DBUS_ERROR_INIT;
+  int fd;
+
+  _dbus_assert (socket_transport->body_memfd < 0);
+  _dbus_assert (_dbus_string_get_length (&socket_transport->encoded_outgoing) == 0);
+
+  fd = _dbus_message_get_body_memfd (message);
+  socket_transport->body_memfd_owned = fd < 0;
+
+  if (fd < 0)
+    {
+      fd = _dbus_memfd_new_sealed (body, 0, _dbus_string_get_length (body),
+                                   &error);
+      if (fd < 0)
+        {
+          _dbus_verbose ("Writing body in the stream instead: %s\n",
+                         error.message);
+          dbus_error_free (&error);
+          return TRUE;
+        }
+    }
+
+  if (!_dbus_string_copy (header, 0, &socket_transport->encoded_outgoing, 0))
+    {
+      if (socket_transport->body_memfd_owned)
+        _dbus_close (fd, NULL);
+      return FALSE;
+    }
+
+  _dbus_header_toggle_flag_in_data (&socket_transport->encoded_outgoing, 0,
+                                    _DBUS_HEADER_FLAG_BODY_IN_MEMFD, TRUE);
+  socket_transport->body_memfd = fd;
+  return TRUE;
+}
+
+static void
+clear_body_memfd (DBusTransportSocket *socket_transport)
+{
+  if (socket_transport->body_memfd >= 0 && socket_transport->body_memfd_owned)
+    _dbus_close (socket_transport->body_memfd, NULL);
+
+  socket_transport->body_memfd = -1;
+}
+#endif
+
 static void
 socket_finalize (DBusTransport *transport)
 {
@@ -109,7 +155,11 @@ socket_finalize (DBusTransport *transport)
 
   _dbus_string_free (&socket_transport->encoded_outgoing);
   _dbus_string_free (&socket_transport->encoded_incoming);
-  
+
+#ifdef DBUS_HAVE_MEMFD_BODIES
+  clear_body_memfd (socket_transport);
+#endif
+
   _dbus_transport_finalize_base (transport);
 
   _dbus_assert (socket_transport->read_watch == NULL);
@@ -118,6 +168,22 @@ socket_finalize (DBusTransport *transport)
   dbus_free (transport);
 }
 
+/* A client pipelining its authentication may send messages right
+ * behind its BEGIN, before the server has answered it. */
+static dbus_bool_t
+may_write_messages (DBusTransport *transport)
+{
+  if (_dbus_transport_get_is_authenticated (transport))
+    return TRUE;
+
+  /* messages going some other way wait for that to be set up */
+  if (((DBusTransportSocket *) transport)->hooks != NULL)
+    return FALSE;
+
+  return !transport->send_credentials_pending &&
+    _dbus_auth_is_pipelining (transport->auth);
+}
+
 static void
 check_write_watch (DBusTransport *transport)
 {
@@ -136,7 +202,12 @@ check_write_watch (DBusTransport *transport)
   _dbus_transport_ref (transport);
 
   if (_dbus_transport_get_is_authenticated (transport))
-    needed = _dbus_connection_has_messages_to_send_unlocked (transport->connection);
+    {
+      if (socket_transport->hooks != NULL)
+        needed = FALSE;
+      else
+        needed = _dbus_connection_has_messages_to_send_unlocked (transport->connection);
+    }
   else
     {
       if (transport->send_credentials_pending)
@@ -154,6 +225,8 @@ check_write_watch (DBusTransport *transport)
           if (auth_state == DBUS_AUTH_STATE_HAVE_BYTES_TO_SEND ||
               auth_state == DBUS_AUTH_STATE_WAITING_FOR_MEMORY)
             needed = TRUE;
+          else if (may_write_messages (transport))
+            needed = _dbus_connection_has_messages_to_send_unlocked (transport->connection);
           else
             needed = FALSE;
         }
@@ -191,9 +264,12 @@ check_read_watch (DBusTransport *transport)
   _dbus_transport_ref (transport);
 
   if (_dbus_transport_get_is_authenticated (transport))
-    need_read_watch =
-      (_dbus_counter_get_size_value (transport->live_messages) < transport->max_live_messages_size) &&
-      (_dbus_counter_get_unix_fd_value (transport->live_messages) < transport->max_live_messages_unix_fds);
+    {
+      if (socket_transport->hooks != NULL)
+        need_read_watch = (* socket_transport->hooks->check_watches) (transport);
+      else
+        need_read_watch = _dbus_transport_below_live_messages_limits (transport);
+    }
   else
     {
       if (transport->receive_credentials_pending)
@@ -231,6 +307,18 @@ check_read_watch (DBusTransport *transport)
   _dbus_transport_unref (transport);
 }
 
+/**
+ * Enables or disables the read watch of a socket transport, or of a
+ * transport built on one, as it would itself after reading.
+ *
+ * @param transport the transport
+ */
+void
+_dbus_transport_socket_check_read_watch (DBusTransport *transport)
+{
+  check_read_watch (transport);
+}
+
 static void
 do_io_error (DBusTransport *transport)
 {
@@ -239,6 +327,46 @@ do_io_error (DBusTransport *transport)
   _dbus_transport_unref (transport);
 }
 
+/* Reads what the socket has for us: up to max_bytes_read_per_iteration
+ * from a stream, or the whole of the next packet however big it is
+ * from a seqpacket socket. fds may be NULL to read no unix fds. */
+static int
+read_socket (DBusTransportSocket *socket_transport,
+             DBusString          *buffer,
+             int                 *fds,
+             int                 *n_fds)
+{
+#ifdef DBUS_HAVE_SEQPACKET
+  if (socket_transport->seqpacket)
+    return _dbus_read_socket_packet (socket_transport->fd, buffer, fds, n_fds);
+#endif
+
+  if (fds != NULL)
+    return _dbus_read_socket_with_unix_fds (socket_transport->fd, buffer,
+                                            socket_transport->max_bytes_read_per_iteration,
+                                            fds, n_fds);
+  else
+    return _dbus_read_socket (socket_transport->fd, buffer,
+                              socket_transport->max_bytes_read_per_iteration);
+}
+
+/* How much of the rest of the current outgoing message to write now:
+ * all of it on a stream, but no more than one packet's worth on a
+ * seqpacket socket */
+static int
+get_write_len (DBusTransportSocket *socket_transport,
+               int                  total_bytes_to_write)
+{
+  int len = total_bytes_to_write - socket_transport->message_bytes_written;
+
+#ifdef DBUS_HAVE_SEQPACKET
+  if (socket_transport->seqpacket)
+    len = MIN (len, socket_transport->max_packet_size);
+#endif
+
+  return len;
+}
+
 /* return value is whether we successfully read any new data. */
 static dbus_bool_t
 read_data_into_auth (DBusTransport *transport,
@@ -252,8 +380,7 @@ read_data_into_auth (DBusTransport *transport,
 
   _dbus_auth_get_buffer (transport->auth, &buffer);
   
-  bytes_read = _dbus_read_socket (socket_transport->fd,
-                                  buffer, socket_transport->max_bytes_read_per_iteration);
+  bytes_read = read_socket (socket_transport, buffer, NULL, NULL);
 
   _dbus_auth_return_buffer (transport->auth, buffer,
                             bytes_read > 0 ? bytes_read : 0);
@@ -344,6 +471,10 @@ exchange_credentials (DBusTransport *transport,
   _dbus_verbose ("exchange_credentials: do_reading = %d, do_writing = %d\n",
                   do_reading, do_writing);
 
+  if (socket_transport->hooks != NULL &&
+      !(* socket_transport->hooks->setup) (transport, do_reading, do_writing))
+    return TRUE;
+
   if (do_writing && transport->send_credentials_pending)
     {
       if (_dbus_send_credentials_socket (socket_transport->fd,
@@ -478,7 +609,8 @@ do_authentication (DBusTransport *transport,
  out:
   if (auth_completed)
     *auth_completed = (orig_auth_state != _dbus_transport_get_is_authenticated (transport));
-  
+
+
   check_read_watch (transport);
   check_write_watch (transport);
   _dbus_transport_unref (transport);
@@ -498,7 +630,7 @@ do_writing (DBusTransport *transport)
   dbus_bool_t oom;
   
   /* No messages without authentication! */
-  if (!_dbus_transport_get_is_authenticated (transport))
+  if (!may_write_messages (transport))
     {
       _dbus_verbose ("Not authenticated, not writing anything\n");
       return TRUE;
@@ -528,6 +660,7 @@ do_writing (DBusTransport *transport)
       const DBusString *body;
       int header_len, body_len;
       int total_bytes_to_write;
+      int write_len;
       
       if (total > socket_transport->max_bytes_written_per_iteration)
         {
@@ -584,11 +717,37 @@ do_writing (DBusTransport *transport)
             _dbus_write_socket (socket_transport->fd,
                                 &socket_transport->encoded_outgoing,
                                 socket_transport->message_bytes_written,
-                                total_bytes_to_write - socket_transport->message_bytes_written);
+                                get_write_len (socket_transport,
+                                               total_bytes_to_write));
         }
       else
         {
+#ifdef DBUS_HAVE_MEMFD_BODIES
+          if (socket_transport->message_bytes_written == 0 &&
+              socket_transport->body_memfd < 0 &&
+              DBUS_TRANSPORT_CAN_SEND_MEMFD_BODY (transport) &&
+              (body_len >= MIN_BODY_SIZE_FOR_MEMFD ||
+               _dbus_message_get_body_memfd (message) >= 0))
+            {
+              if (!prepare_body_memfd (socket_transport, message,
+                                       header, body))
+                {
+                  oom = TRUE;
+                  goto out;
+                }
+            }
+
+          /* then only the flagged header goes in the stream */
+          if (socket_transport->body_memfd >= 0)
+            {
+              header = &socket_transport->encoded_outgoing;
+              header_len = _dbus_string_get_length (header);
+              body_len = 0;
+            }
+#endif
+
           total_bytes_to_write = header_len + body_len;
+          write_len = get_write_len (socket_transport, total_bytes_to_write);
 
 #if 0
           _dbus_verbose ("message is %d bytes\n",
@@ -601,21 +760,48 @@ do_writing (DBusTransport *transport)
               /* Send the fds along with the first byte of the message */
               const int *unix_fds;
               unsigned n;
+#ifdef DBUS_HAVE_MEMFD_BODIES
+              int *fds_and_body = NULL;
+#endif
 
               _dbus_message_get_unix_fds(message, &unix_fds, &n);
 
+#ifdef DBUS_HAVE_MEMFD_BODIES
+              /* the body goes after the message's own fds */
+              if (socket_transport->body_memfd >= 0)
+                {
+                  fds_and_body = dbus_new (int, n + 1);
+                  if (fds_and_body == NULL)
+                    {
+                      oom = TRUE;
+                      goto out;
+                    }
+
+                  if (n > 0)
+                    memcpy (fds_and_body, unix_fds, n * sizeof (int));
+
+                  fds_and_body[n] = socket_transport->body_memfd;
+                  unix_fds = fds_and_body;
+                  n++;
+                }
+#endif
+
               bytes_written =
                 _dbus_write_socket_with_unix_fds_two (socket_transport->fd,
                                                       header,
                                                       socket_transport->message_bytes_written,
-                                                      header_len - socket_transport->message_bytes_written,
+                                                      MIN (header_len - socket_transport->message_bytes_written, write_len),
                                                       body,
-                                                      0, body_len,
+                                                      0, MAX (write_len - header_len + socket_transport->message_bytes_written, 0),
                                                       unix_fds,
                                                       n);
 
               if (bytes_written > 0 && n > 0)
                 _dbus_verbose("Wrote %i unix fds\n", n);
+
+#ifdef DBUS_HAVE_MEMFD_BODIES
+              dbus_free (fds_and_body);
+#endif
             }
           else
 #endif
@@ -626,9 +812,9 @@ do_writing (DBusTransport *transport)
                     _dbus_write_socket_two (socket_transport->fd,
                                             header,
                                             socket_transport->message_bytes_written,
-                                            header_len - socket_transport->message_bytes_written,
+                                            MIN (header_len - socket_transport->message_bytes_written, write_len),
                                             body,
-                                            0, body_len);
+                                            0, MAX (write_len - header_len + socket_transport->message_bytes_written, 0));
                 }
               else
                 {
@@ -636,8 +822,7 @@ do_writing (DBusTransport *transport)
                     _dbus_write_socket (socket_transport->fd,
                                         body,
                                         (socket_transport->message_bytes_written - header_len),
-                                        body_len -
-                                        (socket_transport->message_bytes_written - header_len));
+                                        write_len);
                 }
             }
         }
@@ -652,6 +837,17 @@ do_writing (DBusTransport *transport)
           
           if (_dbus_get_is_errno_eagain_or_ewouldblock () || _dbus_get_is_errno_epipe ())
             goto out;
+#ifdef DBUS_HAVE_SEQPACKET
+          /* the packet did not fit in the socket's send buffer */
+          else if (socket_transport->seqpacket &&
+                   _dbus_get_is_errno_emsgsize () &&
+                   socket_transport->max_packet_size > MIN_PACKET_SIZE)
+            {
+              socket_transport->max_packet_size /= 2;
+              _dbus_verbose ("Packet too big, trying %d bytes\n",
+                             socket_transport->max_packet_size);
+            }
+#endif
           else
             {
               _dbus_verbose ("Error writing to remote app: %s\n",
@@ -676,6 +872,9 @@ do_writing (DBusTransport *transport)
               socket_transport->message_bytes_written = 0;
               _dbus_string_set_length (&socket_transport->encoded_outgoing, 0);
               _dbus_string_compact (&socket_transport->encoded_outgoing, 2048);
+#ifdef DBUS_HAVE_MEMFD_BODIES
+              clear_body_memfd (socket_transport);
+#endif
 
               _dbus_connection_message_sent_unlocked (transport->connection,
                                                       message);
@@ -739,9 +938,9 @@ do_reading (DBusTransport *transport)
       if (_dbus_string_get_length (&socket_transport->encoded_incoming) > 0)
         bytes_read = _dbus_string_get_length (&socket_transport->encoded_incoming);
       else
-        bytes_read = _dbus_read_socket (socket_transport->fd,
-                                        &socket_transport->encoded_incoming,
-                                        socket_transport->max_bytes_read_per_iteration);
+        bytes_read = read_socket (socket_transport,
+                                  &socket_transport->encoded_incoming,
+                                  NULL, NULL);
 
       _dbus_assert (_dbus_string_get_length (&socket_transport->encoded_incoming) ==
                     bytes_read);
@@ -794,10 +993,7 @@ do_reading (DBusTransport *transport)
               goto out;
             }
 
-          bytes_read = _dbus_read_socket_with_unix_fds(socket_transport->fd,
-                                                       buffer,
-                                                       socket_transport->max_bytes_read_per_iteration,
-                                                       fds, &n_fds);
+          bytes_read = read_socket (socket_transport, buffer, fds, &n_fds);
 
           if (bytes_read >= 0 && n_fds > 0)
             _dbus_verbose("Read %i unix fds\n", n_fds);
@@ -807,8 +1003,7 @@ do_reading (DBusTransport *transport)
       else
 #endif
         {
-          bytes_read = _dbus_read_socket (socket_transport->fd,
-                                          buffer, socket_transport->max_bytes_read_per_iteration);
+          bytes_read = read_socket (socket_transport, buffer, NULL, NULL);
         }
 
       _dbus_message_loader_return_buffer (transport->loader,
@@ -1101,6 +1296,11 @@ socket_do_iteration (DBusTransport *transport,
       if (transport->send_credentials_pending ||
           auth_state == DBUS_AUTH_STATE_HAVE_BYTES_TO_SEND)
 	poll_fd.events |= _DBUS_POLLOUT;
+
+      if ((flags & DBUS_ITERATION_DO_WRITING) &&
+          may_write_messages (transport) &&
+          _dbus_connection_has_messages_to_send_unlocked (transport->connection))
+        poll_fd.events |= _DBUS_POLLOUT;
     }
 
   if (poll_fd.events)
@@ -1207,7 +1407,9 @@ socket_get_socket_fd (DBusTransport *transport,
   return TRUE;
 }
 
-static const DBusTransportVTable socket_vtable = {
+/** The methods of a socket transport, which transports built on one
+ * call for whatever they do not handle themselves */
+const DBusTransportVTable _dbus_transport_socket_vtable = {
   socket_finalize,
   socket_handle_watch,
   socket_disconnect,
@@ -1218,27 +1420,27 @@ static const DBusTransportVTable socket_vtable = {
 };
 
 /**
- * Creates a new transport for the given socket file descriptor.  The file
- * descriptor must be nonblocking (use _dbus_set_fd_nonblocking() to
- * make it so). This function is shared by various transports that
- * boil down to a full duplex file descriptor.
+ * Initializes a socket transport, or a transport built on one, for
+ * the given socket file descriptor. The file descriptor must be
+ * nonblocking (use _dbus_set_fd_nonblocking() to make it so).
  *
+ * @param socket_transport the zero-filled transport to initialize
+ * @param vtable the transport's methods
+ * @param hooks what the transport changes about authenticating
+ *  over the socket, or #NULL to send messages through it too
  * @param fd the file descriptor.
  * @param server_guid non-#NULL if this transport is on the server side of a connection
  * @param address the transport's address
- * @returns the new transport, or #NULL if no memory.
+ * @returns #FALSE if no memory
  */
-DBusTransport*
-_dbus_transport_new_for_socket (int               fd,
-                                const DBusString *server_guid,
-                                const DBusString *address)
+dbus_bool_t
+_dbus_transport_socket_init (DBusTransportSocket            *socket_transport,
+                             const DBusTransportVTable      *vtable,
+                             const DBusTransportSocketHooks *hooks,
+                             int                             fd,
+                             const DBusString               *server_guid,
+                             const DBusString               *address)
 {
-  DBusTransportSocket *socket_transport;
-  
-  socket_transport = dbus_new0 (DBusTransportSocket, 1);
-  if (socket_transport == NULL)
-    return NULL;
-
   if (!_dbus_string_init (&socket_transport->encoded_outgoing))
     goto failed_0;
 
@@ -1260,7 +1462,7 @@ _dbus_transport_new_for_socket (int               fd,
     goto failed_3;
 
   if (!_dbus_transport_init_base (&socket_transport->base,
-                                  &socket_vtable,
+                                  vtable,
                                   server_guid, address))
     goto failed_4;
 
@@ -1268,14 +1470,26 @@ _dbus_transport_new_for_socket (int               fd,
   _dbus_auth_set_unix_fd_possible(socket_transport->base.auth, _dbus_socket_can_pass_unix_fd(fd));
 #endif
 
+#ifdef DBUS_HAVE_MEMFD_BODIES
+  _dbus_auth_set_memfd_body_possible (socket_transport->base.auth,
+                                      _dbus_socket_can_pass_unix_fd (fd));
+  socket_transport->body_memfd = -1;
+#endif
+
   socket_transport->fd = fd;
   socket_transport->message_bytes_written = 0;
+  socket_transport->hooks = hooks;
   
   /* These values should probably be tunable or something. */     
   socket_transport->max_bytes_read_per_iteration = 2048;
   socket_transport->max_bytes_written_per_iteration = 2048;
+
+#ifdef DBUS_HAVE_SEQPACKET
+  socket_transport->seqpacket = _dbus_socket_is_seqpacket (fd);
+  socket_transport->max_packet_size = MAX_PACKET_SIZE;
+#endif
   
-  return (DBusTransport*) socket_transport;
+  return TRUE;
 
  failed_4:
   _dbus_watch_invalidate (socket_transport->read_watch);
@@ -1288,8 +1502,40 @@ _dbus_transport_new_for_socket (int               fd,
  failed_1:
   _dbus_string_free (&socket_transport->encoded_outgoing);
  failed_0:
-  dbus_free (socket_transport);
-  return NULL;
+  return FALSE;
+}
+
+/**
+ * Creates a new transport for the given socket file descriptor.  The file
+ * descriptor must be nonblocking (use _dbus_set_fd_nonblocking() to
+ * make it so). This function is shared by various transports that
+ * boil down to a full duplex file descriptor.
+ *
+ * @param fd the file descriptor.
+ * @param server_guid non-#NULL if this transport is on the server side of a connection
+ * @param address the transport's address
+ * @returns the new transport, or #NULL if no memory.
+ */
+DBusTransport*
+_dbus_transport_new_for_socket (int               fd,
+                                const DBusString *server_guid,
+                                const DBusString *address)
+{
+  DBusTransportSocket *socket_transport;
+  
+  socket_transport = dbus_new0 (DBusTransportSocket, 1);
+  if (socket_transport == NULL)
+    return NULL;
+
+  if (!_dbus_transport_socket_init (socket_transport,
+                                    &_dbus_transport_socket_vtable, NULL,
+                                    fd, server_guid, address))
+    {
+      dbus_free (socket_transport);
+      return NULL;
+    }
+
+  return (DBusTransport*) socket_transport;
 }
 
 /**
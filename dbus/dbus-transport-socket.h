@@ -24,9 +24,90 @@
 #define DBUS_TRANSPORT_SOCKET_H
 
 #include <dbus/dbus-transport-protected.h>
+#include <dbus/dbus-message-internal.h>
+#include <dbus/dbus-watch.h>
+#ifdef DBUS_UNIX
+#include <dbus/dbus-sysdeps-unix.h>
+#endif
 
 DBUS_BEGIN_DECLS
 
+typedef struct DBusTransportSocket DBusTransportSocket;
+
+/**
+ * What a transport that authenticates over a socket, but then sends
+ * and receives messages some other way, changes about
+ * DBusTransportSocket. Once authenticated, the socket is not written
+ * to again, and messages are not pipelined behind the authentication.
+ */
+typedef struct
+{
+  dbus_bool_t (* setup)         (DBusTransport *transport,
+                                 dbus_bool_t    do_reading,
+                                 dbus_bool_t    do_writing);
+  /**< Exchanges whatever goes before the credentials byte; returns
+   * #FALSE to leave the credentials until later. Disconnects the
+   * transport if that fails.
+   */
+
+  dbus_bool_t (* check_watches) (DBusTransport *transport);
+  /**< Called once authenticated whenever the read watch is checked,
+   * to update the transport's own watches; returns whether the socket
+   * still needs watching for reading.
+   */
+} DBusTransportSocketHooks;
+
+/**
+ * Implementation details of DBusTransportSocket. Only transports built
+ * on it, such as the shm: one, look at the members.
+ */
+struct DBusTransportSocket
+{
+  DBusTransport base;                   /**< Parent instance */
+  int fd;                               /**< File descriptor. */
+  DBusWatch *read_watch;                /**< Watch for readability. */
+  DBusWatch *write_watch;               /**< Watch for writability. */
+
+  int max_bytes_read_per_iteration;     /**< To avoid blocking too long. */
+  int max_bytes_written_per_iteration;  /**< To avoid blocking too long. */
+
+  int message_bytes_written;            /**< Number of bytes of current
+                                         *   outgoing message that have
+                                         *   been written.
+                                         */
+  DBusString encoded_outgoing;          /**< Encoded version of current
+                                         *   outgoing message.
+                                         */
+  DBusString encoded_incoming;          /**< Encoded version of current
+                                         *   incoming data.
+                                         */
+#ifdef DBUS_HAVE_MEMFD_BODIES
+  int body_memfd;                       /**< Memfd the body of the current
+                                         *   outgoing message goes in, or -1;
+                                         *   its flagged header is then in
+                                         *   encoded_outgoing, which is
+                                         *   otherwise unused with unix fds
+                                         */
+  unsigned int body_memfd_owned : 1;    /**< body_memfd was made for this
+                                         *   message and is ours to close
+                                         */
+#endif
+#ifdef DBUS_HAVE_SEQPACKET
+  int max_packet_size;                  /**< Most bytes to write at once
+                                         *   on a seqpacket socket
+                                         */
+  unsigned int seqpacket : 1;           /**< Socket keeps message
+                                         *   boundaries (unixpacket:)
+                                         */
+#endif
+  const DBusTransportSocketHooks *hooks; /**< How a transport that only
+                                         *   authenticates over the socket
+                                         *   differs, or #NULL
+                                         */
+};
+
+extern const DBusTransportVTable _dbus_transport_socket_vtable;
+
 DBusTransport*          _dbus_transport_new_for_socket     (int                fd,
                                                             const DBusString  *server_guid,
                                                             const DBusString  *address);
@@ -38,6 +119,13 @@ DBusTransport*          _dbus_transport_new_for_tcp_socket (const char        *h
 DBusTransportOpenResult _dbus_transport_open_socket        (DBusAddressEntry  *entry,
                                                             DBusTransport    **transport_p,
                                                             DBusError         *error);
+dbus_bool_t             _dbus_transport_socket_init        (DBusTransportSocket            *socket_transport,
+                                                            const DBusTransportVTable      *vtable,
+                                                            const DBusTransportSocketHooks *hooks,
+                                                            int                             fd,
+                                                            const DBusString               *server_guid,
+                                                            const DBusString               *address);
+void                    _dbus_transport_socket_check_read_watch (DBusTransport *transport);
 
 
 
@@ -42,22 +42,11 @@
  * @{
  */
 
-/**
- * Creates a new transport for the given Unix domain socket
- * path. This creates a client-side of a transport.
- *
- * @todo once we add a way to escape paths in a dbus
- * address, this function needs to do escaping.
- *
- * @param path the path to the domain socket.
- * @param abstract #TRUE to use abstract socket namespace
- * @param error address where an error can be returned.
- * @returns a new transport, or #NULL on failure.
- */
-DBusTransport*
-_dbus_transport_new_for_domain_socket (const char     *path,
-                                       dbus_bool_t     abstract,
-                                       DBusError      *error)
+static DBusTransport*
+new_for_domain_socket (const char     *method,
+                       const char     *path,
+                       dbus_bool_t     abstract,
+                       DBusError      *error)
 {
   int fd;
   DBusTransport *transport;
@@ -73,17 +62,21 @@ _dbus_transport_new_for_domain_socket (const char     *path,
 
   fd = -1;
 
-  if ((abstract &&
-       !_dbus_string_append (&address, "unix:abstract=")) ||
-      (!abstract &&
-       !_dbus_string_append (&address, "unix:path=")) ||
+  if (!_dbus_string_append (&address, method) ||
+      !_dbus_string_append (&address, abstract ? ":abstract=" : ":path=") ||
       !_dbus_string_append (&address, path))
     {
       dbus_set_error (error, DBUS_ERROR_NO_MEMORY, NULL);
       goto failed_0;
     }
+
   
-  fd = _dbus_connect_unix_socket (path, abstract, error);
+#ifdef DBUS_HAVE_SEQPACKET
+  if (strcmp (method, "unixpacket") == 0)
+    fd = _dbus_connect_unix_seqpacket_socket (path, abstract, error);
+  else
+#endif
+    fd = _dbus_connect_unix_socket (path, abstract, error);
   if (fd < 0)
     {
       _DBUS_ASSERT_ERROR_IS_SET (error);
@@ -94,6 +87,7 @@ _dbus_transport_new_for_domain_socket (const char     *path,
                  path);
 
   transport = _dbus_transport_new_for_socket (fd, NULL, &address);
+
   if (transport == NULL)
     {
       dbus_set_error (error, DBUS_ERROR_NO_MEMORY, NULL);
@@ -111,6 +105,26 @@ _dbus_transport_new_for_domain_socket (const char     *path,
   return NULL;
 }
 
+/**
+ * Creates a new transport for the given Unix domain socket
+ * path. This creates a client-side of a transport.
+ *
+ * @todo once we add a way to escape paths in a dbus
+ * address, this function needs to do escaping.
+ *
+ * @param path the path to the domain socket.
+ * @param abstract #TRUE to use abstract socket namespace
+ * @param error address where an error can be returned.
+ * @returns a new transport, or #NULL on failure.
+ */
+DBusTransport*
+_dbus_transport_new_for_domain_socket (const char     *path,
+                                       dbus_bool_t     abstract,
+                                       DBusError      *error)
+{
+  return new_for_domain_socket ("unix", path, abstract, error);
+}
+
 /**
  * Creates a new transport for the given binary and arguments. This
  * creates a client-side of a transport. The process will be forked
@@ -227,11 +241,17 @@ _dbus_transport_open_platform_specific (DBusAddressEntry  *entry,
                                         DBusError         *error)
 {
   const char *method;
+  dbus_bool_t use_seqpacket = FALSE;
   
   method = dbus_address_entry_get_method (entry);
   _dbus_assert (method != NULL);
 
-  if (strcmp (method, "unix") == 0)
+#ifdef DBUS_HAVE_SEQPACKET
+  /* connects like unix:, but each message is a packet of its own */
+  use_seqpacket = strcmp (method, "unixpacket") == 0;
+#endif
+
+  if (strcmp (method, "unix") == 0 || use_seqpacket)
     {
       const char *path = dbus_address_entry_get_value (entry, "path");
       const char *tmpdir = dbus_address_entry_get_value (entry, "tmpdir");
@@ -246,7 +266,7 @@ _dbus_transport_open_platform_specific (DBusAddressEntry  *entry,
           
       if (path == NULL && abstract == NULL)
         {
-          _dbus_set_bad_address (error, "unix",
+          _dbus_set_bad_address (error, method,
                                  "path or abstract",
                                  NULL);
           return DBUS_TRANSPORT_OPEN_BAD_ADDRESS;
@@ -260,11 +280,9 @@ _dbus_transport_open_platform_specific (DBusAddressEntry  *entry,
         }
 
       if (path)
-        *transport_p = _dbus_transport_new_for_domain_socket (path, FALSE,
-                                                           error);
+        *transport_p = new_for_domain_socket (method, path, FALSE, error);
       else
-        *transport_p = _dbus_transport_new_for_domain_socket (abstract, TRUE,
-                                                           error);
+        *transport_p = new_for_domain_socket (method, abstract, TRUE, error);
       if (*transport_p == NULL)
         {
           _DBUS_ASSERT_ERROR_IS_SET (error);
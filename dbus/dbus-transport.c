@@ -25,6 +25,7 @@
 #include "dbus-transport-protected.h"
 #include "dbus-transport-unix.h"
 #include "dbus-transport-socket.h"
+#include "dbus-transport-shm.h"
 #include "dbus-connection-internal.h"
 #include "dbus-watch.h"
 #include "dbus-auth.h"
@@ -346,6 +347,9 @@ static const struct {
                                     DBusError        *error);
 } open_funcs[] = {
   { _dbus_transport_open_socket },
+#ifdef DBUS_HAVE_SHM_CHANNEL
+  { _dbus_transport_open_shm },
+#endif
   { _dbus_transport_open_platform_specific },
   { _dbus_transport_open_autolaunch }
 #ifdef DBUS_BUILD_TESTS
@@ -513,6 +517,25 @@ _dbus_transport_disconnect (DBusTransport *transport)
   _dbus_verbose ("end\n");
 }
 
+/**
+ * Disconnects the transport because the peer sent a message that was
+ * found to be invalid after it had been loaded, as though the loader
+ * had rejected it. The loader records the reason and reads no further
+ * messages.
+ *
+ * @param transport the transport.
+ * @param reason why the message was invalid
+ */
+void
+_dbus_transport_reject_message (DBusTransport *transport,
+                                DBusValidity   reason)
+{
+  _dbus_message_loader_set_corrupted (transport->loader, reason);
+
+  _dbus_verbose ("Corrupted message stream, disconnecting\n");
+  _dbus_transport_disconnect (transport);
+}
+
 /**
  * Returns #TRUE if the transport has not been disconnected.
  * Disconnection can result from _dbus_transport_disconnect()
@@ -781,6 +804,12 @@ _dbus_transport_get_is_authenticated (DBusTransport *transport)
 
       transport->authenticated = maybe_authenticated;
 
+#ifdef DBUS_HAVE_MEMFD_BODIES
+      if (maybe_authenticated)
+        _dbus_message_loader_set_memfd_bodies (transport->loader,
+                                               DBUS_TRANSPORT_CAN_SEND_MEMFD_BODY (transport));
+#endif
+
       _dbus_connection_unref_unlocked (transport->connection);
       return maybe_authenticated;
     }
@@ -1069,6 +1098,22 @@ recover_unused_bytes (DBusTransport *transport)
   return FALSE;
 }
 
+/**
+ * Checks whether the messages this transport has read and not yet
+ * seen freed are within the limits set on them, so that it may read
+ * more.
+ *
+ * @param transport the transport
+ * @returns #TRUE if below both the size and unix fd limits
+ */
+dbus_bool_t
+_dbus_transport_below_live_messages_limits (DBusTransport *transport)
+{
+  return
+    (_dbus_counter_get_size_value (transport->live_messages) < transport->max_live_messages_size) &&
+    (_dbus_counter_get_unix_fd_value (transport->live_messages) < transport->max_live_messages_unix_fds);
+}
+
 /**
  * Reports our current dispatch status (whether there's buffered
  * data to be queued as messages, or not, or we need memory).
@@ -1079,8 +1124,7 @@ recover_unused_bytes (DBusTransport *transport)
 DBusDispatchStatus
 _dbus_transport_get_dispatch_status (DBusTransport *transport)
 {
-  if (_dbus_counter_get_size_value (transport->live_messages) >= transport->max_live_messages_size ||
-      _dbus_counter_get_unix_fd_value (transport->live_messages) >= transport->max_live_messages_unix_fds)
+  if (!_dbus_transport_below_live_messages_limits (transport))
     return DBUS_DISPATCH_COMPLETE; /* complete for now */
 
   if (!_dbus_transport_get_is_authenticated (transport))
@@ -1218,6 +1262,62 @@ _dbus_transport_get_max_message_unix_fds (DBusTransport  *transport)
   return _dbus_message_loader_get_max_message_unix_fds (transport->loader);
 }
 
+/**
+ * See dbus_connection_set_trust_peer_data().
+ *
+ * @param transport the transport
+ * @param trust #TRUE to stop validating message bodies
+ */
+void
+_dbus_transport_set_trust_peer_data (DBusTransport *transport,
+                                     dbus_bool_t    trust)
+{
+  _dbus_message_loader_set_trust_bodies (transport->loader, trust);
+}
+
+/**
+ * See dbus_connection_get_trust_peer_data().
+ *
+ * @param transport the transport
+ * @returns #TRUE if message bodies are not validated
+ */
+dbus_bool_t
+_dbus_transport_get_trust_peer_data (DBusTransport *transport)
+{
+  return _dbus_message_loader_get_trust_bodies (transport->loader);
+}
+
+/**
+ * See _dbus_connection_set_pipelined_auth().
+ *
+ * @param transport the transport
+ * @returns #FALSE if no memory
+ */
+dbus_bool_t
+_dbus_transport_set_pipelined_auth (DBusTransport *transport)
+{
+  if (transport->is_server || transport->authenticated ||
+      transport->disconnected)
+    return TRUE;
+
+  return _dbus_auth_set_pipelined (transport->auth);
+}
+
+/**
+ * See _dbus_connection_set_spill_large_bodies().
+ *
+ * @param transport the transport
+ * @param spill #TRUE to spill large bodies
+ */
+void
+_dbus_transport_set_spill_large_bodies (DBusTransport *transport,
+                                        dbus_bool_t    spill)
+{
+#ifdef DBUS_HAVE_MEMFD_BODIES
+  _dbus_message_loader_set_spill_bodies (transport->loader, spill);
+#endif
+}
+
 /**
  * See dbus_connection_set_max_received_size().
  *
@@ -27,6 +27,7 @@
 #include <dbus/dbus-connection.h>
 #include <dbus/dbus-protocol.h>
 #include <dbus/dbus-address.h>
+#include <dbus/dbus-marshal-validate.h>
 
 DBUS_BEGIN_DECLS
 
@@ -37,6 +38,8 @@ DBusTransport*     _dbus_transport_open                   (DBusAddressEntry
 DBusTransport*     _dbus_transport_ref                    (DBusTransport              *transport);
 void               _dbus_transport_unref                  (DBusTransport              *transport);
 void               _dbus_transport_disconnect             (DBusTransport              *transport);
+void               _dbus_transport_reject_message         (DBusTransport              *transport,
+                                                           DBusValidity                reason);
 dbus_bool_t        _dbus_transport_get_is_connected       (DBusTransport              *transport);
 dbus_bool_t        _dbus_transport_get_is_authenticated   (DBusTransport              *transport);
 dbus_bool_t        _dbus_transport_get_is_anonymous       (DBusTransport              *transport);
@@ -65,6 +68,12 @@ long               _dbus_transport_get_max_received_size  (DBusTransport
 void               _dbus_transport_set_max_message_unix_fds (DBusTransport              *transport,
                                                              long                        n);
 long               _dbus_transport_get_max_message_unix_fds (DBusTransport              *transport);
+void               _dbus_transport_set_trust_peer_data    (DBusTransport              *transport,
+                                                           dbus_bool_t                 trust);
+dbus_bool_t        _dbus_transport_get_trust_peer_data    (DBusTransport              *transport);
+dbus_bool_t        _dbus_transport_set_pipelined_auth     (DBusTransport              *transport);
+void               _dbus_transport_set_spill_large_bodies (DBusTransport              *transport,
+                                                           dbus_bool_t                 spill);
 void               _dbus_transport_set_max_received_unix_fds(DBusTransport              *transport,
                                                              long                        n);
 long               _dbus_transport_get_max_received_unix_fds(DBusTransport              *transport);
@@ -31,6 +31,7 @@
 #include <dbus/dbus-bus.h>
 #include <dbus/dbus-connection.h>
 #include <dbus/dbus-errors.h>
+#include <dbus/dbus-loop.h>
 #include <dbus/dbus-macros.h>
 #include <dbus/dbus-message.h>
 #include <dbus/dbus-misc.h>
@@ -0,0 +1,219 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/* batch.c  Tests for dbus_connection_send_batch() and
+ *          dbus_connection_pop_messages()
+ *
+ * Licensed under the Academic Free License version 2.1
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <config.h>
+#include "test-utils.h"
+
+#define TEST_INTERFACE "org.freedesktop.DBus.TestSuite.Batch"
+#define N_MESSAGES 50
+
+static DBusConnection *client;
+static DBusConnection *server;
+
+static void
+die (const char *message)
+{
+  fprintf (stderr, "*** test-batch: %s\n", message);
+  exit (1);
+}
+
+static DBusMessage *
+new_signal (dbus_int32_t value)
+{
+  DBusMessage *message;
+
+  message = dbus_message_new_signal ("/", TEST_INTERFACE, "Numbered");
+  if (message == NULL ||
+      !dbus_message_append_args (message,
+                                 DBUS_TYPE_INT32, &value,
+                                 DBUS_TYPE_INVALID))
+    die ("no memory");
+
+  return message;
+}
+
+static dbus_int32_t
+get_value (DBusMessage *message)
+{
+  dbus_int32_t value;
+
+  if (!dbus_message_is_signal (message, TEST_INTERFACE, "Numbered") ||
+      !dbus_message_get_args (message, NULL,
+                              DBUS_TYPE_INT32, &value,
+                              DBUS_TYPE_INVALID))
+    die ("unexpected message");
+
+  return value;
+}
+
+/* Receives n messages on the server in chunks of at most chunk_size,
+ * checking they carry first, first + 1, ... in that order */
+static void
+receive (dbus_int32_t        first,
+         int                 n,
+         int                 chunk_size,
+         const dbus_uint32_t *serials)
+{
+  DBusMessage *messages[N_MESSAGES];
+  int received = 0;
+
+  dbus_connection_flush (client);
+
+  while (received < n)
+    {
+      int n_popped, i;
+
+      n_popped = dbus_connection_pop_messages (server, messages, chunk_size);
+
+      if (n_popped == 0)
+        {
+          if (!dbus_connection_read_write (server, -1))
+            die ("server disconnected");
+
+          continue;
+        }
+
+      if (n_popped > chunk_size || received + n_popped > n)
+        die ("popped too many messages");
+
+      for (i = 0; i < n_popped; i++)
+        {
+          if (get_value (messages[i]) != first + received + i)
+            die ("messages out of order");
+
+          if (serials != NULL &&
+              dbus_message_get_serial (messages[i]) != serials[received + i])
+            die ("serial does not match");
+
+          dbus_message_unref (messages[i]);
+        }
+
+      received += n_popped;
+    }
+}
+
+static void
+test_send_batch (void)
+{
+  DBusMessage *messages[N_MESSAGES];
+  dbus_uint32_t serials[N_MESSAGES];
+  int i;
+
+  for (i = 0; i < N_MESSAGES; i++)
+    messages[i] = new_signal (i);
+
+  if (!dbus_connection_send_batch (client, messages, N_MESSAGES, serials))
+    die ("no memory");
+
+  for (i = 0; i < N_MESSAGES; i++)
+    {
+      if (serials[i] == 0 || serials[i] != dbus_message_get_serial (messages[i]))
+        die ("bad serial returned");
+
+      if (i > 0 && serials[i] <= serials[i - 1])
+        die ("serials not assigned in order");
+
+      dbus_message_unref (messages[i]);
+    }
+
+  receive (0, N_MESSAGES, 16, serials);
+  printf ("ok - send batch, pop in chunks\n");
+}
+
+static void
+test_mixed (void)
+{
+  DBusMessage *messages[3];
+  DBusMessage *message;
+  int i;
+
+  /* Single sends and batches share one queue and one order */
+  message = new_signal (100);
+  if (!dbus_connection_send (client, message, NULL))
+    die ("no memory");
+  dbus_message_unref (message);
+
+  for (i = 0; i < 3; i++)
+    messages[i] = new_signal (101 + i);
+
+  if (!dbus_connection_send_batch (client, messages, 3, NULL))
+    die ("no memory");
+
+  for (i = 0; i < 3; i++)
+    dbus_message_unref (messages[i]);
+
+  message = new_signal (104);
+  if (!dbus_connection_send (client, message, NULL))
+    die ("no memory");
+  dbus_message_unref (message);
+
+  receive (100, 5, N_MESSAGES, NULL);
+
+  /* and the queue is left empty */
+  if (dbus_connection_pop_messages (server, messages, 3) != 0)
+    die ("queue should be empty");
+
+  printf ("ok - batches interleaved with single sends\n");
+}
+
+static void
+test_empty (void)
+{
+  DBusMessage *message;
+
+  if (!dbus_connection_send_batch (client, NULL, 0, NULL))
+    die ("empty batch failed");
+
+  if (dbus_connection_pop_messages (server, &message, 0) != 0)
+    die ("popped into an empty array");
+
+  printf ("ok - empty batches\n");
+}
+
+int
+main (int argc, char **argv)
+{
+  if (!test_connection_pair_new ("unix:tmpdir=/tmp", &client, &server))
+    die ("could not set up connections");
+
+  /* Both ends are driven from this thread, so finish authenticating
+   * before either blocks */
+  while (!dbus_connection_get_is_authenticated (client) ||
+         !dbus_connection_get_is_authenticated (server))
+    {
+      if (!dbus_connection_read_write (client, 0) ||
+          !dbus_connection_read_write (server, 0))
+        die ("disconnected");
+    }
+
+  test_send_batch ();
+  test_mixed ();
+  test_empty ();
+
+  dbus_connection_close (client);
+  dbus_connection_unref (client);
+  dbus_connection_close (server);
+  dbus_connection_unref (server);
+
+  dbus_shutdown ();
+  return 0;
+}
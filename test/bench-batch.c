@@ -0,0 +1,216 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/* bench-batch.c  Sending and receiving signals one at a time or in batches
+ *
+ * Licensed under the Academic Free License version 2.1
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/*
+ * One thread sends a stream of small signals on one end of a connection
+ * and another drains them from the other end, using either
+ * dbus_connection_send() and dbus_connection_pop_message(), or
+ * dbus_connection_send_batch() and dbus_connection_pop_messages(). Each
+ * combination is timed separately. Building the messages is included in
+ * the time, the same way for every combination.
+ *
+ * Usage: bench-batch [TOTAL_MESSAGES [BATCH_SIZE [LISTEN_ADDRESS]]]
+ */
+
+#include <config.h>
+#include "test-utils.h"
+
+#include <pthread.h>
+#include <string.h>
+
+#include <dbus/dbus-sysdeps.h>
+
+#define BENCH_INTERFACE "org.freedesktop.DBus.Benchmark"
+#define MAX_BATCH_SIZE 1024
+
+static DBusConnection *client;
+static DBusConnection *server;
+static int total_messages;
+static int batch_size;
+static dbus_bool_t batch_send;
+
+static void
+die (const char *message)
+{
+  fprintf (stderr, "*** bench-batch: %s\n", message);
+  exit (1);
+}
+
+static double
+now (void)
+{
+  long tv_sec, tv_usec;
+
+  _dbus_get_monotonic_time (&tv_sec, &tv_usec);
+
+  return tv_sec + tv_usec / 1000000.0;
+}
+
+static DBusMessage *
+new_signal (dbus_int32_t value)
+{
+  DBusMessage *message;
+
+  message = dbus_message_new_signal ("/", BENCH_INTERFACE, "Sample");
+  if (message == NULL ||
+      !dbus_message_append_args (message,
+                                 DBUS_TYPE_INT32, &value,
+                                 DBUS_TYPE_INVALID))
+    die ("no memory");
+
+  return message;
+}
+
+static void *
+producer_thread (void *data)
+{
+  DBusMessage *messages[MAX_BATCH_SIZE];
+  int sent = 0;
+
+  while (sent < total_messages)
+    {
+      if (batch_send)
+        {
+          int n, i;
+
+          n = total_messages - sent;
+          if (n > batch_size)
+            n = batch_size;
+
+          for (i = 0; i < n; i++)
+            messages[i] = new_signal (sent + i);
+
+          if (!dbus_connection_send_batch (server, messages, n, NULL))
+            die ("no memory");
+
+          for (i = 0; i < n; i++)
+            dbus_message_unref (messages[i]);
+
+          sent += n;
+        }
+      else
+        {
+          DBusMessage *message = new_signal (sent);
+
+          if (!dbus_connection_send (server, message, NULL))
+            die ("no memory");
+
+          dbus_message_unref (message);
+          sent++;
+        }
+    }
+
+  dbus_connection_flush (server);
+  return NULL;
+}
+
+static void
+consume (dbus_bool_t batch_pop)
+{
+  DBusMessage *messages[MAX_BATCH_SIZE];
+  int received = 0;
+
+  while (received < total_messages)
+    {
+      int n, i;
+
+      if (batch_pop)
+        {
+          n = dbus_connection_pop_messages (client, messages, batch_size);
+        }
+      else
+        {
+          messages[0] = dbus_connection_pop_message (client);
+          n = messages[0] != NULL ? 1 : 0;
+        }
+
+      if (n == 0)
+        {
+          if (!dbus_connection_read_write (client, -1))
+            die ("disconnected");
+
+          continue;
+        }
+
+      for (i = 0; i < n; i++)
+        dbus_message_unref (messages[i]);
+
+      received += n;
+    }
+}
+
+static void
+run (dbus_bool_t send_in_batches,
+     dbus_bool_t pop_in_batches)
+{
+  pthread_t producer;
+  double start, elapsed;
+
+  batch_send = send_in_batches;
+
+  start = now ();
+
+  pthread_create (&producer, NULL, producer_thread, NULL);
+  consume (pop_in_batches);
+  pthread_join (producer, NULL);
+
+  elapsed = now () - start;
+
+  printf ("%-12s %-14s %10d %12.0f %10.2f\n",
+          send_in_batches ? "send_batch" : "send",
+          pop_in_batches ? "pop_messages" : "pop_message",
+          total_messages, total_messages / elapsed,
+          elapsed * 1000000.0 / total_messages);
+}
+
+int
+main (int argc, char **argv)
+{
+  total_messages = argc > 1 ? atoi (argv[1]) : 200000;
+  batch_size = argc > 2 ? atoi (argv[2]) : 64;
+
+  if (total_messages < 1 || batch_size < 1 || batch_size > MAX_BATCH_SIZE)
+    die ("bad arguments");
+
+  if (!dbus_threads_init_default ())
+    die ("no memory");
+
+  if (!test_connection_pair_new (argc > 3 ? argv[3] : "unix:tmpdir=/tmp",
+                                 &client, &server))
+    die ("could not set up connections");
+
+  printf ("batch size %d\n", batch_size);
+  printf ("%-12s %-14s %10s %12s %10s\n", "sender", "receiver", "messages",
+          "msgs/sec", "usec/msg");
+
+  run (FALSE, FALSE);
+  run (TRUE, FALSE);
+  run (FALSE, TRUE);
+  run (TRUE, TRUE);
+
+  dbus_connection_close (client);
+  dbus_connection_unref (client);
+  dbus_connection_close (server);
+  dbus_connection_unref (server);
+
+  dbus_shutdown ();
+  return 0;
+}
@@ -0,0 +1,214 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/* bench-bulk-append.c  Building large arrays at once or element by element
+ *
+ * Licensed under the Academic Free License version 2.1
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/*
+ * Times building a message holding one large as, ao or a{ss}, appending
+ * each element with dbus_message_iter_append_basic() or the whole array
+ * with dbus_message_iter_append_string_array(), with and without
+ * reserving the body with dbus_message_reserve_body() first.
+ *
+ * Usage: bench-bulk-append [ELEMENTS [ITERATIONS]]
+ */
+
+#include <config.h>
+#include "test-utils.h"
+
+#include <string.h>
+
+#include <dbus/dbus-sysdeps.h>
+
+static void
+die (const char *message)
+{
+  fprintf (stderr, "*** bench-bulk-append: %s\n", message);
+  exit (1);
+}
+
+static double
+now (void)
+{
+  long tv_sec, tv_usec;
+
+  _dbus_get_monotonic_time (&tv_sec, &tv_usec);
+
+  return tv_sec + tv_usec / 1000000.0;
+}
+
+static DBusMessage *
+build (const char         *element_signature,
+       const char * const *values,
+       int                 n_values,
+       dbus_bool_t         bulk,
+       int                 reserve)
+{
+  DBusMessage *message;
+  DBusMessageIter iter, array, entry;
+  int type = element_signature[0];
+  int i;
+
+  message = dbus_message_new_signal ("/", "org.freedesktop.DBus.Benchmark",
+                                     "Sample");
+  if (message == NULL)
+    die ("no memory");
+
+  if (reserve > 0 && !dbus_message_reserve_body (message, reserve))
+    die ("no memory");
+
+  dbus_message_iter_init_append (message, &iter);
+
+  if (!dbus_message_iter_open_container (&iter, DBUS_TYPE_ARRAY,
+                                         element_signature, &array))
+    die ("no memory");
+
+  if (bulk)
+    {
+      if (!dbus_message_iter_append_string_array (&array, values, n_values))
+        die ("no memory");
+    }
+  else if (type == DBUS_DICT_ENTRY_BEGIN_CHAR)
+    {
+      for (i = 0; i < n_values; i += 2)
+        {
+          if (!dbus_message_iter_open_container (&array, DBUS_TYPE_DICT_ENTRY,
+                                                 NULL, &entry) ||
+              !dbus_message_iter_append_basic (&entry, DBUS_TYPE_STRING,
+                                               &values[i]) ||
+              !dbus_message_iter_append_basic (&entry, DBUS_TYPE_STRING,
+                                               &values[i + 1]) ||
+              !dbus_message_iter_close_container (&array, &entry))
+            die ("no memory");
+        }
+    }
+  else
+    {
+      for (i = 0; i < n_values; i++)
+        {
+          if (!dbus_message_iter_append_basic (&array, type, &values[i]))
+            die ("no memory");
+        }
+    }
+
+  if (!dbus_message_iter_close_container (&iter, &array))
+    die ("no memory");
+
+  return message;
+}
+
+static void
+bench (const char *element_signature,
+       int         n_elements,
+       long        iterations)
+{
+  const char **values;
+  char *storage;
+  char signature[16];
+  int n_values;
+  int body_size = 0;
+  int i;
+  int reserved;
+
+  n_values = element_signature[0] == DBUS_DICT_ENTRY_BEGIN_CHAR ?
+    2 * n_elements : n_elements;
+
+  values = dbus_new (const char *, n_values);
+  storage = dbus_malloc (n_values * 48);
+  if (values == NULL || storage == NULL)
+    die ("no memory");
+
+  for (i = 0; i < n_values; i++)
+    {
+      char *s = storage + i * 48;
+
+      if (element_signature[0] == DBUS_TYPE_OBJECT_PATH)
+        snprintf (s, 48, "/org/example/Inventory/Item%d", i);
+      else
+        snprintf (s, 48, "org.example.Item%d", i);
+
+      values[i] = s;
+    }
+
+  snprintf (signature, sizeof (signature), "a%s", element_signature);
+
+  for (reserved = 0; reserved < 2; reserved++)
+    {
+      int bulk;
+
+      for (bulk = 0; bulk < 2; bulk++)
+        {
+          double start, elapsed;
+          long j;
+
+          start = now ();
+
+          for (j = 0; j < iterations; j++)
+            {
+              DBusMessage *message;
+
+              message = build (element_signature, values, n_values, bulk,
+                               reserved ? body_size : 0);
+
+              if (body_size == 0)
+                {
+                  char *data;
+                  int len;
+
+                  if (!dbus_message_marshal (message, &data, &len))
+                    die ("no memory");
+
+                  body_size = len;
+                  dbus_free (data);
+                }
+
+              dbus_message_unref (message);
+            }
+
+          elapsed = now () - start;
+
+          printf ("%-8s %8d %-7s %-8s %12.0f %10.1f\n", signature, n_elements,
+                  bulk ? "bulk" : "basic", reserved ? "reserve" : "-",
+                  elapsed * 1e9 / iterations,
+                  elapsed * 1e9 / iterations / n_elements);
+        }
+    }
+
+  dbus_free (storage);
+  dbus_free (values);
+}
+
+int
+main (int argc, char **argv)
+{
+  int n_elements = argc > 1 ? atoi (argv[1]) : 50000;
+  long iterations = argc > 2 ? atol (argv[2]) : 100;
+
+  if (n_elements < 1 || iterations < 1)
+    die ("bad arguments");
+
+  printf ("%-8s %8s %-7s %-8s %12s %10s\n", "type", "elements", "append",
+          "body", "ns/message", "ns/elem");
+
+  bench ("s", n_elements, iterations);
+  bench ("o", n_elements, iterations);
+  bench ("{ss}", n_elements, iterations);
+
+  dbus_shutdown ();
+  return 0;
+}
@@ -0,0 +1,301 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/* bench-bulk-read.c  Reading whole arrays at once or element by element
+ *
+ * Licensed under the Academic Free License version 2.1
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/*
+ * Builds messages holding one large as, a{ss} or a(iiu), then times
+ * reading every element of it: with an iterator per element, with
+ * dbus_message_get_args() where that works, and with
+ * dbus_message_iter_get_string_array() or
+ * dbus_message_iter_get_fixed_struct_array().
+ *
+ * Usage: bench-bulk-read [ELEMENTS [ITERATIONS]]
+ */
+
+#include <config.h>
+#include "test-utils.h"
+
+#include <string.h>
+
+#include <dbus/dbus-sysdeps.h>
+
+static void
+die (const char *message)
+{
+  fprintf (stderr, "*** bench-bulk-read: %s\n", message);
+  exit (1);
+}
+
+static double
+now (void)
+{
+  long tv_sec, tv_usec;
+
+  _dbus_get_monotonic_time (&tv_sec, &tv_usec);
+
+  return tv_sec + tv_usec / 1000000.0;
+}
+
+static DBusMessage *
+new_message (const char *element_signature,
+             int         n_elements)
+{
+  DBusMessage *message;
+  DBusMessageIter iter, array, element;
+  char name[32];
+  const char *s = name;
+  int i;
+
+  message = dbus_message_new_signal ("/", "org.freedesktop.DBus.Benchmark",
+                                     "Sample");
+  if (message == NULL)
+    die ("no memory");
+
+  dbus_message_iter_init_append (message, &iter);
+
+  if (!dbus_message_iter_open_container (&iter, DBUS_TYPE_ARRAY,
+                                         element_signature, &array))
+    die ("no memory");
+
+  for (i = 0; i < n_elements; i++)
+    {
+      dbus_bool_t ok;
+
+      snprintf (name, sizeof (name), "org.example.Item%d", i);
+
+      switch (element_signature[0])
+        {
+        case DBUS_TYPE_STRING:
+          ok = dbus_message_iter_append_basic (&array, DBUS_TYPE_STRING, &s);
+          break;
+
+        case DBUS_DICT_ENTRY_BEGIN_CHAR:
+          ok = dbus_message_iter_open_container (&array, DBUS_TYPE_DICT_ENTRY,
+                                                 NULL, &element) &&
+            dbus_message_iter_append_basic (&element, DBUS_TYPE_STRING, &s) &&
+            dbus_message_iter_append_basic (&element, DBUS_TYPE_STRING, &s) &&
+            dbus_message_iter_close_container (&array, &element);
+          break;
+
+        default:
+          {
+            dbus_int32_t v_INT32 = i;
+            dbus_uint32_t v_UINT32 = i;
+
+            ok = dbus_message_iter_open_container (&array, DBUS_TYPE_STRUCT,
+                                                   NULL, &element) &&
+              dbus_message_iter_append_basic (&element, DBUS_TYPE_INT32, &v_INT32) &&
+              dbus_message_iter_append_basic (&element, DBUS_TYPE_INT32, &v_INT32) &&
+              dbus_message_iter_append_basic (&element, DBUS_TYPE_UINT32, &v_UINT32) &&
+              dbus_message_iter_close_container (&array, &element);
+          }
+          break;
+        }
+
+      if (!ok)
+        die ("no memory");
+    }
+
+  if (!dbus_message_iter_close_container (&iter, &array))
+    die ("no memory");
+
+  return message;
+}
+
+/* Reads every basic value in the array one at a time, adding up the
+ * string lengths or integers so that the reads are not optimized away */
+static long
+read_iter (DBusMessage *message)
+{
+  DBusMessageIter iter, array;
+  long total = 0;
+
+  dbus_message_iter_init (message, &iter);
+  dbus_message_iter_recurse (&iter, &array);
+
+  while (dbus_message_iter_get_arg_type (&array) != DBUS_TYPE_INVALID)
+    {
+      DBusMessageIter element;
+      DBusBasicValue value;
+
+      if (dbus_message_iter_get_arg_type (&array) == DBUS_TYPE_STRING)
+        {
+          dbus_message_iter_get_basic (&array, &value);
+          total += strlen (value.str);
+        }
+      else
+        {
+          dbus_message_iter_recurse (&array, &element);
+
+          do
+            {
+              dbus_message_iter_get_basic (&element, &value);
+
+              if (dbus_message_iter_get_arg_type (&element) == DBUS_TYPE_STRING)
+                total += strlen (value.str);
+              else
+                total += value.u32;
+            }
+          while (dbus_message_iter_next (&element));
+        }
+
+      dbus_message_iter_next (&array);
+    }
+
+  return total;
+}
+
+/* Only works for as */
+static long
+read_get_args (DBusMessage *message)
+{
+  char **strings;
+  int n, i;
+  long total = 0;
+
+  if (!dbus_message_get_args (message, NULL,
+                              DBUS_TYPE_ARRAY, DBUS_TYPE_STRING, &strings, &n,
+                              DBUS_TYPE_INVALID))
+    die ("no memory");
+
+  for (i = 0; i < n; i++)
+    total += strlen (strings[i]);
+
+  dbus_free_string_array (strings);
+
+  return total;
+}
+
+static long
+read_bulk (DBusMessage *message)
+{
+  DBusMessageIter iter, array;
+  long total = 0;
+  int n, i;
+
+  dbus_message_iter_init (message, &iter);
+  dbus_message_iter_recurse (&iter, &array);
+
+  if (dbus_message_iter_get_element_type (&iter) == DBUS_TYPE_STRUCT)
+    {
+      const unsigned char *elements;
+      const void *value;
+      int stride;
+
+      if (!dbus_message_iter_get_fixed_struct_array (&array, &value, &stride,
+                                                     &n))
+        die ("no fixed layout");
+
+      elements = value;
+      for (i = 0; i < n; i++)
+        {
+          const dbus_uint32_t *element =
+            (const dbus_uint32_t *) (elements + i * stride);
+
+          total += element[0] + element[1] + element[2];
+        }
+    }
+  else
+    {
+      const char **values;
+      int *lengths;
+
+      if (!dbus_message_iter_get_string_array (&array, &values, &lengths, &n))
+        die ("no memory");
+
+      for (i = 0; i < n; i++)
+        total += lengths[i];
+
+      dbus_free (values);
+    }
+
+  return total;
+}
+
+static void
+bench (const char *element_signature,
+       int         n_elements,
+       long        iterations)
+{
+  static const struct
+  {
+    const char *name;
+    long (* read) (DBusMessage *);
+  } readers[] = {
+    { "iter", read_iter },
+    { "get_args", read_get_args },
+    { "bulk", read_bulk }
+  };
+  DBusMessage *message;
+  char signature[16];
+  unsigned int r;
+  long expected;
+
+  message = new_message (element_signature, n_elements);
+  snprintf (signature, sizeof (signature), "a%s", element_signature);
+
+  expected = read_iter (message);
+
+  for (r = 0; r < _DBUS_N_ELEMENTS (readers); r++)
+    {
+      double start, elapsed;
+      long i;
+
+      if (readers[r].read == read_get_args &&
+          strcmp (element_signature, "s") != 0)
+        continue;
+
+      start = now ();
+
+      for (i = 0; i < iterations; i++)
+        {
+          if ((* readers[r].read) (message) != expected)
+            die ("read the wrong values");
+        }
+
+      elapsed = now () - start;
+
+      printf ("%-8s %8d %-10s %12.0f %10.1f\n", signature, n_elements,
+              readers[r].name, elapsed * 1e9 / iterations,
+              elapsed * 1e9 / iterations / n_elements);
+    }
+
+  dbus_message_unref (message);
+}
+
+int
+main (int argc, char **argv)
+{
+  int n_elements = argc > 1 ? atoi (argv[1]) : 10000;
+  long iterations = argc > 2 ? atol (argv[2]) : 1000;
+
+  if (n_elements < 1 || iterations < 1)
+    die ("bad arguments");
+
+  printf ("%-8s %8s %-10s %12s %10s\n", "type", "elements", "reader",
+          "ns/array", "ns/elem");
+
+  bench ("s", n_elements, iterations);
+  bench ("{ss}", n_elements, iterations);
+  bench ("(iiu)", n_elements, iterations);
+
+  dbus_shutdown ();
+  return 0;
+}
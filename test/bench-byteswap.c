@@ -0,0 +1,155 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/* bench-byteswap.c  Throughput of byte-swapping foreign-endian bodies
+ *
+ * Licensed under the Academic Free License version 2.1
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/*
+ * Swaps message bodies holding one large array back and forth between
+ * byte orders with each byte-swapping implementation available on this
+ * machine, the way _dbus_message_byteswap() does for messages from a
+ * peer of the other endianness.
+ *
+ * Usage: bench-byteswap [MEGABYTES [ARRAY_BYTES]]
+ */
+
+#include <config.h>
+#include "test-utils.h"
+
+#define DBUS_COMPILATION
+#include <dbus/dbus-marshal-basic.h>
+#include <dbus/dbus-marshal-byteswap.h>
+#include <dbus/dbus-string.h>
+#include <dbus/dbus-sysdeps.h>
+#undef DBUS_COMPILATION
+
+static const char * const byteswappers[] =
+{
+  "scalar", "ssse3", "avx2", "neon"
+};
+
+static void
+die (const char *message)
+{
+  fprintf (stderr, "*** bench-byteswap: %s\n", message);
+  exit (1);
+}
+
+static double
+now (void)
+{
+  long tv_sec, tv_usec;
+
+  _dbus_get_monotonic_time (&tv_sec, &tv_usec);
+
+  return tv_sec + tv_usec / 1000000.0;
+}
+
+/* An array of about array_bytes bytes of the given element type; the
+ * contents don't matter for swapping */
+static void
+build_body (const DBusString *signature,
+            DBusString       *body,
+            int               array_bytes)
+{
+  DBusFixedLayout layout;
+  dbus_uint32_t len;
+
+  if (_dbus_type_get_fixed_layout (signature, 1, &layout))
+    len = (array_bytes / layout.stride - 1) * layout.stride + layout.size;
+  else
+    len = array_bytes;
+
+  if (!_dbus_marshal_write_basic (body, 0, DBUS_TYPE_UINT32, &len,
+                                  DBUS_LITTLE_ENDIAN, NULL) ||
+      !_dbus_string_align_length (body, 8) ||
+      !_dbus_string_lengthen (body, len))
+    die ("no memory");
+}
+
+static void
+bench (const char *signature_str,
+       int         array_bytes,
+       double      megabytes)
+{
+  DBusString signature;
+  DBusString body;
+  unsigned int i;
+
+  _dbus_string_init_const (&signature, signature_str);
+
+  if (!_dbus_string_init (&body))
+    die ("no memory");
+
+  build_body (&signature, &body, array_bytes);
+
+  for (i = 0; i < _DBUS_N_ELEMENTS (byteswappers); i++)
+    {
+      double start, elapsed;
+      long n, j;
+
+      if (!_dbus_marshal_set_byteswapper (byteswappers[i]))
+        continue;
+
+      n = (long) (megabytes * 1024 * 1024 / _dbus_string_get_length (&body));
+      if (n < 2)
+        n = 2;
+
+      start = now ();
+
+      for (j = 0; j < n; j += 2)
+        {
+          _dbus_marshal_byteswap (&signature, 0, DBUS_LITTLE_ENDIAN,
+                                  DBUS_BIG_ENDIAN, &body, 0);
+          _dbus_marshal_byteswap (&signature, 0, DBUS_BIG_ENDIAN,
+                                  DBUS_LITTLE_ENDIAN, &body, 0);
+        }
+
+      elapsed = now () - start;
+
+      printf ("%-10s %8d %-8s %10.1f MB/s\n", signature_str,
+              _dbus_string_get_length (&body), byteswappers[i],
+              n * (double) _dbus_string_get_length (&body) / elapsed /
+              (1024 * 1024));
+    }
+
+  _dbus_marshal_set_byteswapper (NULL);
+  _dbus_string_free (&body);
+}
+
+int
+main (int argc, char **argv)
+{
+  double megabytes = argc > 1 ? atof (argv[1]) : 1024;
+  int array_bytes = argc > 2 ? atoi (argv[2]) : 64 * 1024;
+
+  if (megabytes <= 0 || array_bytes < 64)
+    die ("bad arguments");
+
+  bench ("an", array_bytes, megabytes);
+  bench ("au", array_bytes, megabytes);
+  bench ("ax", array_bytes, megabytes);
+  bench ("ad", array_bytes, megabytes);
+  bench ("a(dddd)", array_bytes, megabytes);
+  bench ("a(dd)", array_bytes, megabytes);
+  bench ("a(iiu)", array_bytes, megabytes);
+  bench ("a(ynd)", array_bytes, megabytes);
+  bench ("a{ud}", array_bytes, megabytes);
+
+  return 0;
+}
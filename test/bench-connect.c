@@ -0,0 +1,295 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/* bench-connect.c  Many clients connecting to one server at once
+ *
+ * Licensed under the Academic Free License version 2.1
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/*
+ * A connection storm, as at boot when every service connects to the
+ * system bus at once: N client threads are released together, each
+ * opens a private connection to a DBusServer run by a DBusLoop in the
+ * main thread and makes a blocking Hello() call, which the server
+ * answers as the bus would. Reports how long the clients waited for
+ * their Hello() reply, counting from when they were released, so that
+ * connecting and authenticating are included. Each storm is run twice,
+ * once waiting for each step of the authentication handshake and once
+ * pipelining it as clients of the system bus do.
+ *
+ * Usage: bench-connect [CLIENTS [LISTEN_ADDRESS]]
+ */
+
+#include <config.h>
+#include "test-utils.h"
+
+#include <pthread.h>
+#include <string.h>
+
+#define DBUS_COMPILATION
+#include <dbus/dbus-connection-internal.h>
+#include <dbus/dbus-sysdeps.h>
+#undef DBUS_COMPILATION
+
+#define MAX_CLIENTS 400
+
+static DBusLoop *loop;
+static char *address;
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t released = PTHREAD_COND_INITIALIZER;
+static dbus_bool_t go;
+static dbus_bool_t pipelined;
+static double start;
+static int n_finished;
+
+static double latencies[MAX_CLIENTS];
+
+static DBusConnection *server_side[MAX_CLIENTS];
+static int n_server_side;
+
+static void
+die (const char *message)
+{
+  fprintf (stderr, "*** bench-connect: %s\n", message);
+  exit (1);
+}
+
+static double
+now (void)
+{
+  long tv_sec, tv_usec;
+
+  _dbus_get_monotonic_time (&tv_sec, &tv_usec);
+
+  return tv_sec + tv_usec / 1000000.0;
+}
+
+static DBusHandlerResult
+hello_filter (DBusConnection *connection,
+              DBusMessage    *message,
+              void           *data)
+{
+  DBusMessage *reply;
+  char name[32];
+  const char *p = name;
+
+  if (!dbus_message_is_method_call (message, DBUS_INTERFACE_DBUS, "Hello"))
+    return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+
+  snprintf (name, sizeof (name), ":1.%d", n_server_side);
+
+  reply = dbus_message_new_method_return (message);
+  if (reply == NULL ||
+      !dbus_message_append_args (reply, DBUS_TYPE_STRING, &p,
+                                 DBUS_TYPE_INVALID) ||
+      !dbus_connection_send (connection, reply, NULL))
+    die ("no memory");
+
+  dbus_message_unref (reply);
+  return DBUS_HANDLER_RESULT_HANDLED;
+}
+
+static void
+new_connection (DBusServer     *server,
+                DBusConnection *connection,
+                void           *data)
+{
+  if (n_server_side >= MAX_CLIENTS)
+    die ("too many connections");
+
+  if (!dbus_connection_add_filter (connection, hello_filter, NULL, NULL) ||
+      !test_connection_setup (loop, connection))
+    die ("no memory");
+
+  server_side[n_server_side++] = dbus_connection_ref (connection);
+}
+
+static void *
+client_thread (void *data)
+{
+  double *latency = data;
+  DBusConnection *connection;
+  DBusMessage *hello, *reply;
+  DBusError error;
+
+  dbus_error_init (&error);
+
+  pthread_mutex_lock (&lock);
+  while (!go)
+    pthread_cond_wait (&released, &lock);
+  pthread_mutex_unlock (&lock);
+
+  connection = dbus_connection_open_private (address, &error);
+  if (connection == NULL)
+    die (error.message);
+
+  if (pipelined && !_dbus_connection_set_pipelined_auth (connection))
+    die ("no memory");
+
+  hello = dbus_message_new_method_call (DBUS_SERVICE_DBUS, DBUS_PATH_DBUS,
+                                        DBUS_INTERFACE_DBUS, "Hello");
+  if (hello == NULL)
+    die ("no memory");
+
+  reply = dbus_connection_send_with_reply_and_block (connection, hello, -1,
+                                                     &error);
+  if (reply == NULL)
+    die (error.message);
+
+  *latency = now () - start;
+
+  dbus_message_unref (reply);
+  dbus_message_unref (hello);
+  dbus_connection_close (connection);
+  dbus_connection_unref (connection);
+
+  pthread_mutex_lock (&lock);
+  n_finished++;
+  pthread_mutex_unlock (&lock);
+
+  return NULL;
+}
+
+static int
+compare_doubles (const void *a,
+                 const void *b)
+{
+  double x = *(const double *) a;
+  double y = *(const double *) b;
+
+  return x < y ? -1 : x > y;
+}
+
+static void
+storm (int         n_clients,
+       dbus_bool_t pipeline)
+{
+  pthread_t threads[MAX_CLIENTS];
+  double total = 0;
+  dbus_bool_t finished = FALSE;
+  int i;
+
+  n_finished = 0;
+  go = FALSE;
+  pipelined = pipeline;
+
+  for (i = 0; i < n_clients; i++)
+    pthread_create (&threads[i], NULL, client_thread, &latencies[i]);
+
+  pthread_mutex_lock (&lock);
+  start = now ();
+  go = TRUE;
+  pthread_cond_broadcast (&released);
+  pthread_mutex_unlock (&lock);
+
+  /* each client closing its connection wakes the loop up, so it cannot
+   * sleep through the last one finishing */
+  while (!finished)
+    {
+      _dbus_loop_iterate (loop, TRUE);
+
+      pthread_mutex_lock (&lock);
+      finished = n_finished == n_clients;
+      pthread_mutex_unlock (&lock);
+    }
+
+  for (i = 0; i < n_clients; i++)
+    pthread_join (threads[i], NULL);
+
+  for (i = 0; i < n_server_side; i++)
+    {
+      test_connection_shutdown (loop, server_side[i]);
+      dbus_connection_close (server_side[i]);
+      dbus_connection_unref (server_side[i]);
+    }
+
+  n_server_side = 0;
+
+  qsort (latencies, n_clients, sizeof (double), compare_doubles);
+
+  for (i = 0; i < n_clients; i++)
+    total += latencies[i];
+
+  printf ("%8d %-10s %12.2f %12.2f %12.2f\n", n_clients,
+          pipeline ? "pipelined" : "stepwise",
+          total * 1000.0 / n_clients,
+          latencies[n_clients / 2] * 1000.0,
+          latencies[n_clients - 1] * 1000.0);
+}
+
+int
+main (int argc, char **argv)
+{
+  static const int client_counts[] = { 1, 10, 100, 300 };
+  DBusServer *server;
+  DBusError error;
+  unsigned int i;
+
+  dbus_error_init (&error);
+
+  if (!dbus_threads_init_default ())
+    die ("no memory");
+
+  loop = _dbus_loop_new ();
+  if (loop == NULL)
+    die ("no memory");
+
+  server = dbus_server_listen (argc > 2 ? argv[2] : "unix:tmpdir=/tmp",
+                               &error);
+  if (server == NULL)
+    die (error.message);
+
+  dbus_server_set_new_connection_function (server, new_connection,
+                                           NULL, NULL);
+
+  if (!test_server_setup (loop, server))
+    die ("no memory");
+
+  address = dbus_server_get_address (server);
+  if (address == NULL)
+    die ("no memory");
+
+  printf ("%8s %-10s %12s %12s %12s\n", "clients", "auth", "mean ms",
+          "median ms", "last ms");
+
+  if (argc > 1)
+    {
+      int n_clients = atoi (argv[1]);
+
+      if (n_clients < 1 || n_clients > MAX_CLIENTS)
+        die ("bad arguments");
+
+      storm (n_clients, FALSE);
+      storm (n_clients, TRUE);
+    }
+  else
+    {
+      for (i = 0; i < _DBUS_N_ELEMENTS (client_counts); i++)
+        {
+          storm (client_counts[i], FALSE);
+          storm (client_counts[i], TRUE);
+        }
+    }
+
+  dbus_free (address);
+  test_server_shutdown (loop, server);
+  dbus_server_unref (server);
+  _dbus_loop_unref (loop);
+
+  dbus_shutdown ();
+  return 0;
+}
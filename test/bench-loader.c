@@ -0,0 +1,288 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/* bench-loader.c  Loading messages with and without validating bodies
+ *
+ * Licensed under the Academic Free License version 2.1
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/*
+ * Marshals a few typical messages, then times a message loader
+ * splitting a buffer full of copies of each one back into messages,
+ * as a transport's loader does with what it reads: once validating
+ * every message, and once trusting the bodies and deferring the checks
+ * on header names as a connection does after
+ * dbus_connection_set_trust_peer_data().
+ *
+ * Usage: bench-loader [MESSAGES-PER-BUFFER [ITERATIONS]]
+ */
+
+#include <config.h>
+#include "test-utils.h"
+
+#include <string.h>
+
+#define DBUS_COMPILATION
+#include <dbus/dbus-message-internal.h>
+#include <dbus/dbus-string.h>
+#include <dbus/dbus-sysdeps.h>
+#undef DBUS_COMPILATION
+
+static void
+die (const char *message)
+{
+  fprintf (stderr, "*** bench-loader: %s\n", message);
+  exit (1);
+}
+
+static double
+now (void)
+{
+  long tv_sec, tv_usec;
+
+  _dbus_get_monotonic_time (&tv_sec, &tv_usec);
+
+  return tv_sec + tv_usec / 1000000.0;
+}
+
+static DBusMessage *
+new_signal (void)
+{
+  DBusMessage *message;
+
+  message = dbus_message_new_signal ("/org/freedesktop/NetworkManager/Devices/3",
+                                     "org.freedesktop.DBus.Properties",
+                                     "PropertiesChanged");
+  /* as the bus delivers it */
+  if (message == NULL ||
+      !dbus_message_set_sender (message, ":1.7") ||
+      !dbus_message_set_destination (message, ":1.2345"))
+    die ("no memory");
+
+  return message;
+}
+
+/* no arguments */
+static DBusMessage *
+build_empty (void)
+{
+  return new_signal ();
+}
+
+/* sa{sv}as: PropertiesChanged with a few properties */
+static DBusMessage *
+build_properties_changed (void)
+{
+  static const char * const names[] = {
+    "State", "Interface", "Driver", "Mtu", "Managed", "Autoconnect"
+  };
+  DBusMessage *message = new_signal ();
+  DBusMessageIter iter, dict, entry, variant, array;
+  const char *interface = "org.freedesktop.NetworkManager.Device";
+  const char *text = "wlp2s0";
+  unsigned int i;
+
+  dbus_message_iter_init_append (message, &iter);
+
+  if (!dbus_message_iter_append_basic (&iter, DBUS_TYPE_STRING, &interface) ||
+      !dbus_message_iter_open_container (&iter, DBUS_TYPE_ARRAY, "{sv}", &dict))
+    die ("no memory");
+
+  for (i = 0; i < _DBUS_N_ELEMENTS (names); i++)
+    {
+      dbus_uint32_t number = 100 + i;
+
+      if (!dbus_message_iter_open_container (&dict, DBUS_TYPE_DICT_ENTRY,
+                                             NULL, &entry) ||
+          !dbus_message_iter_append_basic (&entry, DBUS_TYPE_STRING,
+                                           &names[i]))
+        die ("no memory");
+
+      if (i % 2 == 0)
+        {
+          if (!dbus_message_iter_open_container (&entry, DBUS_TYPE_VARIANT,
+                                                 "u", &variant) ||
+              !dbus_message_iter_append_basic (&variant, DBUS_TYPE_UINT32,
+                                               &number))
+            die ("no memory");
+        }
+      else
+        {
+          if (!dbus_message_iter_open_container (&entry, DBUS_TYPE_VARIANT,
+                                                 "s", &variant) ||
+              !dbus_message_iter_append_basic (&variant, DBUS_TYPE_STRING,
+                                               &text))
+            die ("no memory");
+        }
+
+      if (!dbus_message_iter_close_container (&entry, &variant) ||
+          !dbus_message_iter_close_container (&dict, &entry))
+        die ("no memory");
+    }
+
+  if (!dbus_message_iter_close_container (&iter, &dict) ||
+      !dbus_message_iter_open_container (&iter, DBUS_TYPE_ARRAY, "s", &array) ||
+      !dbus_message_iter_close_container (&iter, &array))
+    die ("no memory");
+
+  return message;
+}
+
+/* as: a list of 200 names */
+static DBusMessage *
+build_names (void)
+{
+  DBusMessage *message = new_signal ();
+  const char *values[200];
+  const char **p = values;
+  char storage[200][32];
+  unsigned int i;
+
+  for (i = 0; i < _DBUS_N_ELEMENTS (values); i++)
+    {
+      snprintf (storage[i], sizeof (storage[i]), "org.example.Service%u", i);
+      values[i] = storage[i];
+    }
+
+  if (!dbus_message_append_args (message,
+                                 DBUS_TYPE_ARRAY, DBUS_TYPE_STRING, &p,
+                                 (int) _DBUS_N_ELEMENTS (values),
+                                 DBUS_TYPE_INVALID))
+    die ("no memory");
+
+  return message;
+}
+
+/* ay: 64 KiB of data */
+static DBusMessage *
+build_bytes (void)
+{
+  DBusMessage *message = new_signal ();
+  static unsigned char bytes[64 * 1024];
+  const unsigned char *p = bytes;
+
+  if (!dbus_message_append_args (message,
+                                 DBUS_TYPE_ARRAY, DBUS_TYPE_BYTE, &p,
+                                 (int) sizeof (bytes),
+                                 DBUS_TYPE_INVALID))
+    die ("no memory");
+
+  return message;
+}
+
+static double
+load (const DBusString *stream,
+      int               n_messages,
+      dbus_bool_t       trust,
+      long              iterations)
+{
+  double start;
+  long i;
+  int n;
+
+  start = now ();
+
+  for (i = 0; i < iterations; i++)
+    {
+      DBusMessageLoader *loader;
+      DBusMessage *message;
+      DBusString *buffer;
+
+      loader = _dbus_message_loader_new ();
+      if (loader == NULL)
+        die ("no memory");
+
+      _dbus_message_loader_set_trust_bodies (loader, trust);
+
+      _dbus_message_loader_get_buffer (loader, &buffer);
+      if (!_dbus_string_copy (stream, 0, buffer, 0))
+        die ("no memory");
+      _dbus_message_loader_return_buffer (loader, buffer,
+                                          _dbus_string_get_length (stream));
+
+      if (!_dbus_message_loader_queue_messages (loader) ||
+          _dbus_message_loader_get_is_corrupted (loader))
+        die ("could not load messages");
+
+      for (n = 0; (message = _dbus_message_loader_pop_message (loader)) != NULL; n++)
+        dbus_message_unref (message);
+
+      if (n != n_messages)
+        die ("loaded the wrong number of messages");
+
+      _dbus_message_loader_unref (loader);
+    }
+
+  return (now () - start) * 1e9 / iterations / n_messages;
+}
+
+static void
+bench (const char     *signature,
+       DBusMessage * (* build) (void),
+       int             n_messages,
+       long            iterations)
+{
+  DBusMessage *message;
+  DBusString stream;
+  double untrusted, trusted;
+  char *data;
+  int len;
+  int i;
+
+  message = (* build) ();
+  dbus_message_set_serial (message, 1);
+
+  if (!dbus_message_marshal (message, &data, &len) ||
+      !_dbus_string_init (&stream))
+    die ("no memory");
+
+  for (i = 0; i < n_messages; i++)
+    {
+      if (!_dbus_string_append_len (&stream, data, len))
+        die ("no memory");
+    }
+
+  untrusted = load (&stream, n_messages, FALSE, iterations);
+  trusted = load (&stream, n_messages, TRUE, iterations);
+
+  printf ("%-10s %8d %14.0f %14.0f %14.0f\n", signature, len,
+          untrusted, trusted, untrusted - trusted);
+
+  _dbus_string_free (&stream);
+  dbus_free (data);
+  dbus_message_unref (message);
+}
+
+int
+main (int argc, char **argv)
+{
+  int n_messages = argc > 1 ? atoi (argv[1]) : 1;
+  long iterations = argc > 2 ? atol (argv[2]) : 100000;
+
+  if (n_messages < 1 || iterations < 1)
+    die ("bad arguments");
+
+  printf ("%-10s %8s %14s %14s %14s\n", "signature", "bytes",
+          "validated ns", "trusted ns", "saved ns");
+
+  bench ("", build_empty, n_messages, iterations);
+  bench ("sa{sv}as", build_properties_changed, n_messages, iterations);
+  bench ("as", build_names, n_messages, iterations);
+  bench ("ay", build_bytes, n_messages, iterations / 10 + 1);
+
+  dbus_shutdown ();
+  return 0;
+}
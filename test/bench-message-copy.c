@@ -0,0 +1,148 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/* bench-message-copy.c  Copying large messages
+ *
+ * Licensed under the Academic Free License version 2.1
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/*
+ * Builds one message holding a large byte array, then times copying it
+ * with dbus_message_copy() before and after it is locked (as it is once
+ * it has been queued for sending), optionally setting a header field or
+ * appending an argument to each copy.
+ *
+ * Usage: bench-message-copy [BODY-BYTES [ITERATIONS]]
+ */
+
+#include <config.h>
+#include "test-utils.h"
+
+#include <string.h>
+
+#include <dbus/dbus-sysdeps.h>
+
+static void
+die (const char *message)
+{
+  fprintf (stderr, "*** bench-message-copy: %s\n", message);
+  exit (1);
+}
+
+static double
+now (void)
+{
+  long tv_sec, tv_usec;
+
+  _dbus_get_monotonic_time (&tv_sec, &tv_usec);
+
+  return tv_sec + tv_usec / 1000000.0;
+}
+
+typedef enum
+{
+  COPY_ONLY,
+  SET_DESTINATION,
+  APPEND
+} Modification;
+
+static void
+bench (DBusMessage  *message,
+       const char   *what,
+       Modification  modification,
+       long          iterations)
+{
+  dbus_uint32_t v_UINT32 = 1;
+  double start, elapsed;
+  long i;
+
+  start = now ();
+
+  for (i = 0; i < iterations; i++)
+    {
+      DBusMessage *copy = dbus_message_copy (message);
+
+      if (copy == NULL)
+        die ("no memory");
+
+      switch (modification)
+        {
+        case SET_DESTINATION:
+          if (!dbus_message_set_destination (copy, ":1.42"))
+            die ("no memory");
+          break;
+
+        case APPEND:
+          if (!dbus_message_append_args (copy, DBUS_TYPE_UINT32, &v_UINT32,
+                                         DBUS_TYPE_INVALID))
+            die ("no memory");
+          break;
+
+        default:
+          break;
+        }
+
+      dbus_message_unref (copy);
+    }
+
+  elapsed = now () - start;
+
+  printf ("%-26s %14.0f\n", what, elapsed * 1e9 / iterations);
+}
+
+int
+main (int argc, char **argv)
+{
+  int n_bytes = argc > 1 ? atoi (argv[1]) : 10 * 1024 * 1024;
+  long iterations = argc > 2 ? atol (argv[2]) : 200;
+  DBusMessage *message;
+  unsigned char *bytes;
+
+  if (n_bytes < 1 || iterations < 1)
+    die ("bad arguments");
+
+  bytes = dbus_malloc (n_bytes);
+  message = dbus_message_new_signal ("/", "org.freedesktop.DBus.Benchmark",
+                                     "Sample");
+  if (bytes == NULL || message == NULL)
+    die ("no memory");
+
+  memset (bytes, 'x', n_bytes);
+
+  if (!dbus_message_append_args (message,
+                                 DBUS_TYPE_ARRAY, DBUS_TYPE_BYTE,
+                                 &bytes, n_bytes,
+                                 DBUS_TYPE_INVALID))
+    die ("no memory");
+
+  printf ("%d-byte body\n", n_bytes);
+  printf ("%-26s %14s\n", "copy", "ns/copy");
+
+  bench (message, "unlocked", COPY_ONLY, iterations);
+
+  dbus_message_set_serial (message, 1);
+  dbus_message_lock (message);
+
+  bench (message, "locked", COPY_ONLY, iterations);
+  bench (message, "locked, set_destination", SET_DESTINATION, iterations);
+  bench (message, "locked, append", APPEND, iterations);
+
+  dbus_message_unref (message);
+  dbus_free (bytes);
+
+  dbus_shutdown ();
+  return 0;
+}
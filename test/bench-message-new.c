@@ -0,0 +1,125 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/* bench-message-new.c  Constructing signals and method returns
+ *
+ * Licensed under the Academic Free License version 2.1
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/*
+ * Creates, fills in with one small argument and frees messages as
+ * fast as possible: signals made with dbus_message_new_signal() or
+ * from a template with dbus_message_new_from_template(), and replies
+ * made with dbus_message_new_method_return().
+ *
+ * Usage: bench-message-new [ITERATIONS]
+ */
+
+#include <config.h>
+#include "test-utils.h"
+
+#include <dbus/dbus-sysdeps.h>
+
+#define BENCH_PATH "/org/freedesktop/NetworkManager/Devices/3"
+#define BENCH_INTERFACE "org.freedesktop.NetworkManager.Device.Statistics"
+#define BENCH_MEMBER "PropertiesChanged"
+
+static void
+die (const char *message)
+{
+  fprintf (stderr, "*** bench-message-new: %s\n", message);
+  exit (1);
+}
+
+static double
+now (void)
+{
+  long tv_sec, tv_usec;
+
+  _dbus_get_monotonic_time (&tv_sec, &tv_usec);
+
+  return tv_sec + tv_usec / 1000000.0;
+}
+
+static void
+fill_and_free (DBusMessage  *message,
+               dbus_uint32_t value)
+{
+  if (message == NULL ||
+      !dbus_message_append_args (message,
+                                 DBUS_TYPE_UINT32, &value,
+                                 DBUS_TYPE_INVALID))
+    die ("no memory");
+
+  dbus_message_unref (message);
+}
+
+static void
+report (const char *what,
+        double      start,
+        long        iterations)
+{
+  double elapsed = now () - start;
+
+  printf ("%-24s %12.0f %10.1f\n", what, iterations / elapsed,
+          elapsed * 1e9 / iterations);
+}
+
+int
+main (int argc, char **argv)
+{
+  long iterations = argc > 1 ? atol (argv[1]) : 2000000;
+  DBusMessage *template_message, *call;
+  double start;
+  long i;
+
+  if (iterations < 1)
+    die ("bad arguments");
+
+  template_message = dbus_message_new_signal (BENCH_PATH, BENCH_INTERFACE,
+                                              BENCH_MEMBER);
+  call = dbus_message_new_method_call ("org.freedesktop.NetworkManager",
+                                       BENCH_PATH, BENCH_INTERFACE, "GetStats");
+  if (template_message == NULL || call == NULL ||
+      !dbus_message_set_sender (call, ":1.2345"))
+    die ("no memory");
+
+  dbus_message_set_serial (call, 42);
+
+  printf ("%-24s %12s %10s\n", "constructor", "msgs/sec", "ns/msg");
+
+  start = now ();
+  for (i = 0; i < iterations; i++)
+    fill_and_free (dbus_message_new_signal (BENCH_PATH, BENCH_INTERFACE,
+                                            BENCH_MEMBER), i);
+  report ("new_signal", start, iterations);
+
+  start = now ();
+  for (i = 0; i < iterations; i++)
+    fill_and_free (dbus_message_new_from_template (template_message), i);
+  report ("new_from_template", start, iterations);
+
+  start = now ();
+  for (i = 0; i < iterations; i++)
+    fill_and_free (dbus_message_new_method_return (call), i);
+  report ("new_method_return", start, iterations);
+
+  dbus_message_unref (call);
+  dbus_message_unref (template_message);
+
+  dbus_shutdown ();
+  return 0;
+}
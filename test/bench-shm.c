@@ -0,0 +1,240 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/* bench-shm.c  Peer-to-peer latency and throughput over unix:, unixpacket:
+ * and shm:
+ *
+ * Licensed under the Academic Free License version 2.1
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/*
+ * Connects a client to a server thread in the same process over each
+ * transport in turn, then times blocking round trips with no payload,
+ * and streams of one-way messages with payloads of a few sizes
+ * followed by one round trip to be sure they have all arrived.
+ *
+ * Usage: bench-shm [ROUND-TRIPS [MEGABYTES]]
+ */
+
+#include <config.h>
+#include "test-utils.h"
+
+#include <pthread.h>
+#include <string.h>
+
+#define DBUS_COMPILATION
+#include <dbus/dbus-sysdeps.h>
+#undef DBUS_COMPILATION
+
+#define BENCH_INTERFACE "org.freedesktop.DBus.Bench.Shm"
+
+static DBusConnection *client;
+static DBusConnection *server;
+
+static void
+die (const char *message)
+{
+  fprintf (stderr, "*** bench-shm: %s\n", message);
+  exit (1);
+}
+
+static double
+now (void)
+{
+  long tv_sec, tv_usec;
+
+  _dbus_get_monotonic_time (&tv_sec, &tv_usec);
+
+  return tv_sec + tv_usec / 1000000.0;
+}
+
+/* Replies to Ping, drops Data, and returns when asked to Quit */
+static void *
+server_thread (void *data)
+{
+  dbus_bool_t done = FALSE;
+
+  while (!done && dbus_connection_read_write (server, -1))
+    {
+      DBusMessage *message;
+
+      while (!done && (message = dbus_connection_pop_message (server)) != NULL)
+        {
+          if (dbus_message_is_method_call (message, BENCH_INTERFACE, "Ping"))
+            {
+              DBusMessage *reply;
+
+              reply = dbus_message_new_method_return (message);
+              if (reply == NULL ||
+                  !dbus_connection_send (server, reply, NULL))
+                die ("no memory");
+
+              dbus_message_unref (reply);
+            }
+          else if (dbus_message_is_method_call (message, BENCH_INTERFACE,
+                                                "Quit"))
+            {
+              done = TRUE;
+            }
+
+          dbus_message_unref (message);
+        }
+    }
+
+  return NULL;
+}
+
+static void
+ping (void)
+{
+  DBusMessage *message, *reply;
+  DBusError error;
+
+  dbus_error_init (&error);
+
+  message = dbus_message_new_method_call (NULL, "/", BENCH_INTERFACE, "Ping");
+  if (message == NULL)
+    die ("no memory");
+
+  reply = dbus_connection_send_with_reply_and_block (client, message,
+                                                     DBUS_TIMEOUT_INFINITE,
+                                                     &error);
+  if (reply == NULL)
+    die (error.message);
+
+  dbus_message_unref (reply);
+  dbus_message_unref (message);
+}
+
+static double
+stream (int  payload,
+        long megabytes)
+{
+  DBusMessage *message;
+  unsigned char *bytes;
+  const unsigned char *p;
+  double start;
+  long n_messages, i;
+
+  bytes = dbus_malloc0 (payload);
+  if (bytes == NULL)
+    die ("no memory");
+
+  p = bytes;
+  message = dbus_message_new_signal ("/", BENCH_INTERFACE, "Data");
+  if (message == NULL ||
+      !dbus_message_append_args (message,
+                                 DBUS_TYPE_ARRAY, DBUS_TYPE_BYTE,
+                                 &p, payload,
+                                 DBUS_TYPE_INVALID))
+    die ("no memory");
+
+  n_messages = megabytes * 1024 * 1024 / payload;
+  start = now ();
+
+  for (i = 0; i < n_messages; i++)
+    {
+      if (!dbus_connection_send (client, message, NULL))
+        die ("no memory");
+
+      /* don't queue the whole stream up before writing any of it */
+      if (i % 64 == 63)
+        dbus_connection_flush (client);
+    }
+
+  ping ();
+
+  dbus_message_unref (message);
+  dbus_free (bytes);
+
+  return megabytes / (now () - start);
+}
+
+static void
+bench (const char *name,
+       const char *listen_address,
+       long        round_trips,
+       long        megabytes)
+{
+  static const int payloads[] = { 64, 4096, 65536 };
+  DBusMessage *quit;
+  pthread_t thread;
+  double start;
+  unsigned int i;
+  long n;
+
+  if (!test_connection_pair_new (listen_address, &client, &server))
+    {
+      printf ("%-10s not supported\n", name);
+      return;
+    }
+
+  pthread_create (&thread, NULL, server_thread, NULL);
+
+  /* authenticate and warm up */
+  ping ();
+
+  start = now ();
+
+  for (n = 0; n < round_trips; n++)
+    ping ();
+
+  printf ("%-10s %14.1f", name,
+          (now () - start) * 1e6 / round_trips);
+
+  for (i = 0; i < _DBUS_N_ELEMENTS (payloads); i++)
+    printf (" %12.0f", stream (payloads[i], megabytes));
+
+  printf ("\n");
+
+  quit = dbus_message_new_method_call (NULL, "/", BENCH_INTERFACE, "Quit");
+  if (quit == NULL || !dbus_connection_send (client, quit, NULL))
+    die ("no memory");
+
+  dbus_connection_flush (client);
+  dbus_message_unref (quit);
+  pthread_join (thread, NULL);
+
+  dbus_connection_close (client);
+  dbus_connection_unref (client);
+  dbus_connection_close (server);
+  dbus_connection_unref (server);
+}
+
+int
+main (int argc, char **argv)
+{
+  long round_trips = argc > 1 ? atol (argv[1]) : 20000;
+  long megabytes = argc > 2 ? atol (argv[2]) : 256;
+
+  if (round_trips < 1 || megabytes < 1)
+    die ("bad arguments");
+
+  if (!dbus_threads_init_default ())
+    die ("no memory");
+
+  printf ("%-10s %14s %12s %12s %12s\n", "", "round trip us",
+          "64B MB/s", "4KiB MB/s", "64KiB MB/s");
+
+  bench ("unix", "unix:tmpdir=/tmp", round_trips, megabytes);
+#ifdef __linux__
+  bench ("unixpacket", "unixpacket:tmpdir=/tmp", round_trips, megabytes);
+#endif
+  bench ("shm", "shm:tmpdir=/tmp", round_trips, megabytes);
+
+  dbus_shutdown ();
+  return 0;
+}
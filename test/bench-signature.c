@@ -0,0 +1,409 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/* bench-signature.c  Reading message bodies with and without compiled
+ *                    signatures
+ *
+ * Licensed under the Academic Free License version 2.1
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/*
+ * Builds one message for each of a few common signatures, then times
+ * demarshalling it (which validates the body), byte-swapping it, and
+ * walking every value in it with a DBusMessageIter, first reading the
+ * signature directly and then through its compiled program.
+ *
+ * Usage: bench-signature [ITERATIONS]
+ */
+
+#include <config.h>
+#include "test-utils.h"
+
+#include <string.h>
+
+#define DBUS_COMPILATION
+#include <dbus/dbus-marshal-byteswap.h>
+#include <dbus/dbus-marshal-program.h>
+#include <dbus/dbus-message-internal.h>
+#include <dbus/dbus-string.h>
+#include <dbus/dbus-sysdeps.h>
+#undef DBUS_COMPILATION
+
+static void
+die (const char *message)
+{
+  fprintf (stderr, "*** bench-signature: %s\n", message);
+  exit (1);
+}
+
+static double
+now (void)
+{
+  long tv_sec, tv_usec;
+
+  _dbus_get_monotonic_time (&tv_sec, &tv_usec);
+
+  return tv_sec + tv_usec / 1000000.0;
+}
+
+static void
+open_container (DBusMessageIter *iter,
+                int              type,
+                const char      *signature,
+                DBusMessageIter *sub)
+{
+  if (!dbus_message_iter_open_container (iter, type, signature, sub))
+    die ("no memory");
+}
+
+static void
+close_container (DBusMessageIter *iter,
+                 DBusMessageIter *sub)
+{
+  if (!dbus_message_iter_close_container (iter, sub))
+    die ("no memory");
+}
+
+static void
+append_basic (DBusMessageIter *iter,
+              int              type,
+              const void      *value)
+{
+  if (!dbus_message_iter_append_basic (iter, type, value))
+    die ("no memory");
+}
+
+/* Appends a{sv} with n properties, alternating between uint32, string
+ * and boolean values, the way property dictionaries usually look */
+static void
+append_properties (DBusMessageIter *iter,
+                   int              n)
+{
+  DBusMessageIter dict;
+  int i;
+
+  open_container (iter, DBUS_TYPE_ARRAY, "{sv}", &dict);
+
+  for (i = 0; i < n; i++)
+    {
+      static const char * const names[] = {
+        "State", "Interface", "Managed", "Mtu", "Driver", "Autoconnect"
+      };
+      DBusMessageIter entry, variant;
+      const char *name = names[i % _DBUS_N_ELEMENTS (names)];
+      const char *text = "wlp2s0";
+      dbus_uint32_t number = 100 + i;
+      dbus_bool_t flag = TRUE;
+
+      open_container (&dict, DBUS_TYPE_DICT_ENTRY, NULL, &entry);
+      append_basic (&entry, DBUS_TYPE_STRING, &name);
+
+      switch (i % 3)
+        {
+        case 0:
+          open_container (&entry, DBUS_TYPE_VARIANT, "u", &variant);
+          append_basic (&variant, DBUS_TYPE_UINT32, &number);
+          break;
+        case 1:
+          open_container (&entry, DBUS_TYPE_VARIANT, "s", &variant);
+          append_basic (&variant, DBUS_TYPE_STRING, &text);
+          break;
+        default:
+          open_container (&entry, DBUS_TYPE_VARIANT, "b", &variant);
+          append_basic (&variant, DBUS_TYPE_BOOLEAN, &flag);
+          break;
+        }
+
+      close_container (&entry, &variant);
+      close_container (&dict, &entry);
+    }
+
+  close_container (iter, &dict);
+}
+
+/* a{sv}: a GetAll reply */
+static void
+build_get_all (DBusMessageIter *iter)
+{
+  append_properties (iter, 12);
+}
+
+/* (oa{sa{sv}}): one object from GetManagedObjects */
+static void
+build_managed_object (DBusMessageIter *iter)
+{
+  static const char * const interfaces[] = {
+    "org.freedesktop.NetworkManager.Device",
+    "org.freedesktop.NetworkManager.Device.Wireless",
+    "org.freedesktop.DBus.Properties"
+  };
+  DBusMessageIter object, dict, entry;
+  const char *path = "/org/freedesktop/NetworkManager/Devices/3";
+  unsigned int i;
+
+  open_container (iter, DBUS_TYPE_STRUCT, NULL, &object);
+  append_basic (&object, DBUS_TYPE_OBJECT_PATH, &path);
+  open_container (&object, DBUS_TYPE_ARRAY, "{sa{sv}}", &dict);
+
+  for (i = 0; i < _DBUS_N_ELEMENTS (interfaces); i++)
+    {
+      open_container (&dict, DBUS_TYPE_DICT_ENTRY, NULL, &entry);
+      append_basic (&entry, DBUS_TYPE_STRING, &interfaces[i]);
+      append_properties (&entry, 6);
+      close_container (&dict, &entry);
+    }
+
+  close_container (&object, &dict);
+  close_container (iter, &object);
+}
+
+/* sa{sv}as: PropertiesChanged */
+static void
+build_properties_changed (DBusMessageIter *iter)
+{
+  const char *interface = "org.freedesktop.NetworkManager.Device";
+  const char *invalidated[] = { "Ip4Config", "Ip6Config" };
+  DBusMessageIter array;
+  unsigned int i;
+
+  append_basic (iter, DBUS_TYPE_STRING, &interface);
+  append_properties (iter, 4);
+
+  open_container (iter, DBUS_TYPE_ARRAY, "s", &array);
+  for (i = 0; i < _DBUS_N_ELEMENTS (invalidated); i++)
+    append_basic (&array, DBUS_TYPE_STRING, &invalidated[i]);
+  close_container (iter, &array);
+}
+
+/* a(iiu) followed by a string: skipping the array is cheap either way,
+ * but iterating steps over each element */
+static void
+build_struct_array (DBusMessageIter *iter)
+{
+  DBusMessageIter array, element;
+  const char *trailer = "done";
+  dbus_int32_t i;
+
+  open_container (iter, DBUS_TYPE_ARRAY, "(iiu)", &array);
+
+  for (i = 0; i < 64; i++)
+    {
+      dbus_uint32_t u = i;
+
+      open_container (&array, DBUS_TYPE_STRUCT, NULL, &element);
+      append_basic (&element, DBUS_TYPE_INT32, &i);
+      append_basic (&element, DBUS_TYPE_INT32, &i);
+      append_basic (&element, DBUS_TYPE_UINT32, &u);
+      close_container (&array, &element);
+    }
+
+  close_container (iter, &array);
+  append_basic (iter, DBUS_TYPE_STRING, &trailer);
+}
+
+/* Reads every basic value, the way a binding converting a message
+ * into its own types would */
+static int
+walk (DBusMessageIter *iter)
+{
+  int n = 0;
+  int t;
+
+  while ((t = dbus_message_iter_get_arg_type (iter)) != DBUS_TYPE_INVALID)
+    {
+      if (dbus_type_is_container (t))
+        {
+          DBusMessageIter sub;
+
+          dbus_message_iter_recurse (iter, &sub);
+          n += walk (&sub);
+        }
+      else
+        {
+          DBusBasicValue value;
+
+          dbus_message_iter_get_basic (iter, &value);
+          n++;
+        }
+
+      dbus_message_iter_next (iter);
+    }
+
+  return n;
+}
+
+/* Steps over the elements of each container argument without looking
+ * inside them, as a binding does to count them */
+static int
+count (DBusMessageIter *iter)
+{
+  int n = 0;
+
+  do
+    {
+      DBusMessageIter sub;
+
+      if (!dbus_type_is_container (dbus_message_iter_get_arg_type (iter)))
+        continue;
+
+      dbus_message_iter_recurse (iter, &sub);
+
+      while (dbus_message_iter_get_arg_type (&sub) != DBUS_TYPE_INVALID)
+        {
+          n++;
+          dbus_message_iter_next (&sub);
+        }
+    }
+  while (dbus_message_iter_next (iter));
+
+  return n;
+}
+
+static void
+bench (const char *signature,
+       void      (* build) (DBusMessageIter *),
+       long        iterations)
+{
+  DBusMessage *message;
+  DBusMessageIter iter;
+  const DBusString *header, *network_body;
+  DBusString sig;
+  DBusString body;
+  char *data;
+  int len;
+  int compiled;
+
+  message = dbus_message_new_signal ("/", "org.freedesktop.DBus.Benchmark",
+                                     "Sample");
+  if (message == NULL)
+    die ("no memory");
+
+  dbus_message_iter_init_append (message, &iter);
+  (* build) (&iter);
+
+  if (strcmp (dbus_message_get_signature (message), signature) != 0)
+    die ("built the wrong signature");
+
+  dbus_message_set_serial (message, 1);
+
+  if (!dbus_message_marshal (message, &data, &len))
+    die ("no memory");
+
+  /* swap a copy of the body, since the message is locked */
+  dbus_message_lock (message);
+  _dbus_message_get_network_data (message, &header, &network_body);
+
+  if (!_dbus_string_init (&body) ||
+      !_dbus_string_copy (network_body, 0, &body, 0))
+    die ("no memory");
+
+  _dbus_string_init_const (&sig, signature);
+
+  for (compiled = 0; compiled < 2; compiled++)
+    {
+      double start, demarshal_time, swap_time, walk_time, count_time;
+      long i;
+      int n = 0;
+
+      _dbus_signature_program_set_enabled (compiled);
+
+      start = now ();
+
+      for (i = 0; i < iterations; i++)
+        {
+          DBusMessage *copy = dbus_message_demarshal (data, len, NULL);
+
+          if (copy == NULL)
+            die ("could not demarshal");
+
+          dbus_message_unref (copy);
+        }
+
+      demarshal_time = now () - start;
+
+      /* the body is swapped back and forth, so it is in each order
+       * alternately */
+      start = now ();
+
+      for (i = 0; i < iterations; i++)
+        {
+          if (i % 2 == 0)
+            _dbus_marshal_byteswap (&sig, 0, DBUS_LITTLE_ENDIAN,
+                                    DBUS_BIG_ENDIAN, &body, 0);
+          else
+            _dbus_marshal_byteswap (&sig, 0, DBUS_BIG_ENDIAN,
+                                    DBUS_LITTLE_ENDIAN, &body, 0);
+        }
+
+      swap_time = now () - start;
+
+      start = now ();
+
+      for (i = 0; i < iterations; i++)
+        {
+          if (!dbus_message_iter_init (message, &iter))
+            die ("empty message");
+
+          n = walk (&iter);
+        }
+
+      walk_time = now () - start;
+
+      start = now ();
+
+      for (i = 0; i < iterations; i++)
+        {
+          if (!dbus_message_iter_init (message, &iter))
+            die ("empty message");
+
+          count (&iter);
+        }
+
+      count_time = now () - start;
+
+      printf ("%-14s %-9s %6d %12.0f %12.0f %12.0f %12.0f\n",
+              signature, compiled ? "compiled" : "plain", n,
+              demarshal_time * 1e9 / iterations,
+              swap_time * 1e9 / iterations,
+              walk_time * 1e9 / iterations,
+              count_time * 1e9 / iterations);
+    }
+
+  _dbus_signature_program_set_enabled (TRUE);
+  _dbus_string_free (&body);
+  dbus_free (data);
+  dbus_message_unref (message);
+}
+
+int
+main (int argc, char **argv)
+{
+  long iterations = argc > 1 ? atol (argv[1]) : 200000;
+
+  if (iterations < 1)
+    die ("bad arguments");
+
+  printf ("%-14s %-9s %6s %12s %12s %12s %12s\n", "signature", "reader",
+          "values", "demarshal ns", "byteswap ns", "walk ns", "count ns");
+
+  bench ("a{sv}", build_get_all, iterations);
+  bench ("(oa{sa{sv}})", build_managed_object, iterations);
+  bench ("sa{sv}as", build_properties_changed, iterations);
+  bench ("a(iiu)s", build_struct_array, iterations);
+
+  dbus_shutdown ();
+  return 0;
+}
@@ -0,0 +1,206 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/* bench-threads.c  Round trips through one connection from many threads
+ *
+ * Licensed under the Academic Free License version 2.1
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/*
+ * N client threads share one connection and make blocking method calls
+ * on it; a single thread on the other end pops each call and sends the
+ * reply. This is dominated by the connection's mutex, its I/O path and
+ * dispatch handshakes, so it is the benchmark to use when changing the
+ * lock implementation.
+ *
+ * With --io-thread, the client connection's I/O is done by its own
+ * thread (dbus_connection_start_io_thread()) instead of by the callers
+ * taking turns.
+ *
+ * Usage: bench-threads [--io-thread] [TOTAL_CALLS [LISTEN_ADDRESS]]
+ */
+
+#include <config.h>
+#include "test-utils.h"
+
+#include <pthread.h>
+#include <string.h>
+
+#include <dbus/dbus-sysdeps.h>
+
+#define BENCH_INTERFACE "org.freedesktop.DBus.Benchmark"
+
+static DBusConnection *client;
+static DBusConnection *server;
+static int calls_per_thread;
+
+static void
+die (const char *message)
+{
+  fprintf (stderr, "*** bench-threads: %s\n", message);
+  exit (1);
+}
+
+static double
+now (void)
+{
+  long tv_sec, tv_usec;
+
+  _dbus_get_monotonic_time (&tv_sec, &tv_usec);
+
+  return tv_sec + tv_usec / 1000000.0;
+}
+
+static void *
+echo_thread (void *data)
+{
+  dbus_bool_t done = FALSE;
+
+  while (!done && dbus_connection_read_write (server, -1))
+    {
+      DBusMessage *message;
+
+      while ((message = dbus_connection_pop_message (server)) != NULL)
+        {
+          if (dbus_message_is_method_call (message, BENCH_INTERFACE, "Quit"))
+            {
+              done = TRUE;
+            }
+          else if (dbus_message_get_type (message) ==
+                   DBUS_MESSAGE_TYPE_METHOD_CALL)
+            {
+              DBusMessage *reply;
+
+              reply = dbus_message_new_method_return (message);
+              if (reply == NULL || !dbus_connection_send (server, reply, NULL))
+                die ("no memory");
+
+              dbus_message_unref (reply);
+            }
+
+          dbus_message_unref (message);
+        }
+    }
+
+  dbus_connection_flush (server);
+  return NULL;
+}
+
+static void *
+caller_thread (void *data)
+{
+  int i;
+
+  for (i = 0; i < calls_per_thread; i++)
+    {
+      DBusMessage *call, *reply;
+      DBusError error;
+
+      dbus_error_init (&error);
+
+      call = dbus_message_new_method_call (NULL, "/", BENCH_INTERFACE, "Ping");
+      if (call == NULL)
+        die ("no memory");
+
+      reply = dbus_connection_send_with_reply_and_block (client, call, -1,
+                                                         &error);
+      if (reply == NULL)
+        die (error.message);
+
+      dbus_message_unref (reply);
+      dbus_message_unref (call);
+    }
+
+  return NULL;
+}
+
+int
+main (int argc, char **argv)
+{
+  static const int thread_counts[] = { 1, 2, 4, 8, 16, 32 };
+  pthread_t echo, callers[32];
+  DBusMessage *quit;
+  dbus_bool_t io_thread = FALSE;
+  int total_calls;
+  unsigned int i;
+
+  if (argc > 1 && strcmp (argv[1], "--io-thread") == 0)
+    {
+      io_thread = TRUE;
+      argc--;
+      argv++;
+    }
+
+  total_calls = argc > 1 ? atoi (argv[1]) : 20000;
+
+  if (!dbus_threads_init_default ())
+    die ("no memory");
+
+  if (!test_connection_pair_new (argc > 2 ? argv[2] : "unix:tmpdir=/tmp",
+                                 &client, &server))
+    die ("could not set up connections");
+
+  if (io_thread && !dbus_connection_start_io_thread (client))
+    die ("could not start I/O thread");
+
+  pthread_create (&echo, NULL, echo_thread, NULL);
+
+  printf ("%8s %10s %12s %10s\n", "threads", "calls", "calls/sec", "usec/call");
+
+  for (i = 0; i < _DBUS_N_ELEMENTS (thread_counts); i++)
+    {
+      double start, elapsed;
+      int j;
+
+      calls_per_thread = total_calls / thread_counts[i];
+      if (calls_per_thread < 1)
+        calls_per_thread = 1;
+
+      start = now ();
+
+      for (j = 0; j < thread_counts[i]; j++)
+        pthread_create (&callers[j], NULL, caller_thread, NULL);
+
+      for (j = 0; j < thread_counts[i]; j++)
+        pthread_join (callers[j], NULL);
+
+      elapsed = now () - start;
+
+      printf ("%8d %10d %12.0f %10.2f\n", thread_counts[i],
+              calls_per_thread * thread_counts[i],
+              calls_per_thread * thread_counts[i] / elapsed,
+              elapsed * 1000000.0 / (calls_per_thread * thread_counts[i]));
+    }
+
+  quit = dbus_message_new_method_call (NULL, "/", BENCH_INTERFACE, "Quit");
+  if (quit == NULL || !dbus_connection_send (client, quit, NULL))
+    die ("no memory");
+
+  dbus_message_unref (quit);
+  dbus_connection_flush (client);
+  pthread_join (echo, NULL);
+
+  if (io_thread)
+    dbus_connection_stop_io_thread (client);
+
+  dbus_connection_close (client);
+  dbus_connection_unref (client);
+  dbus_connection_close (server);
+  dbus_connection_unref (server);
+
+  dbus_shutdown ();
+  return 0;
+}
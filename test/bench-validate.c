@@ -0,0 +1,186 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/* bench-validate.c  Throughput of the UTF-8 and name validators
+ *
+ * Licensed under the Academic Free License version 2.1
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/*
+ * Validates the same strings over and over with each UTF-8
+ * implementation available on this machine, and times the name
+ * validators on typical header fields.
+ *
+ * Usage: bench-validate [MEGABYTES]
+ */
+
+#include <config.h>
+#include "test-utils.h"
+
+#include <string.h>
+
+#include <dbus/dbus-marshal-validate.h>
+#include <dbus/dbus-string.h>
+#include <dbus/dbus-sysdeps.h>
+
+static const char * const utf8_validators[] =
+{
+  "bytewise", "word", "sse2", "avx2", "neon"
+};
+
+static void
+die (const char *message)
+{
+  fprintf (stderr, "*** bench-validate: %s\n", message);
+  exit (1);
+}
+
+static double
+now (void)
+{
+  long tv_sec, tv_usec;
+
+  _dbus_get_monotonic_time (&tv_sec, &tv_usec);
+
+  return tv_sec + tv_usec / 1000000.0;
+}
+
+/* Fills len bytes with text; non_ascii in 1000 characters are
+ * two-byte sequences */
+static void
+fill_text (DBusString *str,
+           int         len,
+           int         non_ascii)
+{
+  int i = 0;
+
+  while (i < len)
+    {
+      if (len - i >= 2 && (i * 7919) % 1000 < non_ascii)
+        {
+          /* U+00E9 */
+          if (!_dbus_string_append_byte (str, 0xc3) ||
+              !_dbus_string_append_byte (str, 0xa9))
+            die ("no memory");
+
+          i += 2;
+        }
+      else
+        {
+          if (!_dbus_string_append_byte (str, 'a' + i % 26))
+            die ("no memory");
+
+          i++;
+        }
+    }
+}
+
+static void
+bench_utf8 (const char *what,
+            int         len,
+            int         non_ascii,
+            double      megabytes)
+{
+  DBusString str;
+  unsigned int i;
+
+  if (!_dbus_string_init (&str))
+    die ("no memory");
+
+  fill_text (&str, len, non_ascii);
+
+  for (i = 0; i < _DBUS_N_ELEMENTS (utf8_validators); i++)
+    {
+      double start, elapsed;
+      long n, j;
+
+      if (!_dbus_string_set_utf8_validator (utf8_validators[i]))
+        continue;
+
+      n = (long) (megabytes * 1024 * 1024 / len);
+      if (n < 1)
+        n = 1;
+
+      start = now ();
+
+      for (j = 0; j < n; j++)
+        {
+          if (!_dbus_string_validate_utf8 (&str, 0, len))
+            die ("text did not validate");
+        }
+
+      elapsed = now () - start;
+
+      printf ("%-24s %6d %-10s %10.1f MB/s\n", what, len, utf8_validators[i],
+              n * (double) len / elapsed / (1024 * 1024));
+    }
+
+  _dbus_string_set_utf8_validator (NULL);
+  _dbus_string_free (&str);
+}
+
+static void
+bench_name (const char *what,
+            const char *name,
+            dbus_bool_t (* validate) (const DBusString *, int, int))
+{
+  DBusString str;
+  double start, elapsed;
+  long i, n = 10 * 1000 * 1000;
+
+  _dbus_string_init_const (&str, name);
+
+  start = now ();
+
+  for (i = 0; i < n; i++)
+    {
+      if (!(* validate) (&str, 0, _dbus_string_get_length (&str)))
+        die ("name did not validate");
+    }
+
+  elapsed = now () - start;
+
+  printf ("%-24s %-40s %8.1f ns\n", what, name, elapsed * 1e9 / n);
+}
+
+int
+main (int argc, char **argv)
+{
+  double megabytes = argc > 1 ? atof (argv[1]) : 256;
+
+  if (megabytes <= 0)
+    die ("bad arguments");
+
+  bench_utf8 ("ascii", 16, 0, megabytes / 4);
+  bench_utf8 ("ascii", 64, 0, megabytes);
+  bench_utf8 ("ascii", 4096, 0, megabytes);
+  bench_utf8 ("1% non-ascii", 4096, 10, megabytes);
+  bench_utf8 ("10% non-ascii", 4096, 100, megabytes);
+  bench_utf8 ("all non-ascii", 4096, 1000, megabytes / 4);
+
+  printf ("\n");
+
+  bench_name ("path", "/org/freedesktop/NetworkManager/Devices/0",
+              _dbus_validate_path);
+  bench_name ("interface", "org.freedesktop.DBus.Properties",
+              _dbus_validate_interface);
+  bench_name ("member", "PropertiesChanged", _dbus_validate_member);
+  bench_name ("bus name", "org.freedesktop.NetworkManager",
+              _dbus_validate_bus_name);
+  bench_name ("unique name", ":1.2345", _dbus_validate_bus_name);
+
+  return 0;
+}
@@ -0,0 +1,358 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/* dispatch-workers.c  Tests for dbus_connection_start_dispatch_workers()
+ *
+ * Licensed under the Academic Free License version 2.1
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <config.h>
+#include "test-utils.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+
+#define TEST_INTERFACE "org.freedesktop.DBus.TestSuite.DispatchWorkers"
+#define N_WORKERS 4
+#define MAX_QUEUED 8
+#define N_OBJECTS 8
+#define N_CALLS 400
+/* how long the slow handler waits to be released before giving up */
+#define SLOW_TIMEOUT 10
+
+static DBusConnection *client;
+static DBusConnection *server;
+static pthread_t server_thread;
+
+static pthread_mutex_t slow_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t slow_cond = PTHREAD_COND_INITIALIZER;
+static dbus_bool_t slow_released = FALSE;
+static dbus_bool_t slow_timed_out = FALSE;
+
+/* only ever touched by the one worker each object is assigned to */
+static dbus_int32_t next_handled[N_OBJECTS];
+static dbus_int32_t next_reply[N_OBJECTS];
+static int n_replies = 0;
+static dbus_bool_t handled_on_dispatch_thread = FALSE;
+
+static void
+die (const char *message)
+{
+  fprintf (stderr, "*** test-dispatch-workers: %s\n", message);
+  exit (1);
+}
+
+static void
+reply_int32 (DBusConnection *connection,
+             DBusMessage    *message,
+             dbus_int32_t    value)
+{
+  DBusMessage *reply;
+
+  reply = dbus_message_new_method_return (message);
+  if (reply == NULL ||
+      !dbus_message_append_args (reply,
+                                 DBUS_TYPE_INT32, &value,
+                                 DBUS_TYPE_INVALID) ||
+      !dbus_connection_send (connection, reply, NULL))
+    die ("no memory");
+
+  dbus_message_unref (reply);
+}
+
+/* Blocks until the client has had a reply from some other object, or
+ * gives up after a while */
+static DBusHandlerResult
+slow_message (DBusConnection *connection,
+              DBusMessage    *message,
+              void           *data)
+{
+  struct timespec deadline;
+
+  if (!dbus_message_is_method_call (message, TEST_INTERFACE, "Block"))
+    return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+
+  clock_gettime (CLOCK_REALTIME, &deadline);
+  deadline.tv_sec += SLOW_TIMEOUT;
+
+  pthread_mutex_lock (&slow_mutex);
+
+  while (!slow_released && !slow_timed_out)
+    {
+      if (pthread_cond_timedwait (&slow_cond, &slow_mutex,
+                                  &deadline) == ETIMEDOUT)
+        slow_timed_out = TRUE;
+    }
+
+  pthread_mutex_unlock (&slow_mutex);
+
+  reply_int32 (connection, message, 0);
+  return DBUS_HANDLER_RESULT_HANDLED;
+}
+
+/* Replies to Echo on /obj/N with its argument, which must be the next
+ * in sequence for that object */
+static DBusHandlerResult
+object_message (DBusConnection *connection,
+                DBusMessage    *message,
+                void           *data)
+{
+  dbus_int32_t object, seq;
+
+  if (!dbus_message_is_method_call (message, TEST_INTERFACE, "Echo"))
+    return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+
+  if (!dbus_message_get_args (message, NULL,
+                              DBUS_TYPE_INT32, &object,
+                              DBUS_TYPE_INT32, &seq,
+                              DBUS_TYPE_INVALID) ||
+      object < 0 || object >= N_OBJECTS)
+    die ("bad Echo call");
+
+  if (seq != next_handled[object]++)
+    die ("calls to one object were handled out of order");
+
+  if (pthread_equal (pthread_self (), server_thread))
+    handled_on_dispatch_thread = TRUE;
+
+  reply_int32 (connection, message, seq);
+  return DBUS_HANDLER_RESULT_HANDLED;
+}
+
+static const DBusObjectPathVTable slow_vtable = {
+  NULL, slow_message
+};
+
+static const DBusObjectPathVTable object_vtable = {
+  NULL, object_message
+};
+
+static void *
+server_main (void *data)
+{
+  while (dbus_connection_read_write_dispatch (server, -1))
+    ;
+
+  return NULL;
+}
+
+static void
+release_slow (void)
+{
+  pthread_mutex_lock (&slow_mutex);
+  slow_released = TRUE;
+  pthread_cond_signal (&slow_cond);
+  pthread_mutex_unlock (&slow_mutex);
+}
+
+static void
+echo_reply_received (DBusPendingCall *pending,
+                     void            *data)
+{
+  DBusMessage *reply;
+  dbus_int32_t object = (long) data;
+  dbus_int32_t seq;
+
+  reply = dbus_pending_call_steal_reply (pending);
+
+  if (reply == NULL ||
+      !dbus_message_get_args (reply, NULL,
+                              DBUS_TYPE_INT32, &seq,
+                              DBUS_TYPE_INVALID))
+    die ("unexpected reply");
+
+  if (seq != next_reply[object]++)
+    die ("replies from one object arrived out of order");
+
+  dbus_message_unref (reply);
+
+  /* something got through while the slow handler was busy */
+  if (n_replies++ == 0)
+    release_slow ();
+}
+
+static DBusPendingCall *
+send_call (const char  *path,
+           const char  *method,
+           dbus_int32_t object,
+           dbus_int32_t seq)
+{
+  DBusMessage *message;
+  DBusPendingCall *pending;
+
+  message = dbus_message_new_method_call (NULL, path, TEST_INTERFACE, method);
+  if (message == NULL ||
+      (object >= 0 &&
+       !dbus_message_append_args (message,
+                                  DBUS_TYPE_INT32, &object,
+                                  DBUS_TYPE_INT32, &seq,
+                                  DBUS_TYPE_INVALID)) ||
+      !dbus_connection_send_with_reply (client, message, &pending,
+                                        DBUS_TIMEOUT_INFINITE) ||
+      pending == NULL)
+    die ("no memory");
+
+  dbus_message_unref (message);
+  return pending;
+}
+
+static void
+test_parallel (void)
+{
+  DBusPendingCall *slow;
+  DBusMessage *reply;
+  char path[32];
+  int i;
+
+  slow = send_call ("/slow", "Block", -1, 0);
+
+  for (i = 0; i < N_CALLS; i++)
+    {
+      DBusPendingCall *pending;
+      dbus_int32_t object = i % N_OBJECTS;
+
+      snprintf (path, sizeof (path), "/obj/%d", object);
+      pending = send_call (path, "Echo", object, i / N_OBJECTS);
+
+      if (!dbus_pending_call_set_notify (pending, echo_reply_received,
+                                         (void *) (long) object, NULL))
+        die ("no memory");
+
+      dbus_pending_call_unref (pending);
+    }
+
+  while (n_replies < N_CALLS || !dbus_pending_call_get_completed (slow))
+    {
+      if (!dbus_connection_read_write_dispatch (client, -1))
+        die ("disconnected");
+    }
+
+  reply = dbus_pending_call_steal_reply (slow);
+  if (reply == NULL ||
+      dbus_message_get_type (reply) != DBUS_MESSAGE_TYPE_METHOD_RETURN)
+    die ("Block failed");
+
+  dbus_message_unref (reply);
+  dbus_pending_call_unref (slow);
+
+  if (slow_timed_out)
+    die ("a slow handler held up calls to other objects");
+
+  if (handled_on_dispatch_thread)
+    die ("handler ran on the dispatching thread");
+
+  printf ("ok - %d calls served while another object was busy\n", N_CALLS);
+  printf ("ok - calls to each object handled in order\n");
+}
+
+static void
+test_unknown_object (void)
+{
+  DBusPendingCall *pending;
+  DBusMessage *reply;
+
+  pending = send_call ("/nowhere", "Echo", -1, 0);
+  dbus_pending_call_block (pending);
+  reply = dbus_pending_call_steal_reply (pending);
+
+  if (reply == NULL ||
+      (!dbus_message_is_error (reply, DBUS_ERROR_UNKNOWN_METHOD) &&
+       !dbus_message_is_error (reply, DBUS_ERROR_UNKNOWN_OBJECT)))
+    die ("expected an UnknownMethod error");
+
+  dbus_message_unref (reply);
+  dbus_pending_call_unref (pending);
+
+  printf ("ok - unhandled calls get an error from the worker\n");
+}
+
+static void
+test_stop (void)
+{
+  DBusPendingCall *pending;
+  DBusMessage *reply;
+
+  dbus_connection_stop_dispatch_workers (server);
+
+  pending = send_call ("/obj/0", "Echo", 0, next_handled[0]);
+  next_reply[0]++;
+  dbus_pending_call_block (pending);
+  reply = dbus_pending_call_steal_reply (pending);
+
+  if (reply == NULL ||
+      dbus_message_get_type (reply) != DBUS_MESSAGE_TYPE_METHOD_RETURN)
+    die ("Echo failed after stopping the workers");
+
+  if (!handled_on_dispatch_thread)
+    die ("handler did not run on the dispatching thread");
+
+  dbus_message_unref (reply);
+  dbus_pending_call_unref (pending);
+
+  printf ("ok - handlers run in dispatch after stopping\n");
+
+  /* and the workers can be started again */
+  if (!dbus_connection_start_dispatch_workers (server, N_WORKERS, 0))
+    die ("could not restart the workers");
+
+  printf ("ok - restart\n");
+}
+
+int
+main (int argc, char **argv)
+{
+  if (!dbus_threads_init_default ())
+    die ("no memory");
+
+  if (!test_connection_pair_new ("unix:tmpdir=/tmp", &client, &server))
+    die ("could not set up connections");
+
+  if (!dbus_connection_register_object_path (server, "/slow", &slow_vtable,
+                                             NULL) ||
+      !dbus_connection_register_fallback (server, "/obj", &object_vtable,
+                                          NULL))
+    die ("no memory");
+
+  /* so that replies from the workers are written while the server
+   * thread is blocked waiting for more to dispatch */
+  if (!dbus_connection_start_io_thread (server))
+    die ("could not start the I/O thread");
+
+  if (!dbus_connection_start_dispatch_workers (server, N_WORKERS,
+                                               MAX_QUEUED))
+    die ("could not start the workers");
+
+  pthread_create (&server_thread, NULL, server_main, NULL);
+
+  test_parallel ();
+  test_unknown_object ();
+  test_stop ();
+
+  /* the workers exit by themselves when the connection goes away */
+  dbus_connection_close (client);
+  pthread_join (server_thread, NULL);
+
+  printf ("ok - disconnect\n");
+
+  dbus_connection_stop_dispatch_workers (server);
+  dbus_connection_unref (client);
+  dbus_connection_unref (server);
+
+  dbus_shutdown ();
+  return 0;
+}
@@ -0,0 +1,270 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/* io-thread.c  Tests for dbus_connection_start_io_thread()
+ *
+ * Licensed under the Academic Free License version 2.1
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <config.h>
+#include "test-utils.h"
+
+#include <pthread.h>
+#include <string.h>
+
+#define TEST_INTERFACE "org.freedesktop.DBus.TestSuite.IOThread"
+#define N_THREADS 8
+#define N_CALLS 500
+
+static DBusConnection *client;
+static DBusConnection *server;
+
+static void
+die (const char *message)
+{
+  fprintf (stderr, "*** test-io-thread: %s\n", message);
+  exit (1);
+}
+
+/* Replies to Echo with its arguments, ignores anything it does not
+ * know, and closes the connection without replying when asked to
+ * Disconnect. */
+static void *
+echo_thread (void *data)
+{
+  dbus_bool_t done = FALSE;
+
+  while (!done && dbus_connection_read_write (server, -1))
+    {
+      DBusMessage *message;
+
+      while (!done && (message = dbus_connection_pop_message (server)) != NULL)
+        {
+          if (dbus_message_is_method_call (message, TEST_INTERFACE, "Echo"))
+            {
+              DBusMessage *reply;
+              dbus_int32_t thread, call;
+
+              reply = dbus_message_new_method_return (message);
+              if (reply == NULL ||
+                  !dbus_message_get_args (message, NULL,
+                                          DBUS_TYPE_INT32, &thread,
+                                          DBUS_TYPE_INT32, &call,
+                                          DBUS_TYPE_INVALID) ||
+                  !dbus_message_append_args (reply,
+                                             DBUS_TYPE_INT32, &thread,
+                                             DBUS_TYPE_INT32, &call,
+                                             DBUS_TYPE_INVALID) ||
+                  !dbus_connection_send (server, reply, NULL))
+                die ("could not echo");
+
+              dbus_message_unref (reply);
+            }
+          else if (dbus_message_is_method_call (message, TEST_INTERFACE,
+                                                "Disconnect"))
+            {
+              dbus_connection_close (server);
+              done = TRUE;
+            }
+          else if (dbus_message_is_method_call (message, TEST_INTERFACE,
+                                                "Quit"))
+            {
+              done = TRUE;
+            }
+
+          dbus_message_unref (message);
+        }
+    }
+
+  dbus_connection_flush (server);
+  return NULL;
+}
+
+static void *
+caller_thread (void *data)
+{
+  dbus_int32_t thread = (dbus_int32_t) (long) data;
+  dbus_int32_t call;
+
+  for (call = 0; call < N_CALLS; call++)
+    {
+      DBusMessage *message, *reply;
+      dbus_int32_t reply_thread, reply_call;
+      DBusError error;
+
+      dbus_error_init (&error);
+
+      message = dbus_message_new_method_call (NULL, "/", TEST_INTERFACE,
+                                              "Echo");
+      if (message == NULL ||
+          !dbus_message_append_args (message,
+                                     DBUS_TYPE_INT32, &thread,
+                                     DBUS_TYPE_INT32, &call,
+                                     DBUS_TYPE_INVALID))
+        die ("no memory");
+
+      reply = dbus_connection_send_with_reply_and_block (client, message,
+                                                         DBUS_TIMEOUT_INFINITE,
+                                                         &error);
+      if (reply == NULL)
+        die (error.message);
+
+      /* each caller must get its own reply, not a neighbour's */
+      if (!dbus_message_get_args (reply, NULL,
+                                  DBUS_TYPE_INT32, &reply_thread,
+                                  DBUS_TYPE_INT32, &reply_call,
+                                  DBUS_TYPE_INVALID) ||
+          reply_thread != thread || reply_call != call)
+        die ("got the wrong reply");
+
+      dbus_message_unref (reply);
+      dbus_message_unref (message);
+    }
+
+  return NULL;
+}
+
+static void
+run_callers (void)
+{
+  pthread_t callers[N_THREADS];
+  long i;
+
+  for (i = 0; i < N_THREADS; i++)
+    pthread_create (&callers[i], NULL, caller_thread, (void *) i);
+
+  for (i = 0; i < N_THREADS; i++)
+    pthread_join (callers[i], NULL);
+}
+
+static void
+send_method (const char *method)
+{
+  DBusMessage *message;
+
+  message = dbus_message_new_method_call (NULL, "/", TEST_INTERFACE, method);
+  if (message == NULL || !dbus_connection_send (client, message, NULL))
+    die ("no memory");
+
+  dbus_message_unref (message);
+}
+
+static void
+test_blocking_calls (void)
+{
+  run_callers ();
+  printf ("ok - blocking calls from %d threads\n", N_THREADS);
+}
+
+static void
+test_flush (void)
+{
+  int i;
+
+  /* The server ignores these, so all flush has to wait for is the
+   * I/O thread writing them out.
+   */
+  for (i = 0; i < 100; i++)
+    send_method ("Signal");
+
+  dbus_connection_flush (client);
+
+  if (dbus_connection_has_messages_to_send (client))
+    die ("flush returned with messages still queued");
+
+  printf ("ok - flush\n");
+}
+
+static void
+test_restart (void)
+{
+  dbus_connection_stop_io_thread (client);
+
+  /* Without the I/O thread the callers go back to taking turns */
+  run_callers ();
+
+  if (!dbus_connection_start_io_thread (client))
+    die ("could not restart I/O thread");
+
+  run_callers ();
+  printf ("ok - stop and restart\n");
+}
+
+static void
+test_disconnect (void)
+{
+  DBusMessage *message, *reply;
+  DBusError error;
+
+  dbus_error_init (&error);
+
+  message = dbus_message_new_method_call (NULL, "/", TEST_INTERFACE,
+                                          "Disconnect");
+  if (message == NULL)
+    die ("no memory");
+
+  /* The server hangs up instead of replying; we must be woken */
+  reply = dbus_connection_send_with_reply_and_block (client, message,
+                                                     DBUS_TIMEOUT_INFINITE,
+                                                     &error);
+  if (reply != NULL || !dbus_error_is_set (&error))
+    die ("expected an error when the peer disconnected");
+
+  dbus_error_free (&error);
+  dbus_message_unref (message);
+
+  /* The I/O thread exits by itself; stopping it just waits for that */
+  dbus_connection_stop_io_thread (client);
+
+  if (dbus_connection_get_is_connected (client))
+    die ("still connected");
+
+  if (dbus_connection_start_io_thread (client))
+    die ("started an I/O thread on a disconnected connection");
+
+  printf ("ok - disconnect\n");
+}
+
+int
+main (int argc, char **argv)
+{
+  pthread_t echo;
+
+  if (!dbus_threads_init_default ())
+    die ("no memory");
+
+  if (!test_connection_pair_new ("unix:tmpdir=/tmp", &client, &server))
+    die ("could not set up connections");
+
+  if (!dbus_connection_start_io_thread (client))
+    die ("could not start I/O thread");
+
+  pthread_create (&echo, NULL, echo_thread, NULL);
+
+  test_blocking_calls ();
+  test_flush ();
+  test_restart ();
+  test_disconnect ();
+
+  pthread_join (echo, NULL);
+
+  dbus_connection_close (client);
+  dbus_connection_unref (client);
+  dbus_connection_unref (server);
+
+  dbus_shutdown ();
+  return 0;
+}
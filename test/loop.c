@@ -0,0 +1,409 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/* loop.c  Tests for the public DBusLoop API
+ *
+ * Licensed under the Academic Free License version 2.1
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <config.h>
+
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <dbus/dbus.h>
+
+#define TEST_INTERFACE "org.freedesktop.DBus.TestSuite.Loop"
+#define N_CLIENTS 4
+#define N_CALLS 100
+#define N_TICKS 3
+
+static DBusLoop *loop;
+static DBusConnection *clients[N_CLIENTS];
+static DBusConnection *accepted[N_CLIENTS];
+static int n_accepted = 0;
+static int n_replies = 0;
+static int n_ticks = 0;
+static int n_idles = 0;
+static int n_reads = 0;
+static int n_freed = 0;
+static dbus_bool_t running = FALSE;
+
+static void
+die (const char *message)
+{
+  fprintf (stderr, "*** test-loop: %s\n", message);
+  exit (1);
+}
+
+static void
+maybe_quit (void)
+{
+  if (running &&
+      n_replies == N_CLIENTS * N_CALLS &&
+      n_ticks == N_TICKS &&
+      n_idles == 1 &&
+      n_reads == 1)
+    dbus_loop_quit (loop);
+}
+
+static void
+count_freed (void *data)
+{
+  n_freed++;
+}
+
+static DBusHandlerResult
+echo_filter (DBusConnection *connection,
+             DBusMessage    *message,
+             void           *data)
+{
+  DBusMessage *reply;
+  dbus_int32_t value;
+
+  if (!dbus_message_is_method_call (message, TEST_INTERFACE, "Echo"))
+    return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+
+  reply = dbus_message_new_method_return (message);
+  if (reply == NULL ||
+      !dbus_message_get_args (message, NULL,
+                              DBUS_TYPE_INT32, &value,
+                              DBUS_TYPE_INVALID) ||
+      !dbus_message_append_args (reply,
+                                 DBUS_TYPE_INT32, &value,
+                                 DBUS_TYPE_INVALID) ||
+      !dbus_connection_send (connection, reply, NULL))
+    die ("could not reply");
+
+  dbus_message_unref (reply);
+  return DBUS_HANDLER_RESULT_HANDLED;
+}
+
+static void
+new_connection (DBusServer     *server,
+                DBusConnection *connection,
+                void           *data)
+{
+  if (n_accepted >= N_CLIENTS)
+    die ("too many connections");
+
+  if (!dbus_connection_add_filter (connection, echo_filter, NULL, NULL) ||
+      !dbus_loop_add_connection (loop, connection))
+    die ("no memory");
+
+  accepted[n_accepted++] = dbus_connection_ref (connection);
+}
+
+static void
+reply_received (DBusPendingCall *pending,
+                void            *data)
+{
+  DBusMessage *reply;
+  dbus_int32_t value;
+
+  reply = dbus_pending_call_steal_reply (pending);
+
+  if (reply == NULL ||
+      !dbus_message_get_args (reply, NULL,
+                              DBUS_TYPE_INT32, &value,
+                              DBUS_TYPE_INVALID) ||
+      value != (dbus_int32_t) (long) data)
+    die ("got the wrong reply");
+
+  dbus_message_unref (reply);
+  n_replies++;
+  maybe_quit ();
+}
+
+static void
+tick (DBusLoopSource *source,
+      void           *data)
+{
+  if (++n_ticks == N_TICKS)
+    dbus_loop_remove_source (source);
+
+  maybe_quit ();
+}
+
+static void
+idle (DBusLoopSource *source,
+      void           *data)
+{
+  /* runs once, then goes away */
+  n_idles++;
+  dbus_loop_remove_source (source);
+  maybe_quit ();
+}
+
+static void
+readable (DBusLoopSource *source,
+          int             fd,
+          unsigned int    condition,
+          void           *data)
+{
+  char c;
+
+  if (!(condition & DBUS_WATCH_READABLE) || read (fd, &c, 1) != 1)
+    die ("fd was not readable");
+
+  n_reads++;
+  dbus_loop_remove_source (source);
+  maybe_quit ();
+}
+
+static void
+timed_out (DBusLoopSource *source,
+           void           *data)
+{
+  die ("timed out");
+}
+
+static void
+send_calls (DBusConnection *connection)
+{
+  long i;
+
+  for (i = 0; i < N_CALLS; i++)
+    {
+      DBusMessage *message;
+      DBusPendingCall *pending;
+      dbus_int32_t value = i;
+
+      message = dbus_message_new_method_call (NULL, "/", TEST_INTERFACE,
+                                              "Echo");
+      if (message == NULL ||
+          !dbus_message_append_args (message,
+                                     DBUS_TYPE_INT32, &value,
+                                     DBUS_TYPE_INVALID) ||
+          !dbus_connection_send_with_reply (connection, message, &pending,
+                                            DBUS_TIMEOUT_INFINITE) ||
+          pending == NULL ||
+          !dbus_pending_call_set_notify (pending, reply_received,
+                                         (void *) i, NULL))
+        die ("no memory");
+
+      dbus_pending_call_unref (pending);
+      dbus_message_unref (message);
+    }
+}
+
+static void
+test_run (void)
+{
+  DBusServer *server;
+  DBusLoopSource *watchdog;
+  DBusError error;
+  char *address;
+  int fds[2];
+  int i;
+
+  dbus_error_init (&error);
+
+  loop = dbus_loop_new ();
+  if (loop == NULL)
+    die ("no memory");
+
+  server = dbus_server_listen ("unix:tmpdir=/tmp", &error);
+  if (server == NULL)
+    die (error.message);
+
+  dbus_server_set_new_connection_function (server, new_connection,
+                                           NULL, NULL);
+
+  if (!dbus_loop_add_server (loop, server))
+    die ("no memory");
+
+  address = dbus_server_get_address (server);
+  if (address == NULL)
+    die ("no memory");
+
+  /* all the connections, both ends, run on the one loop */
+  for (i = 0; i < N_CLIENTS; i++)
+    {
+      clients[i] = dbus_connection_open_private (address, &error);
+      if (clients[i] == NULL)
+        die (error.message);
+
+      if (!dbus_loop_add_connection (loop, clients[i]))
+        die ("no memory");
+
+      send_calls (clients[i]);
+    }
+
+  dbus_free (address);
+
+  if (pipe (fds) < 0 || write (fds[1], "x", 1) != 1)
+    die ("could not make a pipe");
+
+  if (dbus_loop_add_fd (loop, fds[0], DBUS_WATCH_READABLE, readable,
+                        NULL, count_freed) == NULL ||
+      dbus_loop_add_timer (loop, 10, tick, NULL, count_freed) == NULL ||
+      dbus_loop_add_idle (loop, idle, NULL, count_freed) == NULL)
+    die ("no memory");
+
+  watchdog = dbus_loop_add_timer (loop, 60 * 1000, timed_out, NULL, NULL);
+  if (watchdog == NULL)
+    die ("no memory");
+
+  running = TRUE;
+  dbus_loop_run (loop);
+  running = FALSE;
+
+  if (n_accepted != N_CLIENTS)
+    die ("not all connections were accepted");
+
+  if (n_freed != 3)
+    die ("source data was not freed");
+
+  printf ("ok - %d calls on each of %d connections\n", N_CALLS, N_CLIENTS);
+  printf ("ok - fd, timer and idle sources\n");
+
+  dbus_loop_remove_source (watchdog);
+
+  for (i = 0; i < N_CLIENTS; i++)
+    {
+      dbus_loop_remove_connection (loop, clients[i]);
+      dbus_connection_close (clients[i]);
+      dbus_connection_unref (clients[i]);
+
+      dbus_loop_remove_connection (loop, accepted[i]);
+      dbus_connection_close (accepted[i]);
+      dbus_connection_unref (accepted[i]);
+    }
+
+  dbus_loop_remove_server (loop, server);
+  dbus_server_disconnect (server);
+  dbus_server_unref (server);
+
+  dbus_loop_unref (loop);
+  close (fds[0]);
+  close (fds[1]);
+}
+
+static void
+count_tick (DBusLoopSource *source,
+            void           *data)
+{
+  if (++n_ticks == N_TICKS)
+    dbus_loop_remove_source (source);
+}
+
+/* Drives a loop from poll() on its one fd, as a program with its own
+ * main loop would */
+static void
+test_process (void)
+{
+  DBusServer *server;
+  DBusConnection *client;
+  DBusError error;
+  struct pollfd pfd;
+  char *address;
+  int n_processed;
+
+  dbus_error_init (&error);
+  n_accepted = 0;
+  n_replies = 0;
+  n_ticks = 0;
+
+  loop = dbus_loop_new ();
+  if (loop == NULL)
+    die ("no memory");
+
+  pfd.fd = dbus_loop_get_fd (loop);
+  pfd.events = POLLIN;
+
+  if (pfd.fd < 0)
+    {
+      printf ("ok # SKIP no loop fd on this platform\n");
+      dbus_loop_unref (loop);
+      return;
+    }
+
+  server = dbus_server_listen ("unix:tmpdir=/tmp", &error);
+  if (server == NULL)
+    die (error.message);
+
+  dbus_server_set_new_connection_function (server, new_connection,
+                                           NULL, NULL);
+
+  address = dbus_server_get_address (server);
+  if (address == NULL || !dbus_loop_add_server (loop, server))
+    die ("no memory");
+
+  client = dbus_connection_open_private (address, &error);
+  if (client == NULL)
+    die (error.message);
+
+  dbus_free (address);
+
+  if (!dbus_loop_add_connection (loop, client) ||
+      dbus_loop_add_timer (loop, 10, count_tick, NULL, NULL) == NULL)
+    die ("no memory");
+
+  send_calls (client);
+
+  n_processed = 0;
+
+  while (n_replies < N_CALLS || n_ticks < N_TICKS)
+    {
+      if (poll (&pfd, 1, 60 * 1000) != 1)
+        die ("timed out waiting for the loop fd");
+
+      dbus_loop_process (loop, 1);
+      n_processed++;
+    }
+
+  /* each call and each reply was dispatched on its own */
+  if (n_processed < 2 * N_CALLS)
+    die ("dispatched more than the budget");
+
+  printf ("ok - %d calls driven from the loop fd\n", N_CALLS);
+
+  while (dbus_loop_process (loop, -1))
+    ;
+
+  /* nothing left to do, so nothing to wake up for */
+  if (poll (&pfd, 1, 0) != 0)
+    die ("loop fd readable when idle");
+
+  printf ("ok - loop fd is quiet when idle\n");
+
+  dbus_loop_remove_connection (loop, client);
+  dbus_connection_close (client);
+  dbus_connection_unref (client);
+
+  dbus_loop_remove_connection (loop, accepted[0]);
+  dbus_connection_close (accepted[0]);
+  dbus_connection_unref (accepted[0]);
+
+  dbus_loop_remove_server (loop, server);
+  dbus_server_disconnect (server);
+  dbus_server_unref (server);
+
+  dbus_loop_unref (loop);
+}
+
+int
+main (int argc, char **argv)
+{
+  test_run ();
+  test_process ();
+
+  dbus_shutdown ();
+  return 0;
+}
@@ -207,5 +207,19 @@ main (int argc,
       test_message, teardown);
 #endif
 
+#ifdef __linux__
+  g_test_add ("/connect/unixpacket", Fixture, "unixpacket:tmpdir=/tmp", setup,
+      test_connect, teardown);
+  g_test_add ("/message/unixpacket", Fixture, "unixpacket:tmpdir=/tmp", setup,
+      test_message, teardown);
+#endif
+
+#if defined(HAVE_MEMFD_CREATE) && defined(HAVE_EVENTFD)
+  g_test_add ("/connect/shm", Fixture, "shm:tmpdir=/tmp", setup,
+      test_connect, teardown);
+  g_test_add ("/message/shm", Fixture, "shm:tmpdir=/tmp", setup,
+      test_message, teardown);
+#endif
+
   return g_test_run ();
 }
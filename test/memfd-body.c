@@ -0,0 +1,393 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/* memfd-body.c  Tests for passing large message bodies in memfds
+ *
+ * Licensed under the Academic Free License version 2.1
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <config.h>
+#include "test-utils.h"
+
+#include <pthread.h>
+#include <string.h>
+
+#define DBUS_COMPILATION
+#include <dbus/dbus-message-internal.h>
+#undef DBUS_COMPILATION
+
+#ifdef DBUS_HAVE_MEMFD_BODIES
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define TEST_INTERFACE "org.freedesktop.DBus.TestSuite.MemfdBody"
+#define SMALL_MESSAGE_SIZE 16
+#define BIG_MESSAGE_SIZE (1024 * 1024)
+
+static DBusConnection *client;
+static DBusConnection *server;
+
+static void
+die (const char *message)
+{
+  fprintf (stderr, "*** test-memfd-body: %s\n", message);
+  exit (1);
+}
+
+static dbus_uint64_t
+memfd_inode (DBusMessage *message)
+{
+  struct stat sb;
+  int fd;
+
+  fd = _dbus_message_get_body_memfd (message);
+  if (fd < 0 || fstat (fd, &sb) < 0)
+    return 0;
+
+  return sb.st_ino;
+}
+
+/* Replies to Echo with whether the body came in a memfd and the bytes
+ * it was sent, after checking the unix fd it may also carry. */
+static DBusMessage *
+echo (DBusMessage *message)
+{
+  DBusMessage *reply;
+  DBusMessageIter iter;
+  const unsigned char *bytes;
+  int n_bytes;
+  dbus_bool_t in_memfd;
+  int fd;
+
+  dbus_message_iter_init (message, &iter);
+
+  if (dbus_message_iter_get_arg_type (&iter) == DBUS_TYPE_UNIX_FD)
+    {
+      struct stat sb;
+
+      dbus_message_iter_get_basic (&iter, &fd);
+      if (fd < 0 || fstat (fd, &sb) < 0 || !S_ISFIFO (sb.st_mode))
+        die ("unix fd did not arrive with the body");
+
+      close (fd);
+      dbus_message_iter_next (&iter);
+    }
+
+  if (dbus_message_iter_get_arg_type (&iter) != DBUS_TYPE_ARRAY)
+    die ("unexpected arguments");
+
+  dbus_message_iter_recurse (&iter, &iter);
+  dbus_message_iter_get_fixed_array (&iter, &bytes, &n_bytes);
+
+  in_memfd = _dbus_message_get_body_memfd (message) >= 0;
+
+  reply = dbus_message_new_method_return (message);
+  if (reply == NULL ||
+      !dbus_message_append_args (reply,
+                                 DBUS_TYPE_BOOLEAN, &in_memfd,
+                                 DBUS_TYPE_ARRAY, DBUS_TYPE_BYTE,
+                                 &bytes, n_bytes,
+                                 DBUS_TYPE_INVALID))
+    die ("could not echo");
+
+  return reply;
+}
+
+/* Forwarded messages go back to the client as they are, as the bus
+ * would pass them on, followed by the inode of the memfd they came in
+ * so that the client can check it got the same one. */
+static void
+forward (DBusMessage *message)
+{
+  DBusMessage *inode;
+  dbus_uint64_t ino;
+
+  ino = memfd_inode (message);
+
+  inode = dbus_message_new_signal ("/", TEST_INTERFACE, "Inode");
+  if (inode == NULL ||
+      !dbus_message_append_args (inode,
+                                 DBUS_TYPE_UINT64, &ino,
+                                 DBUS_TYPE_INVALID) ||
+      !dbus_connection_send (server, message, NULL) ||
+      !dbus_connection_send (server, inode, NULL))
+    die ("no memory");
+
+  dbus_message_unref (inode);
+}
+
+static void *
+echo_thread (void *data)
+{
+  dbus_bool_t done = FALSE;
+
+  while (!done && dbus_connection_read_write (server, -1))
+    {
+      DBusMessage *message;
+
+      while (!done && (message = dbus_connection_pop_message (server)) != NULL)
+        {
+          if (dbus_message_is_method_call (message, TEST_INTERFACE, "Echo"))
+            {
+              DBusMessage *reply = echo (message);
+
+              if (!dbus_connection_send (server, reply, NULL))
+                die ("no memory");
+
+              dbus_message_unref (reply);
+            }
+          else if (dbus_message_is_method_call (message, TEST_INTERFACE,
+                                                "Forward"))
+            {
+              forward (message);
+            }
+          else if (dbus_message_is_method_call (message, TEST_INTERFACE,
+                                                "Disconnect"))
+            {
+              dbus_connection_close (server);
+              done = TRUE;
+            }
+
+          dbus_message_unref (message);
+        }
+    }
+
+  dbus_connection_flush (server);
+  return NULL;
+}
+
+static unsigned char *
+new_bytes (int n_bytes)
+{
+  unsigned char *bytes;
+  int i;
+
+  bytes = dbus_malloc (n_bytes);
+  if (bytes == NULL)
+    die ("no memory");
+
+  for (i = 0; i < n_bytes; i++)
+    bytes[i] = (i * 7) ^ (i >> 11);
+
+  return bytes;
+}
+
+static DBusMessage *
+new_call (const char          *method,
+          const unsigned char *bytes,
+          int                  n_bytes,
+          int                  fd)
+{
+  DBusMessage *message;
+
+  message = dbus_message_new_method_call (NULL, "/", TEST_INTERFACE, method);
+  if (message == NULL)
+    die ("no memory");
+
+  if (fd >= 0 &&
+      !dbus_message_append_args (message,
+                                 DBUS_TYPE_UNIX_FD, &fd,
+                                 DBUS_TYPE_INVALID))
+    die ("no memory");
+
+  if (!dbus_message_append_args (message,
+                                 DBUS_TYPE_ARRAY, DBUS_TYPE_BYTE,
+                                 &bytes, n_bytes,
+                                 DBUS_TYPE_INVALID))
+    die ("no memory");
+
+  return message;
+}
+
+static void
+check_bytes (DBusMessage         *message,
+             DBusMessageIter     *iter,
+             const unsigned char *expected,
+             int                  n_expected)
+{
+  const unsigned char *bytes;
+  int n_bytes;
+
+  if (dbus_message_iter_get_arg_type (iter) != DBUS_TYPE_ARRAY)
+    die ("no bytes");
+
+  dbus_message_iter_recurse (iter, iter);
+  dbus_message_iter_get_fixed_array (iter, &bytes, &n_bytes);
+
+  if (n_bytes != n_expected || memcmp (bytes, expected, n_bytes) != 0)
+    die ("body was corrupted");
+}
+
+static void
+test_echo (int         n_bytes,
+           dbus_bool_t with_fd,
+           dbus_bool_t expect_memfd)
+{
+  DBusMessage *message, *reply;
+  DBusMessageIter iter;
+  DBusError error;
+  unsigned char *bytes;
+  dbus_bool_t in_memfd;
+  int fds[2] = { -1, -1 };
+
+  dbus_error_init (&error);
+
+  if (with_fd && pipe (fds) < 0)
+    die ("could not make a pipe");
+
+  bytes = new_bytes (n_bytes);
+  message = new_call ("Echo", bytes, n_bytes, fds[0]);
+
+  reply = dbus_connection_send_with_reply_and_block (client, message,
+                                                     DBUS_TIMEOUT_INFINITE,
+                                                     &error);
+  if (reply == NULL)
+    die (error.message);
+
+  dbus_message_iter_init (reply, &iter);
+  if (dbus_message_iter_get_arg_type (&iter) != DBUS_TYPE_BOOLEAN)
+    die ("unexpected reply");
+
+  dbus_message_iter_get_basic (&iter, &in_memfd);
+  dbus_message_iter_next (&iter);
+  check_bytes (reply, &iter, bytes, n_bytes);
+
+  if (in_memfd != expect_memfd)
+    die (expect_memfd ? "body was not sent in a memfd" :
+         "small body was sent in a memfd");
+
+  if ((_dbus_message_get_body_memfd (reply) >= 0) != expect_memfd)
+    die ("reply body went the wrong way");
+
+  dbus_message_unref (reply);
+  dbus_message_unref (message);
+  dbus_free (bytes);
+
+  if (with_fd)
+    {
+      close (fds[0]);
+      close (fds[1]);
+    }
+
+  printf ("ok - message of %d bytes%s %s a memfd\n", n_bytes,
+          with_fd ? " and a unix fd" : "",
+          expect_memfd ? "in" : "not in");
+}
+
+static void
+test_forward (void)
+{
+  DBusMessage *message, *forwarded, *inode;
+  DBusMessageIter iter;
+  unsigned char *bytes;
+  dbus_uint64_t ino;
+
+  bytes = new_bytes (BIG_MESSAGE_SIZE);
+  message = new_call ("Forward", bytes, BIG_MESSAGE_SIZE, -1);
+  dbus_message_set_no_reply (message, TRUE);
+
+  if (!dbus_connection_send (client, message, NULL))
+    die ("no memory");
+
+  forwarded = NULL;
+  inode = NULL;
+
+  while (inode == NULL && dbus_connection_read_write (client, -1))
+    {
+      DBusMessage *m;
+
+      while ((m = dbus_connection_pop_message (client)) != NULL)
+        {
+          if (dbus_message_is_method_call (m, TEST_INTERFACE, "Forward"))
+            forwarded = m;
+          else if (dbus_message_is_signal (m, TEST_INTERFACE, "Inode"))
+            inode = m;
+          else
+            dbus_message_unref (m);
+        }
+    }
+
+  if (forwarded == NULL || inode == NULL)
+    die ("forwarded message did not come back");
+
+  dbus_message_iter_init (forwarded, &iter);
+  check_bytes (forwarded, &iter, bytes, BIG_MESSAGE_SIZE);
+
+  if (!dbus_message_get_args (inode, NULL,
+                              DBUS_TYPE_UINT64, &ino,
+                              DBUS_TYPE_INVALID))
+    die ("unexpected inode signal");
+
+  /* the server passed on the memfd it got rather than a copy */
+  if (ino == 0 || memfd_inode (forwarded) != ino)
+    die ("forwarded body was copied");
+
+  dbus_message_unref (inode);
+  dbus_message_unref (forwarded);
+  dbus_message_unref (message);
+  dbus_free (bytes);
+
+  printf ("ok - forwarded body keeps its memfd\n");
+}
+
+int
+main (int argc, char **argv)
+{
+  DBusMessage *message;
+  pthread_t thread;
+
+  if (!dbus_threads_init_default ())
+    die ("no memory");
+
+  if (!test_connection_pair_new ("unix:tmpdir=/tmp", &client, &server))
+    die ("could not set up connections");
+
+  pthread_create (&thread, NULL, echo_thread, NULL);
+
+  test_echo (SMALL_MESSAGE_SIZE, FALSE, FALSE);
+  test_echo (BIG_MESSAGE_SIZE, FALSE, TRUE);
+  test_echo (BIG_MESSAGE_SIZE, TRUE, TRUE);
+  test_forward ();
+
+  message = dbus_message_new_method_call (NULL, "/", TEST_INTERFACE,
+                                          "Disconnect");
+  if (message == NULL || !dbus_connection_send (client, message, NULL))
+    die ("no memory");
+
+  dbus_message_unref (message);
+  dbus_connection_flush (client);
+
+  pthread_join (thread, NULL);
+
+  dbus_connection_close (client);
+  dbus_connection_unref (client);
+  dbus_connection_unref (server);
+
+  dbus_shutdown ();
+  return 0;
+}
+
+#else /* !DBUS_HAVE_MEMFD_BODIES */
+
+int
+main (int argc, char **argv)
+{
+  printf ("ok # SKIP memfd message bodies not supported\n");
+  return 0;
+}
+
+#endif
@@ -0,0 +1,277 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/* reply-queue.c  Tests for finding replies in the incoming queue
+ *
+ * Licensed under the Academic Free License version 2.1
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <config.h>
+#include "test-utils.h"
+
+#define TEST_INTERFACE "org.freedesktop.DBus.TestSuite.ReplyQueue"
+/* The server flushes everything before the client reads anything, so
+ * this is kept well within what a socket buffer holds */
+#define N_SIGNALS 100
+
+static DBusConnection *client;
+static DBusConnection *server;
+static dbus_int32_t next_signal;
+static dbus_int32_t next_expected_signal;
+
+static void
+die (const char *message)
+{
+  fprintf (stderr, "*** test-reply-queue: %s\n", message);
+  exit (1);
+}
+
+static DBusPendingCall *
+call (DBusMessage **call_p)
+{
+  DBusMessage *message;
+  DBusPendingCall *pending;
+
+  message = dbus_message_new_method_call (NULL, "/", TEST_INTERFACE, "Call");
+  if (message == NULL ||
+      !dbus_connection_send_with_reply (client, message, &pending, -1) ||
+      pending == NULL)
+    die ("no memory");
+
+  /* Both ends are driven from this thread, so neither can block until
+   * authentication has finished */
+  while ((*call_p = dbus_connection_pop_message (server)) == NULL)
+    {
+      if (!dbus_connection_read_write (client, 0) ||
+          !dbus_connection_read_write (server, 0))
+        die ("disconnected");
+    }
+
+  dbus_message_unref (message);
+  return pending;
+}
+
+static void
+send_signals (int n)
+{
+  int i;
+
+  for (i = 0; i < n; i++)
+    {
+      DBusMessage *message;
+
+      message = dbus_message_new_signal ("/", TEST_INTERFACE, "Chatter");
+      if (message == NULL ||
+          !dbus_message_append_args (message,
+                                     DBUS_TYPE_INT32, &next_signal,
+                                     DBUS_TYPE_INVALID) ||
+          !dbus_connection_send (server, message, NULL))
+        die ("no memory");
+
+      dbus_message_unref (message);
+      next_signal++;
+    }
+}
+
+static void
+reply (DBusMessage *call_message,
+       dbus_int32_t value)
+{
+  DBusMessage *message;
+
+  message = dbus_message_new_method_return (call_message);
+  if (message == NULL ||
+      !dbus_message_append_args (message,
+                                 DBUS_TYPE_INT32, &value,
+                                 DBUS_TYPE_INVALID) ||
+      !dbus_connection_send (server, message, NULL))
+    die ("no memory");
+
+  dbus_message_unref (message);
+}
+
+static dbus_int32_t
+get_value (DBusMessage *message)
+{
+  dbus_int32_t value;
+
+  if (!dbus_message_get_args (message, NULL,
+                              DBUS_TYPE_INT32, &value,
+                              DBUS_TYPE_INVALID))
+    die ("message has no value");
+
+  return value;
+}
+
+static void
+block_for_reply (DBusPendingCall *pending,
+                 dbus_int32_t     expected)
+{
+  DBusMessage *message;
+
+  dbus_pending_call_block (pending);
+
+  message = dbus_pending_call_steal_reply (pending);
+  if (message == NULL ||
+      dbus_message_get_type (message) != DBUS_MESSAGE_TYPE_METHOD_RETURN)
+    die ("expected a method return");
+
+  if (get_value (message) != expected)
+    die ("got the wrong reply");
+
+  dbus_message_unref (message);
+  dbus_pending_call_unref (pending);
+}
+
+/* Pops everything the blocking calls left behind and checks the signals
+ * come out in the order they were sent, with any unclaimed method
+ * returns in their place.
+ */
+static void
+check_remaining (int n_method_returns)
+{
+  DBusMessage *message;
+
+  /* The server has flushed everything, but it may not all have been
+   * read yet */
+  while (next_expected_signal < next_signal || n_method_returns > 0)
+    {
+      message = dbus_connection_pop_message (client);
+
+      if (message == NULL)
+        {
+          if (!dbus_connection_read_write (client, -1))
+            die ("client disconnected");
+
+          continue;
+        }
+
+      if (dbus_message_is_signal (message, TEST_INTERFACE, "Chatter"))
+        {
+          if (get_value (message) != next_expected_signal)
+            die ("signals out of order");
+
+          next_expected_signal++;
+        }
+      else if (dbus_message_get_type (message) ==
+               DBUS_MESSAGE_TYPE_METHOD_RETURN)
+        {
+          if (n_method_returns == 0)
+            die ("unexpected method return");
+
+          n_method_returns--;
+        }
+      else
+        {
+          die ("unexpected message");
+        }
+
+      dbus_message_unref (message);
+    }
+}
+
+static void
+test_reply_behind_signals (void)
+{
+  DBusPendingCall *pending;
+  DBusMessage *call_message;
+
+  pending = call (&call_message);
+
+  send_signals (N_SIGNALS);
+  reply (call_message, 42);
+  send_signals (N_SIGNALS);
+  dbus_connection_flush (server);
+  dbus_message_unref (call_message);
+
+  block_for_reply (pending, 42);
+  check_remaining (0);
+
+  printf ("ok - reply behind %d signals\n", N_SIGNALS);
+}
+
+static void
+test_replies_out_of_order (void)
+{
+  DBusPendingCall *pending[3];
+  DBusMessage *call_message[3];
+  int i;
+
+  for (i = 0; i < 3; i++)
+    pending[i] = call (&call_message[i]);
+
+  reply (call_message[2], 2);
+  send_signals (10);
+  reply (call_message[0], 0);
+  send_signals (10);
+  reply (call_message[1], 1);
+  send_signals (10);
+  dbus_connection_flush (server);
+
+  for (i = 0; i < 3; i++)
+    dbus_message_unref (call_message[i]);
+
+  block_for_reply (pending[1], 1);
+  block_for_reply (pending[0], 0);
+  block_for_reply (pending[2], 2);
+  check_remaining (0);
+
+  printf ("ok - replies out of order\n");
+}
+
+static void
+test_duplicate_reply (void)
+{
+  DBusPendingCall *pending;
+  DBusMessage *call_message;
+
+  pending = call (&call_message);
+
+  /* A misbehaving peer replies twice; the first reply completes the
+   * call and the second is left to be dispatched like any other
+   * message, in order. */
+  send_signals (5);
+  reply (call_message, 1);
+  send_signals (5);
+  reply (call_message, 2);
+  send_signals (5);
+  dbus_connection_flush (server);
+  dbus_message_unref (call_message);
+
+  block_for_reply (pending, 1);
+  check_remaining (1);
+
+  printf ("ok - duplicate reply\n");
+}
+
+int
+main (int argc, char **argv)
+{
+  if (!test_connection_pair_new ("unix:tmpdir=/tmp", &client, &server))
+    die ("could not set up connections");
+
+  test_reply_behind_signals ();
+  test_replies_out_of_order ();
+  test_duplicate_reply ();
+
+  dbus_connection_close (client);
+  dbus_connection_unref (client);
+  dbus_connection_close (server);
+  dbus_connection_unref (server);
+
+  dbus_shutdown ();
+  return 0;
+}
@@ -0,0 +1,332 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/* shm.c  Tests for the shared memory transport
+ *
+ * Licensed under the Academic Free License version 2.1
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <config.h>
+#include "test-utils.h"
+
+#include <pthread.h>
+#include <string.h>
+
+#if defined(HAVE_MEMFD_CREATE) && defined(HAVE_EVENTFD)
+
+#define TEST_INTERFACE "org.freedesktop.DBus.TestSuite.Shm"
+#define N_CALLS 1000
+#define N_PENDING 5000
+/* several times the size of each ring */
+#define BIG_MESSAGE_SIZE (1024 * 1024)
+
+static DBusConnection *client;
+static DBusConnection *server;
+
+static void
+die (const char *message)
+{
+  fprintf (stderr, "*** test-shm: %s\n", message);
+  exit (1);
+}
+
+static DBusMessage *
+echo (DBusMessage *message)
+{
+  DBusMessage *reply;
+  dbus_int32_t value;
+  const unsigned char *bytes;
+  int n_bytes;
+
+  reply = dbus_message_new_method_return (message);
+  if (reply == NULL)
+    die ("no memory");
+
+  if (dbus_message_has_signature (message, "i"))
+    {
+      if (!dbus_message_get_args (message, NULL,
+                                  DBUS_TYPE_INT32, &value,
+                                  DBUS_TYPE_INVALID) ||
+          !dbus_message_append_args (reply,
+                                     DBUS_TYPE_INT32, &value,
+                                     DBUS_TYPE_INVALID))
+        die ("could not echo");
+    }
+  else
+    {
+      if (!dbus_message_get_args (message, NULL,
+                                  DBUS_TYPE_ARRAY, DBUS_TYPE_BYTE,
+                                  &bytes, &n_bytes,
+                                  DBUS_TYPE_INVALID) ||
+          !dbus_message_append_args (reply,
+                                     DBUS_TYPE_ARRAY, DBUS_TYPE_BYTE,
+                                     &bytes, n_bytes,
+                                     DBUS_TYPE_INVALID))
+        die ("could not echo");
+    }
+
+  return reply;
+}
+
+/* Replies to Echo with its argument, and closes the connection without
+ * replying when asked to Disconnect. */
+static void *
+echo_thread (void *data)
+{
+  dbus_bool_t done = FALSE;
+
+  while (!done && dbus_connection_read_write (server, -1))
+    {
+      DBusMessage *message;
+
+      while (!done && (message = dbus_connection_pop_message (server)) != NULL)
+        {
+          if (dbus_message_is_method_call (message, TEST_INTERFACE, "Echo"))
+            {
+              DBusMessage *reply = echo (message);
+
+              if (!dbus_connection_send (server, reply, NULL))
+                die ("no memory");
+
+              dbus_message_unref (reply);
+            }
+          else if (dbus_message_is_method_call (message, TEST_INTERFACE,
+                                                "Disconnect"))
+            {
+              dbus_connection_close (server);
+              done = TRUE;
+            }
+
+          dbus_message_unref (message);
+        }
+    }
+
+  dbus_connection_flush (server);
+  return NULL;
+}
+
+static DBusMessage *
+new_echo (dbus_int32_t value)
+{
+  DBusMessage *message;
+
+  message = dbus_message_new_method_call (NULL, "/", TEST_INTERFACE, "Echo");
+  if (message == NULL ||
+      !dbus_message_append_args (message,
+                                 DBUS_TYPE_INT32, &value,
+                                 DBUS_TYPE_INVALID))
+    die ("no memory");
+
+  return message;
+}
+
+static void
+check_reply (DBusMessage  *reply,
+             dbus_int32_t  expected)
+{
+  dbus_int32_t value;
+
+  if (!dbus_message_get_args (reply, NULL,
+                              DBUS_TYPE_INT32, &value,
+                              DBUS_TYPE_INVALID) ||
+      value != expected)
+    die ("got the wrong reply");
+}
+
+static void
+test_blocking_calls (void)
+{
+  dbus_int32_t i;
+
+  for (i = 0; i < N_CALLS; i++)
+    {
+      DBusMessage *message, *reply;
+      DBusError error;
+
+      dbus_error_init (&error);
+      message = new_echo (i);
+
+      reply = dbus_connection_send_with_reply_and_block (client, message,
+                                                         DBUS_TIMEOUT_INFINITE,
+                                                         &error);
+      if (reply == NULL)
+        die (error.message);
+
+      check_reply (reply, i);
+      dbus_message_unref (reply);
+      dbus_message_unref (message);
+    }
+
+  printf ("ok - %d blocking calls\n", N_CALLS);
+}
+
+static void
+test_pipelined_calls (void)
+{
+  DBusPendingCall *pending[N_PENDING];
+  dbus_int32_t i;
+
+  /* enough at once to fill the rings, so both sides have to wait for
+   * space and be woken when the other makes some */
+  for (i = 0; i < N_PENDING; i++)
+    {
+      DBusMessage *message = new_echo (i);
+
+      if (!dbus_connection_send_with_reply (client, message, &pending[i],
+                                            DBUS_TIMEOUT_INFINITE) ||
+          pending[i] == NULL)
+        die ("no memory");
+
+      dbus_message_unref (message);
+    }
+
+  for (i = N_PENDING - 1; i >= 0; i--)
+    {
+      DBusMessage *reply;
+
+      dbus_pending_call_block (pending[i]);
+      reply = dbus_pending_call_steal_reply (pending[i]);
+      if (reply == NULL)
+        die ("no reply");
+
+      check_reply (reply, i);
+      dbus_message_unref (reply);
+      dbus_pending_call_unref (pending[i]);
+    }
+
+  printf ("ok - %d pipelined calls\n", N_PENDING);
+}
+
+static void
+test_big_message (void)
+{
+  DBusMessage *message, *reply;
+  DBusError error;
+  unsigned char *bytes;
+  const unsigned char *p;
+  int n_bytes;
+  int i;
+
+  dbus_error_init (&error);
+
+  bytes = dbus_malloc (BIG_MESSAGE_SIZE);
+  if (bytes == NULL)
+    die ("no memory");
+
+  for (i = 0; i < BIG_MESSAGE_SIZE; i++)
+    bytes[i] = (i * 7) ^ (i >> 11);
+
+  p = bytes;
+  message = dbus_message_new_method_call (NULL, "/", TEST_INTERFACE, "Echo");
+  if (message == NULL ||
+      !dbus_message_append_args (message,
+                                 DBUS_TYPE_ARRAY, DBUS_TYPE_BYTE,
+                                 &p, BIG_MESSAGE_SIZE,
+                                 DBUS_TYPE_INVALID))
+    die ("no memory");
+
+  reply = dbus_connection_send_with_reply_and_block (client, message,
+                                                     DBUS_TIMEOUT_INFINITE,
+                                                     &error);
+  if (reply == NULL)
+    die (error.message);
+
+  if (!dbus_message_get_args (reply, NULL,
+                              DBUS_TYPE_ARRAY, DBUS_TYPE_BYTE,
+                              &p, &n_bytes,
+                              DBUS_TYPE_INVALID) ||
+      n_bytes != BIG_MESSAGE_SIZE ||
+      memcmp (p, bytes, BIG_MESSAGE_SIZE) != 0)
+    die ("big message was corrupted");
+
+  dbus_message_unref (reply);
+  dbus_message_unref (message);
+  dbus_free (bytes);
+
+  printf ("ok - message of %d bytes\n", BIG_MESSAGE_SIZE);
+}
+
+static void
+test_disconnect (void)
+{
+  DBusMessage *message, *reply;
+  DBusError error;
+
+  dbus_error_init (&error);
+
+  message = dbus_message_new_method_call (NULL, "/", TEST_INTERFACE,
+                                          "Disconnect");
+  if (message == NULL)
+    die ("no memory");
+
+  /* The server hangs up instead of replying; nothing more will ever
+   * arrive in the ring, so we must notice the socket closing */
+  reply = dbus_connection_send_with_reply_and_block (client, message,
+                                                     DBUS_TIMEOUT_INFINITE,
+                                                     &error);
+  if (reply != NULL || !dbus_error_is_set (&error))
+    die ("expected an error when the peer disconnected");
+
+  dbus_error_free (&error);
+  dbus_message_unref (message);
+
+  while (dbus_connection_read_write (client, -1))
+    ;
+
+  if (dbus_connection_get_is_connected (client))
+    die ("still connected");
+
+  printf ("ok - disconnect\n");
+}
+
+int
+main (int argc, char **argv)
+{
+  pthread_t thread;
+
+  if (!dbus_threads_init_default ())
+    die ("no memory");
+
+  if (!test_connection_pair_new ("shm:tmpdir=/tmp", &client, &server))
+    die ("could not set up connections");
+
+  pthread_create (&thread, NULL, echo_thread, NULL);
+
+  test_blocking_calls ();
+  test_pipelined_calls ();
+  test_big_message ();
+  test_disconnect ();
+
+  pthread_join (thread, NULL);
+
+  dbus_connection_close (client);
+  dbus_connection_unref (client);
+  dbus_connection_unref (server);
+
+  dbus_shutdown ();
+  return 0;
+}
+
+#else /* !(HAVE_MEMFD_CREATE && HAVE_EVENTFD) */
+
+int
+main (int argc, char **argv)
+{
+  printf ("ok # SKIP shared memory transport not supported\n");
+  return 0;
+}
+
+#endif
@@ -313,3 +313,82 @@ test_server_shutdown (DBusLoop         *loop,
                                           NULL))
     _dbus_assert_not_reached ("setting timeout functions to NULL failed");  
 }
+
+static void
+pair_new_connection (DBusServer     *server,
+                     DBusConnection *server_connection,
+                     void           *data)
+{
+  DBusConnection **server_connection_p = data;
+
+  *server_connection_p = dbus_connection_ref (server_connection);
+}
+
+/**
+ * Listens on the given address, connects a private client connection
+ * to it and accepts the connection. Neither connection is attached to
+ * a main loop, so they are driven with dbus_connection_read_write()
+ * and friends.
+ */
+dbus_bool_t
+test_connection_pair_new (const char      *listen_address,
+                          DBusConnection **client_p,
+                          DBusConnection **server_p)
+{
+  DBusLoop *loop;
+  DBusServer *server;
+  DBusError error;
+  char *address;
+
+  *client_p = NULL;
+  *server_p = NULL;
+  dbus_error_init (&error);
+
+  loop = _dbus_loop_new ();
+  if (loop == NULL)
+    return FALSE;
+
+  server = dbus_server_listen (listen_address, &error);
+  if (server == NULL)
+    {
+      fprintf (stderr, "Failed to listen on %s: %s\n", listen_address,
+               error.message);
+      dbus_error_free (&error);
+      _dbus_loop_unref (loop);
+      return FALSE;
+    }
+
+  dbus_server_set_new_connection_function (server, pair_new_connection,
+                                           server_p, NULL);
+
+  if (!test_server_setup (loop, server))
+    goto failed;
+
+  address = dbus_server_get_address (server);
+  if (address == NULL)
+    goto failed;
+
+  *client_p = dbus_connection_open_private (address, &error);
+  dbus_free (address);
+
+  if (*client_p == NULL)
+    {
+      fprintf (stderr, "Failed to connect: %s\n", error.message);
+      dbus_error_free (&error);
+      goto failed;
+    }
+
+  while (*server_p == NULL)
+    _dbus_loop_iterate (loop, TRUE);
+
+  test_server_shutdown (loop, server);
+  dbus_server_unref (server);
+  _dbus_loop_unref (loop);
+  return TRUE;
+
+ failed:
+  test_server_shutdown (loop, server);
+  dbus_server_unref (server);
+  _dbus_loop_unref (loop);
+  return FALSE;
+}
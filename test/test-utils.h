@@ -22,4 +22,8 @@ dbus_bool_t test_server_setup                     (DBusLoop      *loop,
 void        test_server_shutdown                  (DBusLoop      *loop,
                                                    DBusServer    *server);
 
+dbus_bool_t test_connection_pair_new              (const char      *listen_address,
+                                                   DBusConnection **client_p,
+                                                   DBusConnection **server_p);
+
 #endif
@@ -0,0 +1,371 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/* unixpacket.c  Tests for the SOCK_SEQPACKET unix transport
+ *
+ * Licensed under the Academic Free License version 2.1
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <config.h>
+#include "test-utils.h"
+
+#include <pthread.h>
+#include <string.h>
+
+#define DBUS_COMPILATION
+#include <dbus/dbus-sysdeps-unix.h>
+#undef DBUS_COMPILATION
+
+#ifdef DBUS_HAVE_SEQPACKET
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define TEST_INTERFACE "org.freedesktop.DBus.TestSuite.UnixPacket"
+#define N_CALLS 1000
+#define N_PENDING 200
+/* several packets' worth once the send buffer has been shrunk */
+#define BIG_MESSAGE_SIZE (48 * 1024)
+
+static DBusConnection *client;
+static DBusConnection *server;
+
+static void
+die (const char *message)
+{
+  fprintf (stderr, "*** test-unixpacket: %s\n", message);
+  exit (1);
+}
+
+/* Replies with the inode of the unix fd it was sent, if any, so that
+ * the client can check each fd came with its own message; otherwise
+ * echoes the bytes it was sent */
+static DBusMessage *
+echo (DBusMessage *message)
+{
+  DBusMessage *reply;
+  const unsigned char *bytes;
+  int n_bytes;
+  int fd;
+
+  reply = dbus_message_new_method_return (message);
+  if (reply == NULL)
+    die ("no memory");
+
+  if (dbus_message_has_signature (message, "h"))
+    {
+      struct stat sb;
+      dbus_uint64_t ino;
+
+      if (!dbus_message_get_args (message, NULL,
+                                  DBUS_TYPE_UNIX_FD, &fd,
+                                  DBUS_TYPE_INVALID) ||
+          fstat (fd, &sb) < 0)
+        die ("no unix fd");
+
+      close (fd);
+      ino = sb.st_ino;
+
+      if (!dbus_message_append_args (reply,
+                                     DBUS_TYPE_UINT64, &ino,
+                                     DBUS_TYPE_INVALID))
+        die ("no memory");
+    }
+  else
+    {
+      if (!dbus_message_get_args (message, NULL,
+                                  DBUS_TYPE_ARRAY, DBUS_TYPE_BYTE,
+                                  &bytes, &n_bytes,
+                                  DBUS_TYPE_INVALID) ||
+          !dbus_message_append_args (reply,
+                                     DBUS_TYPE_ARRAY, DBUS_TYPE_BYTE,
+                                     &bytes, n_bytes,
+                                     DBUS_TYPE_INVALID))
+        die ("could not echo");
+    }
+
+  return reply;
+}
+
+static void *
+echo_thread (void *data)
+{
+  dbus_bool_t done = FALSE;
+
+  while (!done && dbus_connection_read_write (server, -1))
+    {
+      DBusMessage *message;
+
+      while (!done && (message = dbus_connection_pop_message (server)) != NULL)
+        {
+          if (dbus_message_is_method_call (message, TEST_INTERFACE, "Echo"))
+            {
+              DBusMessage *reply = echo (message);
+
+              if (!dbus_connection_send (server, reply, NULL))
+                die ("no memory");
+
+              dbus_message_unref (reply);
+            }
+          else if (dbus_message_is_method_call (message, TEST_INTERFACE,
+                                                "Disconnect"))
+            {
+              dbus_connection_close (server);
+              done = TRUE;
+            }
+
+          dbus_message_unref (message);
+        }
+    }
+
+  dbus_connection_flush (server);
+  return NULL;
+}
+
+static DBusMessage *
+new_echo (const unsigned char *bytes,
+          int                  n_bytes)
+{
+  DBusMessage *message;
+
+  message = dbus_message_new_method_call (NULL, "/", TEST_INTERFACE, "Echo");
+  if (message == NULL ||
+      !dbus_message_append_args (message,
+                                 DBUS_TYPE_ARRAY, DBUS_TYPE_BYTE,
+                                 &bytes, n_bytes,
+                                 DBUS_TYPE_INVALID))
+    die ("no memory");
+
+  return message;
+}
+
+static void
+call_echo (const unsigned char *bytes,
+           int                  n_bytes)
+{
+  DBusMessage *message, *reply;
+  DBusError error;
+  const unsigned char *p;
+  int n;
+
+  dbus_error_init (&error);
+  message = new_echo (bytes, n_bytes);
+
+  reply = dbus_connection_send_with_reply_and_block (client, message,
+                                                     DBUS_TIMEOUT_INFINITE,
+                                                     &error);
+  if (reply == NULL)
+    die (error.message);
+
+  if (!dbus_message_get_args (reply, NULL,
+                              DBUS_TYPE_ARRAY, DBUS_TYPE_BYTE,
+                              &p, &n,
+                              DBUS_TYPE_INVALID) ||
+      n != n_bytes ||
+      memcmp (p, bytes, n) != 0)
+    die ("got the wrong reply");
+
+  dbus_message_unref (reply);
+  dbus_message_unref (message);
+}
+
+static void
+test_socket_type (void)
+{
+  int fd;
+
+  if (!dbus_connection_get_socket (client, &fd) ||
+      !_dbus_socket_is_seqpacket (fd))
+    die ("not a seqpacket socket");
+
+  printf ("ok - seqpacket socket\n");
+}
+
+static void
+test_blocking_calls (void)
+{
+  unsigned char bytes[16];
+  int i;
+
+  for (i = 0; i < N_CALLS; i++)
+    {
+      memset (bytes, i, sizeof (bytes));
+      call_echo (bytes, (i % sizeof (bytes)) + 1);
+    }
+
+  printf ("ok - %d blocking calls\n", N_CALLS);
+}
+
+static void
+test_unix_fds (void)
+{
+  DBusPendingCall *pending[N_PENDING];
+  dbus_uint64_t inodes[N_PENDING];
+  int i;
+
+  if (!dbus_connection_can_send_type (client, DBUS_TYPE_UNIX_FD))
+    {
+      printf ("ok # SKIP unix fds not supported\n");
+      return;
+    }
+
+  /* all sent before any reply is read, so that several messages and
+   * their fds are queued in the socket at once */
+  for (i = 0; i < N_PENDING; i++)
+    {
+      DBusMessage *message;
+      struct stat sb;
+      int fds[2];
+
+      if (pipe (fds) < 0 || fstat (fds[0], &sb) < 0)
+        die ("could not make a pipe");
+
+      inodes[i] = sb.st_ino;
+
+      message = dbus_message_new_method_call (NULL, "/", TEST_INTERFACE,
+                                              "Echo");
+      if (message == NULL ||
+          !dbus_message_append_args (message,
+                                     DBUS_TYPE_UNIX_FD, &fds[0],
+                                     DBUS_TYPE_INVALID) ||
+          !dbus_connection_send_with_reply (client, message, &pending[i],
+                                            DBUS_TIMEOUT_INFINITE) ||
+          pending[i] == NULL)
+        die ("no memory");
+
+      dbus_message_unref (message);
+      close (fds[0]);
+      close (fds[1]);
+    }
+
+  for (i = 0; i < N_PENDING; i++)
+    {
+      DBusMessage *reply;
+      dbus_uint64_t ino;
+
+      dbus_pending_call_block (pending[i]);
+      reply = dbus_pending_call_steal_reply (pending[i]);
+
+      if (reply == NULL ||
+          !dbus_message_get_args (reply, NULL,
+                                  DBUS_TYPE_UINT64, &ino,
+                                  DBUS_TYPE_INVALID))
+        die ("unexpected reply");
+
+      if (ino != inodes[i])
+        die ("unix fd arrived with the wrong message");
+
+      dbus_message_unref (reply);
+      dbus_pending_call_unref (pending[i]);
+    }
+
+  printf ("ok - %d messages with unix fds\n", N_PENDING);
+}
+
+static void
+test_big_message (void)
+{
+  unsigned char *bytes;
+  int size;
+  int fd;
+  int i;
+
+  bytes = dbus_malloc (BIG_MESSAGE_SIZE);
+  if (bytes == NULL)
+    die ("no memory");
+
+  for (i = 0; i < BIG_MESSAGE_SIZE; i++)
+    bytes[i] = (i * 7) ^ (i >> 11);
+
+  /* too small for the message to go in one packet, so that it has to
+   * be split and put back together */
+  size = 4096;
+  if (!dbus_connection_get_socket (client, &fd) ||
+      setsockopt (fd, SOL_SOCKET, SO_SNDBUF, &size, sizeof (size)) < 0)
+    die ("could not shrink the send buffer");
+
+  call_echo (bytes, BIG_MESSAGE_SIZE);
+
+  /* and a small one still arrives by itself afterwards */
+  call_echo (bytes, 16);
+
+  dbus_free (bytes);
+
+  printf ("ok - message of %d bytes in several packets\n",
+          BIG_MESSAGE_SIZE);
+}
+
+static void
+test_disconnect (void)
+{
+  DBusMessage *message;
+
+  message = dbus_message_new_method_call (NULL, "/", TEST_INTERFACE,
+                                          "Disconnect");
+  if (message == NULL || !dbus_connection_send (client, message, NULL))
+    die ("no memory");
+
+  dbus_message_unref (message);
+
+  while (dbus_connection_read_write (client, -1))
+    ;
+
+  if (dbus_connection_get_is_connected (client))
+    die ("still connected");
+
+  printf ("ok - disconnect\n");
+}
+
+int
+main (int argc, char **argv)
+{
+  pthread_t thread;
+
+  if (!dbus_threads_init_default ())
+    die ("no memory");
+
+  if (!test_connection_pair_new ("unixpacket:tmpdir=/tmp", &client, &server))
+    die ("could not set up connections");
+
+  pthread_create (&thread, NULL, echo_thread, NULL);
+
+  test_socket_type ();
+  test_blocking_calls ();
+  test_unix_fds ();
+  test_big_message ();
+  test_disconnect ();
+
+  pthread_join (thread, NULL);
+
+  dbus_connection_close (client);
+  dbus_connection_unref (client);
+  dbus_connection_unref (server);
+
+  dbus_shutdown ();
+  return 0;
+}
+
+#else /* !DBUS_HAVE_SEQPACKET */
+
+int
+main (int argc, char **argv)
+{
+  printf ("ok # SKIP seqpacket unix sockets not supported\n");
+  return 0;
+}
+
+#endif
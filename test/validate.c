@@ -0,0 +1,552 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/* validate.c  Differential tests for the UTF-8 and name validators
+ *
+ * Licensed under the Academic Free License version 2.1
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/*
+ * Each validator is compared with a straightforward reference
+ * implementation (the byte-at-a-time code the library used to have),
+ * exhaustively over short inputs and at every offset within a buffer
+ * long enough for the vector code paths, for every UTF-8 implementation
+ * available on this machine.
+ */
+
+#include <config.h>
+#include "test-utils.h"
+
+#include <string.h>
+
+#include <dbus/dbus-marshal-validate.h>
+#include <dbus/dbus-string.h>
+
+static const char * const utf8_validators[] =
+{
+  "bytewise", "word", "sse2", "avx2", "neon"
+};
+
+#define BUFFER_SIZE 96
+
+static void
+die (const char *message)
+{
+  fprintf (stderr, "*** test-validate: %s\n", message);
+  exit (1);
+}
+
+/* ---- reference implementations ---- */
+
+static dbus_bool_t
+reference_utf8 (const unsigned char *p,
+                int                  len)
+{
+  const unsigned char *end = p + len;
+
+  while (p < end)
+    {
+      dbus_uint32_t c;
+      int n, i;
+
+      if (*p == '\0')
+        return FALSE;
+
+      if (*p < 0x80)
+        {
+          p++;
+          continue;
+        }
+      else if ((*p & 0xe0) == 0xc0)
+        {
+          n = 2;
+          c = *p & 0x1f;
+        }
+      else if ((*p & 0xf0) == 0xe0)
+        {
+          n = 3;
+          c = *p & 0x0f;
+        }
+      else if ((*p & 0xf8) == 0xf0)
+        {
+          n = 4;
+          c = *p & 0x07;
+        }
+      else if ((*p & 0xfc) == 0xf8)
+        {
+          n = 5;
+          c = *p & 0x03;
+        }
+      else if ((*p & 0xfe) == 0xfc)
+        {
+          n = 6;
+          c = *p & 0x01;
+        }
+      else
+        {
+          return FALSE;
+        }
+
+      if (end - p < n)
+        return FALSE;
+
+      for (i = 1; i < n; i++)
+        {
+          if ((p[i] & 0xc0) != 0x80)
+            return FALSE;
+
+          c = (c << 6) | (p[i] & 0x3f);
+        }
+
+      /* overlong */
+      if (n != (c < 0x80 ? 1 : c < 0x800 ? 2 : c < 0x10000 ? 3 :
+                c < 0x200000 ? 4 : c < 0x4000000 ? 5 : 6))
+        return FALSE;
+
+      /* out of range, surrogates and noncharacters */
+      if (c >= 0x110000 ||
+          (c & 0xfffff800) == 0xd800 ||
+          (c >= 0xfdd0 && c <= 0xfdef) ||
+          (c & 0xfffe) == 0xfffe)
+        return FALSE;
+
+      p += n;
+    }
+
+  return TRUE;
+}
+
+static dbus_bool_t
+is_initial (unsigned char c)
+{
+  return (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || c == '_';
+}
+
+static dbus_bool_t
+is_later (unsigned char c)
+{
+  return is_initial (c) || (c >= '0' && c <= '9');
+}
+
+static dbus_bool_t
+is_bus_initial (unsigned char c)
+{
+  return is_initial (c) || c == '-';
+}
+
+static dbus_bool_t
+is_bus_later (unsigned char c)
+{
+  return is_later (c) || c == '-';
+}
+
+static dbus_bool_t
+reference_path (const unsigned char *s,
+                int                  len)
+{
+  const unsigned char *end = s + len;
+  const unsigned char *last_slash;
+
+  if (len == 0 || *s != '/')
+    return FALSE;
+
+  last_slash = s++;
+
+  for (; s != end; s++)
+    {
+      if (*s == '/')
+        {
+          if (s - last_slash < 2)
+            return FALSE;
+
+          last_slash = s;
+        }
+      else if (!is_later (*s))
+        {
+          return FALSE;
+        }
+    }
+
+  return !(end - last_slash < 2 && len > 1);
+}
+
+static dbus_bool_t
+reference_interface (const unsigned char *s,
+                     int                  len)
+{
+  const unsigned char *end = s + len;
+  dbus_bool_t seen_dot = FALSE;
+
+  if (len == 0 || len > DBUS_MAXIMUM_NAME_LENGTH || !is_initial (*s))
+    return FALSE;
+
+  for (s++; s != end; s++)
+    {
+      if (*s == '.')
+        {
+          if (s + 1 == end || !is_initial (s[1]))
+            return FALSE;
+
+          seen_dot = TRUE;
+          s++;
+        }
+      else if (!is_later (*s))
+        {
+          return FALSE;
+        }
+    }
+
+  return seen_dot;
+}
+
+static dbus_bool_t
+reference_member (const unsigned char *s,
+                  int                  len)
+{
+  int i;
+
+  if (len == 0 || len > DBUS_MAXIMUM_NAME_LENGTH || !is_initial (*s))
+    return FALSE;
+
+  for (i = 1; i < len; i++)
+    {
+      if (!is_later (s[i]))
+        return FALSE;
+    }
+
+  return TRUE;
+}
+
+static dbus_bool_t
+reference_bus_name (const unsigned char *s,
+                    int                  len,
+                    dbus_bool_t          is_namespace)
+{
+  const unsigned char *end = s + len;
+  dbus_bool_t seen_dot = FALSE;
+
+  if (len == 0 || len > DBUS_MAXIMUM_NAME_LENGTH)
+    return FALSE;
+
+  if (*s == ':')
+    {
+      for (s++; s != end; s++)
+        {
+          if (*s == '.')
+            {
+              if (s + 1 == end || !is_bus_later (s[1]))
+                return FALSE;
+
+              s++;
+            }
+          else if (!is_bus_later (*s))
+            {
+              return FALSE;
+            }
+        }
+
+      return TRUE;
+    }
+
+  if (!is_bus_initial (*s))
+    return FALSE;
+
+  for (s++; s != end; s++)
+    {
+      if (*s == '.')
+        {
+          if (s + 1 == end || !is_bus_initial (s[1]))
+            return FALSE;
+
+          seen_dot = TRUE;
+          s++;
+        }
+      else if (!is_bus_later (*s))
+        {
+          return FALSE;
+        }
+    }
+
+  return is_namespace || seen_dot;
+}
+
+/* ---- comparisons ---- */
+
+static void
+report (const char          *what,
+        const unsigned char *data,
+        int                  len)
+{
+  int i;
+
+  fprintf (stderr, "*** test-validate: %s (%s) disagrees with the reference on:",
+           what, _dbus_string_get_utf8_validator ());
+
+  for (i = 0; i < len; i++)
+    fprintf (stderr, " %02x", data[i]);
+
+  fprintf (stderr, "\n");
+  exit (1);
+}
+
+static void
+check_utf8 (const unsigned char *data,
+            int                  len)
+{
+  DBusString str;
+
+  _dbus_string_init_const_len (&str, (const char *) data, len);
+
+  if (!_dbus_string_validate_utf8 (&str, 0, len) != !reference_utf8 (data, len))
+    report ("UTF-8", data, len);
+}
+
+static void
+check_names (const unsigned char *data,
+             int                  len)
+{
+  DBusString str;
+
+  _dbus_string_init_const_len (&str, (const char *) data, len);
+
+  if (!_dbus_validate_path (&str, 0, len) != !reference_path (data, len))
+    report ("path", data, len);
+
+  if (!_dbus_validate_interface (&str, 0, len) !=
+      !reference_interface (data, len))
+    report ("interface", data, len);
+
+  if (!_dbus_validate_member (&str, 0, len) != !reference_member (data, len))
+    report ("member", data, len);
+
+  if (!_dbus_validate_bus_name (&str, 0, len) !=
+      !reference_bus_name (data, len, FALSE))
+    report ("bus name", data, len);
+
+  if (!_dbus_validate_bus_namespace (&str, 0, len) !=
+      !reference_bus_name (data, len, TRUE))
+    report ("bus namespace", data, len);
+}
+
+/* Every sequence of up to three bytes on its own, and in the middle of
+ * a run of ASCII long enough to go through the vector code. Three-byte
+ * sequences that start with ASCII are covered by the shorter ones, so
+ * only those starting with a lead byte are embedded. */
+static void
+test_utf8_exhaustive (void)
+{
+  unsigned char buffer[48];
+  unsigned char *seq = buffer + 21;
+  unsigned int i;
+  int len;
+
+  memset (buffer, 'x', sizeof (buffer));
+
+  for (len = 1; len <= 3; len++)
+    {
+      for (i = 0; i < (1u << (8 * len)); i++)
+        {
+          int j;
+
+          for (j = 0; j < len; j++)
+            seq[j] = (i >> (8 * (len - 1 - j))) & 0xff;
+
+          check_utf8 (seq, len);
+
+          if (len < 3 || seq[0] >= 0xc0)
+            check_utf8 (buffer, sizeof (buffer));
+
+          memset (seq, 'x', len);
+        }
+    }
+}
+
+/* Every code point, and a sample of invalid sequences, at every offset
+ * in the buffer and with every length that cuts through it */
+static void
+test_utf8_offsets (void)
+{
+  static const unsigned char special[][6] =
+  {
+    { 0x00 },
+    { 0x80 },
+    { 0xc0, 0x80 },
+    { 0xed, 0xa0, 0x80 },
+    { 0xef, 0xbf, 0xbe },
+    { 0xf4, 0x90, 0x80, 0x80 },
+    { 0xf8, 0x88, 0x80, 0x80, 0x80 },
+    { 0xfc, 0x84, 0x80, 0x80, 0x80, 0x80 },
+    { 0xfe },
+    { 0xff }
+  };
+  unsigned char buffer[BUFFER_SIZE];
+  unsigned char seq[6];
+  dbus_uint32_t c;
+  int offset, len, n;
+  unsigned int i;
+
+  memset (buffer, 'x', sizeof (buffer));
+
+  /* every code point, and some beyond the last */
+  for (c = 0x80; c < 0x110000 + 0x1000; c++)
+    {
+      if (c < 0x800)
+        {
+          seq[0] = 0xc0 | (c >> 6);
+          seq[1] = 0x80 | (c & 0x3f);
+          n = 2;
+        }
+      else if (c < 0x10000)
+        {
+          seq[0] = 0xe0 | (c >> 12);
+          seq[1] = 0x80 | ((c >> 6) & 0x3f);
+          seq[2] = 0x80 | (c & 0x3f);
+          n = 3;
+        }
+      else
+        {
+          seq[0] = 0xf0 | (c >> 18);
+          seq[1] = 0x80 | ((c >> 12) & 0x3f);
+          seq[2] = 0x80 | ((c >> 6) & 0x3f);
+          seq[3] = 0x80 | (c & 0x3f);
+          n = 4;
+        }
+
+      /* straddling the end of the first 16 and 32 bytes */
+      for (offset = 15; offset < 32; offset += 16)
+        {
+          memcpy (buffer + offset, seq, n);
+          check_utf8 (buffer, 48);
+          check_utf8 (buffer, offset + n);
+          check_utf8 (buffer, offset + n - 1);
+          memset (buffer + offset, 'x', n);
+        }
+    }
+
+  for (i = 0; i < _DBUS_N_ELEMENTS (special); i++)
+    {
+      n = 1;
+      while (n < 6 && special[i][n] != 0)
+        n++;
+
+      for (offset = 0; offset + n <= BUFFER_SIZE; offset++)
+        {
+          memcpy (buffer + offset, special[i], n);
+
+          for (len = 0; len <= BUFFER_SIZE; len++)
+            check_utf8 (buffer, len);
+
+          memset (buffer + offset, 'x', n);
+        }
+    }
+}
+
+/* Every string of up to two bytes, and every string of up to five
+ * characters drawn from an alphabet of the characters that matter */
+static void
+test_names_exhaustive (void)
+{
+  static const unsigned char alphabet[] = "aZ_09-./:\x80 ";
+  const int n_alphabet = sizeof (alphabet); /* including the nul */
+  unsigned char buffer[5];
+  unsigned int i;
+  int len;
+
+  for (len = 1; len <= 2; len++)
+    {
+      for (i = 0; i < (1u << (8 * len)); i++)
+        {
+          int j;
+
+          for (j = 0; j < len; j++)
+            buffer[j] = (i >> (8 * j)) & 0xff;
+
+          check_names (buffer, len);
+        }
+    }
+
+  for (len = 1; len <= 5; len++)
+    {
+      unsigned int total = 1;
+      int j;
+
+      for (j = 0; j < len; j++)
+        total *= n_alphabet;
+
+      for (i = 0; i < total; i++)
+        {
+          unsigned int k = i;
+
+          for (j = 0; j < len; j++)
+            {
+              buffer[j] = alphabet[k % n_alphabet];
+              k /= n_alphabet;
+            }
+
+          check_names (buffer, len);
+        }
+    }
+}
+
+static void
+test_names_long (void)
+{
+  unsigned char buffer[DBUS_MAXIMUM_NAME_LENGTH + 2];
+  int len;
+
+  /* around the length limit */
+  memset (buffer, 'a', sizeof (buffer));
+  buffer[1] = '.';
+
+  for (len = DBUS_MAXIMUM_NAME_LENGTH - 2; len <= (int) sizeof (buffer); len++)
+    {
+      check_names (buffer, len);
+      buffer[0] = '/';
+      check_names (buffer, len);
+      buffer[0] = ':';
+      check_names (buffer, len);
+      buffer[0] = 'a';
+    }
+}
+
+int
+main (int argc, char **argv)
+{
+  unsigned int i;
+
+  for (i = 0; i < _DBUS_N_ELEMENTS (utf8_validators); i++)
+    {
+      if (!_dbus_string_set_utf8_validator (utf8_validators[i]))
+        {
+          printf ("ok - # SKIP %s UTF-8 validation not available\n",
+                  utf8_validators[i]);
+          continue;
+        }
+
+      test_utf8_exhaustive ();
+      test_utf8_offsets ();
+      printf ("ok - %s UTF-8 validation\n", utf8_validators[i]);
+    }
+
+  if (!_dbus_string_set_utf8_validator (NULL))
+    die ("could not restore default UTF-8 validation");
+
+  test_names_exhaustive ();
+  test_names_long ();
+  printf ("ok - name validation\n");
+
+  return 0;
+}